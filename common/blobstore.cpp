@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "blobstore.h"
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+BlobStore::BlobStore()
+: mReferenceCount(0)
+, mTotalBytes(0)
+, mStorage(NULL)
+, mOwnsStorage(false)
+, mSpillFile(NULL)
+, mSpillFileSize(0)
+{
+
+}
+
+// ------------------------------------------------------------------------------------------------
+BlobStore::~BlobStore()
+{
+	if (mStorage && mOwnsStorage) {
+		UnregisterBorrowedPayloadRange(mStorage);
+		SafeFree(mStorage);
+	}
+
+	if (mSpillFile) {
+		fclose(mSpillFile);
+		mSpillFile = NULL;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlobStore::SpillTo(const TCHAR* _scratchFilename)
+{
+	assert(mBlobs.empty() && mSpillFile == NULL);
+
+	// T: keep it in the cache if we can, D: delete it once it's closed.
+	if (_tfopen_s(&mSpillFile, _scratchFilename, TC("w+bTD")) != 0) {
+		LogError(TC("Couldn't create blob scratch file '%s'."), _scratchFilename);
+		throw 10;
+	}
+	assert(mSpillFile);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool BlobStore::Add(const void* _bytes, size_t _len, Hash128* _outId)
+{
+	assert(_outId);
+	if (_bytes == NULL || _len < kMinBlobSize) {
+		return false;
+	}
+
+	Hash128 id = HashBytes(_bytes, _len);
+	auto it = mBlobs.find(id);
+	if (it != mBlobs.end()) {
+		// Being paranoid is cheap here compared to writing the payload out.
+		bool matches = it->second.mLength == _len;
+		if (matches) {
+			matches = mSpillFile ? SpilledBlobEquals(it->second, _bytes) 
+			                     : memcmp(it->second.mBytes, _bytes, _len) == 0;
+		}
+
+		if (!matches) {
+			Once(LogWarn(TC("128-bit hash collision in the blob store--storing payload inline.")));
+			return false;
+		}
+	} else {
+		BlobInfo blob;
+		blob.mBytes = _bytes;
+		blob.mLength = _len;
+		blob.mSpillOffset = 0;
+
+		if (mSpillFile) {
+			blob.mBytes = NULL;
+			blob.mSpillOffset = mSpillFileSize;
+			if (_fseeki64(mSpillFile, (__int64)mSpillFileSize, SEEK_SET) != 0 || 1 != fwrite(_bytes, _len, 1, mSpillFile)) {
+				throw 10;
+			}
+			mSpillFileSize += _len;
+		}
+
+		mBlobs[id] = blob;
+		mTotalBytes += _len;
+	}
+
+	++mReferenceCount;
+	(*_outId) = id;
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlobStore::Write(FileLike* _out) const
+{
+	_out->Write(Checkpoint("BlobsBegin"));
+	
+	_out->Write(mBlobs.size());
+	_out->Write(mTotalBytes);
+	for (auto it = mBlobs.cbegin(); it != mBlobs.cend(); ++it) {
+		_out->Write(it->first);
+		_out->Write(it->second.mLength);
+	}
+
+	// Then all of the contents, back to back and in the same order.
+	if (mSpillFile) {
+		unsigned char* chunk = (unsigned char*)malloc(kBlobSpillChunkSize);
+		assert(chunk);
+		for (auto it = mBlobs.cbegin(); it != mBlobs.cend(); ++it) {
+			if (_fseeki64(mSpillFile, (__int64)it->second.mSpillOffset, SEEK_SET) != 0) {
+				SafeFree(chunk);
+				throw 10;
+			}
+
+			for (size_t offset = 0; offset < it->second.mLength; offset += kBlobSpillChunkSize) {
+				size_t chunkSize = min(kBlobSpillChunkSize, it->second.mLength - offset);
+				if (1 != fread(chunk, chunkSize, 1, mSpillFile)) {
+					SafeFree(chunk);
+					throw 10;
+				}
+				_out->WriteRaw(chunk, chunkSize);
+			}
+		}
+		SafeFree(chunk);
+	} else {
+		for (auto it = mBlobs.cbegin(); it != mBlobs.cend(); ++it) {
+			_out->WriteRaw(it->second.mBytes, it->second.mLength);
+		}
+	}
+
+	_out->Write(Checkpoint("BlobsEnd"));
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlobStore::Read(FileLike* _in)
+{
+	assert(mBlobs.empty() && mStorage == NULL);
+
+	_in->Read(Checkpoint("BlobsBegin"));
+
+	size_t blobCount = 0;
+	_in->Read(&blobCount);
+	_in->Read(&mTotalBytes);
+	if (mTotalBytes > (size_t)-1) {
+		throw 10;
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < blobCount; ++i) {
+		Hash128 id;
+		BlobInfo blob;
+		_in->Read(&id);
+		_in->Read(&blob.mLength);
+
+		// Store the offset for now, it's fixed up once we know where the storage is.
+		blob.mBytes = (const void*)offset;
+		blob.mSpillOffset = 0;
+		offset += blob.mLength;
+		mBlobs[id] = blob;
+	}
+
+	if (offset != mTotalBytes) {
+		throw 10;
+	}
+
+	if (mTotalBytes > 0) {
+		mStorage = _in->ReadPayload((size_t)mTotalBytes);
+
+		// For mapped traces the storage is already part of the mapping, which is borrowed in its own right.
+		mOwnsStorage = !IsBorrowedPayload(mStorage);
+		if (mOwnsStorage) {
+			RegisterBorrowedPayloadRange(mStorage, (size_t)mTotalBytes);
+		}
+	}
+
+	for (auto it = mBlobs.begin(); it != mBlobs.end(); ++it) {
+		it->second.mBytes = (const unsigned char*)mStorage + (size_t)it->second.mBytes;
+	}
+
+	_in->Read(Checkpoint("BlobsEnd"));
+}
+
+// ------------------------------------------------------------------------------------------------
+void* BlobStore::Find(const Hash128& _id, size_t _len) const
+{
+	auto it = mBlobs.find(_id);
+	if (it == mBlobs.end() || it->second.mLength != _len) {
+		return NULL;
+	}
+
+	return const_cast<void*>(it->second.mBytes);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool BlobStore::SpilledBlobEquals(const BlobInfo& _blob, const void* _bytes) const
+{
+	assert(mSpillFile);
+	if (_fseeki64(mSpillFile, (__int64)_blob.mSpillOffset, SEEK_SET) != 0) {
+		throw 10;
+	}
+
+	unsigned char* chunk = (unsigned char*)malloc(kBlobSpillChunkSize);
+	assert(chunk);
+
+	bool retVal = true;
+	for (size_t offset = 0; offset < _blob.mLength && retVal; offset += kBlobSpillChunkSize) {
+		size_t chunkSize = min(kBlobSpillChunkSize, _blob.mLength - offset);
+		if (1 != fread(chunk, chunkSize, 1, mSpillFile)) {
+			SafeFree(chunk);
+			throw 10;
+		}
+		retVal = memcmp(chunk, (const unsigned char*)_bytes + offset, chunkSize) == 0;
+	}
+
+	SafeFree(chunk);
+	return retVal;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <map>
+
+// Payloads smaller than this are always stored inline--a blob reference wouldn't save anything.
+const size_t kMinBlobSize = 256;
+
+// Spilled blobs are copied back out (or compared) this much at a time.
+const size_t kBlobSpillChunkSize = 64 * 1024;
+
+// ------------------------------------------------------------------------------------------------
+// Content-addressed storage for the payloads of a trace file (texture data, buffer contents, pointer
+// arguments of commands). Each distinct payload is stored once in the blobs section, and every use
+// of it is written as a reference to its hash. 
+// When saving, the store only remembers where the payloads are, so they need to stay alive until 
+// Write has been called. When loading, the whole blob section is kept in one piece (or left in the 
+// mapping, for mapped traces) and payloads read through the store point into it.
+class BlobStore
+{
+public:
+	BlobStore();
+	~BlobStore();
+
+	// Instead of remembering where payloads are, copy each new one into a scratch file (deleted when the 
+	// store goes away). Payloads can then be freed as soon as they've been added, at the cost of some I/O.
+	// Must be called before anything is added.
+	void SpillTo(const TCHAR* _scratchFilename);
+
+	// Writing side. Returns false if the payload should be stored inline instead--which is only the case
+	// for tiny payloads and (astronomically unlikely) hash collisions.
+	bool Add(const void* _bytes, size_t _len, Hash128* _outId);
+	void Write(FileLike* _out) const;
+
+	// Reading side. Returns NULL if _id isn't in the store or doesn't have length _len.
+	void Read(FileLike* _in);
+	void* Find(const Hash128& _id, size_t _len) const;
+
+	size_t GetBlobCount() const { return mBlobs.size(); }
+	size_t GetReferenceCount() const { return mReferenceCount; }
+	TraceFileOffset GetTotalBytes() const { return mTotalBytes; }
+
+private:
+	struct BlobInfo
+	{
+		const void* mBytes;		// While writing, the first payload we saw. While reading, points into mStorage.
+		size_t mLength;
+		TraceFileOffset mSpillOffset;	// Where the bytes are in mSpillFile, if we're spilling.
+	};
+
+	std::map<Hash128, BlobInfo> mBlobs;
+	size_t mReferenceCount;
+	TraceFileOffset mTotalBytes;
+
+	void* mStorage;	// Everything we read, in one piece. Borrowed while it's alive, see IsBorrowedPayload.
+	bool mOwnsStorage;
+
+	FILE* mSpillFile;
+	TraceFileOffset mSpillFileSize;
+
+	bool SpilledBlobEquals(const BlobInfo& _blob, const void* _bytes) const;
+};
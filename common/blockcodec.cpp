@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "blockcodec.h"
+
+#include "lz.h"
+#include "workerpool.h"
+
+// ------------------------------------------------------------------------------------------------
+bool ParseTraceCodec(const TCHAR* _name, ETraceCodec* _outCodec)
+{
+	assert(_outCodec);
+	for (int i = 0; i < ETC_Count; ++i) {
+		if (_tcsicmp(_name, TraceCodecName((ETraceCodec)i)) == 0) {
+			(*_outCodec) = (ETraceCodec)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// ------------------------------------------------------------------------------------------------
+const TCHAR* TraceCodecName(ETraceCodec _codec)
+{
+	switch (_codec) {
+	case ETC_None:	return TC("none");
+	case ETC_LZ:	return TC("lz");
+	default:		assert(!"Unknown codec in TraceCodecName"); break;
+	}
+	return TC("unknown");
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+CodecChunkInfo::CodecChunkInfo()
+: mLogicalOffset(0)
+, mPhysicalOffset(0)
+, mRawSize(0)
+, mEncodedSize(0)
+{
+
+}
+
+// ------------------------------------------------------------------------------------------------
+void CodecChunkInfo::Read(FileLike* _in)
+{
+	_in->Read(&mLogicalOffset);
+	_in->Read(&mPhysicalOffset);
+	_in->Read(&mRawSize);
+	_in->Read(&mEncodedSize);
+}
+
+// ------------------------------------------------------------------------------------------------
+void CodecChunkInfo::Write(FileLike* _out) const
+{
+	_out->Write(mLogicalOffset);
+	_out->Write(mPhysicalOffset);
+	_out->Write(mRawSize);
+	_out->Write(mEncodedSize);
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+class BlockEncodeJob : public WorkerJob
+{
+public:
+	BlockEncodeJob(ETraceCodec _codec, TraceFileOffset _logicalOffset)
+	: mCodec(_codec)
+	, mLogicalOffset(_logicalOffset)
+	, mRaw(NULL)
+	, mRawSize(0)
+	, mEncoded(NULL)
+	, mEncodedSize(0)
+	{
+		mRaw = (unsigned char*)malloc(kCodecChunkSize);
+		assert(mRaw);
+	}
+
+	virtual ~BlockEncodeJob()
+	{
+		SafeFree(mEncoded);
+		SafeFree(mRaw);
+	}
+
+	virtual void Execute()
+	{
+		assert(mCodec == ETC_LZ);
+
+		mEncoded = (unsigned char*)malloc(LZCompressBound(mRawSize));
+		assert(mEncoded);
+		mEncodedSize = LZCompress(mRaw, mRawSize, mEncoded);
+
+		// Incompressible chunks are stored as-is, the reader recognizes them by their size.
+		if (mEncodedSize >= mRawSize) {
+			SafeFree(mEncoded);
+			mEncodedSize = mRawSize;
+		}
+	}
+
+	const unsigned char* GetEncodedBytes() const { return mEncoded ? mEncoded : mRaw; }
+
+	ETraceCodec mCodec;
+	TraceFileOffset mLogicalOffset;
+	unsigned char* mRaw;
+	size_t mRawSize;
+	unsigned char* mEncoded;
+	size_t mEncodedSize;
+};
+
+// ------------------------------------------------------------------------------------------------
+BlockEncoder::BlockEncoder(FILE* _file, ETraceCodec _codec, TraceFileOffset _logicalStart)
+: mCurrentJob(NULL)
+, mMaxInFlight(0)
+, mFile(_file)
+, mCodec(_codec)
+, mLogicalOffset(_logicalStart)
+, mPhysicalOffset(_logicalStart)
+{
+	assert(mFile);
+	assert(mCodec != ETC_None);
+
+	// Enough to keep every worker busy while we're writing out the oldest chunk.
+	mMaxInFlight = 2 * GetWorkerPool()->GetThreadCount();
+}
+
+// ------------------------------------------------------------------------------------------------
+BlockEncoder::~BlockEncoder()
+{
+	// Finish should've been called, but make sure nothing is left running against our buffers.
+	SafeDelete(mCurrentJob);
+	while (!mInFlight.empty()) {
+		mInFlight.front()->Wait();
+		SafeDelete(mInFlight.front());
+		mInFlight.pop_front();
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockEncoder::Write(const void* _bytes, size_t _len)
+{
+	const unsigned char* src = (const unsigned char*)_bytes;
+	while (_len > 0) {
+		if (!mCurrentJob) {
+			mCurrentJob = new BlockEncodeJob(mCodec, mLogicalOffset);
+		}
+
+		size_t toCopy = min(_len, kCodecChunkSize - mCurrentJob->mRawSize);
+		memcpy(mCurrentJob->mRaw + mCurrentJob->mRawSize, src, toCopy);
+		mCurrentJob->mRawSize += toCopy;
+		mLogicalOffset += toCopy;
+		src += toCopy;
+		_len -= toCopy;
+
+		if (mCurrentJob->mRawSize == kCodecChunkSize) {
+			SubmitCurrentJob();
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockEncoder::Finish(std::vector<CodecChunkInfo>* _outChunks)
+{
+	assert(_outChunks);
+
+	if (mCurrentJob && mCurrentJob->mRawSize > 0) {
+		SubmitCurrentJob();
+	}
+	SafeDelete(mCurrentJob);
+
+	while (!mInFlight.empty()) {
+		RetireOldestJob();
+	}
+
+	(*_outChunks) = mChunks;
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockEncoder::SubmitCurrentJob()
+{
+	assert(mCurrentJob);
+
+	if (mInFlight.size() >= mMaxInFlight) {
+		RetireOldestJob();
+	}
+
+	GetWorkerPool()->Submit(mCurrentJob);
+	mInFlight.push_back(mCurrentJob);
+	mCurrentJob = NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockEncoder::RetireOldestJob()
+{
+	assert(!mInFlight.empty());
+
+	BlockEncodeJob* job = mInFlight.front();
+	mInFlight.pop_front();
+	job->Wait();
+
+	CodecChunkInfo chunk;
+	chunk.mLogicalOffset = job->mLogicalOffset;
+	chunk.mPhysicalOffset = mPhysicalOffset;
+	chunk.mRawSize = (unsigned int)job->mRawSize;
+	chunk.mEncodedSize = (unsigned int)job->mEncodedSize;
+	mChunks.push_back(chunk);
+
+	if (1 != fwrite(job->GetEncodedBytes(), job->mEncodedSize, 1, mFile)) {
+		SafeDelete(job);
+		throw 10;
+	}
+	mPhysicalOffset += job->mEncodedSize;
+
+	SafeDelete(job);
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+class BlockDecodeJob : public WorkerJob
+{
+public:
+	BlockDecodeJob(ETraceCodec _codec, const CodecChunkInfo& _chunk)
+	: mCodec(_codec)
+	, mChunk(_chunk)
+	, mEncoded(NULL)
+	, mOwnedEncoded(NULL)
+	, mDecoded(NULL)
+	, mSucceeded(false)
+	{
+		mDecoded = (unsigned char*)malloc(mChunk.mRawSize);
+		assert(mDecoded);
+	}
+
+	virtual ~BlockDecodeJob()
+	{
+		SafeFree(mDecoded);
+		SafeFree(mOwnedEncoded);
+	}
+
+	virtual void Execute()
+	{
+		if (mChunk.mEncodedSize == mChunk.mRawSize) {
+			memcpy(mDecoded, mEncoded, mChunk.mRawSize);
+			mSucceeded = true;
+			return;
+		}
+
+		assert(mCodec == ETC_LZ);
+		mSucceeded = LZDecompress(mEncoded, mChunk.mEncodedSize, mDecoded, mChunk.mRawSize);
+	}
+
+	ETraceCodec mCodec;
+	CodecChunkInfo mChunk;
+	const unsigned char* mEncoded;		// Either mOwnedEncoded or a pointer into a mapping.
+	unsigned char* mOwnedEncoded;
+	unsigned char* mDecoded;
+	bool mSucceeded;
+};
+
+// ------------------------------------------------------------------------------------------------
+BlockDecoder::BlockDecoder(FILE* _file, const MappedFile* _mappedFile, ETraceCodec _codec, const std::vector<CodecChunkInfo>& _chunks)
+: mFile(_file)
+, mMappedFile(_mappedFile)
+, mCodec(_codec)
+, mChunks(_chunks)
+, mReadAhead(0)
+, mLogicalOffset(0)
+{
+	assert((mFile != 0) ^ (mMappedFile != 0));
+	assert(mCodec != ETC_None);
+
+	mReadAhead = GetWorkerPool()->GetThreadCount();
+	if (!mChunks.empty()) {
+		mLogicalOffset = mChunks[0].mLogicalOffset;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+BlockDecoder::~BlockDecoder()
+{
+	ReleaseAllChunks();
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockDecoder::Read(void* _bytes, size_t _len)
+{
+	unsigned char* dst = (unsigned char*)_bytes;
+	while (_len > 0) {
+		size_t chunkNum = FindChunk(mLogicalOffset);
+		if (chunkNum == (size_t)-1) {
+			throw 10;
+		}
+
+		const CodecChunkInfo& chunk = mChunks[chunkNum];
+		const unsigned char* decoded = AcquireChunk(chunkNum);
+
+		size_t offsetInChunk = (size_t)(mLogicalOffset - chunk.mLogicalOffset);
+		size_t toCopy = min(_len, chunk.mRawSize - offsetInChunk);
+		memcpy(dst, decoded + offsetInChunk, toCopy);
+
+		mLogicalOffset += toCopy;
+		dst += toCopy;
+		_len -= toCopy;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockDecoder::Seek(TraceFileOffset _logicalOffset)
+{
+	if (mChunks.empty() || _logicalOffset < mChunks[0].mLogicalOffset) {
+		throw 10;
+	}
+
+	const CodecChunkInfo& lastChunk = mChunks.back();
+	if (_logicalOffset > lastChunk.mLogicalOffset + lastChunk.mRawSize) {
+		throw 10;
+	}
+
+	// Going backwards invalidates the read-ahead. Going forwards just lets us drop what we skipped.
+	if (_logicalOffset < mLogicalOffset) {
+		ReleaseAllChunks();
+	} else {
+		size_t chunkNum = FindChunk(_logicalOffset);
+		ReleaseChunksBefore(chunkNum != (size_t)-1 ? chunkNum : mChunks.size());
+	}
+
+	mLogicalOffset = _logicalOffset;
+}
+
+// ------------------------------------------------------------------------------------------------
+size_t BlockDecoder::FindChunk(TraceFileOffset _logicalOffset) const
+{
+	size_t lo = 0, 
+	       hi = mChunks.size();
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const CodecChunkInfo& chunk = mChunks[mid];
+		if (_logicalOffset < chunk.mLogicalOffset) {
+			hi = mid;
+		} else if (_logicalOffset >= chunk.mLogicalOffset + chunk.mRawSize) {
+			lo = mid + 1;
+		} else {
+			return mid;
+		}
+	}
+
+	return (size_t)-1;
+}
+
+// ------------------------------------------------------------------------------------------------
+const unsigned char* BlockDecoder::AcquireChunk(size_t _chunkNum)
+{
+	ReleaseChunksBefore(_chunkNum);
+
+	// Keep the workers busy with the chunks we're most likely to want next.
+	size_t endChunk = min(_chunkNum + 1 + mReadAhead, mChunks.size());
+	for (size_t i = _chunkNum; i < endChunk; ++i) {
+		if (mDecodeJobs.find(i) == mDecodeJobs.end()) {
+			SubmitChunk(i);
+		}
+	}
+
+	BlockDecodeJob* job = mDecodeJobs[_chunkNum];
+	job->Wait();
+	if (!job->mSucceeded) {
+		LogError(TC("Trace is corrupt--chunk %d failed to decode."), _chunkNum);
+		throw 10;
+	}
+
+	return job->mDecoded;
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockDecoder::SubmitChunk(size_t _chunkNum)
+{
+	const CodecChunkInfo& chunk = mChunks[_chunkNum];
+	BlockDecodeJob* job = new BlockDecodeJob(mCodec, chunk);
+
+	// Reading happens here, on the calling thread--only decoding is spread across the pool.
+	if (mMappedFile) {
+		if (chunk.mPhysicalOffset + chunk.mEncodedSize > mMappedFile->GetSize()) {
+			SafeDelete(job);
+			throw 10;
+		}
+		job->mEncoded = mMappedFile->GetBase() + chunk.mPhysicalOffset;
+	} else {
+		job->mOwnedEncoded = (unsigned char*)malloc(chunk.mEncodedSize);
+		assert(job->mOwnedEncoded);
+		if (_fseeki64(mFile, (__int64)chunk.mPhysicalOffset, SEEK_SET) != 0 || 1 != fread(job->mOwnedEncoded, chunk.mEncodedSize, 1, mFile)) {
+			SafeDelete(job);
+			throw 10;
+		}
+		job->mEncoded = job->mOwnedEncoded;
+	}
+
+	mDecodeJobs[_chunkNum] = job;
+	GetWorkerPool()->Submit(job);
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockDecoder::ReleaseChunksBefore(size_t _chunkNum)
+{
+	while (!mDecodeJobs.empty() && mDecodeJobs.begin()->first < _chunkNum) {
+		BlockDecodeJob* job = mDecodeJobs.begin()->second;
+		job->Wait();
+		SafeDelete(job);
+		mDecodeJobs.erase(mDecodeJobs.begin());
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void BlockDecoder::ReleaseAllChunks()
+{
+	ReleaseChunksBefore(mChunks.size());
+}
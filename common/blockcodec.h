@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <vector>
+
+class BlockDecodeJob;
+class BlockEncodeJob;
+class FileLike;
+class MappedFile;
+
+// How the body of a trace (everything after the header) is stored. Recorded in the trace header.
+enum ETraceCodec
+{
+	ETC_None,	// Stored as-is.
+	ETC_LZ,		// Independent blocks compressed with the in-tree LZ codec, see lz.h.
+
+	ETC_Count
+};
+
+// Uncompressed size of each independently coded chunk.
+const size_t kCodecChunkSize = 256 * 1024;
+
+// Converts between codecs and the names used on the command line. ParseTraceCodec returns false 
+// for names it doesn't know.
+bool ParseTraceCodec(const TCHAR* _name, ETraceCodec* _outCodec);
+const TCHAR* TraceCodecName(ETraceCodec _codec);
+
+// ------------------------------------------------------------------------------------------------
+// Where one chunk of the logical (uncompressed) stream lives in the file.
+struct CodecChunkInfo
+{
+	CodecChunkInfo();
+
+	void Read(FileLike* _in);
+	void Write(FileLike* _out) const;
+
+	TraceFileOffset mLogicalOffset;
+	TraceFileOffset mPhysicalOffset;
+	unsigned int mRawSize;
+	unsigned int mEncodedSize;	// Equal to mRawSize if the chunk didn't compress and was stored as-is.
+};
+
+// ------------------------------------------------------------------------------------------------
+// Splits a stream into chunks and compresses them on the worker pool, writing them out in order.
+class BlockEncoder
+{
+public:
+	BlockEncoder(FILE* _file, ETraceCodec _codec, TraceFileOffset _logicalStart);
+	~BlockEncoder();
+
+	void Write(const void* _bytes, size_t _len);
+	TraceFileOffset Tell() const { return mLogicalOffset; }
+
+	// Writes out everything that's pending and returns the table of chunks that were written.
+	void Finish(std::vector<CodecChunkInfo>* _outChunks);
+
+private:
+	BlockEncodeJob* mCurrentJob;
+	std::deque<BlockEncodeJob*> mInFlight;
+	size_t mMaxInFlight;
+
+	FILE* mFile;
+	ETraceCodec mCodec;
+	TraceFileOffset mLogicalOffset;
+	TraceFileOffset mPhysicalOffset;
+	std::vector<CodecChunkInfo> mChunks;
+
+	void SubmitCurrentJob();
+	void RetireOldestJob();
+};
+
+// ------------------------------------------------------------------------------------------------
+// Reads a stream written by BlockEncoder, decoding ahead of the reader on the worker pool.
+// The encoded chunks come either from a file or straight out of a mapping.
+class BlockDecoder
+{
+public:
+	BlockDecoder(FILE* _file, const MappedFile* _mappedFile, ETraceCodec _codec, const std::vector<CodecChunkInfo>& _chunks);
+	~BlockDecoder();
+
+	void Read(void* _bytes, size_t _len);
+
+	TraceFileOffset Tell() const { return mLogicalOffset; }
+	void Seek(TraceFileOffset _logicalOffset);
+
+private:
+	FILE* mFile;
+	const MappedFile* mMappedFile;
+	ETraceCodec mCodec;
+	std::vector<CodecChunkInfo> mChunks;
+
+	// Chunks that are decoded or being decoded, keyed by chunk number.
+	std::map<size_t, BlockDecodeJob*> mDecodeJobs;
+	size_t mReadAhead;
+
+	TraceFileOffset mLogicalOffset;
+
+	size_t FindChunk(TraceFileOffset _logicalOffset) const;
+	const unsigned char* AcquireChunk(size_t _chunkNum);
+	void SubmitChunk(size_t _chunkNum);
+	void ReleaseChunksBefore(size_t _chunkNum);
+	void ReleaseAllChunks();
+};
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "bytediff.h"
+
+#include <intrin.h>
+
+// The AVX2 intrinsics arrived with VS2012 (_MSC_VER 1700). Older compilers only get the SSE2 path.
+#if _MSC_VER >= 1700
+#include <immintrin.h>
+#endif
+
+// ------------------------------------------------------------------------------------------------
+// Collects changed bytes into runs, merging the ones that are close together.
+class RunBuilder
+{
+public:
+	RunBuilder(size_t _baseOffset, size_t _mergeGap, std::vector<ByteRun>* _outRuns)
+	: mBaseOffset(_baseOffset)
+	, mMergeGap(_mergeGap)
+	, mOutRuns(_outRuns)
+	, mHavePending(false)
+	, mPendingStart(0)
+	, mPendingEnd(0)
+	{ }
+
+	~RunBuilder() { Flush(); }
+
+	// Bytes _first through _last changed. Calls come in order of _first.
+	inline void AddChanged(size_t _first, size_t _last)
+	{
+		if (mHavePending && _first - mPendingEnd < mMergeGap) {
+			mPendingEnd = _last + 1;
+			return;
+		}
+
+		Flush();
+		mHavePending = true;
+		mPendingStart = _first;
+		mPendingEnd = _last + 1;
+	}
+
+	void Flush()
+	{
+		if (mHavePending) {
+			mOutRuns->push_back(ByteRun(mBaseOffset + mPendingStart, mPendingEnd - mPendingStart));
+			mHavePending = false;
+		}
+	}
+
+private:
+	size_t mBaseOffset;
+	size_t mMergeGap;
+	std::vector<ByteRun>* mOutRuns;
+
+	bool mHavePending;
+	size_t mPendingStart;
+	size_t mPendingEnd;
+};
+
+// ------------------------------------------------------------------------------------------------
+// _changed has a bit set for each byte of the block at _blockOffset that changed. Everything between 
+// the first and last of them goes in, which is never more than a block's worth of unchanged bytes.
+static inline void AddChangedBlock(size_t _blockOffset, unsigned int _changed, RunBuilder* _runs)
+{
+	unsigned long first = 0;
+	unsigned long last = 0;
+	_BitScanForward(&first, _changed);
+	_BitScanReverse(&last, _changed);
+	_runs->AddChanged(_blockOffset + first, _blockOffset + last);
+}
+
+#if _MSC_VER >= 1700
+// ------------------------------------------------------------------------------------------------
+static bool CpuHasAVX2()
+{
+	int info[4] = { 0 };
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	// The OS has to be saving the YMM registers, too.
+	__cpuid(info, 1);
+	const int kOSXSave = 1 << 27;
+	const int kAVX = 1 << 28;
+	if ((info[2] & (kOSXSave | kAVX)) != (kOSXSave | kAVX) || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+}
+
+static const bool kHaveAVX2 = CpuHasAVX2();
+
+// ------------------------------------------------------------------------------------------------
+// These return how far they got; whatever's left is less than a block.
+static size_t FindChangedBlocksAVX2(const unsigned char* _old, const unsigned char* _new, size_t _len, RunBuilder* _runs)
+{
+	size_t offset = 0;
+	for (; offset + 32 <= _len; offset += 32) {
+		__m256i oldBytes = _mm256_loadu_si256((const __m256i*)(_old + offset));
+		__m256i newBytes = _mm256_loadu_si256((const __m256i*)(_new + offset));
+		unsigned int changed = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(oldBytes, newBytes));
+		if (changed) {
+			AddChangedBlock(offset, changed, _runs);
+		}
+	}
+
+	// Don't leave the SSE code after us paying for dirty upper halves.
+	_mm256_zeroupper();
+	return offset;
+}
+#endif
+
+// ------------------------------------------------------------------------------------------------
+static size_t FindChangedBlocksSSE2(const unsigned char* _old, const unsigned char* _new, size_t _len, RunBuilder* _runs)
+{
+	size_t offset = 0;
+	for (; offset + 16 <= _len; offset += 16) {
+		__m128i oldBytes = _mm_loadu_si128((const __m128i*)(_old + offset));
+		__m128i newBytes = _mm_loadu_si128((const __m128i*)(_new + offset));
+		unsigned int changed = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(oldBytes, newBytes)) & 0xFFFF;
+		if (changed) {
+			AddChangedBlock(offset, changed, _runs);
+		}
+	}
+
+	return offset;
+}
+
+// ------------------------------------------------------------------------------------------------
+void FindChangedRuns(const void* _old, const void* _new, size_t _len, size_t _baseOffset, size_t _mergeGap, std::vector<ByteRun>* _outRuns)
+{
+	const unsigned char* oldBytes = (const unsigned char*)_old;
+	const unsigned char* newBytes = (const unsigned char*)_new;
+	RunBuilder runs(_baseOffset, _mergeGap, _outRuns);
+
+#if _MSC_VER >= 1700
+	size_t offset = kHaveAVX2 ? FindChangedBlocksAVX2(oldBytes, newBytes, _len, &runs)
+	                          : FindChangedBlocksSSE2(oldBytes, newBytes, _len, &runs);
+#else
+	size_t offset = FindChangedBlocksSSE2(oldBytes, newBytes, _len, &runs);
+#endif
+
+	for (; offset < _len; ++offset) {
+		if (oldBytes[offset] != newBytes[offset]) {
+			runs.AddChanged(offset, offset);
+		}
+	}
+}
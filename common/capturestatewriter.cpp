@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "capturestatewriter.h"
+
+#include "functionhooks.gen.h"
+
+// How often the writer thread looks for more of the capture to pass on when the hooks are quiet.
+const DWORD kCaptureStateWriterPollTimeMs = 5;
+
+// How long we give the writer thread to finish up when we're torn down.
+const DWORD kCaptureStateWriterShutdownTimeoutMs = 5000;
+
+CaptureStateWriter* gCaptureStateWriter = NULL;
+
+// ------------------------------------------------------------------------------------------------
+DWORD WINAPI CaptureStateWriter_RunWriteThread(LPVOID _writerPtr)
+{
+	((CaptureStateWriter*)_writerPtr)->Thread_Write();
+	return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+CaptureStateWriter::CaptureStateWriter(MessageStream* _stream)
+: mStream(_stream)
+, mHoldingStream(NULL)
+, mSnapshot(NULL)
+, mBaseGeneration(0)
+, mBaseContext(0)
+, mThreadHandle(NULL)
+, mCaptureEnded(true)
+{
+	assert(mStream);
+	mHoldingStream = new MessageStream(true, "", "", EMT_Loopback);
+}
+
+// ------------------------------------------------------------------------------------------------
+CaptureStateWriter::~CaptureStateWriter()
+{
+	mCaptureEnded = true;
+	if (mThreadHandle) {
+		if (WaitForSingleObject(mThreadHandle, kCaptureStateWriterShutdownTimeoutMs) != WAIT_OBJECT_0) {
+			// Still sending. Leak everything rather than pull it out from under the thread.
+			LogError(TC("The last capture didn't finish sending in time."));
+			return;
+		}
+		CloseHandle(mThreadHandle);
+		mThreadHandle = NULL;
+	}
+
+	SafeDelete(mSnapshot);
+	SafeDelete(mHoldingStream);
+}
+
+// ------------------------------------------------------------------------------------------------
+MessageStream* CaptureStateWriter::BeginCapture(ContextState* _snapshot, unsigned int _baseGeneration, unsigned __int64 _baseContext)
+{
+	assert(_snapshot);
+	assert(mCaptureEnded);
+
+	// One capture at a time, so the stream only ever has one sender.
+	WaitForThread();
+
+	mSnapshot = _snapshot;
+	mBaseGeneration = _baseGeneration;
+	mBaseContext = _baseContext;
+	mCaptureEnded = false;
+
+	mThreadHandle = CreateThread(NULL, 0, CaptureStateWriter_RunWriteThread, this, 0, NULL);
+	if (!mThreadHandle) {
+		// Do it the slow way, then.
+		LogError(TC("Couldn't start the capture writer thread, sending the context state from the render thread."));
+		FileLike out(mStream);
+		WriteCaptureHeader(&out, mSnapshot, mBaseGeneration, mBaseContext);
+		out.Write(Checkpoint("FrameCommandsBegin"));
+		SafeDelete(mSnapshot);
+		return mStream;
+	}
+
+	FileLike holding(mHoldingStream);
+	holding.Write(Checkpoint("FrameCommandsBegin"));
+	return mHoldingStream;
+}
+
+// ------------------------------------------------------------------------------------------------
+MessageStream* CaptureStateWriter::EndCapture()
+{
+	mCaptureEnded = true;
+	return mStream;
+}
+
+// ------------------------------------------------------------------------------------------------
+void CaptureStateWriter::WaitForThread()
+{
+	if (mThreadHandle) {
+		WaitForSingleObject(mThreadHandle, INFINITE);
+		CloseHandle(mThreadHandle);
+		mThreadHandle = NULL;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void CaptureStateWriter::WriteCaptureHeader(FileLike* _out, const ContextState* _snapshot, unsigned int _baseGeneration, unsigned __int64 _baseContext)
+{
+	// Sending can block for far longer than the shadow budget keeps payloads around unpinned.
+	SharedObjectsPayloadPins pins(_snapshot->GetSharedObjects());
+
+	// The state's packets have to work out how big their pointers are from the state they're part of.
+	_out->SetContextState(_snapshot);
+	_out->Write(Checkpoint("TraceCapturingBegin"));
+	_out->Write(kPacketFormatVersion);
+	_snapshot->WriteCaptureState(_out, _baseGeneration, _baseContext);
+	_out->Flush();
+	_out->SetContextState(NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+void CaptureStateWriter::Thread_Write()
+{
+	bool sending = true;
+	try {
+		FileLike out(mStream);
+		WriteCaptureHeader(&out, mSnapshot, mBaseGeneration, mBaseContext);
+	} catch (...) {
+		LogError(TC("Sending the context state failed."));
+		sending = false;
+	}
+	SafeDelete(mSnapshot);
+
+	// Then pass on what the hooks have sent since, until the capture is over and all of it has gone. 
+	// If sending fails, keep draining anyway so the hooks don't end up stuck on a full ring.
+	try {
+		while (true) {
+			bool captureEnded = mCaptureEnded;
+			if (!mHoldingStream->WaitForRecv(kCaptureStateWriterPollTimeMs)) {
+				if (captureEnded) {
+					break;
+				}
+				continue;
+			}
+
+			size_t bufferedLen = 0;
+			const unsigned char* bytes = mHoldingStream->FillRecvBuffer(1, &bufferedLen);
+			if (sending) {
+				try {
+					mStream->Send(bytes, bufferedLen);
+				} catch (...) {
+					LogError(TC("Sending the capture failed."));
+					sending = false;
+				}
+			}
+			mHoldingStream->ConsumeRecvBuffer(bufferedLen);
+		}
+
+		// The other end is waiting on the end of the capture, don't leave it sitting in the send ring.
+		if (sending) {
+			mStream->FlushSendBuffer();
+		}
+	} catch (...) {
+		// The holding stream is going away.
+	}
+}
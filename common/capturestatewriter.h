@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+class ContextState;
+class MessageStream;
+
+// ------------------------------------------------------------------------------------------------
+// Sends the context state that starts a capture from a thread of its own, so that the application 
+// only waits for a copy of the state to be taken (see ContextState::OnCaptureStart) instead of for 
+// all of it to be serialized and sent. Meanwhile, the hooks send the capture's commands to a loopback
+// stream, and the writer passes them on once the state is out--the other end sees the capture in 
+// the same order as ever.
+class CaptureStateWriter
+{
+public:
+	// Captures go to _stream, which stays owned by the caller.
+	CaptureStateWriter(MessageStream* _stream);
+	~CaptureStateWriter();
+
+	// On the render thread, when a capture starts. Takes ownership of _snapshot and starts sending the
+	// capture's header and state. Returns the stream the hooks should send the rest of the capture to.
+	MessageStream* BeginCapture(ContextState* _snapshot, unsigned int _baseGeneration, unsigned __int64 _baseContext);
+
+	// On the render thread, once the end of the capture has been sent to the stream BeginCapture 
+	// returned. Returns the stream captures go to, for the hooks to go back to.
+	MessageStream* EndCapture();
+
+private:
+	MessageStream* mStream;
+	MessageStream* mHoldingStream;
+
+	ContextState* mSnapshot;
+	unsigned int mBaseGeneration;
+	unsigned __int64 mBaseContext;
+
+	HANDLE mThreadHandle;
+	volatile bool mCaptureEnded;
+
+	// Waits for the capture before this one to make it all the way out.
+	void WaitForThread();
+
+	static void WriteCaptureHeader(FileLike* _out, const ContextState* _snapshot, unsigned int _baseGeneration, unsigned __int64 _baseContext);
+
+	void Thread_Write();
+
+	friend DWORD WINAPI CaptureStateWriter_RunWriteThread(LPVOID _writerPtr);
+};
+
+extern CaptureStateWriter* gCaptureStateWriter;
@@ -37,6 +37,10 @@ kGetStaticProcAddress = "GetProcAddress"
 kGlobalState = "GlobalState"
 kRealPrefix = "gReal_"
 kDataPacketStructName = "SSerializeDataPacket"
+kPacketOpcodeType = "unsigned short"
+# Bump whenever the on-the-wire / on-disk encoding of SSerializeDataPacket (or of the scalars FileLike
+# writes, which the context state shares) changes.
+kPacketFormatVersion = 4
 
 # -------------------------------------------------------------------------------------------------
 # -------------------------------------------------------------------------------------------------
@@ -176,7 +180,8 @@ class GLFunction:
                 lines.append("\t%s(%s);" % (self.asRealPointerName, self.argsForPassingAsStr))
             else:
                 lines.append("\tauto retVal = %s(%s);" % (self.asRealPointerName, self.argsForPassingAsStr))
-            lines.append("\tif (!gContextState->CheckOwnerThreadId())")
+            lines.append("\tContextState* contextState = gIsTracking ? gContextRegistry->GetCurrent() : NULL;")
+            lines.append("\tif (!contextState)")
             if self.returnType == "void":
                 lines.append("\t\treturn;")
             else:
@@ -184,10 +189,10 @@ class GLFunction:
             if self.alias is not None:
                 lines.append("\t// NOTE: Calling aliased function, see functionhooks.py for alias define!")
             if self.supported:
-                lines.append("\tif (gIsRecording)")
-                lines.append("\t\t%s::%s(%s).Write(&FileLike(gMessageStream));" % (kDataPacketStructName, callName, self.argsForPassingAsStr))
+                lines.append("\tif (gIsRecording && contextState->SharesObjectsWith(gContextState))")
+                lines.append("\t\tgCommandRecorder->Record(contextState, %s::%s(%s));" % (kDataPacketStructName, callName, self.argsForPassingAsStr))
                 if self.isState:
-                    lines.append("\tgContextState->%s(%s);" % (callName, self.argsForPassingAsStateStr))
+                    lines.append("\tcontextState->%s(%s);" % (callName, self.argsForPassingAsStateStr))
                 if self.returnType != "void":
                     lines.append("\treturn retVal;")
             else:
@@ -418,6 +423,7 @@ def generateHeader(allMembers, allClasses, cmdLine):
     lines.append("")
 
     lines.append("extern bool gIsRecording;")
+    lines.append("extern bool gIsTracking;")
     lines.append("extern class ContextState* gContextState;")
     for member in allMembers:
         if member.needsManualDetour:
@@ -454,6 +460,12 @@ def generateHeader(allMembers, allClasses, cmdLine):
 
     lines.append("};")
 
+    lines.append("")
+    lines.append("// Version of the packet encoding produced by %s::Write. Traces and streams carry this value so " % kDataPacketStructName)
+    lines.append("// that readers can reject data they don't understand.")
+    lines.append("const unsigned int kPacketFormatVersion = %d;" % kPacketFormatVersion)
+    lines.append("// Where %s::Write puts the packet id: right after the opcode." % kDataPacketStructName)
+    lines.append("const size_t kPacketIdOffset = sizeof(%s);" % kPacketOpcodeType)
     lines.append("")
 
     # Generate structure for serialization.
@@ -463,8 +475,14 @@ def generateHeader(allMembers, allClasses, cmdLine):
     lines.append("\tvoid Write(FileLike* _out) const;")
     lines.append("\tvoid Play() const;")
     lines.append("")
+    lines.append("\t// Frees the payloads Read allocated. Only valid for packets that were filled in by Read. Payloads Read")
+    lines.append("\t// took from an arena (see FileLike::SetPayloadArena) are left alone.")
+    lines.append("\tvoid ReleasePayloads();")
+    lines.append("")
     lines.append("\tESerializeTypes mDataType;")
     lines.append("\tsize_t mPacketId;")
+    lines.append("\t// Set by Read--bit i means argument i holds a payload rather than the pointer value from the stream.")
+    lines.append("\tunsigned int mOwnedPayloads;")
     lines.append("\tunion {")
     for member in allMembers:
         if member.alias is not None:
@@ -509,11 +527,29 @@ def generateHeader(allMembers, allClasses, cmdLine):
         lines.append("\t~%s();" % stateClass.cname)
         lines.append("\tvoid Read(FileLike* _in);")
         lines.append("\tvoid Write(FileLike* _out) const;")
-        lines.append("\tvoid OnCaptureStart();")
+        lines.append("\t// Same as Write/Read, except that objects are only written if they changed after _sinceGeneration, and ")
+        lines.append("\t// ReadDelta applies them to the state that's already here.")
+        lines.append("\tvoid WriteDelta(FileLike* _out, unsigned int _sinceGeneration) const;")
+        lines.append("\tvoid ReadDelta(FileLike* _in);")
+        lines.append("\t// Called when a capture starts. Returns a copy of the state as it is now, to be written out with ")
+        lines.append("\t// WriteCaptureState--on any thread, while this one carries on. The copy shares payloads with us.")
+        lines.append("\tContextState* OnCaptureStart();")
+        lines.append("\t// Sends only what changed since _baseGeneration if that's the last capture of this very context, _baseContext.")
+        lines.append("\tvoid WriteCaptureState(FileLike* _out, unsigned int _baseGeneration, unsigned __int64 _baseContext) const;")
+        lines.append("\t// Rebuilds the state, and the objects of every context sharing them, by asking the driver--for when ")
+        lines.append("\t// the hooks weren't tracking it. Needs the context current on this thread.")
+        lines.append("\tvoid QueryDriverState();")
+        lines.append("\t// Hands out the errors the application had pending when QueryDriverState ran, oldest first. Returns ")
+        lines.append("\t// false once there are none left.")
+        lines.append("\tbool PopPendingError(GLenum* _outError);")
         lines.append("\tvoid Restore();")
         # TODO: need a way to specify C functions on the class, rather than here.
-        lines.append("\tvoid SetOwnerThreadId(DWORD _threadId);")
-        lines.append("\tbool CheckOwnerThreadId() const;")
+        lines.append("\tvoid SetContext(HDC _hdc, HGLRC _hglrc);")
+        lines.append("\t// Drops our objects for _other's, which we then share with it and everything else sharing them.")
+        lines.append("\tvoid ShareObjectsWith(ContextState* _other);")
+        lines.append("\tinline bool SharesObjectsWith(const ContextState* _other) const { return _other && _other->mData_SharedObjects == mData_SharedObjects; }")
+        lines.append("\t// The buffer object bound to _target, or NULL. Hold a SharedObjectsLock while using it.")
+        lines.append("\tGLBuffer* GetBoundBuffer(GLenum _target) const;")
 
         lines.append("")
         for member in stateClass.members:
@@ -534,8 +570,14 @@ def generateHeader(allMembers, allClasses, cmdLine):
         if len(stateClass.members) > 0:
             lines.append("\tvoid ManualConstruct(); // Construct any manual data members")
             lines.append("\tvoid ManualDestruct(); // Destroy any manual data members")
+        lines.append("\tvoid WriteCurrentState(FileLike* _out) const;")
+        lines.append("\tvoid ReadCurrentState(FileLike* _in);")
+        lines.append("\tvoid CopyCurrentState(const %s& _src);" % stateClass.cname)
         lines.append("\tvoid ManualWrite(FileLike* _out) const;")
         lines.append("\tvoid ManualRead(FileLike* _in);")
+        lines.append("\tvoid ManualWriteDelta(FileLike* _out, unsigned int _sinceGeneration) const;")
+        lines.append("\tvoid ManualReadDelta(FileLike* _in);")
+        lines.append("\tvoid ManualCopy(const %s& _src);" % stateClass.cname)
         lines.append("\tvoid ManualPreRestore();")
         lines.append("\tvoid ManualRestore();")
         lines.append("")
@@ -567,9 +609,13 @@ def generateCpp(allMembers, allClasses, cmdLine):
     lines.append('#include "functionhooks.gen.h"')
     lines.append('#include "thirdparty/mhook/mhook-lib/mhook.h"')
     lines.append('#include "extensions.h"')
+    lines.append('#include "commandrecorder.h"')
+    lines.append('#include "contextregistry.h"')
     lines.append("")
 
     lines.append("bool gIsRecording = false;")
+    lines.append("// When false, the hooks go straight to the driver without keeping track of anything.")
+    lines.append("bool gIsTracking = true;")
     lines.append("ContextState* gContextState = NULL;")
 
     lines.append("")
@@ -635,9 +681,17 @@ def generateCpp(allMembers, allClasses, cmdLine):
             lines.append("%s\n" % member.asDetouredFunction(True))
 
     # Generate SSerializeDataPacket::Read and SSerializeDataPacket::Write
+    # Packets are encoded compactly: a small opcode, the packet id, then only the arguments belonging to that 
+    # command (in declaration order) followed by any pointer payloads. See kPacketFormatVersion.
+    # Payloads come from FileLike::ReadPayload, so they may point into a mapped trace rather than the heap,
+    # or belong to the FileLike's payload arena.
     lines.append("void %s::Read(FileLike* _in)" % (kDataPacketStructName,))
     lines.append("{")
-    lines.append("\t_in->ReadRaw(this, sizeof(*this));")
+    lines.append("\t%s opcode = 0;" % kPacketOpcodeType)
+    lines.append("\t_in->ReadRaw(&opcode, sizeof(opcode));")
+    lines.append("\tmDataType = (ESerializeTypes)opcode;")
+    lines.append("\t_in->ReadRaw(&mPacketId, sizeof(mPacketId));")
+    lines.append("\tmOwnedPayloads = 0;")
     lines.append("")
     lines.append("\tswitch(mDataType)")
     lines.append("\t{")
@@ -646,46 +700,101 @@ def generateCpp(allMembers, allClasses, cmdLine):
             continue
         if not member.supported:
             continue
+        if len(member.args) == 0:
+            continue
+        lines.append("\t\tcase %s:" % member.asDataName)
+        lines.append("\t\t{")
         if member.hasAnyPointers:
-            lines.append("\t\tcase %s:" % member.asDataName)
-            lines.append("\t\t{")
             lines.append("\t\t\tsize_t toStreamSize = 0;")
-            for arg in member.args:
-                if arg.isPointer:
-                    lines.append("\t\t\ttoStreamSize = (size_t)(%s.%s);" % (member.asDataStructMemberName, arg.name))
-                    lines.append("\t\t\tif (toStreamSize != 0) {")
-                    lines.append("\t\t\t\tvoid* newBuffer = malloc(toStreamSize);")
-                    lines.append("\t\t\t\tassert(newBuffer != 0);")
-                    lines.append("\t\t\t\t_in->ReadRaw(newBuffer, toStreamSize);")
-                    lines.append("\t\t\t\t%s.%s = (%s)newBuffer;" % (member.asDataStructMemberName, arg.name, arg.ctype))
-                    lines.append("\t\t\t} else {")
-                    lines.append("\t\t\t\t_in->Read((size_t*)&%s.%s);" % (member.asDataStructMemberName, arg.name))
-                    lines.append("\t\t\t}")
-
-            lines.append("\t\t\tbreak;")
-            lines.append("\t\t}")
-            lines.append("")
+        for i, arg in enumerate(member.args):
+            fieldName = "%s.%s" % (member.asDataStructMemberName, arg.name)
+            if arg.isPointerOrOffset:
+                flagName = "%s.%s" % (member.asDataStructMemberName, arg.pointerOrOffsetName)
+                lines.append("\t\t\t_in->ReadRaw(&%s, sizeof(%s));" % (flagName, flagName))
+            if arg.isPointer:
+                lines.append("\t\t\t_in->ReadRaw(&toStreamSize, sizeof(toStreamSize));")
+                lines.append("\t\t\tif (toStreamSize != 0) {")
+                lines.append("\t\t\t\t%s = (%s)_in->ReadPayload(toStreamSize);" % (fieldName, arg.ctype))
+                lines.append("\t\t\t\tmOwnedPayloads |= (1 << %d);" % i)
+                lines.append("\t\t\t} else {")
+                lines.append("\t\t\t\t_in->Read((size_t*)&%s);" % (fieldName))
+                lines.append("\t\t\t}")
+            else:
+                lines.append("\t\t\t_in->ReadRaw(&%s, sizeof(%s));" % (fieldName, fieldName))
+
+        lines.append("\t\t\tbreak;")
+        lines.append("\t\t}")
+        lines.append("")
     lines.append("\t\tcase EST_Message:")
     lines.append("\t\t{")
-    lines.append("\t\t\tsize_t toStreamSize = (size_t)mData_Message.messageBody;")
+    lines.append("\t\t\tsize_t toStreamSize = 0;")
+    lines.append("\t\t\t_in->ReadRaw(&mData_Message.level, sizeof(mData_Message.level));")
+    lines.append("\t\t\t_in->ReadRaw(&toStreamSize, sizeof(toStreamSize));")
     lines.append("\t\t\tassert(toStreamSize != 0);")
-    lines.append("\t\t\tvoid* newBuffer = malloc(toStreamSize);")
-    lines.append("\t\t\tassert(newBuffer != 0);")
-    lines.append("\t\t\t_in->ReadRaw(newBuffer, toStreamSize);")
-    lines.append("\t\t\tmData_Message.messageBody = (TCHAR*)newBuffer;")
+    lines.append("\t\t\tmData_Message.messageBody = (TCHAR*)_in->ReadPayload(toStreamSize);")
+    lines.append("\t\t\tmOwnedPayloads |= 1;")
     lines.append("\t\t\tbreak;")
     lines.append("\t\t}")
     lines.append("")
+    lines.append("\t\tcase EST_Sentinel:")
+    lines.append("\t\t\tbreak;")
+    lines.append("")
     lines.append("\t\tdefault:")
+    lines.append("\t\t\t// Commands without arguments are fully described by their opcode.")
+    lines.append("\t\t\tif (mDataType >= EST_Sentinel) {")
+    lines.append("\t\t\t\t// Unknown opcode--the stream is either corrupt or from an incompatible version.")
+    lines.append("\t\t\t\tthrow 10;")
+    lines.append("\t\t\t}")
     lines.append("\t\t\tbreak;")
     lines.append("\t};")
+    lines.append("")
+    lines.append("\t// Payloads that came out of an arena are the arena's to free.")
+    lines.append("\tif (_in->GetPayloadArena()) {")
+    lines.append("\t\tmOwnedPayloads = 0;")
+    lines.append("\t}")
+    lines.append("}")
+    lines.append("")
+
+    lines.append("void %s::ReleasePayloads()" % (kDataPacketStructName,))
+    lines.append("{")
+    lines.append("\tswitch(mDataType)")
+    lines.append("\t{")
+    for member in allMembers:
+        if member.alias is not None:
+            continue
+        if not member.supported:
+            continue
+        if not member.hasAnyPointers:
+            continue
+        lines.append("\t\tcase %s:" % member.asDataName)
+        for i, arg in enumerate(member.args):
+            if arg.isPointer:
+                fieldName = "%s.%s" % (member.asDataStructMemberName, arg.name)
+                lines.append("\t\t\tif (mOwnedPayloads & (1 << %d)) {" % i)
+                lines.append("\t\t\t\tSafeFreePayload(%s);" % fieldName)
+                lines.append("\t\t\t}")
+        lines.append("\t\t\tbreak;")
+        lines.append("")
+    lines.append("\t\tcase EST_Message:")
+    lines.append("\t\t\tif (mOwnedPayloads & 1) {")
+    lines.append("\t\t\t\tSafeFreePayload(mData_Message.messageBody);")
+    lines.append("\t\t\t}")
+    lines.append("\t\t\tbreak;")
+    lines.append("")
+    lines.append("\t\tdefault:")
+    lines.append("\t\t\tbreak;")
+    lines.append("\t};")
+    lines.append("\tmOwnedPayloads = 0;")
     lines.append("}")
     lines.append("")
 
     lines.append("void %s::Write(FileLike* _out) const" % (kDataPacketStructName,))
     lines.append("{")
-    lines.append("\t%s tmpPkt(*this);" % (kDataPacketStructName,))
-    lines.append("\ttmpPkt.mPacketId = _out->AllocatePacketId();")
+    lines.append("\tassert(mDataType <= EST_Sentinel);")
+    lines.append("\t%s opcode = (%s)mDataType;" % (kPacketOpcodeType, kPacketOpcodeType))
+    lines.append("\tsize_t packetId = _out->AllocatePacketId();")
+    lines.append("\t_out->WriteRaw(&opcode, sizeof(opcode));")
+    lines.append("\t_out->WriteRaw(&packetId, sizeof(packetId));")
     lines.append("")
     lines.append("\tswitch(mDataType)")
     lines.append("\t{")
@@ -694,36 +803,44 @@ def generateCpp(allMembers, allClasses, cmdLine):
             continue
         if not member.supported:
             continue
+        if len(member.args) == 0:
+            continue
+        lines.append("\t\tcase %s:" % member.asDataName)
+        lines.append("\t\t{")
         if member.hasAnyPointers:
-            lines.append("\t\tcase %s:" % member.asDataName)
-            lines.append("\t\t{")
-            for i, arg in enumerate(member.args):
-                if arg.isPointer:
-                    if member.canAutoDeterminePointerLength(i):
-                        lines.append("\t\t\ttmpPkt.%s.%s = (%s) %s(%s);" % (member.asDataStructMemberName, arg.name, arg.ctype, arg.asDeterminePointerLengthFunc(member.name), ", ".join(["mData_%s.%s" % (member.name, arg.name) for arg in member.args])))
-                    else:
-                        lines.append("\t\t\ttmpPkt.%s.%s = (%s) %s(gContextState, %s);" % (member.asDataStructMemberName, arg.name, arg.ctype, arg.asDeterminePointerLengthFunc(member.name), ", ".join(["mData_%s.%s" % (member.name, arg.name) for arg in member.args])))
-            lines.append("\t\t\t_out->WriteRaw(&tmpPkt, sizeof(tmpPkt));")
-            for arg in member.args:
-                if arg.isPointer:
-                    lines.append("\t\t\tif (tmpPkt.%s.%s != 0) {" % (member.asDataStructMemberName, arg.name))
-                    lines.append("\t\t\t\t_out->WriteRaw(%s.%s, (size_t) tmpPkt.%s.%s);" % (member.asDataStructMemberName, arg.name, member.asDataStructMemberName, arg.name))
-                    lines.append("\t\t\t} else {")
-                    lines.append("\t\t\t\t_out->Write((size_t)%s.%s);" % (member.asDataStructMemberName, arg.name))
-                    lines.append("\t\t\t}")
-            lines.append("\t\t\tbreak;")
-            lines.append("\t\t}")
-            lines.append("")
+            lines.append("\t\t\tsize_t toStreamSize = 0;")
+        for i, arg in enumerate(member.args):
+            fieldName = "%s.%s" % (member.asDataStructMemberName, arg.name)
+            if arg.isPointerOrOffset:
+                flagName = "%s.%s" % (member.asDataStructMemberName, arg.pointerOrOffsetName)
+                lines.append("\t\t\t_out->WriteRaw(&%s, sizeof(%s));" % (flagName, flagName))
+            if arg.isPointer:
+                allArgs = ", ".join(["mData_%s.%s" % (member.name, a.name) for a in member.args])
+                if member.canAutoDeterminePointerLength(i):
+                    lines.append("\t\t\ttoStreamSize = %s(%s);" % (arg.asDeterminePointerLengthFunc(member.name), allArgs))
+                else:
+                    lines.append("\t\t\ttoStreamSize = %s(_out->GetContextState(), %s);" % (arg.asDeterminePointerLengthFunc(member.name), allArgs))
+                lines.append("\t\t\t_out->WriteRaw(&toStreamSize, sizeof(toStreamSize));")
+                lines.append("\t\t\tif (toStreamSize != 0) {")
+                lines.append("\t\t\t\t_out->WritePayloadByReference(%s, toStreamSize);" % (fieldName))
+                lines.append("\t\t\t} else {")
+                lines.append("\t\t\t\t_out->Write((size_t)%s);" % (fieldName))
+                lines.append("\t\t\t}")
+            else:
+                lines.append("\t\t\t_out->WriteRaw(&%s, sizeof(%s));" % (fieldName, fieldName))
+        lines.append("\t\t\tbreak;")
+        lines.append("\t\t}")
+        lines.append("")
     lines.append("\t\tcase EST_Message:")
     lines.append("\t\t{")
-    lines.append("\t\t\ttmpPkt.mData_Message.messageBody = (TCHAR*)(sizeof(TCHAR) * (_tcslen(mData_Message.messageBody) + 1));")
-    lines.append("\t\t\t_out->WriteRaw(&tmpPkt, sizeof(tmpPkt));")
-    lines.append("\t\t\t_out->WriteRaw(mData_Message.messageBody, (size_t)tmpPkt.mData_Message.messageBody);")
+    lines.append("\t\t\tsize_t toStreamSize = sizeof(TCHAR) * (_tcslen(mData_Message.messageBody) + 1);")
+    lines.append("\t\t\t_out->WriteRaw(&mData_Message.level, sizeof(mData_Message.level));")
+    lines.append("\t\t\t_out->WriteRaw(&toStreamSize, sizeof(toStreamSize));")
+    lines.append("\t\t\t_out->WritePayloadByReference(mData_Message.messageBody, toStreamSize);")
     lines.append("\t\t\tbreak;")
     lines.append("\t\t}")
     lines.append("\t\tdefault:")
-    lines.append("\t\t\t// Writes out tmpPkt because it has a packet id for debugging")
-    lines.append("\t\t\t_out->WriteRaw(&tmpPkt, sizeof(tmpPkt));")
+    lines.append("\t\t\t// Sentinel and argument-less commands are just the opcode and packet id.")
     lines.append("\t\t\tbreak;")
     lines.append("\t};")
     lines.append("}")
@@ -793,8 +910,37 @@ def generateCpp(allMembers, allClasses, cmdLine):
             lines.append("}")
         lines.append("")
 
+        # The generated state is small, so it's always written whole--only objects are sent as deltas.
         lines.append("void %s::Write(FileLike* _out) const" % (stateClass.cname))
         lines.append("{")
+        lines.append("\tWriteCurrentState(_out);")
+        lines.append("\tManualWrite(_out);")
+        lines.append("}")
+        lines.append("")
+
+        lines.append("void %s::WriteDelta(FileLike* _out, unsigned int _sinceGeneration) const" % (stateClass.cname))
+        lines.append("{")
+        lines.append("\tWriteCurrentState(_out);")
+        lines.append("\tManualWriteDelta(_out, _sinceGeneration);")
+        lines.append("}")
+        lines.append("")
+
+        lines.append("void %s::Read(FileLike* _in)" % (stateClass.cname))
+        lines.append("{")
+        lines.append("\tReadCurrentState(_in);")
+        lines.append("\tManualRead(_in);")
+        lines.append("}")
+        lines.append("")
+
+        lines.append("void %s::ReadDelta(FileLike* _in)" % (stateClass.cname))
+        lines.append("{")
+        lines.append("\tReadCurrentState(_in);")
+        lines.append("\tManualReadDelta(_in);")
+        lines.append("}")
+        lines.append("")
+
+        lines.append("void %s::WriteCurrentState(FileLike* _out) const" % (stateClass.cname))
+        lines.append("{")
         lines.append('\t_out->Write(Checkpoint("CurrentStateBegin"));')
         for member in stateClass.members:
             if member.isState:
@@ -806,12 +952,10 @@ def generateCpp(allMembers, allClasses, cmdLine):
                 lines.append("")
 
         lines.append('\t_out->Write(Checkpoint("CurrentStateEnd"));')
-        lines.append("")
-        lines.append("\tManualWrite(_out);")
         lines.append("}")
         lines.append("")
 
-        lines.append("void %s::Read(FileLike* _in)" % (stateClass.cname))
+        lines.append("void %s::ReadCurrentState(FileLike* _in)" % (stateClass.cname))
         lines.append("{")
         lines.append('\t_in->Read(Checkpoint("CurrentStateBegin"));')
         lines.append("\tbool needToReceiveState = 0;")
@@ -828,7 +972,18 @@ def generateCpp(allMembers, allClasses, cmdLine):
                 lines.append("\t}")
                 lines.append("")
         lines.append('\t_in->Read(Checkpoint("CurrentStateEnd"));')
-        lines.append("\tManualRead(_in);")
+        lines.append("}")
+        lines.append("")
+
+        # Goes through the setters, just like ReadCurrentState, so that pointer arguments get copies of their own.
+        lines.append("void %s::CopyCurrentState(const %s& _src)" % (stateClass.cname, stateClass.cname))
+        lines.append("{")
+        for member in stateClass.members:
+            if member.isState:
+                if member.needsManualState or member.alias is not None or not member.supported:
+                    continue
+                lines.append("\tif (_src.mHasSet_%s)" % (member.name))
+                lines.append("\t\t%s(%s);" % (member.name, ", ".join(["_src.mData_%s.%s" % (member.name, arg.name) for arg in member.args])))
         lines.append("}")
         lines.append("")
 
@@ -168,45 +168,42 @@ class Hooks:
     ''' Container class for all functions we want to hook for OGL support. '''
 
     class GlobalState(GLObject):
-        ''' Global state, consists of one or more Contexts. Currently only one context is supported. '''
+        ''' Global state, consists of one or more Contexts. Each GL context gets its own ContextState (see ContextRegistry). '''
 
         class ContextState(GLObject):
             ''' These are members that affect the global state vector (which is actually tied to each context). '''
 
             Data = (
                 ### Objects for manual data holding.
-                # Which thread owns this context (ie, most recently called MakeCurrent while owner was null)
-                { "name": "OwnerThread",            "ctype": "DWORD" },
+                # The context this is the state of, and the DC it was last made current with.
+                { "name": "Context",                "ctype": "HGLRC" },
+                { "name": "DeviceContext",          "ctype": "HDC" },
+
+                # Textures, buffers, shaders, programs, renderbuffers and samplers. These are shared with every context
+                # that shares lists with this one. Note that unless sampler objects are used, a texture object also 
+                # contains its sampler state.
+                { "name": "SharedObjects",          "ctype": "GLSharedObjects*" },
 
                 # The texture units. Each texture unit can have one texture of each type bound to it.
                 { "name": "TextureUnits",           "ctype": "std::map<std::pair<GLuint, GLenum>, GLuint>" },
-                # The texture objects themselves. Note that unless sampler objects are used, the texture object also contains
-                # its sampler state.
-                { "name": "TextureObjects",         "ctype": "std::map<GLuint, GLTexture*>" },
                 # State set by calling glPixelStoreState{f|i}.
                 { "name": "PixelStoreState",        "ctype": "GLPixelStoreState" },
                 # Pixel Transfer state, which is a multi-state.
                 { "name": "PixelTransferState",     "ctype": "GLPixelTransferState" },
                 # Buffer objects.
                 { "name": "BufferBindings",         "ctype": "std::map<GLenum, GLuint>" },
-                { "name": "BufferObjects",          "ctype": "std::map<GLuint, GLBuffer*>" },
-                # Program objects.
-                { "name": "ProgramObjectsGLSL",     "ctype": "std::map<GLuint, GLProgram*>" },
-                { "name": "ShaderObjectsGLSL",      "ctype": "std::map<GLuint, GLShader*>" },
 
                 # ARB Program objects. Currently minimal support for these.
                 { "name": "ProgramBindingsARB",     "ctype": "std::map<GLenum, GLuint>" },
-                { "name": "ProgramObjectsARB",      "ctype": "std::map<GLuint, GLProgramARB*>" },
 
                 # Enable/Disable
                 { "name": "EnableCap",              "ctype": "std::map<GLenum, GLboolean>" },
                 { "name": "TextureEnableCap",       "ctype": "std::map<std::pair<GLenum, GLenum>, GLboolean>" },
 
-                # FrameBufferObjects/RenderBufferObjects
+                # FrameBufferObjects/RenderBufferObjects. Framebuffer objects aren't shared between contexts.
                 { "name": "FrameBufferBindings",    "ctype": "std::map<GLenum, GLuint>" },
                 { "name": "FrameBufferObjects",     "ctype": "std::map<GLuint, GLFrameBufferObject*>" },
                 { "name": "RenderBufferBindings",   "ctype": "std::map<GLenum, GLuint>" },
-                { "name": "RenderBufferObjects",    "ctype": "std::map<GLuint, GLRenderBufferObject*>" },
 
                 # Clip plane Equations
                 { "name": "ClipPlaneEquations",     "ctype": "std::map<GLenum, GLClipPlane>" },
@@ -217,11 +214,14 @@ class Hooks:
 
                 # Sampler Objects
                 { "name": "SamplerBindings",         "ctype": "std::map<GLuint, GLuint>" },
-                { "name": "SamplerObjects",          "ctype": "std::map<GLuint, GLSampler*>" },
 
                 # Generic vertex attribute enable/disable
                 { "name": "VertexAttribEnabled",    "ctype": "std::map<GLuint, bool>" },
 
+                # GL errors the application hadn't picked up yet when QueryDriverState ran. Only ever looked at by 
+                # glGetError on the thread the context is current on, so never copied or sent.
+                { "name": "PendingErrors",          "ctype": "std::vector<GLenum>" },
+
                 # Queries.
                 # { "name": "QueryObjects",      "ctype": "std::map<GLuint, GLQuery*>" }, TODO
             )
@@ -681,6 +681,7 @@ class Hooks:
         def glGetClipPlane(GLenum_plane, GLdouble_ptr_equation): pass
         def glGetDoublev(GLenum_pname, GLdouble_ptr_params): pass
     
+        @manual_detour
         @returns('GLenum')
         def glGetError(): pass
 
@@ -714,10 +715,27 @@ class Hooks:
         def glRenderMode(GLenum_mode): pass
 
         @manual_detour
+        @manual_replay
         @static_hook
         @returns('BOOL')
         def wglMakeCurrent(HDC_hdc, HGLRC_hglrc): pass
 
+        # These are only hooked to keep track of which contexts share objects, they're never recorded.
+        @manual_detour
+        @static_hook
+        @returns('BOOL')
+        def wglShareLists(HGLRC_hglrc1, HGLRC_hglrc2): pass
+
+        @manual_detour
+        @static_hook
+        @returns('BOOL')
+        def wglDeleteContext(HGLRC_hglrc): pass
+
+        @manual_detour
+        @manual_replay
+        @returns('HGLRC')
+        def wglCreateContextAttribsARB(HDC_hDC, HGLRC_hShareContext, const_int_ptr_attribList): pass
+
         def glDrawRangeElements(GLenum_mode,GLuint_start,GLuint_end,GLsizei_count,GLenum_type,const_GLvoid_ptr_indices): pass
         def glDrawRangeElementsBaseVertex(GLenum_mode,GLuint_start,GLuint_end,GLsizei_count,GLenum_type,const_GLvoid_ptr_indices,GLint_basevertex): pass
         def glGetCompressedTexImage(GLenum_a,GLint_b,GLvoid_ptr_c): pass
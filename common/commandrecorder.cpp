@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "commandrecorder.h"
+
+#include "functionhooks.gen.h"
+
+// How much each thread's queue grows by. A packet bigger than this gets a block of its own.
+const size_t kCommandBlockSize = 256 * 1024;
+
+CommandRecorder* gCommandRecorder = NULL;
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// Packets queued by one thread, in the order it recorded them. The recording thread appends to the 
+// last block and whoever holds the stream reads from the first; neither ever waits on the other.
+struct CommandBlock
+{
+	// Set by the recording thread once it's done with this block.
+	CommandBlock* volatile mNext;
+	// How much of mBytes the recording thread has finished writing.
+	volatile size_t mCommittedBytes;
+	size_t mCapacity;
+	unsigned char mBytes[1];
+};
+
+// Each packet in a block is one of these, followed by the packet itself, padded to a multiple of 8.
+struct CommandRecordHeader
+{
+	LONG64 mSequence;
+	// The context it was recorded on.
+	HGLRC mContext;
+	HDC mDeviceContext;
+	size_t mLength;
+};
+
+struct ThreadCommandQueue
+{
+	ThreadCommandQueue* mNextQueue;
+
+	// The recording thread's.
+	CommandBlock* mWriteBlock;
+	std::vector<unsigned char> mScratch;
+
+	// The stream holder's.
+	CommandBlock* mReadBlock;
+	size_t mReadOffset;
+};
+
+// ------------------------------------------------------------------------------------------------
+static size_t CommandRecordSize(size_t _len)
+{
+	return (sizeof(CommandRecordHeader) + _len + 7) & ~(size_t)7;
+}
+
+// ------------------------------------------------------------------------------------------------
+static CommandBlock* NewCommandBlock(size_t _capacity)
+{
+	CommandBlock* block = (CommandBlock*)malloc(offsetof(CommandBlock, mBytes) + _capacity);
+	if (!block) {
+		LogError(TC("Out of memory queueing a %u byte packet."), (unsigned int)_capacity);
+		throw 1;
+	}
+
+	block->mNext = NULL;
+	block->mCommittedBytes = 0;
+	block->mCapacity = _capacity;
+	return block;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+CommandRecorder::CommandRecorder()
+: mNextSequence(0)
+, mNextSendSequence(0)
+, mStreamContext(NULL)
+, mMergeRequested(0)
+, mQueues(NULL)
+, mQueueTlsIndex(TlsAlloc())
+{
+	InitializeCriticalSection(&mStreamLock);
+	if (mQueueTlsIndex == TLS_OUT_OF_INDEXES) {
+		LogError(TC("Couldn't allocate a TLS slot for recording commands."));
+		throw 1;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+CommandRecorder::~CommandRecorder()
+{
+	LockStream();
+	UnlockStream();
+
+	while (mQueues) {
+		ThreadCommandQueue* queue = mQueues;
+		mQueues = queue->mNextQueue;
+
+		CommandBlock* block = queue->mReadBlock;
+		while (block) {
+			CommandBlock* next = block->mNext;
+			free(block);
+			block = next;
+		}
+		delete queue;
+	}
+
+	TlsFree(mQueueTlsIndex);
+	DeleteCriticalSection(&mStreamLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::Record(const ContextState* _context, const SSerializeDataPacket& _pkt)
+{
+	// If the stream's free and nothing is waiting to go out ahead of us, skip the queue.
+	if (TryEnterCriticalSection(&mStreamLock)) {
+		LONG64 sequence = mNextSendSequence;
+		if (InterlockedCompareExchange64(&mNextSequence, sequence + 1, sequence) == sequence) {
+			// The capture may have ended while we were getting here. Like anything else recorded after
+			// that, the packet is dropped, but its number is still used up.
+			if (gIsRecording) {
+				FileLike out(gMessageStream);
+				out.SetContextState(_context);
+				SwitchStreamContext(&out, _context->GetDeviceContext(), _context->GetContext());
+				_pkt.Write(&out);
+			}
+			++mNextSendSequence;
+			UnlockStream();
+			return;
+		}
+		UnlockStream();
+	}
+
+	// Pointer arguments are sized from the state of the context they were recorded on.
+	ThreadCommandQueue* queue = GetThreadQueue();
+	queue->mScratch.clear();
+	{
+		FileLike scratch(&queue->mScratch);
+		scratch.SetContextState(_context);
+		_pkt.Write(&scratch);
+	}
+
+	size_t len = queue->mScratch.size();
+	size_t recordSize = CommandRecordSize(len);
+
+	// Make room before taking a sequence number, the stream can't go on without the packet after that.
+	CommandBlock* block = queue->mWriteBlock;
+	size_t offset = block->mCommittedBytes;
+	if (offset + recordSize > block->mCapacity) {
+		CommandBlock* newBlock = NewCommandBlock(max(kCommandBlockSize, recordSize));
+		InterlockedExchangePointer((PVOID volatile*)&block->mNext, newBlock);
+		queue->mWriteBlock = newBlock;
+		block = newBlock;
+		offset = 0;
+	}
+
+	CommandRecordHeader* header = (CommandRecordHeader*)(block->mBytes + offset);
+	header->mSequence = InterlockedIncrement64(&mNextSequence) - 1;
+	header->mContext = _context->GetContext();
+	header->mDeviceContext = _context->GetDeviceContext();
+	header->mLength = len;
+	memcpy(header + 1, &queue->mScratch[0], len);
+	MemoryBarrier();
+	block->mCommittedBytes = offset + recordSize;
+
+	InterlockedExchange(&mMergeRequested, 1);
+	TryMerge();
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::LockStream()
+{
+	EnterCriticalSection(&mStreamLock);
+
+	// Anything with a lower number than this was recorded before we got here, so has to go first. 
+	// If some of it is still being written into its queue, wait for it.
+	LONG64 recorded = InterlockedCompareExchange64(&mNextSequence, 0, 0);
+	for (;;) {
+		Merge();
+		if (mNextSendSequence >= recorded) {
+			break;
+		}
+		SwitchToThread();
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::UnlockStream()
+{
+	LeaveCriticalSection(&mStreamLock);
+
+	// Somebody may have queued a packet while we had the stream and left it for us.
+	if (mMergeRequested) {
+		TryMerge();
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::MakeStreamCurrent(FileLike* _out, const ContextState* _context)
+{
+	if (_context) {
+		SwitchStreamContext(_out, _context->GetDeviceContext(), _context->GetContext());
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::ResetStreamContext(const ContextState* _context)
+{
+	mStreamContext = _context ? _context->GetContext() : NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+ThreadCommandQueue* CommandRecorder::GetThreadQueue()
+{
+	ThreadCommandQueue* queue = (ThreadCommandQueue*)TlsGetValue(mQueueTlsIndex);
+	if (queue) {
+		return queue;
+	}
+
+	// Starting both ends on an empty block means neither ever has to look for a missing one.
+	queue = new ThreadCommandQueue;
+	queue->mWriteBlock = NewCommandBlock(0);
+	queue->mReadBlock = queue->mWriteBlock;
+	queue->mReadOffset = 0;
+	TlsSetValue(mQueueTlsIndex, queue);
+
+	ThreadCommandQueue* head;
+	do {
+		head = mQueues;
+		queue->mNextQueue = head;
+	} while (InterlockedCompareExchangePointer((PVOID volatile*)&mQueues, queue, head) != head);
+
+	return queue;
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::Merge()
+{
+	FileLike* out = NULL;
+
+	InterlockedExchange(&mMergeRequested, 0);
+	for (;;) {
+		// The next packet in sequence is at the front of one of the queues, or not written yet.
+		ThreadCommandQueue* queue = mQueues;
+		CommandRecordHeader* record = NULL;
+		for (; queue; queue = queue->mNextQueue) {
+			record = PeekQueue(queue);
+			if (record && record->mSequence == mNextSendSequence) {
+				break;
+			}
+		}
+
+		if (!queue) {
+			break;
+		}
+
+		// Packets recorded after the capture ended are dropped.
+		if (gIsRecording) {
+			if (!out) {
+				out = new FileLike(gMessageStream);
+			}
+
+			SwitchStreamContext(out, record->mDeviceContext, record->mContext);
+
+			// They were written with no stream to number them.
+			unsigned char* bytes = (unsigned char*)(record + 1);
+			size_t packetId = out->AllocatePacketId();
+			memcpy(bytes + kPacketIdOffset, &packetId, sizeof(packetId));
+			out->WriteRaw(bytes, record->mLength);
+		}
+
+		PopQueue(queue, record);
+		++mNextSendSequence;
+	}
+
+	SafeDelete(out);
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::TryMerge()
+{
+	// Whoever has the stream will check for this on the way out.
+	while (TryEnterCriticalSection(&mStreamLock)) {
+		Merge();
+		LeaveCriticalSection(&mStreamLock);
+
+		if (!mMergeRequested) {
+			break;
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::SwitchStreamContext(FileLike* _out, HDC _hdc, HGLRC _hglrc)
+{
+	if (_hglrc != mStreamContext) {
+		SSerializeDataPacket::wglMakeCurrent(_hdc, _hglrc).Write(_out);
+		mStreamContext = _hglrc;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+CommandRecordHeader* CommandRecorder::PeekQueue(ThreadCommandQueue* _queue)
+{
+	CommandBlock* block = _queue->mReadBlock;
+	for (;;) {
+		// A block is finished once it has a next, so look at that before at how much there is.
+		CommandBlock* next = block->mNext;
+		MemoryBarrier();
+		if (_queue->mReadOffset < block->mCommittedBytes) {
+			return (CommandRecordHeader*)(block->mBytes + _queue->mReadOffset);
+		}
+
+		if (!next) {
+			return NULL;
+		}
+
+		free(block);
+		block = next;
+		_queue->mReadBlock = block;
+		_queue->mReadOffset = 0;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void CommandRecorder::PopQueue(ThreadCommandQueue* _queue, const CommandRecordHeader* _record)
+{
+	_queue->mReadOffset += CommandRecordSize(_record->mLength);
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+class ContextState;
+class FileLike;
+struct SSerializeDataPacket;
+
+struct CommandRecordHeader;
+struct ThreadCommandQueue;
+
+// ------------------------------------------------------------------------------------------------
+// Collects the packets the hooks record, from however many threads, into the stream in the order 
+// they were recorded. When nobody else has anything waiting, a packet goes straight to the stream. 
+// Otherwise it's serialized into a queue belonging to the recording thread, stamped with a number
+// from one global sequence, and whoever gets to merge next sends the queues' packets in sequence 
+// order. Recording threads never wait for each other or for the stream: they only ever try to 
+// take it. 
+//
+// Anything else written to the stream while packets may be being recorded (frame boundaries, the
+// end of a capture) has to hold it with LockStream, which first sends everything recorded so far.
+//
+// Packets can be recorded on different contexts. Whenever the context changes from one packet to 
+// the next, the stream gets a wglMakeCurrent in between.
+class CommandRecorder
+{
+public:
+	CommandRecorder();
+	// Sends whatever is still queued.
+	~CommandRecorder();
+
+	// Sends _pkt, recorded on _context, to gMessageStream after every packet recorded before it. 
+	// Anything recorded while gIsRecording is off by the time it's sent is dropped.
+	void Record(const ContextState* _context, const SSerializeDataPacket& _pkt);
+
+	// Waits for anybody sending, then sends every packet recorded up to now. Until UnlockStream, the 
+	// caller has gMessageStream to itself--and may change it.
+	void LockStream();
+	void UnlockStream();
+
+	// With the stream held. Whatever's written to _out next is played on _context, so if the stream 
+	// isn't on it, this writes a wglMakeCurrent.
+	void MakeStreamCurrent(FileLike* _out, const ContextState* _context);
+	// With the stream held. The stream starts over (at a capture, or a keyframe) from the state of 
+	// _context, so that's the context it's on.
+	void ResetStreamContext(const ContextState* _context);
+
+private:
+	// gMessageStream belongs to whoever holds this.
+	CRITICAL_SECTION mStreamLock;
+
+	// The sequence number the next recorded packet gets, and the one the stream is waiting for. Any in
+	// between are queued, or about to be.
+	volatile LONG64 mNextSequence;
+	LONG64 mNextSendSequence;
+
+	// The context the packets in the stream are being played on. Stream held.
+	HGLRC mStreamContext;
+
+	// Set when a packet is queued, cleared by whoever is about to look at the queues. Someone who 
+	// queues a packet while the stream is taken leaves this for the holder to find on the way out.
+	volatile LONG mMergeRequested;
+
+	// Every thread that's ever had to queue a packet. Only ever pushed onto.
+	ThreadCommandQueue* volatile mQueues;
+	DWORD mQueueTlsIndex;
+
+	ThreadCommandQueue* GetThreadQueue();
+
+	// Sends queued packets for as long as the next one in sequence is there. Stream held.
+	void Merge();
+	void TryMerge();
+
+	void SwitchStreamContext(FileLike* _out, HDC _hdc, HGLRC _hglrc);
+
+	// The packet at the front of _queue, or NULL if there's nothing there yet.
+	static CommandRecordHeader* PeekQueue(ThreadCommandQueue* _queue);
+	static void PopQueue(ThreadCommandQueue* _queue, const CommandRecordHeader* _record);
+};
+
+// ------------------------------------------------------------------------------------------------
+// Holds the stream for as long as it's in scope.
+class CommandStreamLock
+{
+public:
+	CommandStreamLock(CommandRecorder* _recorder) : mRecorder(_recorder) { mRecorder->LockStream(); }
+	~CommandStreamLock() { mRecorder->UnlockStream(); }
+
+private:
+	CommandRecorder* mRecorder;
+};
+
+extern CommandRecorder* gCommandRecorder;
@@ -153,5 +153,11 @@ inline void CHECK_GL_ERROR()
 	assert(err == 0);
 }
 
+#include "common/mappedfile.h"
+#include "common/sharedpayload.h"
+#include "common/tracecontainer.h"
+#include "common/blockcodec.h"
+#include "common/hash128.h"
+#include "common/blobstore.h"
 #include "common/filelike.h"
 #include "common/tracelog.h"
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "contextregistry.h"
+
+#include <algorithm>
+
+#include "functionhooks.gen.h"
+
+ContextRegistry* gContextRegistry = NULL;
+
+// ------------------------------------------------------------------------------------------------
+ContextRegistry::ContextRegistry()
+: mCurrentTlsIndex(TlsAlloc())
+{
+	InitializeCriticalSection(&mLock);
+	if (mCurrentTlsIndex == TLS_OUT_OF_INDEXES) {
+		LogError(TC("Couldn't allocate a TLS slot for tracking the current context."));
+		throw 1;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+ContextRegistry::~ContextRegistry()
+{
+	gContextState = NULL;
+	for (auto it = mContexts.begin(); it != mContexts.end(); ++it) {
+		SafeDelete(it->second);
+	}
+	mContexts.clear();
+
+	for (auto it = mRetired.begin(); it != mRetired.end(); ++it) {
+		SafeDelete(*it);
+	}
+	mRetired.clear();
+	for (auto it = mRetiredLastFrame.begin(); it != mRetiredLastFrame.end(); ++it) {
+		SafeDelete(*it);
+	}
+	mRetiredLastFrame.clear();
+
+	TlsFree(mCurrentTlsIndex);
+	DeleteCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextRegistry::OnMakeCurrent(HDC _hdc, HGLRC _hglrc)
+{
+	ContextState* contextState = NULL;
+	if (_hglrc) {
+		EnterCriticalSection(&mLock);
+		contextState = FindOrCreate(_hglrc);
+		contextState->SetContext(_hdc, _hglrc);
+		if (!gContextState) {
+			gContextState = contextState;
+		}
+		LeaveCriticalSection(&mLock);
+	}
+
+	TlsSetValue(mCurrentTlsIndex, contextState);
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextRegistry::OnShareLists(HGLRC _hglrcSrc, HGLRC _hglrcDst)
+{
+	EnterCriticalSection(&mLock);
+	FindOrCreate(_hglrcDst)->ShareObjectsWith(FindOrCreate(_hglrcSrc));
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextRegistry::OnDeleteContext(HGLRC _hglrc)
+{
+	EnterCriticalSection(&mLock);
+	auto it = mContexts.find(_hglrc);
+	if (it != mContexts.end()) {
+		ContextState* contextState = it->second;
+		mContexts.erase(it);
+
+		// A context current on this thread stops being current when it's deleted. (Deleting one that's 
+		// current on another thread fails.)
+		if (GetCurrent() == contextState) {
+			TlsSetValue(mCurrentTlsIndex, NULL);
+		}
+
+		// If it's gContextState, it stays that until the next SwapBuffers (or the end of the capture).
+		mRetired.push_back(contextState);
+	}
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+ContextState* ContextRegistry::RequeryCurrent()
+{
+	ContextState* stale = GetCurrent();
+	if (!stale) {
+		return NULL;
+	}
+
+	// Other contexts sharing objects with this one keep on sharing them. QueryDriverState starts the 
+	// objects over in place.
+	ContextState* fresh = new ContextState;
+	fresh->SetContext(stale->GetDeviceContext(), stale->GetContext());
+	fresh->ShareObjectsWith(stale);
+
+	EnterCriticalSection(&mLock);
+	mContexts[stale->GetContext()] = fresh;
+	if (gContextState == stale) {
+		gContextState = fresh;
+	}
+	mRetired.push_back(stale);
+	LeaveCriticalSection(&mLock);
+
+	TlsSetValue(mCurrentTlsIndex, fresh);
+
+	fresh->QueryDriverState();
+	return fresh;
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextRegistry::OnSwapBuffers(bool _keepCaptured)
+{
+	EnterCriticalSection(&mLock);
+	if (!_keepCaptured) {
+		ContextState* current = GetCurrent();
+		if (current) {
+			gContextState = current;
+		} else if (IsRetired(gContextState)) {
+			// Until somebody swaps again, there's nothing to capture.
+			gContextState = NULL;
+		}
+	}
+
+	// Whatever was retired before the last SwapBuffers has had a whole frame for the hooks on other 
+	// threads to finish with it.
+	std::vector<ContextState*> stillRetired = mRetired;
+	for (auto it = mRetiredLastFrame.begin(); it != mRetiredLastFrame.end(); ++it) {
+		if (*it == gContextState) {
+			stillRetired.push_back(*it);
+		} else {
+			delete *it;
+		}
+	}
+	mRetiredLastFrame.swap(stillRetired);
+	mRetired.clear();
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool ContextRegistry::IsRetired(const ContextState* _contextState) const
+{
+	return std::find(mRetired.cbegin(), mRetired.cend(), _contextState) != mRetired.cend()
+	    || std::find(mRetiredLastFrame.cbegin(), mRetiredLastFrame.cend(), _contextState) != mRetiredLastFrame.cend();
+}
+
+// ------------------------------------------------------------------------------------------------
+ContextState* ContextRegistry::FindOrCreate(HGLRC _hglrc)
+{
+	ContextState*& contextState = mContexts[_hglrc];
+	if (!contextState) {
+		contextState = new ContextState;
+		contextState->SetContext(NULL, _hglrc);
+	}
+
+	return contextState;
+}
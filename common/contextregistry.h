@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+class ContextState;
+
+// ------------------------------------------------------------------------------------------------
+// Keeps a ContextState for every GL context the application uses, by handle, and knows which of them 
+// is current on each thread. Contexts that share lists share the objects in their states too (see 
+// GLSharedObjects).
+//
+// gContextState is the context being captured: whichever one was current when SwapBuffers was last 
+// called, or the first one made current before that. It doesn't change while a capture is underway.
+// The hooks on other threads look at it without taking our lock, so the states of deleted contexts 
+// are retired rather than deleted, and only go once nothing can still be looking at them.
+class ContextRegistry
+{
+public:
+	ContextRegistry();
+	// Deletes every context's state, retired or not.
+	~ContextRegistry();
+
+	// The state of the context current on this thread, or NULL if there isn't one.
+	ContextState* GetCurrent() const { return (ContextState*)TlsGetValue(mCurrentTlsIndex); }
+
+	// Called by the wgl hooks once the real call has succeeded. MakeCurrent is called either way, a 
+	// failed one leaves nothing current. A context created with a share context shares lists with it
+	// just the same as if wglShareLists had been called.
+	void OnMakeCurrent(HDC _hdc, HGLRC _hglrc);
+	void OnShareLists(HGLRC _hglrcSrc, HGLRC _hglrcDst);
+	void OnDeleteContext(HGLRC _hglrc);
+
+	// For when the hooks haven't been keeping track: replaces the state of the context current on this 
+	// thread with what the driver says it is (see ContextState::QueryDriverState), and returns it.
+	ContextState* RequeryCurrent();
+
+	// Called by SwapBuffers, with the command stream locked. Unless _keepCaptured, points gContextState
+	// at the context current on this thread. Then deletes the states retired before the last call, 
+	// other than gContextState's.
+	void OnSwapBuffers(bool _keepCaptured);
+
+private:
+	// With mLock held.
+	ContextState* FindOrCreate(HGLRC _hglrc);
+	bool IsRetired(const ContextState* _contextState) const;
+
+	CRITICAL_SECTION mLock;
+	std::map<HGLRC, ContextState*> mContexts;
+	DWORD mCurrentTlsIndex;
+
+	// Retired since the last SwapBuffers, and before it.
+	std::vector<ContextState*> mRetired;
+	std::vector<ContextState*> mRetiredLastFrame;
+};
+
+extern ContextRegistry* gContextRegistry;
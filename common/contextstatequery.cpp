@@ -0,0 +1,802 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "functionhooks.gen.h"
+
+// Names are handed out from 1 up, and reused after they're deleted, so they're mostly dense. Once we 
+// haven't seen one for this long (and are past every bound one) we assume there aren't any more.
+const GLuint kMaxNameGap = 256;
+
+// GL keeps at most one of each kind of error, so there are never more than a handful pending.
+const size_t kMaxPendingErrors = 16;
+
+// The most mip levels a texture can have (a 2^31 texel wide one).
+const GLint kMaxTextureLevels = 32;
+
+// Targets we'll find textures on, and how to ask what's bound to each.
+static const GLenum kTextureTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_1D, GL_TEXTURE_3D };
+static const GLenum kTextureBindings[] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_CUBE_MAP, GL_TEXTURE_BINDING_1D, GL_TEXTURE_BINDING_3D };
+
+static const GLenum kBufferTargets[] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER };
+static const GLenum kBufferBindings[] = { GL_ARRAY_BUFFER_BINDING, GL_ELEMENT_ARRAY_BUFFER_BINDING, GL_PIXEL_PACK_BUFFER_BINDING, GL_PIXEL_UNPACK_BUFFER_BINDING };
+
+static const GLenum kEnableCaps[] = { 
+	GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_DITHER, GL_MULTISAMPLE, GL_POLYGON_OFFSET_FILL, 
+	GL_SAMPLE_ALPHA_TO_COVERAGE, GL_SCISSOR_TEST, GL_STENCIL_TEST
+};
+
+static const GLenum kPixelStoreParameters[] = { 
+	GL_PACK_SWAP_BYTES, GL_PACK_LSB_FIRST, GL_PACK_ROW_LENGTH, GL_PACK_IMAGE_HEIGHT, GL_PACK_SKIP_PIXELS, 
+	GL_PACK_SKIP_ROWS, GL_PACK_SKIP_IMAGES, GL_PACK_ALIGNMENT, 
+	GL_UNPACK_SWAP_BYTES, GL_UNPACK_LSB_FIRST, GL_UNPACK_ROW_LENGTH, GL_UNPACK_IMAGE_HEIGHT, GL_UNPACK_SKIP_PIXELS, 
+	GL_UNPACK_SKIP_ROWS, GL_UNPACK_SKIP_IMAGES, GL_UNPACK_ALIGNMENT
+};
+
+// ------------------------------------------------------------------------------------------------
+// Entry points for asking the driver about things the application may never have called--so they 
+// aren't among the hooks.
+struct DriverQueries
+{
+	PFNGLACTIVETEXTUREPROC ActiveTexture;
+	PFNGLBINDBUFFERPROC BindBuffer;
+	PFNGLISBUFFERPROC IsBuffer;
+	PFNGLGETBUFFERPARAMETERIVPROC GetBufferParameteriv;
+	PFNGLGETBUFFERSUBDATAPROC GetBufferSubData;
+	PFNGLGETCOMPRESSEDTEXIMAGEPROC GetCompressedTexImage;
+	PFNGLISSHADERPROC IsShader;
+	PFNGLGETSHADERIVPROC GetShaderiv;
+	PFNGLGETSHADERSOURCEPROC GetShaderSource;
+	PFNGLISPROGRAMPROC IsProgram;
+	PFNGLGETPROGRAMIVPROC GetProgramiv;
+	PFNGLGETATTACHEDSHADERSPROC GetAttachedShaders;
+	PFNGLGETACTIVEATTRIBPROC GetActiveAttrib;
+	PFNGLGETATTRIBLOCATIONPROC GetAttribLocation;
+	PFNGLGETACTIVEUNIFORMPROC GetActiveUniform;
+	PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+	PFNGLGETUNIFORMFVPROC GetUniformfv;
+	PFNGLGETUNIFORMIVPROC GetUniformiv;
+	PFNGLGETVERTEXATTRIBIVPROC GetVertexAttribiv;
+	PFNGLISRENDERBUFFERPROC IsRenderbuffer;
+	PFNGLBINDRENDERBUFFERPROC BindRenderbuffer;
+	PFNGLGETRENDERBUFFERPARAMETERIVPROC GetRenderbufferParameteriv;
+	PFNGLISFRAMEBUFFERPROC IsFramebuffer;
+	PFNGLBINDFRAMEBUFFERPROC BindFramebuffer;
+	PFNGLGETFRAMEBUFFERATTACHMENTPARAMETERIVPROC GetFramebufferAttachmentParameteriv;
+};
+
+// ------------------------------------------------------------------------------------------------
+static bool ResolveDriverQueries(DriverQueries* _driver)
+{
+	bool allResolved = true;
+
+	#define RESOLVE_DRIVER_QUERY(_spec, _member, _name) \
+		_driver->_member = (_spec) wglGetProcAddress(_name); \
+		if (_driver->_member == NULL) { \
+			TraceError(TC("Unable to find %s to read the context state back from the driver."), TC(_name)); \
+		} \
+		allResolved = allResolved && _driver->_member != NULL;
+
+	RESOLVE_DRIVER_QUERY(PFNGLACTIVETEXTUREPROC, ActiveTexture, "glActiveTexture");
+	RESOLVE_DRIVER_QUERY(PFNGLBINDBUFFERPROC, BindBuffer, "glBindBuffer");
+	RESOLVE_DRIVER_QUERY(PFNGLISBUFFERPROC, IsBuffer, "glIsBuffer");
+	RESOLVE_DRIVER_QUERY(PFNGLGETBUFFERPARAMETERIVPROC, GetBufferParameteriv, "glGetBufferParameteriv");
+	RESOLVE_DRIVER_QUERY(PFNGLGETBUFFERSUBDATAPROC, GetBufferSubData, "glGetBufferSubData");
+	RESOLVE_DRIVER_QUERY(PFNGLGETCOMPRESSEDTEXIMAGEPROC, GetCompressedTexImage, "glGetCompressedTexImage");
+	RESOLVE_DRIVER_QUERY(PFNGLISSHADERPROC, IsShader, "glIsShader");
+	RESOLVE_DRIVER_QUERY(PFNGLGETSHADERIVPROC, GetShaderiv, "glGetShaderiv");
+	RESOLVE_DRIVER_QUERY(PFNGLGETSHADERSOURCEPROC, GetShaderSource, "glGetShaderSource");
+	RESOLVE_DRIVER_QUERY(PFNGLISPROGRAMPROC, IsProgram, "glIsProgram");
+	RESOLVE_DRIVER_QUERY(PFNGLGETPROGRAMIVPROC, GetProgramiv, "glGetProgramiv");
+	RESOLVE_DRIVER_QUERY(PFNGLGETATTACHEDSHADERSPROC, GetAttachedShaders, "glGetAttachedShaders");
+	RESOLVE_DRIVER_QUERY(PFNGLGETACTIVEATTRIBPROC, GetActiveAttrib, "glGetActiveAttrib");
+	RESOLVE_DRIVER_QUERY(PFNGLGETATTRIBLOCATIONPROC, GetAttribLocation, "glGetAttribLocation");
+	RESOLVE_DRIVER_QUERY(PFNGLGETACTIVEUNIFORMPROC, GetActiveUniform, "glGetActiveUniform");
+	RESOLVE_DRIVER_QUERY(PFNGLGETUNIFORMLOCATIONPROC, GetUniformLocation, "glGetUniformLocation");
+	RESOLVE_DRIVER_QUERY(PFNGLGETUNIFORMFVPROC, GetUniformfv, "glGetUniformfv");
+	RESOLVE_DRIVER_QUERY(PFNGLGETUNIFORMIVPROC, GetUniformiv, "glGetUniformiv");
+	RESOLVE_DRIVER_QUERY(PFNGLGETVERTEXATTRIBIVPROC, GetVertexAttribiv, "glGetVertexAttribiv");
+	RESOLVE_DRIVER_QUERY(PFNGLISRENDERBUFFERPROC, IsRenderbuffer, "glIsRenderbuffer");
+	RESOLVE_DRIVER_QUERY(PFNGLBINDRENDERBUFFERPROC, BindRenderbuffer, "glBindRenderbuffer");
+	RESOLVE_DRIVER_QUERY(PFNGLGETRENDERBUFFERPARAMETERIVPROC, GetRenderbufferParameteriv, "glGetRenderbufferParameteriv");
+	RESOLVE_DRIVER_QUERY(PFNGLISFRAMEBUFFERPROC, IsFramebuffer, "glIsFramebuffer");
+	RESOLVE_DRIVER_QUERY(PFNGLBINDFRAMEBUFFERPROC, BindFramebuffer, "glBindFramebuffer");
+	RESOLVE_DRIVER_QUERY(PFNGLGETFRAMEBUFFERATTACHMENTPARAMETERIVPROC, GetFramebufferAttachmentParameteriv, "glGetFramebufferAttachmentParameteriv");
+
+	#undef RESOLVE_DRIVER_QUERY
+
+	return allResolved;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bound names are in use whatever the gap before them, so the search always goes at least as far as
+// _highestBound. Any unbound objects past a gap like that are missed, which we warn about.
+static std::vector<GLuint> FindNames(GLboolean (APIENTRY *_isName)(GLuint), GLuint _highestBound, const TCHAR* _kind)
+{
+	std::vector<GLuint> retVal;
+	GLuint sinceLastName = 0;
+	for (GLuint name = 1; sinceLastName < kMaxNameGap || name <= _highestBound; ++name) {
+		if (!_isName(name)) {
+			++sinceLastName;
+			continue;
+		}
+
+		if (sinceLastName >= kMaxNameGap) {
+			TraceWarn(TC("Only found %s %u because it's bound, it's more than %u names past the one before it. Unbound %s objects that far apart won't be in the capture."), _kind, name, kMaxNameGap, _kind);
+		}
+		retVal.push_back(name);
+		sinceLastName = 0;
+	}
+
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+static GLuint FindHighestBoundTexture(const DriverQueries& _driver)
+{
+	GLint activeTexture = GL_TEXTURE0,
+	      textureUnits = 0;
+	gReal_glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+	gReal_glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &textureUnits);
+
+	GLuint retVal = 0;
+	for (GLint unit = 0; unit < textureUnits; ++unit) {
+		_driver.ActiveTexture(GL_TEXTURE0 + unit);
+		for (size_t i = 0; i < ARRAYSIZE(kTextureTargets); ++i) {
+			GLint texture = 0;
+			gReal_glGetIntegerv(kTextureBindings[i], &texture);
+			retVal = max(retVal, GLuint(texture));
+		}
+	}
+	_driver.ActiveTexture(activeTexture);
+
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Picks a format and type to read a level back with that ContextState knows how to size, and that 
+// loses as little as possible. Returns false if there isn't one.
+static bool ChooseTexImageReadFormat(GLenum _target, GLint _level, GLenum* _outFormat, GLenum* _outType)
+{
+	GLint depthSize = 0;
+	GLint redType = GL_NONE;
+	glGetTexLevelParameteriv(_target, _level, GL_TEXTURE_DEPTH_SIZE, &depthSize);
+	glGetTexLevelParameteriv(_target, _level, GL_TEXTURE_RED_TYPE, &redType);
+
+	if (depthSize > 0) {
+		(*_outFormat) = GL_DEPTH_COMPONENT;
+		(*_outType) = GL_FLOAT;
+		return true;
+	}
+
+	switch (redType) {
+	case GL_INT:
+	case GL_UNSIGNED_INT:
+		// Integer textures can only be read as integers, which ContextState can't size.
+		return false;
+	case GL_FLOAT:
+	case GL_SIGNED_NORMALIZED:
+		(*_outFormat) = GL_RGBA;
+		(*_outType) = GL_FLOAT;
+		return true;
+	default:
+		(*_outFormat) = GL_RGBA;
+		(*_outType) = GL_UNSIGNED_BYTE;
+		return true;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryTextureLevels(ContextState* _state, const DriverQueries& _driver, GLenum _target)
+{
+	for (GLint level = 0; level < kMaxTextureLevels; ++level) {
+		GLint width = 0, 
+		      height = 0;
+		glGetTexLevelParameteriv(_target, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(_target, level, GL_TEXTURE_HEIGHT, &height);
+		if (width == 0 || height == 0) {
+			break;
+		}
+
+		GLint internalFormat = 0,
+		      compressed = GL_FALSE;
+		glGetTexLevelParameteriv(_target, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		glGetTexLevelParameteriv(_target, level, GL_TEXTURE_COMPRESSED, &compressed);
+
+		if (compressed) {
+			GLint imageSize = 0;
+			glGetTexLevelParameteriv(_target, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &imageSize);
+			std::vector<GLubyte> pixels(max(imageSize, 1));
+			_driver.GetCompressedTexImage(_target, level, &pixels[0]);
+			_state->glCompressedTexImage2D(_target, level, internalFormat, width, height, 0, imageSize, imageSize > 0 ? &pixels[0] : NULL);
+			continue;
+		}
+
+		GLenum format = GL_RGBA,
+		       type = GL_UNSIGNED_BYTE;
+		if (!ChooseTexImageReadFormat(_target, level, &format, &type)) {
+			Once(TraceWarn(TC("Can't read back integer textures, they'll be in the capture without their contents.")));
+			_state->glTexImage2D(_target, level, internalFormat, width, height, 0, format, type, NULL);
+			continue;
+		}
+
+		// The pack state was set to match ContextState's unpack state, so the sizes agree.
+		size_t length = determinePointerLength_glTexImage2D_pixels(_state, _target, level, internalFormat, width, height, 0, format, type, NULL);
+		std::vector<GLubyte> pixels(max(length, size_t(1)));
+		glGetTexImage(_target, level, format, type, &pixels[0]);
+		_state->glTexImage2D(_target, level, internalFormat, width, height, 0, format, type, length > 0 ? &pixels[0] : NULL);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryTextureParameters(ContextState* _state, GLenum _target)
+{
+	static const GLenum kIntParameters[] = { 
+		GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_WRAP_R, 
+		GL_TEXTURE_BASE_LEVEL, GL_TEXTURE_MAX_LEVEL 
+	};
+	static const GLenum kFloatParameters[] = { GL_TEXTURE_MIN_LOD, GL_TEXTURE_MAX_LOD };
+
+	for (size_t i = 0; i < ARRAYSIZE(kIntParameters); ++i) {
+		GLint param = 0;
+		glGetTexParameteriv(_target, kIntParameters[i], &param);
+		_state->glTexParameteri(_target, kIntParameters[i], param);
+	}
+
+	for (size_t i = 0; i < ARRAYSIZE(kFloatParameters); ++i) {
+		GLfloat param = 0;
+		glGetTexParameterfv(_target, kFloatParameters[i], &param);
+		_state->glTexParameterf(_target, kFloatParameters[i], param);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryTextures(ContextState* _state, const DriverQueries& _driver)
+{
+	GLint prevBindings[ARRAYSIZE(kTextureTargets)] = { 0 };
+	for (size_t i = 0; i < ARRAYSIZE(kTextureTargets); ++i) {
+		gReal_glGetIntegerv(kTextureBindings[i], &prevBindings[i]);
+	}
+
+	std::vector<GLuint> textures = FindNames(glIsTexture, FindHighestBoundTexture(_driver), TC("texture"));
+	for (auto it = textures.cbegin(); it != textures.cend(); ++it) {
+		// A texture can only be bound to the target it was created with, which is the only way to find out what that is.
+		for (size_t i = 0; i < ARRAYSIZE(kTextureTargets); ++i) {
+			GLint bound = 0;
+			glBindTexture(kTextureTargets[i], *it);
+			gReal_glGetIntegerv(kTextureBindings[i], &bound);
+			if (GLuint(bound) != *it) {
+				continue;
+			}
+
+			_state->glBindTexture(kTextureTargets[i], *it);
+			QueryTextureParameters(_state, kTextureTargets[i]);
+			if (kTextureTargets[i] == GL_TEXTURE_2D) {
+				QueryTextureLevels(_state, _driver, GL_TEXTURE_2D);
+			} else if (kTextureTargets[i] == GL_TEXTURE_CUBE_MAP) {
+				for (GLenum face = GL_TEXTURE_CUBE_MAP_POSITIVE_X; face <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z; ++face) {
+					QueryTextureLevels(_state, _driver, face);
+				}
+			} else {
+				Once(TraceWarn(TC("Only 2D and cube map textures are read back from the driver, the rest will be in the capture without their contents.")));
+			}
+			break;
+		}
+	}
+
+	// Binding to the wrong targets above leaves errors behind, QueryDriverState clears them.
+	for (size_t i = 0; i < ARRAYSIZE(kTextureTargets); ++i) {
+		glBindTexture(kTextureTargets[i], prevBindings[i]);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryBuffers(ContextState* _state, const DriverQueries& _driver)
+{
+	GLint prevBinding = 0;
+	gReal_glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevBinding);
+
+	GLuint highestBound = 0;
+	for (size_t i = 0; i < ARRAYSIZE(kBufferBindings); ++i) {
+		GLint buffer = 0;
+		gReal_glGetIntegerv(kBufferBindings[i], &buffer);
+		highestBound = max(highestBound, GLuint(buffer));
+	}
+
+	std::vector<GLuint> buffers = FindNames(_driver.IsBuffer, highestBound, TC("buffer"));
+	for (auto it = buffers.cbegin(); it != buffers.cend(); ++it) {
+		GLint size = 0,
+		      usage = GL_STATIC_DRAW,
+		      mapped = GL_FALSE;
+		_driver.BindBuffer(GL_ARRAY_BUFFER, *it);
+		_driver.GetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		_driver.GetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_USAGE, &usage);
+		_driver.GetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_MAPPED, &mapped);
+
+		std::vector<GLubyte> contents;
+		if (mapped) {
+			TraceWarn(TC("Buffer %d was mapped when the capture started, it will be in the capture without its contents."), *it);
+		} else if (size > 0) {
+			contents.resize(size);
+			_driver.GetBufferSubData(GL_ARRAY_BUFFER, 0, size, &contents[0]);
+		}
+
+		_state->glBindBuffer(GL_ARRAY_BUFFER, *it);
+		_state->glBufferData(GL_ARRAY_BUFFER, size, contents.empty() ? NULL : &contents[0], usage);
+	}
+
+	_driver.BindBuffer(GL_ARRAY_BUFFER, prevBinding);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Reads back the values of a linked program's uniforms, and where they are. Leaves the program in use
+// in _state; QueryBindings puts back the one that's really in use.
+static void QueryUniforms(ContextState* _state, const DriverQueries& _driver, GLuint _program)
+{
+	_state->glUseProgram(_program);
+
+	GLint uniformCount = 0,
+	      uniformMaxLength = 0;
+	_driver.GetProgramiv(_program, GL_ACTIVE_UNIFORMS, &uniformCount);
+	_driver.GetProgramiv(_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformMaxLength);
+	std::vector<GLchar> uniformName(max(uniformMaxLength, 1));
+	for (GLint i = 0; i < uniformCount; ++i) {
+		GLint uniformSize = 0;
+		GLenum uniformType = GL_NONE;
+		_driver.GetActiveUniform(_program, i, uniformMaxLength, NULL, &uniformSize, &uniformType, &uniformName[0]);
+
+		// Arrays are reported as their first element, foo[0]. The application may be asking for foo.
+		std::string baseName = &uniformName[0];
+		bool isArray = baseName.size() > 3 && baseName.compare(baseName.size() - 3, 3, "[0]") == 0;
+		if (isArray) {
+			baseName.resize(baseName.size() - 3);
+			_state->glGetUniformLocation(_driver.GetUniformLocation(_program, baseName.c_str()), _program, baseName.c_str());
+		}
+
+		// Only the kinds of uniform ContextState keeps track of.
+		int dimensions = 0;
+		bool isFloat = false;
+		switch (uniformType) {
+		case GL_FLOAT:
+			dimensions = 1;
+			isFloat = true;
+			break;
+		case GL_FLOAT_VEC4:
+			dimensions = 4;
+			isFloat = true;
+			break;
+		case GL_INT:
+		case GL_BOOL:
+		case GL_SAMPLER_1D:
+		case GL_SAMPLER_2D:
+		case GL_SAMPLER_3D:
+		case GL_SAMPLER_CUBE:
+		case GL_SAMPLER_1D_SHADOW:
+		case GL_SAMPLER_2D_SHADOW:
+			dimensions = 1;
+			break;
+		default:
+			Once(TraceWarn(TC("Only float, vec4, int, bool and sampler uniforms are read back from the driver, the rest will start the capture at their defaults.")));
+			break;
+		}
+
+		// Array elements needn't be next to each other, so each is looked up by name.
+		for (GLint element = 0; element < uniformSize; ++element) {
+			std::string elementName = &uniformName[0];
+			if (isArray) {
+				char index[16] = { 0 };
+				sprintf_s(index, "[%d]", element);
+				elementName = baseName + index;
+			}
+
+			GLint location = _driver.GetUniformLocation(_program, elementName.c_str());
+			_state->glGetUniformLocation(location, _program, elementName.c_str());
+			if (location < 0 || dimensions == 0) {
+				continue;
+			}
+
+			if (isFloat) {
+				GLfloat value[4] = { 0 };
+				_driver.GetUniformfv(_program, location, value);
+				if (dimensions == 4) {
+					_state->glUniform4fv(location, 1, value);
+				} else {
+					_state->glUniform1f(location, value[0]);
+				}
+			} else {
+				GLint value = 0;
+				_driver.GetUniformiv(_program, location, &value);
+				_state->glUniform1i(location, value);
+			}
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryShadersAndPrograms(ContextState* _state, const DriverQueries& _driver)
+{
+	// The programs are found first, so that the shaders attached to them count as bound.
+	GLint currentProgram = 0;
+	gReal_glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
+	std::vector<GLuint> programs = FindNames(_driver.IsProgram, currentProgram, TC("program"));
+
+	GLuint highestAttached = 0;
+	for (auto it = programs.cbegin(); it != programs.cend(); ++it) {
+		GLint attachedCount = 0;
+		_driver.GetProgramiv(*it, GL_ATTACHED_SHADERS, &attachedCount);
+		if (attachedCount > 0) {
+			std::vector<GLuint> attached(attachedCount);
+			_driver.GetAttachedShaders(*it, attachedCount, NULL, &attached[0]);
+			for (auto shadIt = attached.cbegin(); shadIt != attached.cend(); ++shadIt) {
+				highestAttached = max(highestAttached, *shadIt);
+			}
+		}
+	}
+
+	std::vector<GLuint> shaders = FindNames(_driver.IsShader, highestAttached, TC("shader"));
+	for (auto it = shaders.cbegin(); it != shaders.cend(); ++it) {
+		GLint type = 0,
+		      sourceLength = 0,
+		      compiled = GL_FALSE;
+		_driver.GetShaderiv(*it, GL_SHADER_TYPE, &type);
+		_driver.GetShaderiv(*it, GL_SHADER_SOURCE_LENGTH, &sourceLength);
+		_driver.GetShaderiv(*it, GL_COMPILE_STATUS, &compiled);
+
+		_state->glCreateShaderObjectARB(*it, type);
+		if (sourceLength > 0) {
+			std::vector<GLchar> source(sourceLength);
+			_driver.GetShaderSource(*it, sourceLength, NULL, &source[0]);
+			const GLchar* sourcePtr = &source[0];
+			_state->glShaderSource(*it, 1, &sourcePtr, NULL);
+		}
+
+		if (compiled) {
+			_state->glCompileShader(*it);
+		}
+	}
+
+	for (auto it = programs.cbegin(); it != programs.cend(); ++it) {
+		_state->glCreateProgramObjectARB(*it);
+
+		GLint attachedCount = 0;
+		_driver.GetProgramiv(*it, GL_ATTACHED_SHADERS, &attachedCount);
+		if (attachedCount > 0) {
+			std::vector<GLuint> attached(attachedCount);
+			_driver.GetAttachedShaders(*it, attachedCount, NULL, &attached[0]);
+			for (auto shadIt = attached.cbegin(); shadIt != attached.cend(); ++shadIt) {
+				_state->glAttachShader(*it, *shadIt);
+			}
+		}
+
+		GLint linked = GL_FALSE;
+		_driver.GetProgramiv(*it, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			continue;
+		}
+
+		// Wherever the attributes ended up, the replay has to put them there too.
+		GLint attribCount = 0,
+		      attribMaxLength = 0;
+		_driver.GetProgramiv(*it, GL_ACTIVE_ATTRIBUTES, &attribCount);
+		_driver.GetProgramiv(*it, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &attribMaxLength);
+		std::vector<GLchar> attribName(max(attribMaxLength, 1));
+		for (GLint i = 0; i < attribCount; ++i) {
+			GLint attribSize = 0;
+			GLenum attribType = GL_NONE;
+			_driver.GetActiveAttrib(*it, i, attribMaxLength, NULL, &attribSize, &attribType, &attribName[0]);
+			GLint location = _driver.GetAttribLocation(*it, &attribName[0]);
+			if (location >= 0) {
+				_state->glBindAttribLocation(*it, location, &attribName[0]);
+			}
+		}
+
+		_state->glLinkProgram(*it);
+		QueryUniforms(_state, _driver, *it);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryRenderbuffers(ContextState* _state, const DriverQueries& _driver)
+{
+	GLint prevBinding = 0;
+	gReal_glGetIntegerv(GL_RENDERBUFFER_BINDING, &prevBinding);
+
+	// Only their storage--what's in them isn't part of the state, tracked or not.
+	std::vector<GLuint> renderbuffers = FindNames(_driver.IsRenderbuffer, prevBinding, TC("renderbuffer"));
+	for (auto it = renderbuffers.cbegin(); it != renderbuffers.cend(); ++it) {
+		GLint width = 0,
+		      height = 0,
+		      internalFormat = GL_RGBA,
+		      samples = 0;
+		_driver.BindRenderbuffer(GL_RENDERBUFFER, *it);
+		_driver.GetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
+		_driver.GetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+		_driver.GetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_INTERNAL_FORMAT, &internalFormat);
+		_driver.GetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_SAMPLES, &samples);
+
+		GLuint renderbuffer = *it;
+		_state->glGenRenderbuffers(1, &renderbuffer);
+		_state->glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+		_state->glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalFormat, width, height);
+	}
+
+	_driver.BindRenderbuffer(GL_RENDERBUFFER, prevBinding);
+	_state->glBindRenderbuffer(GL_RENDERBUFFER, prevBinding);
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryFramebuffers(ContextState* _state, const DriverQueries& _driver)
+{
+	GLint prevDrawBinding = 0,
+	      prevReadBinding = 0,
+	      colorAttachments = 0;
+	gReal_glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevDrawBinding);
+	gReal_glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prevReadBinding);
+	gReal_glGetIntegerv(GL_MAX_COLOR_ATTACHMENTS, &colorAttachments);
+
+	std::vector<GLenum> attachments;
+	for (GLint i = 0; i < colorAttachments; ++i) {
+		attachments.push_back(GL_COLOR_ATTACHMENT0 + i);
+	}
+	attachments.push_back(GL_DEPTH_ATTACHMENT);
+	attachments.push_back(GL_STENCIL_ATTACHMENT);
+
+	std::vector<GLuint> framebuffers = FindNames(_driver.IsFramebuffer, max(prevDrawBinding, prevReadBinding), TC("framebuffer"));
+	for (auto it = framebuffers.cbegin(); it != framebuffers.cend(); ++it) {
+		GLuint framebuffer = *it;
+		_driver.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		_state->glGenFramebuffers(1, &framebuffer);
+		_state->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+		for (auto attIt = attachments.cbegin(); attIt != attachments.cend(); ++attIt) {
+			GLint type = GL_NONE,
+			      object = 0;
+			_driver.GetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, *attIt, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+			if (type == GL_NONE) {
+				continue;
+			}
+
+			_driver.GetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, *attIt, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &object);
+			if (type == GL_RENDERBUFFER) {
+				_state->glFramebufferRenderbuffer(GL_FRAMEBUFFER, *attIt, GL_RENDERBUFFER, object);
+			} else if (type == GL_TEXTURE) {
+				// Like the textures themselves, only 2D and cube map faces are read back.
+				GLint level = 0,
+				      cubeMapFace = 0;
+				_driver.GetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, *attIt, GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_LEVEL, &level);
+				_driver.GetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, *attIt, GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_CUBE_MAP_FACE, &cubeMapFace);
+				_state->glFramebufferTexture2D(GL_FRAMEBUFFER, *attIt, cubeMapFace != 0 ? cubeMapFace : GL_TEXTURE_2D, object, level);
+			}
+		}
+
+		GLint drawBuffer = GL_COLOR_ATTACHMENT0,
+		      readBuffer = GL_COLOR_ATTACHMENT0;
+		gReal_glGetIntegerv(GL_DRAW_BUFFER, &drawBuffer);
+		gReal_glGetIntegerv(GL_READ_BUFFER, &readBuffer);
+		_state->glDrawBuffer(drawBuffer);
+		_state->glReadBuffer(readBuffer);
+	}
+
+	_driver.BindFramebuffer(GL_DRAW_FRAMEBUFFER, prevDrawBinding);
+	_driver.BindFramebuffer(GL_READ_FRAMEBUFFER, prevReadBinding);
+	_state->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prevDrawBinding);
+	_state->glBindFramebuffer(GL_READ_FRAMEBUFFER, prevReadBinding);
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryBindings(ContextState* _state, const DriverQueries& _driver)
+{
+	GLint activeTexture = GL_TEXTURE0,
+	      textureUnits = 0;
+	gReal_glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+	gReal_glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &textureUnits);
+	for (GLint unit = 0; unit < textureUnits; ++unit) {
+		_driver.ActiveTexture(GL_TEXTURE0 + unit);
+		_state->glActiveTexture(GL_TEXTURE0 + unit);
+		for (size_t i = 0; i < ARRAYSIZE(kTextureTargets); ++i) {
+			GLint texture = 0;
+			gReal_glGetIntegerv(kTextureBindings[i], &texture);
+			_state->glBindTexture(kTextureTargets[i], texture);
+		}
+	}
+	_driver.ActiveTexture(activeTexture);
+	_state->glActiveTexture(activeTexture);
+
+	for (size_t i = 0; i < ARRAYSIZE(kBufferTargets); ++i) {
+		GLint buffer = 0;
+		gReal_glGetIntegerv(kBufferBindings[i], &buffer);
+		_state->glBindBuffer(kBufferTargets[i], buffer);
+	}
+
+	GLint program = 0;
+	gReal_glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	_state->glUseProgram(program);
+
+	// Without a framebuffer object bound, these are about the window.
+	GLint framebuffer = 0;
+	gReal_glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	if (framebuffer == 0) {
+		GLint drawBuffer = GL_BACK,
+		      readBuffer = GL_BACK;
+		gReal_glGetIntegerv(GL_DRAW_BUFFER, &drawBuffer);
+		gReal_glGetIntegerv(GL_READ_BUFFER, &readBuffer);
+		_state->glDrawBuffer(drawBuffer);
+		_state->glReadBuffer(readBuffer);
+	}
+
+	GLint vertexAttribs = 0;
+	gReal_glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &vertexAttribs);
+	for (GLint i = 0; i < vertexAttribs; ++i) {
+		GLint enabled = GL_FALSE;
+		_driver.GetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+		if (enabled) {
+			_state->glEnableVertexAttribArray(i);
+		} else {
+			_state->glDisableVertexAttribArray(i);
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+static void QueryFixedState(ContextState* _state)
+{
+	for (size_t i = 0; i < ARRAYSIZE(kEnableCaps); ++i) {
+		if (glIsEnabled(kEnableCaps[i])) {
+			_state->glEnable(kEnableCaps[i]);
+		} else {
+			_state->glDisable(kEnableCaps[i]);
+		}
+	}
+
+	GLint box[4] = { 0 };
+	gReal_glGetIntegerv(GL_VIEWPORT, box);
+	_state->glViewport(box[0], box[1], box[2], box[3]);
+	gReal_glGetIntegerv(GL_SCISSOR_BOX, box);
+	_state->glScissor(box[0], box[1], box[2], box[3]);
+
+	GLint blendSrc = GL_ONE,
+	      blendDst = GL_ZERO,
+	      blendEquation = GL_FUNC_ADD;
+	GLfloat blendColor[4] = { 0 };
+	gReal_glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrc);
+	gReal_glGetIntegerv(GL_BLEND_DST_RGB, &blendDst);
+	gReal_glGetIntegerv(GL_BLEND_EQUATION_RGB, &blendEquation);
+	gReal_glGetFloatv(GL_BLEND_COLOR, blendColor);
+	_state->glBlendFunc(blendSrc, blendDst);
+	_state->glBlendEquation(blendEquation);
+	_state->glBlendColor(blendColor[0], blendColor[1], blendColor[2], blendColor[3]);
+
+	GLint depthFunc = GL_LESS;
+	GLboolean depthMask = GL_TRUE;
+	GLdouble depthRange[2] = { 0, 1 };
+	gReal_glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	glGetDoublev(GL_DEPTH_RANGE, depthRange);
+	_state->glDepthFunc(depthFunc);
+	_state->glDepthMask(depthMask);
+	_state->glDepthRange(depthRange[0], depthRange[1]);
+
+	GLboolean colorMask[4] = { GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE };
+	glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+	_state->glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+
+	GLint stencilFunc = GL_ALWAYS,
+	      stencilRef = 0,
+	      stencilValueMask = ~0,
+	      stencilWriteMask = ~0,
+	      stencilFail = GL_KEEP,
+	      stencilDepthFail = GL_KEEP,
+	      stencilDepthPass = GL_KEEP;
+	gReal_glGetIntegerv(GL_STENCIL_FUNC, &stencilFunc);
+	gReal_glGetIntegerv(GL_STENCIL_REF, &stencilRef);
+	gReal_glGetIntegerv(GL_STENCIL_VALUE_MASK, &stencilValueMask);
+	gReal_glGetIntegerv(GL_STENCIL_WRITEMASK, &stencilWriteMask);
+	gReal_glGetIntegerv(GL_STENCIL_FAIL, &stencilFail);
+	gReal_glGetIntegerv(GL_STENCIL_PASS_DEPTH_FAIL, &stencilDepthFail);
+	gReal_glGetIntegerv(GL_STENCIL_PASS_DEPTH_PASS, &stencilDepthPass);
+	_state->glStencilFunc(stencilFunc, stencilRef, stencilValueMask);
+	_state->glStencilMask(stencilWriteMask);
+	_state->glStencilOp(stencilFail, stencilDepthFail, stencilDepthPass);
+
+	GLfloat clearColor[4] = { 0 };
+	GLdouble clearDepth = 1;
+	GLint clearStencil = 0;
+	gReal_glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glGetDoublev(GL_DEPTH_CLEAR_VALUE, &clearDepth);
+	gReal_glGetIntegerv(GL_STENCIL_CLEAR_VALUE, &clearStencil);
+	_state->glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+	_state->glClearDepth(clearDepth);
+	_state->glClearStencil(clearStencil);
+
+	GLfloat polygonOffset[2] = { 0 };
+	GLint frontFace = GL_CCW;
+	gReal_glGetFloatv(GL_POLYGON_OFFSET_FACTOR, &polygonOffset[0]);
+	gReal_glGetFloatv(GL_POLYGON_OFFSET_UNITS, &polygonOffset[1]);
+	gReal_glGetIntegerv(GL_FRONT_FACE, &frontFace);
+	_state->glPolygonOffset(polygonOffset[0], polygonOffset[1]);
+	_state->glFrontFace(frontFace);
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+void ContextState::QueryDriverState()
+{
+	// Whatever we had of the objects is out of date for every context sharing them, not just ours.
+	SharedObjectsLock lock(mData_SharedObjects);
+	mData_SharedObjects->Clear();
+
+	DriverQueries driver = { 0 };
+	if (!ResolveDriverQueries(&driver)) {
+		TraceError(TC("The capture will start from an empty context state."));
+		return;
+	}
+
+	// The errors the application hasn't picked up yet are its own. They're kept aside for glGetError 
+	// to hand out, so that whatever the driver reports once we're done is ours to clear.
+	mData_PendingErrors.clear();
+	for (GLenum error = gReal_glGetError(); error != GL_NO_ERROR && mData_PendingErrors.size() < kMaxPendingErrors; error = gReal_glGetError()) {
+		mData_PendingErrors.push_back(error);
+	}
+
+	// Read everything back with the pack state matching our (default) unpack state, so the sizes 
+	// ContextState works out for what we hand it are the sizes the driver writes. And into memory, 
+	// not whatever pack buffer the application has bound.
+	// Ours is still all defaults, so the pack half is the same as the unpack half.
+	GLint pixelStore[ARRAYSIZE(kPixelStoreParameters)] = { 0 };
+	for (size_t i = 0; i < ARRAYSIZE(kPixelStoreParameters); ++i) {
+		gReal_glGetIntegerv(kPixelStoreParameters[i], &pixelStore[i]);
+		::glPixelStorei(kPixelStoreParameters[i], mData_PixelStoreState.glGet<GLint>(kPixelStoreParameters[i]));
+	}
+
+	GLint packBuffer = 0;
+	gReal_glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+	driver.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// Objects go on the active texture unit while we find them, QueryBindings puts the units right.
+	GLint activeTexture = GL_TEXTURE0;
+	gReal_glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+	this->glActiveTexture(activeTexture);
+
+	QueryBuffers(this, driver);
+	QueryTextures(this, driver);
+	QueryShadersAndPrograms(this, driver);
+	QueryRenderbuffers(this, driver);
+	QueryFramebuffers(this, driver);
+
+	driver.BindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+	for (size_t i = 0; i < ARRAYSIZE(kPixelStoreParameters); ++i) {
+		::glPixelStorei(kPixelStoreParameters[i], pixelStore[i]);
+		this->glPixelStorei(kPixelStoreParameters[i], pixelStore[i]);
+	}
+
+	QueryBindings(this, driver);
+	QueryFixedState(this);
+
+	for (size_t i = 0; i < kMaxPendingErrors && gReal_glGetError() != GL_NO_ERROR; ++i) ;
+}
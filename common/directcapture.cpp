@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "directcapture.h"
+
+#include "gltrace.h"
+
+const TCHAR* kDirectCaptureFileVariable = TC("GFXTRACE_CAPTURE_FILE");
+const TCHAR* kDirectCaptureFrameVariable = TC("GFXTRACE_CAPTURE_FRAME");
+const TCHAR* kDirectCaptureFrameCountVariable = TC("GFXTRACE_CAPTURE_FRAME_COUNT");
+
+// How often the writer thread checks whether it's been asked to stop while waiting for a capture.
+const DWORD kDirectCapturePollTimeMs = 250;
+
+// How long the end of the capture waits for the writer to finish writing it. The rest of the capture 
+// may still be on its way through the capture state writer, and the trace is compressed as it's 
+// written, so this is generous.
+const DWORD kDirectCaptureFinishTimeoutMs = 60000;
+
+DirectCapture* gDirectCapture = NULL;
+
+// ------------------------------------------------------------------------------------------------
+DWORD WINAPI DirectCapture_RunWriteThread(LPVOID _capturePtr)
+{
+	((DirectCapture*)_capturePtr)->Thread_Write();
+	return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+DirectCapture* DirectCapture::CreateFromEnvironment()
+{
+	TCHAR filename[_MAX_PATH] = { 0 };
+	DWORD len = GetEnvironmentVariable(kDirectCaptureFileVariable, filename, _MAX_PATH);
+	if (len == 0 || len >= _MAX_PATH) {
+		return NULL;
+	}
+
+	unsigned int captureFrame = 0;
+	TCHAR frameString[16] = { 0 };
+	len = GetEnvironmentVariable(kDirectCaptureFrameVariable, frameString, ARRAYSIZE(frameString));
+	if (len > 0 && len < ARRAYSIZE(frameString)) {
+		captureFrame = (unsigned int)_tcstoul(frameString, NULL, 10);
+	}
+
+	unsigned int captureFrameCount = 1;
+	len = GetEnvironmentVariable(kDirectCaptureFrameCountVariable, frameString, ARRAYSIZE(frameString));
+	if (len > 0 && len < ARRAYSIZE(frameString)) {
+		captureFrameCount = max(1u, (unsigned int)_tcstoul(frameString, NULL, 10));
+	}
+
+	ETraceCodec codec = ETC_LZ;
+	ParseTraceCodec(gOptions->TraceCodec, &codec);
+
+	LogInfo(TC("Capturing %u frame(s) from frame %u directly to %s."), captureFrameCount, captureFrame, filename);
+	return new DirectCapture(filename, captureFrame, captureFrameCount, codec);
+}
+
+// ------------------------------------------------------------------------------------------------
+DirectCapture::DirectCapture(const TCHAR* _filename, unsigned int _captureFrame, unsigned int _captureFrameCount, ETraceCodec _codec)
+: mStream(NULL)
+, mFilename(NULL)
+, mCodec(_codec)
+, mCaptureFrame(_captureFrame)
+, mCaptureFrameCount(_captureFrameCount)
+, mFrameNumber(0)
+, mThreadHandle(NULL)
+, mStopThread(false)
+, mCaptureDone(NULL)
+, mCaptureWritten(false)
+, mCaptureRequested(false)
+, mCaptureFinished(false)
+{
+	mFilename = AllocateAndCopy(_filename);
+	mStream = new MessageStream(true, "", "", EMT_Loopback);
+
+	mCaptureDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (mCaptureDone) {
+		mThreadHandle = CreateThread(NULL, 0, DirectCapture_RunWriteThread, this, 0, NULL);
+	}
+
+	if (!mThreadHandle) {
+		if (mCaptureDone) {
+			CloseHandle(mCaptureDone);
+			mCaptureDone = NULL;
+		}
+		SafeDelete(mStream);
+		SafeDeleteArray(mFilename);
+		throw 8;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+DirectCapture::~DirectCapture()
+{
+	if (!mCaptureRequested) {
+		LogInfo(TC("The application went away before frame %u, nothing was captured to %s."), mCaptureFrame, mFilename);
+	} else if (!mCaptureFinished) {
+		LogError(TC("The application went away in the middle of the direct capture, %s is incomplete."), mFilename);
+	}
+
+	// We're torn down from DLL_PROCESS_DETACH, so don't wait on the writer: when the process is exiting 
+	// it's already gone, and when we're being unloaded it can't exit while we hold the loader lock. Once
+	// it's written the capture it's done anyway.
+	mStopThread = true;
+	if (WaitForSingleObject(mThreadHandle, 0) == WAIT_OBJECT_0) {
+		CloseHandle(mThreadHandle);
+		mThreadHandle = NULL;
+		CloseHandle(mCaptureDone);
+		mCaptureDone = NULL;
+		SafeDelete(mStream);
+		SafeDeleteArray(mFilename);
+	}
+	// Otherwise leak everything rather than pull it out from under the thread.
+}
+
+// ------------------------------------------------------------------------------------------------
+bool DirectCapture::PollCommand(RemoteCommand* _outCommand)
+{
+	assert(_outCommand);
+	bool retVal = (mFrameNumber == mCaptureFrame);
+	if (retVal) {
+		_outCommand->mRemoteCommandType = ERC_Capture;
+		_outCommand->mFrameCount = mCaptureFrameCount;
+		// The writer doesn't keep a context state around between captures, so it needs all of it.
+		_outCommand->mBaseGeneration = 0;
+		mCaptureRequested = true;
+	}
+
+	++mFrameNumber;
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void DirectCapture::OnCaptureEnd()
+{
+	assert(mCaptureRequested);
+	if (mCaptureFinished) {
+		return;
+	}
+	mCaptureFinished = true;
+
+	if (WaitForSingleObject(mCaptureDone, kDirectCaptureFinishTimeoutMs) != WAIT_OBJECT_0) {
+		LogError(TC("Direct capture to %s didn't finish writing in time, the trace is probably incomplete."), mFilename);
+	} else if (mCaptureWritten) {
+		LogInfo(TC("Capture written to %s."), mFilename);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void DirectCapture::Thread_Write()
+{
+	try {
+		while (!mStopThread) {
+			if (!mStream->WaitForRecv(kDirectCapturePollTimeMs)) {
+				continue;
+			}
+
+			FileLike in(mStream);
+			in.Read(Checkpoint("TraceCapturingBegin"));
+
+			// There's only the one capture, and by the time this returns all of it has been read and the
+			// trace has been closed.
+			mCaptureWritten = GLTrace::StreamCapture(&in, mFilename, mCodec);
+			SetEvent(mCaptureDone);
+			return;
+		}
+		return;
+	} catch (...) {
+		LogError(TC("Direct capture to %s failed."), mFilename);
+	}
+
+	// Nothing more is going to make it into the trace.
+	SetEvent(mCaptureDone);
+
+	// Keep draining, so the application doesn't end up stuck on a full ring.
+	try {
+		while (!mStopThread) {
+			if (mStream->WaitForRecv(kDirectCapturePollTimeMs)) {
+				size_t bufferedLen = 0;
+				mStream->FillRecvBuffer(1, &bufferedLen);
+				mStream->ConsumeRecvBuffer(bufferedLen);
+			}
+		}
+	} catch (...) {
+		// The stream is going away.
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+class MessageStream;
+struct RemoteCommand;
+
+// ------------------------------------------------------------------------------------------------
+// Captures straight to a trace file from inside the application, for when there's nobody to run 
+// eztrace (e.g. on build agents). Turned on by setting GFXTRACE_CAPTURE_FILE to the trace to write in
+// the application's environment. GFXTRACE_CAPTURE_FRAME is how many frames to let go by before 
+// capturing (0 if it's not set), GFXTRACE_CAPTURE_FRAME_COUNT how many frames to capture (1 if not).
+// The hooks send the capture over a loopback MessageStream exactly as they would to eztrace, and a 
+// writer thread receives it on the other end and streams it to disk. The trace is done by the time 
+// OnCaptureEnd returns--the writer can't be relied on to finish once the process is exiting.
+class DirectCapture
+{
+public:
+	// Returns NULL unless the environment asks for a direct capture. 
+	static DirectCapture* CreateFromEnvironment();
+	~DirectCapture();
+
+	// What the hooks should send to. Owned by the DirectCapture.
+	MessageStream* GetMessageStream() const { return mStream; }
+
+	// Called once a frame in place of receiving a command from eztrace--asks for the capture when it's 
+	// time.
+	bool PollCommand(RemoteCommand* _outCommand);
+
+	// Called once the hooks have sent the end of the capture. Blocks until the writer has written all of
+	// it and closed the trace.
+	void OnCaptureEnd();
+
+private:
+	DirectCapture(const TCHAR* _filename, unsigned int _captureFrame, unsigned int _captureFrameCount, ETraceCodec _codec);
+
+	MessageStream* mStream;
+	TCHAR* mFilename;
+	ETraceCodec mCodec;
+	unsigned int mCaptureFrame;
+	unsigned int mCaptureFrameCount;
+	unsigned int mFrameNumber;
+
+	HANDLE mThreadHandle;
+	volatile bool mStopThread;
+
+	// Set by the writer once it's done with the capture, whether or not it managed to write it.
+	HANDLE mCaptureDone;
+	volatile bool mCaptureWritten;
+
+	bool mCaptureRequested;
+	bool mCaptureFinished;
+
+	void Thread_Write();
+
+	friend DWORD WINAPI DirectCapture_RunWriteThread(LPVOID _capturePtr);
+};
+
+extern DirectCapture* gDirectCapture;
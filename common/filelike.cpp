@@ -29,6 +29,9 @@
 #include "StdAfx.h"
 #include "filelike.h"
 
+#include "functionhooks.gen.h"
+#include "payloadarena.h"
+
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
@@ -72,8 +75,27 @@ FileLike::FileLike(FILE* fp)
 : mMode(FileLike::File)
 , mFile(fp)
 , mMessageStream(NULL)
+, mMappedFile(NULL)
+, mMemory(NULL)
+, mTraceIndex(NULL)
+, mEncoder(NULL)
+, mDecoder(NULL)
+, mBlobStore(NULL)
+, mPayloadArena(NULL)
+, mPayloadBytesRead(0)
+, mContextState(NULL)
+, mBuffer(NULL)
+, mBufferSize(0)
+, mBufferedWriteBytes(0)
+, mPayloadReferenceCount(0)
+, mReadCursor(NULL)
+, mReadEnd(NULL)
+, mRecvWindowStart(NULL)
+, mRecvWindowHandedOut(false)
 {
-
+	mBuffer = (unsigned char*)_aligned_malloc(kFileLikeBufferSize, kFileLikeBufferAlignment);
+	assert(mBuffer);
+	mBufferSize = kFileLikeBufferSize;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -81,8 +103,109 @@ FileLike::FileLike(MessageStream *_msgStream)
 : mMode(FileLike::Socket)
 , mFile(NULL)
 , mMessageStream(_msgStream)
+, mMappedFile(NULL)
+, mMemory(NULL)
+, mTraceIndex(NULL)
+, mEncoder(NULL)
+, mDecoder(NULL)
+, mBlobStore(NULL)
+, mPayloadArena(NULL)
+, mPayloadBytesRead(0)
+, mContextState(NULL)
+, mBuffer(NULL)
+, mBufferSize(0)
+, mBufferedWriteBytes(0)
+, mPayloadReferenceCount(0)
+, mReadCursor(NULL)
+, mReadEnd(NULL)
+, mRecvWindowStart(NULL)
+, mRecvWindowHandedOut(false)
+{
+	// Reads don't need a buffer of our own, they're parsed out of the stream's.
+	mBuffer = mSocketBuffer;
+	mBufferSize = kFileLikeSocketBufferSize;
+}
+
+// ------------------------------------------------------------------------------------------------
+FileLike::FileLike(const MappedFile* _mappedFile)
+: mMode(FileLike::Mapped)
+, mFile(NULL)
+, mMessageStream(NULL)
+, mMappedFile(_mappedFile)
+, mMemory(NULL)
+, mTraceIndex(NULL)
+, mEncoder(NULL)
+, mDecoder(NULL)
+, mBlobStore(NULL)
+, mPayloadArena(NULL)
+, mPayloadBytesRead(0)
+, mContextState(NULL)
+, mBuffer(NULL)
+, mBufferSize(0)
+, mBufferedWriteBytes(0)
+, mPayloadReferenceCount(0)
+, mReadCursor(NULL)
+, mReadEnd(NULL)
+, mRecvWindowStart(NULL)
+, mRecvWindowHandedOut(false)
+{
+	assert(mMappedFile);
+
+	// The mapping is already in memory, so it serves as the read-ahead.
+	mReadCursor = mMappedFile->GetBase();
+	mReadEnd = mReadCursor + mMappedFile->GetSize();
+}
+
+// ------------------------------------------------------------------------------------------------
+FileLike::FileLike(std::vector<unsigned char>* _memory)
+: mMode(FileLike::Memory)
+, mFile(NULL)
+, mMessageStream(NULL)
+, mMappedFile(NULL)
+, mMemory(_memory)
+, mTraceIndex(NULL)
+, mEncoder(NULL)
+, mDecoder(NULL)
+, mBlobStore(NULL)
+, mPayloadArena(NULL)
+, mPayloadBytesRead(0)
+, mContextState(NULL)
+, mBuffer(NULL)
+, mBufferSize(0)
+, mBufferedWriteBytes(0)
+, mPayloadReferenceCount(0)
+, mReadCursor(NULL)
+, mReadEnd(NULL)
+, mRecvWindowStart(NULL)
+, mRecvWindowHandedOut(false)
+{
+	assert(mMemory);
+
+	// Only small fields are staged, anything bigger is appended straight away.
+	mBuffer = mSocketBuffer;
+	mBufferSize = kFileLikeSocketBufferSize;
+}
+
+// ------------------------------------------------------------------------------------------------
+FileLike::~FileLike()
 {
+	// If we're being unwound by an exception, whatever is buffered belongs to a write that failed.
+	if (!std::uncaught_exception()) {
+		Flush();
+	}
+
+	if (mMode == FileLike::Socket) {
+		ReleaseRecvWindow();
+	}
+
+	// If we still have an encoder, a write failed partway--the chunk table was never written anyway.
+	SafeDelete(mEncoder);
+	SafeDelete(mDecoder);
 
+	if (mMode == FileLike::File) {
+		_aligned_free(mBuffer);
+	}
+	mBuffer = NULL;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -90,6 +213,8 @@ size_t FileLike::AllocatePacketId()
 {
 	switch (mMode) {
 	case FileLike::File:	return 0;
+	case FileLike::Mapped:	return 0;
+	case FileLike::Memory:	return 0;
 	case FileLike::Socket:	return mMessageStream->AllocatePacketId();
 	default: assert(!"Invalid mode in FileLike::AllocatePacketId"); break;
 	}
@@ -97,59 +222,149 @@ size_t FileLike::AllocatePacketId()
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(bool* _val)
+void FileLike::Flush()
 {
-	size_t ReadThis = 0;
-	Read(&ReadThis);
-	(*_val) = (ReadThis != 0);
-}
+	if (mPayloadReferenceCount > 0) {
+		FlushGather();
+		return;
+	}
 
-// ------------------------------------------------------------------------------------------------
-void FileLike::Read(char* _val)
-{
-	ReadRaw(_val, sizeof(*_val));
+	if (mBufferedWriteBytes == 0) {
+		return;
+	}
+
+	// Reset first, so that a failed write doesn't get retried by the destructor.
+	size_t bufferedWriteBytes = mBufferedWriteBytes;
+	mBufferedWriteBytes = 0;
+	WriteUnbuffered(mBuffer, bufferedWriteBytes);
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(unsigned char* _val)
+TraceFileOffset FileLike::Tell() const
 {
-	ReadRaw(_val, sizeof(*_val));
+	if (mEncoder) {
+		return mEncoder->Tell() + mBufferedWriteBytes;
+	} else if (mDecoder) {
+		return mDecoder->Tell();
+	}
+
+	if (mMode == FileLike::Mapped) {
+		return mReadCursor - mMappedFile->GetBase();
+	} else if (mMode == FileLike::Memory) {
+		return mMemory->size() + mBufferedWriteBytes;
+	}
+
+	assert(mMode == FileLike::File);
+	__int64 pos = _ftelli64(mFile);
+	if (pos < 0) {
+		throw 10;
+	}
+	return (TraceFileOffset)pos + mBufferedWriteBytes - (mReadEnd - mReadCursor);
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(short* _val)
+void FileLike::Seek(TraceFileOffset _offset)
 {
-	ReadRaw(_val, sizeof(*_val));
+	// Compressed chunks can't be rewritten in place.
+	assert(mEncoder == NULL);
+	if (mDecoder) {
+		mDecoder->Seek(_offset);
+		return;
+	}
+
+	if (mMode == FileLike::Mapped) {
+		if (_offset > mMappedFile->GetSize()) {
+			throw 10;
+		}
+		mReadCursor = mMappedFile->GetBase() + (size_t)_offset;
+		return;
+	}
+
+	assert(mMode == FileLike::File);
+	Flush();
+	DiscardReadAhead();
+	if (_fseeki64(mFile, (__int64)_offset, SEEK_SET) != 0) {
+		throw 10;
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(unsigned short* _val)
+void FileLike::MarkSection(ETraceSection _section)
 {
-	ReadRaw(_val, sizeof(*_val));
+	if (mTraceIndex) {
+		mTraceIndex->SetSectionOffset(_section, Tell());
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(int* _val)
+const ContextState* FileLike::GetContextState() const
 {
-	ReadRaw(_val, sizeof(*_val));
+	return mContextState ? mContextState : gContextState;
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(unsigned int* _val)
+void FileLike::BeginEncoding(ETraceCodec _codec)
 {
-	ReadRaw(_val, sizeof(*_val));
+	assert(mEncoder == NULL && mDecoder == NULL);
+	if (_codec == ETC_None) {
+		return;
+	}
+
+	// Compressing a socket stream would need framing on the other end, which we don't have.
+	assert(mMode == FileLike::File);
+	Flush();
+	mEncoder = new BlockEncoder(mFile, _codec, Tell());
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(float* _val)
+TraceFileOffset FileLike::EndEncoding()
 {
-	ReadRaw(_val, sizeof(*_val));
+	if (!mEncoder) {
+		return kInvalidTraceFileOffset;
+	}
+
+	Flush();
+
+	std::vector<CodecChunkInfo> chunks;
+	mEncoder->Finish(&chunks);
+	SafeDelete(mEncoder);
+
+	// Back to writing the file directly.
+	TraceFileOffset chunkTableOffset = Tell();
+	Write(Checkpoint("CodecChunksBegin"));
+	Write(chunks);
+	Write(Checkpoint("CodecChunksEnd"));
+
+	return chunkTableOffset;
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Read(double* _val)
+void FileLike::BeginDecoding(ETraceCodec _codec, TraceFileOffset _chunkTableOffset)
 {
-	ReadRaw(_val, sizeof(*_val));
+	assert(mEncoder == NULL && mDecoder == NULL);
+	if (_codec == ETC_None) {
+		return;
+	}
+
+	if (_codec >= ETC_Count || _chunkTableOffset == kInvalidTraceFileOffset) {
+		throw 10;
+	}
+
+	assert(mMode == FileLike::File || mMode == FileLike::Mapped);
+	TraceFileOffset logicalStart = Tell();
+
+	std::vector<CodecChunkInfo> chunks;
+	Seek(_chunkTableOffset);
+	Read(Checkpoint("CodecChunksBegin"));
+	Read(&chunks);
+	Read(Checkpoint("CodecChunksEnd"));
+
+	// From here on everything comes out of the decoder, which does its own reading ahead.
+	DiscardReadAhead();
+	mDecoder = new BlockDecoder(mFile, mMappedFile, _codec, chunks);
+	if (!chunks.empty()) {
+		mDecoder->Seek(logicalStart);
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -160,7 +375,12 @@ size_t FileLike::Read(void* _bytes, size_t _len)
 	
 	if (bytesInStream > 0) {
 		assert(_len >= bytesInStream);
-		ReadRaw(_bytes, min(_len, bytesInStream));
+		void* blobBytes = NULL;
+		if (ReadBlobReference(bytesInStream, &blobBytes)) {
+			memcpy(_bytes, blobBytes, min(_len, bytesInStream));
+		} else {
+			ReadRaw(_bytes, min(_len, bytesInStream));
+		}
 	}
 
 	return min(_len, bytesInStream);
@@ -171,31 +391,142 @@ void FileLike::Read(void** _bytes, size_t* _outLen)
 {
 	Read(_outLen);
 	if ((*_outLen) > 0) {
-		(*_bytes) = malloc(*_outLen);
-		assert(*_bytes);
+		(*_bytes) = ReadPayload(*_outLen);
+	}
+}
 
-		ReadRaw((*_bytes), (*_outLen));
+// ------------------------------------------------------------------------------------------------
+void* FileLike::ReadPayload(size_t _len)
+{
+	void* blobBytes = NULL;
+	if (ReadBlobReference(_len, &blobBytes)) {
+		return blobBytes;
 	}
+
+	// Payloads already in the receive window stay there, and the buffer goes to the arena with them.
+	if (mMode == FileLike::Socket && mPayloadArena && mRecvWindowStart && mDecoder == NULL && _len <= (size_t)(mReadEnd - mReadCursor)) {
+		void* retVal = (void*)mReadCursor;
+		mReadCursor += _len;
+		mRecvWindowHandedOut = true;
+		mPayloadBytesRead += _len;
+		return retVal;
+	}
+
+	// Payloads can only reference the mapping directly if they're stored uncompressed.
+	if (mMode == FileLike::Mapped && mDecoder == NULL) {
+		if (_len > (size_t)(mReadEnd - mReadCursor)) {
+			throw 10;
+		}
+
+		void* retVal = (void*)mReadCursor;
+		mReadCursor += _len;
+		return retVal;
+	}
+
+	void* retVal = mPayloadArena ? mPayloadArena->Allocate(_len) : malloc(_len);
+	assert(retVal);
+	ReadRaw(retVal, _len);
+	mPayloadBytesRead += _len;
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool FileLike::ReadBlobReference(size_t _len, void** _outBytes)
+{
+	if (!mBlobStore) {
+		return false;
+	}
+
+	unsigned char isBlob = 0;
+	Read(&isBlob);
+	if (!isBlob) {
+		return false;
+	}
+
+	Hash128 id;
+	Read(&id);
+	(*_outBytes) = mBlobStore->Find(id, _len);
+	if ((*_outBytes) == NULL) {
+		LogError(TC("Payload references a blob that isn't in the trace."));
+		throw 10;
+	}
+
+	return true;
 }
 
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::ReadRaw(void* _bytes, size_t _len)
+void FileLike::ReadRawSlow(void* _bytes, size_t _len)
 {
-	assert((mFile != 0) ^ (mMessageStream != 0));
+	assert((mFile != 0) + (mMessageStream != 0) + (mMappedFile != 0) + (mMemory != 0) == 1);
+
+	// Whatever we're about to read may well be a reply to what we've written.
+	Flush();
+
+	// Use up whatever we have first.
+	unsigned char* dst = (unsigned char*)_bytes;
+	size_t readAhead = (size_t)(mReadEnd - mReadCursor);
+	assert(readAhead < _len);
+	if (readAhead > 0) {
+		memcpy(dst, mReadCursor, readAhead);
+		mReadCursor += readAhead;
+		dst += readAhead;
+		_len -= readAhead;
+	}
+
+	if (mDecoder) {
+		mDecoder->Read(dst, _len);
+		return;
+	}
 
 	switch(mMode) {
 		case FileLike::File:	
 		{
-			if (1 != fread(_bytes, _len, 1, mFile)) { 
-				throw 10; 
-			} 
+			// Big reads go straight to the destination, everything else refills the buffer.
+			if (_len >= mBufferSize) {
+				if (1 != fread(dst, _len, 1, mFile)) { 
+					throw 10; 
+				} 
+				break;
+			}
+
+			size_t bytesRead = fread(mBuffer, 1, mBufferSize, mFile);
+			if (bytesRead < _len) {
+				throw 10;
+			}
+			memcpy(dst, mBuffer, _len);
+			mReadCursor = mBuffer + _len;
+			mReadEnd = mBuffer + bytesRead;
 			break;
 		}
 
+		case FileLike::Mapped:
+		{
+			// The read-ahead was the rest of the mapping.
+			throw 10;
+		}
+
+		case FileLike::Memory:
+		{
+			assert(!"Memory streams are write-only");
+			throw 10;
+		}
+
 		case FileLike::Socket:	
 		{
-			mMessageStream->BlockingRecv(_bytes, _len);
+			// Hand back the part of the stream's receive buffer we've been parsing, then have it receive
+			// more and keep parsing in place. Big reads go straight to the destination instead.
+			ReleaseRecvWindow();
+			if (_len >= kRecvDirectSize) {
+				mMessageStream->BlockingRecv(dst, _len);
+				break;
+			}
+
+			size_t bufferedLen = 0;
+			mRecvWindowStart = mMessageStream->FillRecvBuffer(_len, &bufferedLen);
+			memcpy(dst, mRecvWindowStart, _len);
+			mReadCursor = mRecvWindowStart + _len;
+			mReadEnd = mRecvWindowStart + bufferedLen;
 			break;
 		}
 
@@ -205,76 +536,173 @@ void FileLike::ReadRaw(void* _bytes, size_t _len)
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(bool _val)
+void FileLike::DiscardReadAhead()
 {
-	size_t WriteThis = _val ? 1 : 0;
-	Write(WriteThis);
+	mReadCursor = NULL;
+	mReadEnd = NULL;
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(char _val)
+void FileLike::ReleaseRecvWindow()
 {
-	WriteRaw(&_val, sizeof(_val));
+	if (mRecvWindowHandedOut) {
+		HandRecvBufferToArena();
+	}
+
+	if (mRecvWindowStart) {
+		mMessageStream->ConsumeRecvBuffer(mReadCursor - mRecvWindowStart);
+		mRecvWindowStart = NULL;
+		DiscardReadAhead();
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(unsigned char _val)
+void FileLike::HandRecvBufferToArena()
 {
-	WriteRaw(&_val, sizeof(_val));
+	assert(mRecvWindowHandedOut && mRecvWindowStart && mPayloadArena);
+
+	// What we haven't parsed yet moves to the new buffer, and so do we.
+	mMessageStream->ConsumeRecvBuffer(mReadCursor - mRecvWindowStart);
+	mPayloadArena->Adopt(mMessageStream->DetachRecvBuffer());
+	mRecvWindowHandedOut = false;
+
+	size_t bufferedLen = 0;
+	mRecvWindowStart = mMessageStream->FillRecvBuffer(0, &bufferedLen);
+	mReadCursor = mRecvWindowStart;
+	mReadEnd = mRecvWindowStart + bufferedLen;
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(short _val)
+void FileLike::SetPayloadArena(PayloadArena* _arena)
 {
-	WriteRaw(&_val, sizeof(_val));
+	// The arena that has payloads in the receive buffer gets the buffer before it's swapped out.
+	if (mRecvWindowHandedOut && _arena != mPayloadArena) {
+		HandRecvBufferToArena();
+	}
+
+	mPayloadArena = _arena;
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(unsigned short _val)
+void FileLike::Write(const void* _bytes, size_t _len)
 {
-	WriteRaw(&_val, sizeof(_val));
+	Write(_len);
+	if (_len) {
+		WritePayload(_bytes, _len);
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(int _val)
+void FileLike::WritePayload(const void* _bytes, size_t _len)
 {
-	WriteRaw(&_val, sizeof(_val));
+	if (!WriteBlobReference(_bytes, _len)) {
+		WriteRaw(_bytes, _len);
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(unsigned int _val)
+void FileLike::WritePayloadByReference(const void* _bytes, size_t _len)
 {
-	WriteRaw(&_val, sizeof(_val));
+	if (mMode != FileLike::Socket || _len < kFileLikeMinPayloadReferenceSize) {
+		WritePayload(_bytes, _len);
+		return;
+	}
+
+	if (WriteBlobReference(_bytes, _len)) {
+		return;
+	}
+
+	if (mPayloadReferenceCount == kFileLikeMaxPayloadReferences) {
+		Flush();
+	}
+
+	PayloadReference& ref = mPayloadReferences[mPayloadReferenceCount++];
+	ref.mBufferedBytesBefore = mBufferedWriteBytes;
+	ref.mBytes = _bytes;
+	ref.mLen = _len;
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(float _val)
+void FileLike::FlushGather()
 {
-	WriteRaw(&_val, sizeof(_val));
+	assert(mMode == FileLike::Socket);
+	CompileTimeAssert(2 * kFileLikeMaxPayloadReferences + 1 <= kMaxSendSegments);
+
+	// Interleave the staged bytes with the payloads that go between them.
+	SendSegment segments[2 * kFileLikeMaxPayloadReferences + 1];
+	size_t segmentCount = 0;
+	size_t bufferOffset = 0;
+	for (size_t i = 0; i < mPayloadReferenceCount; ++i) {
+		const PayloadReference& ref = mPayloadReferences[i];
+		segments[segmentCount].mBytes = mBuffer + bufferOffset;
+		segments[segmentCount].mLen = ref.mBufferedBytesBefore - bufferOffset;
+		++segmentCount;
+
+		segments[segmentCount].mBytes = ref.mBytes;
+		segments[segmentCount].mLen = ref.mLen;
+		++segmentCount;
+
+		bufferOffset = ref.mBufferedBytesBefore;
+	}
+
+	segments[segmentCount].mBytes = mBuffer + bufferOffset;
+	segments[segmentCount].mLen = mBufferedWriteBytes - bufferOffset;
+	++segmentCount;
+
+	// Reset first, so that a failed send doesn't get retried by the destructor.
+	mPayloadReferenceCount = 0;
+	mBufferedWriteBytes = 0;
+	mMessageStream->SendGather(segments, segmentCount);
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(double _val)
+bool FileLike::WriteBlobReference(const void* _bytes, size_t _len)
 {
-	WriteRaw(&_val, sizeof(_val));
+	if (!mBlobStore) {
+		return false;
+	}
+
+	Hash128 id;
+	if (!mBlobStore->Add(_bytes, _len, &id)) {
+		Write((unsigned char)0);
+		return false;
+	}
+
+	Write((unsigned char)1);
+	Write(id);
+	return true;
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::Write(const void* _bytes, size_t _len)
+void FileLike::WriteRawSlow(const void* _bytes, size_t _len)
 {
-	Write(_len);
-	if (_len) {
-		WriteRaw(_bytes, _len);
+	// Reading and writing the same file needs a Seek in between. Sockets read and write independently.
+	assert(mMode == FileLike::Socket || mReadCursor == mReadEnd);
+
+	Flush();
+	if (_len >= mBufferSize) {
+		WriteUnbuffered(_bytes, _len);
+	} else {
+		memcpy(mBuffer, _bytes, _len);
+		mBufferedWriteBytes = _len;
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
-void FileLike::WriteRaw(const void* _bytes, size_t _len)
+void FileLike::WriteUnbuffered(const void* _bytes, size_t _len)
 {
-	assert((mFile != 0) ^ (mMessageStream != 0));
+	assert((mFile != 0) + (mMessageStream != 0) + (mMappedFile != 0) + (mMemory != 0) == 1);
+
+	if (mEncoder) {
+		mEncoder->Write(_bytes, _len);
+		return;
+	}
+
 	switch (mMode) {
 	case FileLike::File:	if (1 != fwrite(_bytes, _len, 1, mFile)) { throw 10; } break;
 	case FileLike::Socket:	mMessageStream->Send(_bytes, _len); break;
-	default: assert(!"Invalid mode in FileLike::Read"); break;
+	case FileLike::Mapped:	assert(!"Mapped files are read-only"); throw 10;
+	case FileLike::Memory:	mMemory->insert(mMemory->end(), (const unsigned char*)_bytes, (const unsigned char*)_bytes + _len); break;
+	default: assert(!"Invalid mode in FileLike::Write"); break;
 	}
 }
@@ -28,12 +28,31 @@
 
 #pragma once
 
+class BlobStore;
+class BlockDecoder;
+class BlockEncoder;
 class Checkpoint;
+class ContextState;
 class FileLike;
+class MappedFile;
+class PayloadArena;
 
 #include <map>
 #include <vector>
 
+// File streams read and write through a staging buffer of this size, so that the many small fields 
+// making up a trace don't each turn into a call into the CRT. Anything at least this big bypasses it.
+const size_t kFileLikeBufferSize = 1024 * 1024;
+const size_t kFileLikeBufferAlignment = 4096;
+
+// Socket streams only stage small fields, so that a packet goes out in one Send instead of one per field.
+const size_t kFileLikeSocketBufferSize = 512;
+
+// Payloads written with WritePayloadByReference at least this big are sent straight from where they 
+// are, rather than copied into the staging buffer. At most this many can be pending before a Flush.
+const size_t kFileLikeMinPayloadReferenceSize = 256;
+const size_t kFileLikeMaxPayloadReferences = 8;
+
 // For creating checkpoints (consistency checks) in the various streams we're interacting with.
 class Checkpoint
 {
@@ -54,31 +73,105 @@ class FileLike
 {
 public:
 	FileLike(FILE* fp);
+	// Reads parse straight out of the stream's receive buffer, so only one FileLike at a time should be 
+	// reading from a given stream.
 	FileLike(MessageStream *_msgStream /* TODO: Pass in callback here */); 
+	// Read-only. Payloads returned by ReadPayload point into the mapping; _mappedFile must outlive them.
+	FileLike(const MappedFile* _mappedFile);
+	// Write-only. Everything written is appended to _memory.
+	FileLike(std::vector<unsigned char>* _memory);
+	// Flushes anything still buffered.
+	~FileLike();
 
 	size_t AllocatePacketId();
 
-	void Read(bool* _val);
-	void Read(char* _val);
-	void Read(unsigned char* _val);
+	// Writes out whatever is buffered. Buffered writes are otherwise only written when the buffer fills
+	// (or on Seek/EndEncoding), so call this at the end of anything the other side is waiting on.
+	void Flush();
+
+	// Seeking is only supported for files.
+	TraceFileOffset Tell() const;
+	void Seek(TraceFileOffset _offset);
+
+	// If a trace index is attached, MarkSection records the current offset as the start of _section.
+	// Without an index (e.g. when streaming over a socket) it does nothing.
+	void SetTraceIndex(TraceIndex* _index) { mTraceIndex = _index; }
+	void MarkSection(ETraceSection _section);
+
+	// Everything written between BeginEncoding and EndEncoding is compressed with _codec, in independent
+	// chunks on the worker pool. Tell and MarkSection keep reporting offsets into the uncompressed stream.
+	// EndEncoding writes the table of chunks and returns where it put it. ETC_None does nothing.
+	void BeginEncoding(ETraceCodec _codec);
+	TraceFileOffset EndEncoding();
+
+	// The reading side of the above: from the current position on, the stream is decoded using the chunk
+	// table at _chunkTableOffset. Seek then takes offsets into the uncompressed stream.
+	void BeginDecoding(ETraceCodec _codec, TraceFileOffset _chunkTableOffset);
+
+	// With a blob store attached, payloads (see WritePayload/ReadPayload, and Write/Read of sized byte 
+	// ranges) of any real size are written as references into the store instead of inline.
+	void SetBlobStore(BlobStore* _blobStore) { mBlobStore = _blobStore; }
+
+	// With an arena attached, payloads that ReadPayload would otherwise malloc come out of the arena, and
+	// belong to it instead of to whoever read them. NULL goes back to malloc.
+	void SetPayloadArena(PayloadArena* _arena);
+	PayloadArena* GetPayloadArena() const { return mPayloadArena; }
+
+	// Packets written to the stream work out how big their pointer arguments are from this context state.
+	// By default that's gContextState, which is right for the hooks. Anything writing packets it received
+	// (see TraceWriter) must point this at the state that came with them instead.
+	void SetContextState(const ContextState* _contextState) { mContextState = _contextState; }
+	const ContextState* GetContextState() const;
+
+	void Read(bool* _val) 
+	{ 
+		unsigned char readThis = 0;
+		ReadScalar(&readThis);
+		(*_val) = (readThis != 0);
+	}
+	void Read(char* _val)				{ ReadScalar(_val); }
+	void Read(unsigned char* _val)		{ ReadScalar(_val); }
 
-	void Read(short* _val);
-	void Read(unsigned short* _val);
+	void Read(short* _val)				{ ReadScalar(_val); }
+	void Read(unsigned short* _val)		{ ReadScalar(_val); }
 
-	void Read(int* _val);
-	void Read(unsigned int* _val);
+	void Read(int* _val)				{ ReadScalar(_val); }
+	void Read(unsigned int* _val)		{ ReadScalar(_val); }
 
-	void Read(float* _val);
-	void Read(double* _val);
+	void Read(__int64* _val)			{ ReadScalar(_val); }
+	void Read(unsigned __int64* _val)	{ ReadScalar(_val); }
+
+	void Read(float* _val)				{ ReadScalar(_val); }
+	void Read(double* _val)				{ ReadScalar(_val); }
 
 	size_t Read(void* _bytes, size_t _len);
 
 	// Reads length from the stream, and if >0 then mallocs a chunk of memory to read into--returns through _bytes.
+	// For mapped files, _bytes points into the mapping instead--free it with SafeFreePayload.
 	void Read(void** _bytes, size_t* _outLen);
 
+	// Returns _len bytes from the stream. Normally this is a new malloc'd buffer, but for mapped files 
+	// it points into the mapping and nothing is copied. Either way, release it with SafeFreePayload--
+	// unless it came out of the payload arena (see SetPayloadArena), which frees it when it's cleared.
+	// With an arena, socket payloads that have already been received in full aren't copied either: they
+	// stay in the stream's receive buffer, which the arena takes over once we're done parsing it.
+	// Pairs with WritePayload.
+	void* ReadPayload(size_t _len);
+	// How many bytes ReadPayload has allocated so far (not counting payloads in the mapping or the blob 
+	// store), for anything that has to keep tabs on how much memory what it read is holding on to.
+	size_t GetPayloadBytesRead() const { return mPayloadBytesRead; }
+
 	// Normally, Read expects the size to live in the stream prefixing the data to be read.
 	// With ReadRaw, no size is expected first, and the bytes are directly read.
-	void ReadRaw(void* _bytes, size_t _len);
+	void ReadRaw(void* _bytes, size_t _len)
+	{
+		if (_len <= (size_t)(mReadEnd - mReadCursor)) {
+			memcpy(_bytes, mReadCursor, _len);
+			mReadCursor += _len;
+		} else {
+			ReadRawSlow(_bytes, _len);
+		}
+	}
 
 	void Read(const Checkpoint& _checkpoint) { _checkpoint.Read(this); }
 
@@ -154,24 +247,43 @@ public:
 	}
 
 
-	void Write(bool _val);
-	void Write(char _val);
-	void Write(unsigned char _val);
+	void Write(bool _val)				{ WriteScalar((unsigned char)(_val ? 1 : 0)); }
+	void Write(char _val)				{ WriteScalar(_val); }
+	void Write(unsigned char _val)		{ WriteScalar(_val); }
 
-	void Write(short _val);
-	void Write(unsigned short _val);
+	void Write(short _val)				{ WriteScalar(_val); }
+	void Write(unsigned short _val)		{ WriteScalar(_val); }
 
-	void Write(int _val);
-	void Write(unsigned int _val);
+	void Write(int _val)				{ WriteScalar(_val); }
+	void Write(unsigned int _val)		{ WriteScalar(_val); }
 
-	void Write(float _val);
-	void Write(double _val);
+	void Write(__int64 _val)			{ WriteScalar(_val); }
+	void Write(unsigned __int64 _val)	{ WriteScalar(_val); }
+
+	void Write(float _val)				{ WriteScalar(_val); }
+	void Write(double _val)				{ WriteScalar(_val); }
 
 	void Write(const void* _bytes, size_t _len);
 
+	// Writes a payload (the bytes of a texture update, buffer or pointer argument), with no length first.
+	void WritePayload(const void* _bytes, size_t _len);
+
+	// Same as WritePayload, but on sockets big payloads aren't copied: at the next Flush, they go out 
+	// together with everything buffered around them in one scatter-gather send. _bytes must stay valid 
+	// until then.
+	void WritePayloadByReference(const void* _bytes, size_t _len);
+
 	// Normally, Write outputs the _len to the stream first--with WriteRaw the bytes are simply written, 
 	// no size parameter first.
-	void WriteRaw(const void* _bytes, size_t _len);
+	void WriteRaw(const void* _bytes, size_t _len)
+	{
+		if (_len <= mBufferSize - mBufferedWriteBytes) {
+			memcpy(mBuffer + mBufferedWriteBytes, _bytes, _len);
+			mBufferedWriteBytes += _len;
+		} else {
+			WriteRawSlow(_bytes, _len);
+		}
+	}
 
 	void Write(const Checkpoint& _checkpoint) { _checkpoint.Write(this); }
 
@@ -234,8 +346,84 @@ public:
 	}
 
 private:
-	enum { File, Socket } mMode;
+	enum { File, Socket, Mapped, Memory } mMode;
 	FILE* mFile;
 	MessageStream* mMessageStream;
+	const MappedFile* mMappedFile;
+	std::vector<unsigned char>* mMemory;
+	TraceIndex* mTraceIndex;
+	BlockEncoder* mEncoder;
+	BlockDecoder* mDecoder;
+	BlobStore* mBlobStore;
+	PayloadArena* mPayloadArena;
+	size_t mPayloadBytesRead;
+	const ContextState* mContextState;
+
+	// Staging buffer for writes (and file reads). Aligned and owned for files, mSocketBuffer for sockets
+	// and memory, NULL for mappings.
+	unsigned char* mBuffer;
+	size_t mBufferSize;
+	size_t mBufferedWriteBytes;
+	unsigned char mSocketBuffer[kFileLikeSocketBufferSize];
+
+	// Payloads waiting to be sent from where they are, in order. Each goes right after the first 
+	// mBufferedBytesBefore bytes of the staging buffer.
+	struct PayloadReference
+	{
+		size_t mBufferedBytesBefore;
+		const void* mBytes;
+		size_t mLen;
+	};
+	PayloadReference mPayloadReferences[kFileLikeMaxPayloadReferences];
+	size_t mPayloadReferenceCount;
+
+	// Bytes that have been read ahead but not consumed yet. For files these are in mBuffer, for mappings 
+	// this is the whole (rest of the) mapping, for sockets it's what the stream has buffered (starting at 
+	// mRecvWindowStart). Empty while a decoder is active.
+	const unsigned char* mReadCursor;
+	const unsigned char* mReadEnd;
+	const unsigned char* mRecvWindowStart;
+	// ReadPayload handed out payloads that point into the receive window, so the stream's buffer goes to
+	// mPayloadArena instead of being received into again (see HandRecvBufferToArena).
+	bool mRecvWindowHandedOut;
+
+	template <typename T>
+	void ReadScalar(T* _val)
+	{
+		if (sizeof(T) <= (size_t)(mReadEnd - mReadCursor)) {
+			memcpy(_val, mReadCursor, sizeof(T));
+			mReadCursor += sizeof(T);
+		} else {
+			ReadRawSlow(_val, sizeof(T));
+		}
+	}
+
+	template <typename T>
+	void WriteScalar(const T& _val)
+	{
+		if (sizeof(T) <= mBufferSize - mBufferedWriteBytes) {
+			memcpy(mBuffer + mBufferedWriteBytes, &_val, sizeof(T));
+			mBufferedWriteBytes += sizeof(T);
+		} else {
+			WriteRawSlow(&_val, sizeof(T));
+		}
+	}
+
+	void ReadRawSlow(void* _bytes, size_t _len);
+	void WriteRawSlow(const void* _bytes, size_t _len);
+	void WriteUnbuffered(const void* _bytes, size_t _len);
+	void FlushGather();
+	void DiscardReadAhead();
+	// Tells the stream how much of its receive buffer we've parsed.
+	void ReleaseRecvWindow();
+	// Gives the stream's receive buffer to the arena, and carries on parsing from its new one.
+	void HandRecvBufferToArena();
+
+	bool ReadBlobReference(size_t _len, void** _outBytes);
+	bool WriteBlobReference(const void* _bytes, size_t _len);
+
+	// Not copyable--mBuffer may point at our own mSocketBuffer.
+	FileLike(const FileLike&);
+	FileLike& operator=(const FileLike&);
 };
 
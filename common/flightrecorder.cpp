@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "flightrecorder.h"
+
+#include "commandrecorder.h"
+#include "functionhooks.gen.h"
+#include "tracewriter.h"
+
+const TCHAR* kFlightRecorderFileVariable = TC("GFXTRACE_FLIGHT_RECORDER");
+const TCHAR* kFlightRecorderFramesVariable = TC("GFXTRACE_FLIGHT_RECORDER_FRAMES");
+const TCHAR* kFlightRecorderHitchVariable = TC("GFXTRACE_FLIGHT_RECORDER_HITCH_MS");
+
+const unsigned int kFlightRecorderDefaultFrameCount = 120;
+
+// How often the recorder thread checks whether it's been asked to stop while waiting for a frame.
+const DWORD kFlightRecorderPollTimeMs = 250;
+
+// How long we give the recorder thread to finish up when we're torn down.
+const DWORD kFlightRecorderShutdownTimeoutMs = 5000;
+
+// Sent by the hooks ahead of every frame.
+enum EFlightRecorderFrameFlags
+{
+	EFRF_Dump = 1 << 0,			// Write out the frames before this one.
+	EFRF_Keyframe = 1 << 1,		// The whole ContextState follows.
+};
+
+FlightRecorder* gFlightRecorder = NULL;
+
+// ------------------------------------------------------------------------------------------------
+DWORD WINAPI FlightRecorder_RunRecordThread(LPVOID _recorderPtr)
+{
+	((FlightRecorder*)_recorderPtr)->Thread_Record();
+	return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+FlightRecorder* FlightRecorder::CreateFromEnvironment()
+{
+	TCHAR filename[_MAX_PATH] = { 0 };
+	DWORD len = GetEnvironmentVariable(kFlightRecorderFileVariable, filename, _MAX_PATH);
+	if (len == 0 || len >= _MAX_PATH) {
+		return NULL;
+	}
+
+	unsigned int frameCount = kFlightRecorderDefaultFrameCount;
+	TCHAR valueString[16] = { 0 };
+	len = GetEnvironmentVariable(kFlightRecorderFramesVariable, valueString, ARRAYSIZE(valueString));
+	if (len > 0 && len < ARRAYSIZE(valueString)) {
+		frameCount = max(1u, (unsigned int)_tcstoul(valueString, NULL, 10));
+	}
+
+	double hitchMs = 0;
+	len = GetEnvironmentVariable(kFlightRecorderHitchVariable, valueString, ARRAYSIZE(valueString));
+	if (len > 0 && len < ARRAYSIZE(valueString)) {
+		hitchMs = _tcstod(valueString, NULL);
+	}
+
+	ETraceCodec codec = ETC_LZ;
+	ParseTraceCodec(gOptions->TraceCodec, &codec);
+
+	if (hitchMs > 0) {
+		LogInfo(TC("Flight recorder keeping the last %u frames, dumping to %s on Ctrl+Alt+P or frames over %.1fms."), frameCount, filename, hitchMs);
+	} else {
+		LogInfo(TC("Flight recorder keeping the last %u frames, dumping to %s on Ctrl+Alt+P."), frameCount, filename);
+	}
+	return new FlightRecorder(filename, frameCount, hitchMs, codec);
+}
+
+// ------------------------------------------------------------------------------------------------
+FlightRecorder::FlightRecorder(const TCHAR* _filename, unsigned int _frameCount, double _hitchMs, ETraceCodec _codec)
+: mStream(NULL)
+, mFilename(NULL)
+, mCodec(_codec)
+, mFrameCount(_frameCount)
+, mHitchMs(_hitchMs)
+, mFrameNumber(0)
+, mFramesSinceKeyframe(0)
+, mFramesSinceHitchDump(0)
+, mTicksPerMs(0)
+, mHotkeyWasDown(false)
+, mDumpPending(false)
+, mDumpCount(0)
+, mThreadHandle(NULL)
+, mStopThread(false)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	mTicksPerMs = frequency.QuadPart / 1000.0;
+	mLastSwapTime.QuadPart = 0;
+
+	mFilename = AllocateAndCopy(_filename);
+	mStream = new MessageStream(true, "", "", EMT_Loopback);
+	InitializeCriticalSection(&mPendingKeyframesLock);
+
+	mThreadHandle = CreateThread(NULL, 0, FlightRecorder_RunRecordThread, this, 0, NULL);
+	if (!mThreadHandle) {
+		DeleteCriticalSection(&mPendingKeyframesLock);
+		SafeDelete(mStream);
+		SafeDeleteArray(mFilename);
+		throw 8;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+FlightRecorder::~FlightRecorder()
+{
+	// The hooks are gone by now. The thread is most likely waiting on the rest of a frame that's never
+	// coming, so tell it we're done.
+	if (mFrameNumber > 0) {
+		try {
+			SSerializeDataPacket pkt;
+			pkt.mDataType = EST_Sentinel;
+
+			FileLike out(mStream);
+			out.Write(pkt);
+			out.Flush();
+			mStream->FlushSendBuffer();
+		} catch (...) {
+			// The thread will still notice mStopThread between frames.
+		}
+	}
+
+	mStopThread = true;
+	if (WaitForSingleObject(mThreadHandle, kFlightRecorderShutdownTimeoutMs) == WAIT_OBJECT_0) {
+		CloseHandle(mThreadHandle);
+		mThreadHandle = NULL;
+
+		for (auto it = mFrames.begin(); it != mFrames.end(); ++it) {
+			DeleteFrame(*it);
+		}
+		mFrames.clear();
+
+		DeletePendingKeyframes();
+		DeleteCriticalSection(&mPendingKeyframesLock);
+
+		SafeDelete(mStream);
+		SafeDeleteArray(mFilename);
+	} else {
+		// Still writing a dump. Leak everything rather than pull it out from under the thread.
+		LogError(TC("Flight recorder didn't finish writing to %s in time."), mFilename);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void FlightRecorder::OnSwapBuffers(HDC _hdc)
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+
+	if (IsHotkeyPressed()) {
+		LogInfo(TC("Dumping the flight recorder."));
+		mDumpPending = true;
+	}
+
+	// Hitches within a window of the last one would mostly dump the same frames again.
+	if (mHitchMs > 0 && mFrameNumber > 0 && mFramesSinceHitchDump >= mFrameCount) {
+		double frameMs = (now.QuadPart - mLastSwapTime.QuadPart) / mTicksPerMs;
+		if (frameMs > mHitchMs) {
+			LogInfo(TC("Frame %u took %.1fms, dumping the flight recorder."), mFrameNumber, frameMs);
+			mDumpPending = true;
+			mFramesSinceHitchDump = 0;
+		}
+	}
+
+	// SwapBuffers can come before any context is made current, or after the one we were recording went
+	// away with nothing current since. Keyframes wait for a context to copy, and dumps wait with them 
+	// (and for there to be a frame to dump).
+	unsigned char flags = 0;
+	if (gContextState) {
+		if (mDumpPending && mFrameNumber > 0) {
+			flags |= EFRF_Dump;
+			mDumpPending = false;
+		}
+
+		if (mFrameNumber == 0 || mFramesSinceKeyframe >= mFrameCount) {
+			flags |= EFRF_Keyframe;
+			mFramesSinceKeyframe = 0;
+		}
+	}
+
+	// Frames only start being recorded with the first keyframe.
+	if (mFrameNumber == 0 && (flags & EFRF_Keyframe) == 0) {
+		Once(LogWarn(TC("There's no GL context to record yet, the flight recorder will start once there is.")));
+		QueryPerformanceCounter(&mLastSwapTime);
+		return;
+	}
+
+	{
+		FileLike out(mStream);
+
+		// Finish off the frame that's ending. Before the first SwapBuffers, we weren't recording.
+		if (mFrameNumber > 0) {
+			WriteMessages(&out);
+			gCommandRecorder->MakeStreamCurrent(&out, gContextState);
+			SSerializeDataPacket::SwapBuffers(_hdc).Write(&out);
+		}
+
+		// Then start the next one. The keyframe has to be waiting for the thread before it sees the flags.
+		if (flags & EFRF_Keyframe) {
+			ContextState* keyframe = gContextState->OnCaptureStart();
+			EnterCriticalSection(&mPendingKeyframesLock);
+			mPendingKeyframes.push_back(keyframe);
+			LeaveCriticalSection(&mPendingKeyframesLock);
+
+			gCommandRecorder->ResetStreamContext(gContextState);
+		}
+		out.Write(flags);
+		out.Flush();
+	}
+
+	if (flags & EFRF_Dump) {
+		mStream->FlushSendBuffer();
+	}
+
+	gIsRecording = true;
+	++mFrameNumber;
+	++mFramesSinceKeyframe;
+	++mFramesSinceHitchDump;
+
+	// Don't count our own keyframes against the next frame.
+	QueryPerformanceCounter(&mLastSwapTime);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool FlightRecorder::IsHotkeyPressed()
+{
+	// Same chord eztrace captures on, but polled--the application owns the message loop.
+	bool isDown = (GetAsyncKeyState(VK_CONTROL) & 0x8000) != 0
+	           && (GetAsyncKeyState(VK_MENU) & 0x8000) != 0
+	           && (GetAsyncKeyState('P') & 0x8000) != 0;
+
+	bool retVal = isDown && !mHotkeyWasDown;
+	mHotkeyWasDown = isDown;
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void FlightRecorder::Thread_Record()
+{
+	try {
+		// Every frame is its flags (and keyframe), then its commands up to and including SwapBuffers.
+		// Each frame's flags are sent along with the SwapBuffers before it, so while we wait between
+		// frames it's always for a command.
+		Frame* frame = NULL;
+		while (!mStopThread) {
+			if (!mStream->WaitForRecv(kFlightRecorderPollTimeMs)) {
+				continue;
+			}
+
+			FileLike in(mStream);
+			if (frame) {
+				while (1) {
+					SSerializeDataPacket pkt;
+					in.Read(&pkt);
+
+					// We're being torn down.
+					if (pkt.mDataType == EST_Sentinel) {
+						return;
+					}
+
+					frame->mCommands.push_back(pkt);
+					if (pkt.mDataType == ESTSwapBuffersData) {
+						break;
+					}
+				}
+
+				DropExpiredFrames();
+			}
+
+			unsigned char flags = 0;
+			in.Read(&flags);
+			if (flags & EFRF_Dump) {
+				Dump();
+			}
+
+			frame = new Frame;
+			mFrames.push_back(frame);
+			if (flags & EFRF_Keyframe) {
+				frame->mKeyframe = PopPendingKeyframe();
+			}
+		}
+		return;
+	} catch (...) {
+		LogError(TC("Flight recorder failed, nothing more will be recorded."));
+	}
+
+	for (auto it = mFrames.begin(); it != mFrames.end(); ++it) {
+		DeleteFrame(*it);
+	}
+	mFrames.clear();
+
+	// Keep draining, so the application doesn't end up stuck on a full ring (or piling up keyframes).
+	try {
+		while (!mStopThread) {
+			DeletePendingKeyframes();
+			if (mStream->WaitForRecv(kFlightRecorderPollTimeMs)) {
+				size_t bufferedLen = 0;
+				mStream->FillRecvBuffer(1, &bufferedLen);
+				mStream->ConsumeRecvBuffer(bufferedLen);
+			}
+		}
+	} catch (...) {
+		// The stream is going away.
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+ContextState* FlightRecorder::PopPendingKeyframe()
+{
+	EnterCriticalSection(&mPendingKeyframesLock);
+	ContextState* retVal = NULL;
+	if (!mPendingKeyframes.empty()) {
+		retVal = mPendingKeyframes.front();
+		mPendingKeyframes.pop_front();
+	}
+	LeaveCriticalSection(&mPendingKeyframesLock);
+
+	// The hooks always queue the keyframe before sending the frame that needs it.
+	if (!retVal) {
+		LogError(TC("Flight recorder frame is missing its keyframe."));
+		throw 1;
+	}
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void FlightRecorder::DeletePendingKeyframes()
+{
+	EnterCriticalSection(&mPendingKeyframesLock);
+	for (auto it = mPendingKeyframes.begin(); it != mPendingKeyframes.end(); ++it) {
+		SafeDelete(*it);
+	}
+	mPendingKeyframes.clear();
+	LeaveCriticalSection(&mPendingKeyframesLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void FlightRecorder::DropExpiredFrames()
+{
+	// Frames can only be played back from a keyframe, so the window starts at the newest keyframe 
+	// that still leaves us with enough frames.
+	size_t firstKept = 0;
+	for (size_t i = 1; i < mFrames.size(); ++i) {
+		if (mFrames[i]->mKeyframe && mFrames.size() - i >= mFrameCount) {
+			firstKept = i;
+		}
+	}
+
+	for (size_t i = 0; i < firstKept; ++i) {
+		DeleteFrame(mFrames.front());
+		mFrames.pop_front();
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void FlightRecorder::Dump()
+{
+	if (mFrames.empty()) {
+		LogWarn(TC("The flight recorder doesn't have any frames to dump yet."));
+		return;
+	}
+	assert(mFrames.front()->mKeyframe);
+
+	// hitch.gft becomes hitch_000.gft, hitch_001.gft and so on.
+	const TCHAR* extension = _tcsrchr(mFilename, TC('.'));
+	if (extension == NULL || _tcspbrk(extension, TC("\\/")) != NULL) {
+		extension = mFilename + _tcslen(mFilename);
+	}
+
+	TCHAR filename[_MAX_PATH] = { 0 };
+	_stprintf_s(filename, _MAX_PATH, TC("%.*s_%03u%s"), (int)(extension - mFilename), mFilename, mDumpCount, extension);
+	++mDumpCount;
+
+	try {
+		// We hold on to the frames, so their payloads stay alive until Finish. The keyframe's are pinned
+		// so the shadow budget doesn't spill them meanwhile.
+		SharedObjectsPayloadPins pins(mFrames.front()->mKeyframe->GetSharedObjects());
+		TraceWriter writer(filename, mCodec, false);
+		writer.WriteContextState(*mFrames.front()->mKeyframe);
+		for (auto frameIt = mFrames.cbegin(); frameIt != mFrames.cend(); ++frameIt) {
+			const std::vector<SSerializeDataPacket>& commands = (*frameIt)->mCommands;
+			for (auto it = commands.cbegin(); it != commands.cend(); ++it) {
+				writer.WritePacket(*it);
+			}
+		}
+		writer.Finish();
+	} catch (...) {
+		LogError(TC("Failed to write the flight recorder to %s."), filename);
+		return;
+	}
+
+	LogInfo(TC("Wrote the last %u frames to %s."), (unsigned int)mFrames.size(), filename);
+}
+
+// ------------------------------------------------------------------------------------------------
+void FlightRecorder::DeleteFrame(Frame* _frame)
+{
+	for (auto it = _frame->mCommands.begin(); it != _frame->mCommands.end(); ++it) {
+		it->ReleasePayloads();
+	}
+	SafeDelete(_frame->mKeyframe);
+	SafeDelete(_frame);
+}
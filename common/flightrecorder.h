@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+class ContextState;
+class MessageStream;
+struct SSerializeDataPacket;
+
+// ------------------------------------------------------------------------------------------------
+// Keeps the last few frames the application rendered in memory, so that when something goes wrong 
+// they can still be written out as a trace after the fact. Turned on by setting 
+// GFXTRACE_FLIGHT_RECORDER in the application's environment to the trace to write; each dump gets a 
+// number appended. GFXTRACE_FLIGHT_RECORDER_FRAMES is how many frames to keep (120 if it's not set).
+// A dump is triggered by Ctrl+Alt+P in the application, or by any frame that takes longer than 
+// GFXTRACE_FLIGHT_RECORDER_HITCH_MS (if that's set).
+//
+// The hooks record all the time, into a loopback MessageStream. A thread on the other end parses the
+// frames back out and holds on to them. Every FrameCount frames the hooks also take a copy of the 
+// ContextState as a keyframe (see ContextState::OnCaptureStart) and hand it to the thread, and the 
+// frames held always start at one, so that anywhere between FrameCount and twice that many frames are
+// kept. Keyframes are only serialized if they're dumped, on the thread; on the application's thread 
+// they cost what starting a capture costs, and everything else costs what recording a capture costs,
+// without a socket on the other end.
+class FlightRecorder
+{
+public:
+	// Returns NULL unless the environment asks for a flight recorder. 
+	static FlightRecorder* CreateFromEnvironment();
+	~FlightRecorder();
+
+	// What the hooks should send to. Owned by the FlightRecorder.
+	MessageStream* GetMessageStream() const { return mStream; }
+
+	// Called from hooked_SwapBuffers at the end of every frame, in place of polling for commands.
+	void OnSwapBuffers(HDC _hdc);
+
+private:
+	FlightRecorder(const TCHAR* _filename, unsigned int _frameCount, double _hitchMs, ETraceCodec _codec);
+
+	struct Frame
+	{
+		Frame() : mKeyframe(NULL) { }
+
+		ContextState* mKeyframe;	// The state at the start of the frame, if one was sent with it.
+		std::vector<SSerializeDataPacket> mCommands;
+	};
+
+	MessageStream* mStream;
+	TCHAR* mFilename;
+	ETraceCodec mCodec;
+	unsigned int mFrameCount;
+	double mHitchMs;
+
+	// Only touched by the application's thread.
+	unsigned int mFrameNumber;
+	unsigned int mFramesSinceKeyframe;
+	unsigned int mFramesSinceHitchDump;
+	LARGE_INTEGER mLastSwapTime;
+	double mTicksPerMs;
+	bool mHotkeyWasDown;
+	// A dump asked for while there was no context to record, see OnSwapBuffers.
+	bool mDumpPending;
+
+	// Only touched by the recorder thread.
+	std::deque<Frame*> mFrames;
+	unsigned int mDumpCount;
+
+	// Keyframes taken by the application's thread that the recorder thread hasn't reached yet, in the
+	// order their frames were sent.
+	std::deque<ContextState*> mPendingKeyframes;
+	CRITICAL_SECTION mPendingKeyframesLock;
+
+	HANDLE mThreadHandle;
+	volatile bool mStopThread;
+
+	bool IsHotkeyPressed();
+
+	void Thread_Record();
+	ContextState* PopPendingKeyframe();
+	void DeletePendingKeyframes();
+	void DropExpiredFrames();
+	void Dump();
+	static void DeleteFrame(Frame* _frame);
+
+	friend DWORD WINAPI FlightRecorder_RunRecordThread(LPVOID _recorderPtr);
+};
+
+extern FlightRecorder* gFlightRecorder;
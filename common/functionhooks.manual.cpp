@@ -36,9 +36,25 @@
 #include "common/extensions.h"
 
 #include "common/gltrace.h"
+#include "common/capturestatewriter.h"
+#include "common/commandrecorder.h"
+#include "common/contextregistry.h"
+#include "common/directcapture.h"
+#include "common/flightrecorder.h"
+#include "common/shadowbudget.h"
 
 bool gFirstMakeCurrent = true;
 
+// While recording, how many frames are left to capture--including the one being recorded.
+unsigned int gCaptureFramesLeft = 0;
+
+// A capture that was asked for when there wasn't a context to capture, waiting for one.
+RemoteCommand gPendingCapture;
+
+// If true, the hooks only track state during a capture; the state it starts from is read back from 
+// the driver.
+bool gIdleHooks = false;
+
 static void DummyFunc()
 {
 	// This will fail on Mac, leaving it here as a bomb to fix there. :|
@@ -1441,12 +1457,47 @@ size_t determinePointerLength_glUniform4fv_value(const ContextState* _ctxState,
 }
 
 // ------------------------------------------------------------------------------------------------
-void OnCaptureStart(FileLike* _out)
+size_t determinePointerLength_wglCreateContextAttribsARB_attribList(const ContextState* _ctxState, HDC hDC, HGLRC hShareContext, const int* attribList)
+{
+	if (!attribList)
+		return 0;
+
+	// Name, value pairs, up to a 0 name.
+	size_t count = 0;
+	while (attribList[count] != 0) {
+		count += 2;
+	}
+	return (count + 1) * sizeof(int);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Returns false if there's no context to capture yet.
+bool OnCaptureStart(unsigned int _baseGeneration, unsigned __int64 _baseContext)
 {
+	assert(gCaptureStateWriter);
+
+	if (gIdleHooks) {
+		// Whatever we had is from the last capture. Start over from what the driver has now.
+		ContextState* fresh = gContextRegistry->RequeryCurrent();
+		if (!fresh) {
+			return false;
+		}
+		gContextState = fresh;
+		gIsTracking = true;
+	}
+
+	if (!gContextState) {
+		return false;
+	}
+
+	// The capture starts from this context's state, so that's where its commands play.
+	gCommandRecorder->ResetStreamContext(gContextState);
 	gIsRecording = true; 
-	_out->Write(Checkpoint("TraceCapturingBegin"));
-	_out->Write(*gContextState);
-	_out->Write(Checkpoint("FrameCommandsBegin"));
+
+	// The state goes out on the writer's thread. Until the capture is over, the hooks send what comes 
+	// after it wherever the writer says.
+	gMessageStream = gCaptureStateWriter->BeginCapture(gContextState->OnCaptureStart(), _baseGeneration, _baseContext);
+	return true;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -1462,6 +1513,19 @@ void OnCaptureEnd(FileLike* _out)
 	_out->Write(Checkpoint("FrameCommandsEnd"));
 	_out->Write(Checkpoint("TraceCapturingEnd"));
 	gIsRecording = false;
+	if (gIdleHooks) {
+		gIsTracking = false;
+	}
+
+	// eztrace is waiting on the end of the capture, don't leave it sitting in the ring.
+	_out->Flush();
+	gMessageStream->FlushSendBuffer();
+	gMessageStream = gCaptureStateWriter->EndCapture();
+
+	// Once the process starts exiting, the direct capture's writer can't be counted on to finish.
+	if (gDirectCapture) {
+		gDirectCapture->OnCaptureEnd();
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -1469,20 +1533,51 @@ BOOL APIENTRY hooked_SwapBuffers(HDC hdc)
 {
 	assert(gMessageStream != 0);
 
+	// Everything recorded this frame has to be out before the frame ends, and nothing recorded after 
+	// can go out until we're done with the stream.
+	CommandStreamLock streamLock(gCommandRecorder);
+
+	// Whichever context is presenting is the one that gets captured--but a capture sticks with the 
+	// context it started from, its commands are relative to that. The flight recorder never stops 
+	// recording, and starts over from whichever context is presenting at each keyframe.
+	gContextRegistry->OnSwapBuffers(gIsRecording && !gFlightRecorder);
+
+	if (gShadowBudget) {
+		gShadowBudget->OnFrame();
+	}
+
+	// The flight recorder is always recording, and nobody sends it commands.
+	if (gFlightRecorder) {
+		gFlightRecorder->OnSwapBuffers(hdc);
+		return gReal_SwapBuffers(hdc);
+	}
+
 	// TODO: This should go into a global or something.
 	FileLike likeSocket(gMessageStream);
 	
 	if (gIsRecording) {
+		gCommandRecorder->MakeStreamCurrent(&likeSocket, gContextState);
+
+		--gCaptureFramesLeft;
+		if (gCaptureFramesLeft > 0) {
+			// Keep going. The SwapBuffers is what separates this frame from the next one in the trace.
+			SSerializeDataPacket::SwapBuffers(hdc).Write(&likeSocket);
+			return gReal_SwapBuffers(hdc);
+		}
+
 		SSerializeDataPacket::glFinish().Write(&likeSocket);
 
 		OnCaptureEnd(&likeSocket);
 	}
 
+	// When capturing directly to disk there's nobody to send us commands.
 	RemoteCommand rc;
-	if (gMessageStream->Recv(&rc, sizeof(rc))) {
+	bool haveCommand = gDirectCapture ? gDirectCapture->PollCommand(&rc) 
+	                                  : gMessageStream->Recv(&rc, sizeof(rc));
+	if (haveCommand) {
 		switch (rc.mRemoteCommandType) {
 		case ERC_Capture: 
-			OnCaptureStart(&likeSocket);
+			gPendingCapture = rc;
 			break;
 		case ERC_Terminate:
 			PostQuitMessage(0);
@@ -1492,38 +1587,104 @@ BOOL APIENTRY hooked_SwapBuffers(HDC hdc)
 		};
 	}
 
+	if (gPendingCapture.mRemoteCommandType == ERC_Capture) {
+		if (OnCaptureStart(gPendingCapture.mBaseGeneration, gPendingCapture.mBaseContext)) {
+			gCaptureFramesLeft = max(1u, gPendingCapture.mFrameCount);
+			gPendingCapture = RemoteCommand();
+		} else if (haveCommand && rc.mRemoteCommandType == ERC_Capture) {
+			LogWarn(TC("There's no GL context to capture yet, the capture will start once there is."));
+		}
+	}
+
 	return gReal_SwapBuffers(hdc);
 }
 
 // ------------------------------------------------------------------------------------------------
 void APIENTRY hooked_glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length)
 {
-	if (gIsRecording)
-		SSerializeDataPacket::glFlushMappedBufferRange(target, offset, length).Write(&FileLike(gMessageStream));
-	gContextState->glFlushMappedBufferRange(target, offset, length);
+	ContextState* contextState = gIsTracking ? gContextRegistry->GetCurrent() : NULL;
+	if (!contextState) {
+		gReal_glFlushMappedBufferRange(target, offset, length);
+		return;
+	}
+
+	if (gIsRecording && contextState->SharesObjectsWith(gContextState))
+		gCommandRecorder->Record(contextState, SSerializeDataPacket::glFlushMappedBufferRange(target, offset, length));
+	contextState->glFlushMappedBufferRange(target, offset, length);
 
 	// Call the real function after we've updated the buffer contents.
 	gReal_glFlushMappedBufferRange(target, offset, length);
 }
 
+// ------------------------------------------------------------------------------------------------
+GLenum APIENTRY hooked_glGetError()
+{
+	// Reading the state back from the driver set aside the errors that were waiting for the 
+	// application. They come first.
+	ContextState* current = gContextRegistry->GetCurrent();
+	GLenum retVal = GL_NO_ERROR;
+	if (!current || !current->PopPendingError(&retVal)) {
+		retVal = gReal_glGetError();
+	}
+
+	ContextState* contextState = gIsTracking ? current : NULL;
+	if (!contextState)
+		return retVal;
+
+	if (gIsRecording && contextState->SharesObjectsWith(gContextState))
+		gCommandRecorder->Record(contextState, SSerializeDataPacket::glGetError());
+	return retVal;
+}
+
 // ------------------------------------------------------------------------------------------------
 GLvoid* APIENTRY hooked_glMapBufferARB(GLenum target, GLenum access)
 {
 	auto retVal = gReal_glMapBufferARB(target, access);
-	if (gIsRecording)
-		SSerializeDataPacket::glMapBufferARB(target, access).Write(&FileLike(gMessageStream));
+	ContextState* contextState = gIsTracking ? gContextRegistry->GetCurrent() : NULL;
+	if (!contextState)
+		return retVal;
+
+	if (gIsRecording && contextState->SharesObjectsWith(gContextState))
+		gCommandRecorder->Record(contextState, SSerializeDataPacket::glMapBufferARB(target, access));
 	
-	return gContextState->glMapBufferARB(retVal, target, access);
+	return contextState->glMapBufferARB(retVal, target, access);
 }
 
 // ------------------------------------------------------------------------------------------------
 GLvoid* APIENTRY hooked_glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
 {
 	auto retVal = gReal_glMapBufferRange(target, offset, length, access);
-	if (gIsRecording)
-		SSerializeDataPacket::glMapBufferRange(target, offset, length, access).Write(&FileLike(gMessageStream));
+	ContextState* contextState = gIsTracking ? gContextRegistry->GetCurrent() : NULL;
+	if (!contextState)
+		return retVal;
+
+	if (gIsRecording && contextState->SharesObjectsWith(gContextState))
+		gCommandRecorder->Record(contextState, SSerializeDataPacket::glMapBufferRange(target, offset, length, access));
+
+	return contextState->glMapBufferRange(retVal, target, offset, length, access);
+}
 
-	return gContextState->glMapBufferRange(retVal, target, offset, length, access);
+// ------------------------------------------------------------------------------------------------
+// Replaying a map doesn't bring back anything written through it, so what changed goes out as 
+// glBufferSubData after the unmap. Taken either way, so it doesn't pile up between captures.
+static void RecordMappedWrites(ContextState* _contextState, GLenum _target, bool _record)
+{
+	std::vector<ByteRun> runs;
+	SharedObjectsLock lock(_contextState->GetSharedObjects());
+	GLBuffer* glBuffer = _contextState->GetBoundBuffer(_target);
+	if (!glBuffer) {
+		return;
+	}
+
+	glBuffer->TakeWrittenRuns(&runs);
+	if (!_record) {
+		return;
+	}
+
+	const GLubyte* contents = (const GLubyte*)glBuffer->GetContents();
+	for (auto it = runs.cbegin(); it != runs.cend(); ++it) {
+		gCommandRecorder->Record(_contextState, SSerializeDataPacket::glBufferSubData(_target, it->mOffset, it->mLength, contents + it->mOffset));
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -1531,10 +1692,18 @@ GLboolean APIENTRY hooked_glUnmapBuffer(GLenum buffer)
 {
 	// This is manual because during unmap we have to call the state-tracking version first to let 
 	// it have a crack at updating buffers.
-	if (gIsRecording)
-		SSerializeDataPacket::glUnmapBuffer(buffer).Write(&FileLike(gMessageStream));
-	gContextState->glUnmapBuffer(true, buffer);
-	return gReal_glUnmapBuffer(buffer);
+	ContextState* contextState = gIsTracking ? gContextRegistry->GetCurrent() : NULL;
+	if (!contextState)
+		return gReal_glUnmapBuffer(buffer);
+
+	bool record = gIsRecording && contextState->SharesObjectsWith(gContextState);
+	if (record)
+		gCommandRecorder->Record(contextState, SSerializeDataPacket::glUnmapBuffer(buffer));
+	contextState->glUnmapBuffer(true, buffer);
+	GLboolean retVal = gReal_glUnmapBuffer(buffer);
+
+	RecordMappedWrites(contextState, buffer, record);
+	return retVal;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -1549,10 +1718,44 @@ BOOL APIENTRY hooked_wglMakeCurrent(HDC hdc, HGLRC hglrc)
 		gFirstMakeCurrent = false;
 	}
 
-	if (hglrc != NULL && retVal) {
-		gContextState->SetOwnerThreadId(GetCurrentThreadId());
-	} else {
-		gContextState->SetOwnerThreadId(0);
+	// A failed wglMakeCurrent leaves nothing current on this thread.
+	gContextRegistry->OnMakeCurrent(hdc, retVal ? hglrc : NULL);
+
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+HGLRC APIENTRY hooked_wglCreateContextAttribsARB(HDC hDC, HGLRC hShareContext, const int* attribList)
+{
+	HGLRC retVal = gReal_wglCreateContextAttribsARB(hDC, hShareContext, attribList);
+
+	if (retVal && hShareContext) {
+		gContextRegistry->OnShareLists(hShareContext, retVal);
+	}
+
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+BOOL APIENTRY hooked_wglDeleteContext(HGLRC hglrc)
+{
+	BOOL retVal = gReal_wglDeleteContext(hglrc);
+
+	if (retVal) {
+		gContextRegistry->OnDeleteContext(hglrc);
+	}
+
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+BOOL APIENTRY hooked_wglShareLists(HGLRC hglrc1, HGLRC hglrc2)
+{
+	BOOL retVal = gReal_wglShareLists(hglrc1, hglrc2);
+
+	// hglrc2 gets hglrc1's objects.
+	if (retVal) {
+		gContextRegistry->OnShareLists(hglrc1, hglrc2);
 	}
 
 	return retVal;
@@ -1561,75 +1764,276 @@ BOOL APIENTRY hooked_wglMakeCurrent(HDC hdc, HGLRC hglrc)
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
-void ContextState::OnCaptureStart()
+ContextState* ContextState::OnCaptureStart()
+{
+	// Other contexts sharing our objects mustn't change them between the copy and closing the generation,
+	// or the change wouldn't be in this capture or the next.
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	// The manual state first: some of the generated state works out how big its pointers are from it.
+	ContextState* snapshot = new ContextState;
+	snapshot->ManualCopy(*this);
+	snapshot->CopyCurrentState(*this);
+
+	// Whatever happens from here on is after the capture.
+	mData_SharedObjects->mObjectGenerations.OnCaptured();
+	return snapshot;
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextState::WriteCaptureState(FileLike* _out, unsigned int _baseGeneration, unsigned __int64 _baseContext) const
+{
+	// The other end can only apply a delta to what we sent it last time. Otherwise, send everything.
+	// Generations are counted per share group, so what it has may well be another context's.
+	unsigned __int64 context = (unsigned __int64)mData_Context;
+	if (_baseContext != context || _baseGeneration != mData_SharedObjects->mObjectGenerations.GetLastCaptureGeneration()) {
+		_baseGeneration = 0;
+	}
+
+	_out->Write(_baseGeneration);
+	_out->Write(mData_SharedObjects->mObjectGenerations.GetGeneration());
+	_out->Write(context);
+	if (_baseGeneration != 0) {
+		WriteDelta(_out, _baseGeneration);
+	} else {
+		Write(_out);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+bool ContextState::PopPendingError(GLenum* _outError)
 {
-	// Nothing here atm.
+	if (mData_PendingErrors.empty()) {
+		return false;
+	}
+
+	(*_outError) = mData_PendingErrors.front();
+	mData_PendingErrors.erase(mData_PendingErrors.begin());
+	return true;
 }
 
 // ------------------------------------------------------------------------------------------------
-void ContextState::SetOwnerThreadId(DWORD _threadId)
+void ContextState::SetContext(HDC _hdc, HGLRC _hglrc)
 {
-	// If trying to debug MakeCurrent bugs, uncomment this.
-	// assert(((_threadId == 0) != (mData_OwnerThread == 0)) || mData_OwnerThread == _threadId);
-	mData_OwnerThread = _threadId;
+	mData_Context = _hglrc;
+	mData_DeviceContext = _hdc;
 }
 
 // ------------------------------------------------------------------------------------------------
-bool ContextState::CheckOwnerThreadId() const
+void ContextState::ShareObjectsWith(ContextState* _other)
 {
-	DWORD curThreadId = GetCurrentThreadId();
-	return mData_OwnerThread == curThreadId;
+	if (_other->mData_SharedObjects == mData_SharedObjects) {
+		return;
+	}
+
+	_other->mData_SharedObjects->AddRef();
+	mData_SharedObjects->Release();
+	mData_SharedObjects = _other->mData_SharedObjects;
 }
 
+// ------------------------------------------------------------------------------------------------
+GLBuffer* ContextState::GetBoundBuffer(GLenum _target) const
+{
+	auto bindIt = mData_BufferBindings.find(_target);
+	if (bindIt == mData_BufferBindings.end() || bindIt->second == 0) { 
+		return NULL;
+	}
+
+	auto buffIt = mData_SharedObjects->mBufferObjects.find(bindIt->second);
+	return buffIt != mData_SharedObjects->mBufferObjects.end() ? buffIt->second : NULL;
+}
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::ManualConstruct()
 {
 	// @TODO: Create default textures, stick them in each of the 0 slots.
-	mData_OwnerThread = 0;
+	mData_Context = NULL;
+	mData_DeviceContext = NULL;
+
+	// Until somebody shares lists with us, our objects are our own.
+	mData_SharedObjects = new GLSharedObjects;
 
 	mData_DrawBuffer = GL_NONE;
 	mData_ReadBuffer = GL_NONE;
 }
 
 // ------------------------------------------------------------------------------------------------
-void ContextState::ManualDestruct()
+template <typename T>
+static void DeleteObjects(std::map<GLuint, T*>* _objects)
 {
-	for (auto it = mData_TextureObjects.begin(); it != mData_TextureObjects.end(); ++it) {
+	for (auto it = _objects->begin(); it != _objects->end(); ++it) {
 		SafeDelete(it->second);
 	}
-	mData_TextureObjects.clear();
+	_objects->clear();
+}
+
+// ------------------------------------------------------------------------------------------------
+template <typename T>
+static void CopyObjects(std::map<GLuint, T*>* _dst, const std::map<GLuint, T*>& _src)
+{
+	for (auto it = _src.cbegin(); it != _src.cend(); ++it) {
+		(*_dst)[it->first] = it->second ? new T(*(it->second)) : NULL;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextState::ManualDestruct()
+{
+	// Capture snapshots come and go, so everything they hold has to go with them.
+	DeleteObjects(&mData_FrameBufferObjects);
+	mData_SharedObjects->Release();
+	mData_SharedObjects = NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextState::ManualCopy(const ContextState& _src)
+{
+	// A copy is of the same context, but it's never current anywhere, so nobody makes calls on it. It 
+	// gets objects of its own.
+	mData_Context = _src.mData_Context;
+	mData_DeviceContext = _src.mData_DeviceContext;
+	{
+		SharedObjectsLock lock(_src.mData_SharedObjects);
+		mData_SharedObjects->CopyFrom(*_src.mData_SharedObjects);
+	}
+	mData_TextureUnits = _src.mData_TextureUnits;
+	mData_PixelStoreState = _src.mData_PixelStoreState;
+	mData_PixelTransferState = _src.mData_PixelTransferState;
+	mData_BufferBindings = _src.mData_BufferBindings;
+	mData_ProgramBindingsARB = _src.mData_ProgramBindingsARB;
+	mData_EnableCap = _src.mData_EnableCap;
+	mData_TextureEnableCap = _src.mData_TextureEnableCap;
+	mData_FrameBufferBindings = _src.mData_FrameBufferBindings;
+	CopyObjects(&mData_FrameBufferObjects, _src.mData_FrameBufferObjects);
+	mData_RenderBufferBindings = _src.mData_RenderBufferBindings;
+	mData_ClipPlaneEquations = _src.mData_ClipPlaneEquations;
+	mData_DrawBuffer = _src.mData_DrawBuffer;
+	mData_ReadBuffer = _src.mData_ReadBuffer;
+	mData_SamplerBindings = _src.mData_SamplerBindings;
+	mData_VertexAttribEnabled = _src.mData_VertexAttribEnabled;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+GLSharedObjects::GLSharedObjects()
+: mRefCount(1)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+GLSharedObjects::~GLSharedObjects()
+{
+	Clear();
+	DeleteCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLSharedObjects::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLSharedObjects::Clear()
+{
+	DeleteObjects(&mTextureObjects);
+	DeleteObjects(&mBufferObjects);
+	DeleteObjects(&mProgramObjectsGLSL);
+	DeleteObjects(&mShaderObjectsGLSL);
+	DeleteObjects(&mProgramObjectsARB);
+	DeleteObjects(&mRenderBufferObjects);
+	DeleteObjects(&mSamplerObjects);
+	mObjectGenerations = GLObjectGenerations();
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLSharedObjects::PinPayloads() const
+{
+	for (auto it = mTextureObjects.cbegin(); it != mTextureObjects.cend(); ++it) {
+		if (it->second) {
+			it->second->PinPayloads();
+		}
+	}
+
+	for (auto it = mBufferObjects.cbegin(); it != mBufferObjects.cend(); ++it) {
+		if (it->second) {
+			it->second->PinPayloads();
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLSharedObjects::UnpinPayloads() const
+{
+	for (auto it = mTextureObjects.cbegin(); it != mTextureObjects.cend(); ++it) {
+		if (it->second) {
+			it->second->UnpinPayloads();
+		}
+	}
+
+	for (auto it = mBufferObjects.cbegin(); it != mBufferObjects.cend(); ++it) {
+		if (it->second) {
+			it->second->UnpinPayloads();
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLSharedObjects::CopyFrom(const GLSharedObjects& _src)
+{
+	CopyObjects(&mTextureObjects, _src.mTextureObjects);
+	CopyObjects(&mBufferObjects, _src.mBufferObjects);
+	CopyObjects(&mProgramObjectsGLSL, _src.mProgramObjectsGLSL);
+	CopyObjects(&mShaderObjectsGLSL, _src.mShaderObjectsGLSL);
+	CopyObjects(&mProgramObjectsARB, _src.mProgramObjectsARB);
+	CopyObjects(&mRenderBufferObjects, _src.mRenderBufferObjects);
+	CopyObjects(&mSamplerObjects, _src.mSamplerObjects);
+	mObjectGenerations = _src.mObjectGenerations;
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::ManualWrite(FileLike* _out) const
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	_out->Write(Checkpoint("ContextStateBegin"));
 
+	// Commands in the trace say which context they're on by this (see CommandRecorder).
+	_out->WriteRaw(&mData_Context, sizeof(mData_Context));
+
+	_out->MarkSection(ETS_Textures);
 	_out->Write(Checkpoint("TexturesBegin"));
-	_out->Write(mData_TextureObjects);
+	_out->Write(mData_SharedObjects->mTextureObjects);
 	_out->Write(mData_TextureUnits);
 	_out->Write(Checkpoint("TexturesEnd"));
 
 	_out->Write(mData_PixelStoreState);
 	_out->Write(mData_PixelTransferState);
 
+	_out->MarkSection(ETS_Buffers);
 	_out->Write(Checkpoint("BuffersBegin"));
-	_out->Write(mData_BufferObjects);
+	_out->Write(mData_SharedObjects->mBufferObjects);
 	_out->Write(mData_BufferBindings);
 	_out->Write(Checkpoint("BuffersEnd"));
 
+	_out->MarkSection(ETS_Shaders);
 	_out->Write(Checkpoint("ShadersBegin"));
-	_out->Write(mData_ShaderObjectsGLSL);
+	_out->Write(mData_SharedObjects->mShaderObjectsGLSL);
 	_out->Write(Checkpoint("ShadersEnd"));
 
+	_out->MarkSection(ETS_Programs);
 	_out->Write(Checkpoint("ProgramsBegin"));
-	_out->Write(mData_ProgramObjectsGLSL);
+	_out->Write(mData_SharedObjects->mProgramObjectsGLSL);
 	_out->Write(Checkpoint("ProgramsEnd"));
 
+	_out->MarkSection(ETS_ProgramsARB);
 	_out->Write(Checkpoint("ProgramsARBBegin"));
 	_out->Write(mData_ProgramBindingsARB);
-	_out->Write(mData_ProgramObjectsARB);
+	_out->Write(mData_SharedObjects->mProgramObjectsARB);
 	_out->Write(Checkpoint("ProgramsARBEnd"));
 
 	_out->Write(Checkpoint("EnableCapsBegin"));
@@ -1637,10 +2041,11 @@ void ContextState::ManualWrite(FileLike* _out) const
 	_out->Write(mData_TextureEnableCap);
 	_out->Write(Checkpoint("EnableCapsEnd"));
 
+	_out->MarkSection(ETS_FramebufferObjects);
 	_out->Write(Checkpoint("FramebufferObjectsBegin"));
 	_out->Write(mData_FrameBufferObjects);
 	_out->Write(mData_FrameBufferBindings);
-	_out->Write(mData_RenderBufferObjects);
+	_out->Write(mData_SharedObjects->mRenderBufferObjects);
 	_out->Write(mData_RenderBufferBindings);
 	_out->Write(Checkpoint("FramebufferObjectsEnd"));
 
@@ -1649,7 +2054,7 @@ void ContextState::ManualWrite(FileLike* _out) const
 	_out->Write(mData_DrawBuffer);
 	_out->Write(mData_ReadBuffer);
 
-	_out->Write(mData_SamplerObjects);
+	_out->Write(mData_SharedObjects->mSamplerObjects);
 	_out->Write(mData_SamplerBindings);
 
 	_out->Write(mData_VertexAttribEnabled);
@@ -1662,8 +2067,10 @@ void ContextState::ManualRead(FileLike* _in)
 {
 	_in->Read(Checkpoint("ContextStateBegin"));
 
+	_in->ReadRaw(&mData_Context, sizeof(mData_Context));
+
 	_in->Read(Checkpoint("TexturesBegin"));
-	_in->Read(&mData_TextureObjects);
+	_in->Read(&mData_SharedObjects->mTextureObjects);
 	_in->Read(&mData_TextureUnits);
 	_in->Read(Checkpoint("TexturesEnd"));
 
@@ -1671,21 +2078,21 @@ void ContextState::ManualRead(FileLike* _in)
 	_in->Read(&mData_PixelTransferState);
 
 	_in->Read(Checkpoint("BuffersBegin"));
-	_in->Read(&mData_BufferObjects);
+	_in->Read(&mData_SharedObjects->mBufferObjects);
 	_in->Read(&mData_BufferBindings);
 	_in->Read(Checkpoint("BuffersEnd"));
 
 	_in->Read(Checkpoint("ShadersBegin"));
-	_in->Read(&mData_ShaderObjectsGLSL);
+	_in->Read(&mData_SharedObjects->mShaderObjectsGLSL);
 	_in->Read(Checkpoint("ShadersEnd"));
 
 	_in->Read(Checkpoint("ProgramsBegin"));
-	_in->Read(&mData_ProgramObjectsGLSL);
+	_in->Read(&mData_SharedObjects->mProgramObjectsGLSL);
 	_in->Read(Checkpoint("ProgramsEnd"));
 
 	_in->Read(Checkpoint("ProgramsARBBegin"));
 	_in->Read(&mData_ProgramBindingsARB);
-	_in->Read(&mData_ProgramObjectsARB);
+	_in->Read(&mData_SharedObjects->mProgramObjectsARB);
 	_in->Read(Checkpoint("ProgramsARBEnd"));
 
 	_in->Read(Checkpoint("EnableCapsBegin"));
@@ -1696,7 +2103,7 @@ void ContextState::ManualRead(FileLike* _in)
 	_in->Read(Checkpoint("FramebufferObjectsBegin"));
 	_in->Read(&mData_FrameBufferObjects);
 	_in->Read(&mData_FrameBufferBindings);
-	_in->Read(&mData_RenderBufferObjects);
+	_in->Read(&mData_SharedObjects->mRenderBufferObjects);
 	_in->Read(&mData_RenderBufferBindings);
 	_in->Read(Checkpoint("FramebufferObjectsEnd"));
 
@@ -1705,7 +2112,7 @@ void ContextState::ManualRead(FileLike* _in)
 	_in->Read(&mData_DrawBuffer);
 	_in->Read(&mData_ReadBuffer);
 
-	_in->Read(&mData_SamplerObjects);
+	_in->Read(&mData_SharedObjects->mSamplerObjects);
 	_in->Read(&mData_SamplerBindings);
 
 	_in->Read(&mData_VertexAttribEnabled);
@@ -1713,6 +2120,108 @@ void ContextState::ManualRead(FileLike* _in)
 	_in->Read(Checkpoint("ContextStateEnd"));
 }
 
+// ------------------------------------------------------------------------------------------------
+void ContextState::ManualWriteDelta(FileLike* _out, unsigned int _sinceGeneration) const
+{
+	// Same order as ManualWrite. Objects are the bulk of the state, everything else is small enough to 
+	// just send again.
+	SharedObjectsLock lock(mData_SharedObjects);
+	const GLObjectGenerations& gens = mData_SharedObjects->mObjectGenerations;
+
+	_out->Write(Checkpoint("ContextStateDeltaBegin"));
+
+	_out->WriteRaw(&mData_Context, sizeof(mData_Context));
+
+	gens.WriteChanged(_out, ESOT_Texture, mData_SharedObjects->mTextureObjects, _sinceGeneration);
+	_out->Write(mData_TextureUnits);
+
+	_out->Write(mData_PixelStoreState);
+	_out->Write(mData_PixelTransferState);
+
+	gens.WriteChanged(_out, ESOT_Buffer, mData_SharedObjects->mBufferObjects, _sinceGeneration);
+	_out->Write(mData_BufferBindings);
+
+	gens.WriteChanged(_out, ESOT_ShaderGLSL, mData_SharedObjects->mShaderObjectsGLSL, _sinceGeneration);
+	gens.WriteChanged(_out, ESOT_ProgramGLSL, mData_SharedObjects->mProgramObjectsGLSL, _sinceGeneration);
+
+	_out->Write(mData_ProgramBindingsARB);
+	gens.WriteChanged(_out, ESOT_ProgramARB, mData_SharedObjects->mProgramObjectsARB, _sinceGeneration);
+
+	_out->Write(mData_EnableCap);
+	_out->Write(mData_TextureEnableCap);
+
+	gens.WriteChanged(_out, ESOT_FrameBufferObject, mData_FrameBufferObjects, _sinceGeneration);
+	_out->Write(mData_FrameBufferBindings);
+	gens.WriteChanged(_out, ESOT_RenderBufferObject, mData_SharedObjects->mRenderBufferObjects, _sinceGeneration);
+	_out->Write(mData_RenderBufferBindings);
+
+	_out->Write(mData_ClipPlaneEquations);
+
+	_out->Write(mData_DrawBuffer);
+	_out->Write(mData_ReadBuffer);
+
+	gens.WriteChanged(_out, ESOT_Sampler, mData_SharedObjects->mSamplerObjects, _sinceGeneration);
+	_out->Write(mData_SamplerBindings);
+
+	_out->Write(mData_VertexAttribEnabled);
+
+	_out->Write(Checkpoint("ContextStateDeltaEnd"));
+}
+
+// ------------------------------------------------------------------------------------------------
+void ContextState::ManualReadDelta(FileLike* _in)
+{
+	// Reading a map adds to what's there, so the ones that are sent whole have to be emptied first.
+	_in->Read(Checkpoint("ContextStateDeltaBegin"));
+
+	_in->ReadRaw(&mData_Context, sizeof(mData_Context));
+
+	GLObjectGenerations::ReadChanged(_in, &mData_SharedObjects->mTextureObjects);
+	mData_TextureUnits.clear();
+	_in->Read(&mData_TextureUnits);
+
+	_in->Read(&mData_PixelStoreState);
+	_in->Read(&mData_PixelTransferState);
+
+	GLObjectGenerations::ReadChanged(_in, &mData_SharedObjects->mBufferObjects);
+	mData_BufferBindings.clear();
+	_in->Read(&mData_BufferBindings);
+
+	GLObjectGenerations::ReadChanged(_in, &mData_SharedObjects->mShaderObjectsGLSL);
+	GLObjectGenerations::ReadChanged(_in, &mData_SharedObjects->mProgramObjectsGLSL);
+
+	mData_ProgramBindingsARB.clear();
+	_in->Read(&mData_ProgramBindingsARB);
+	GLObjectGenerations::ReadChanged(_in, &mData_SharedObjects->mProgramObjectsARB);
+
+	mData_EnableCap.clear();
+	_in->Read(&mData_EnableCap);
+	mData_TextureEnableCap.clear();
+	_in->Read(&mData_TextureEnableCap);
+
+	GLObjectGenerations::ReadChanged(_in, &mData_FrameBufferObjects);
+	mData_FrameBufferBindings.clear();
+	_in->Read(&mData_FrameBufferBindings);
+	GLObjectGenerations::ReadChanged(_in, &mData_SharedObjects->mRenderBufferObjects);
+	mData_RenderBufferBindings.clear();
+	_in->Read(&mData_RenderBufferBindings);
+
+	mData_ClipPlaneEquations.clear();
+	_in->Read(&mData_ClipPlaneEquations);
+
+	_in->Read(&mData_DrawBuffer);
+	_in->Read(&mData_ReadBuffer);
+
+	GLObjectGenerations::ReadChanged(_in, &mData_SharedObjects->mSamplerObjects);
+	mData_SamplerBindings.clear();
+	_in->Read(&mData_SamplerBindings);
+
+	mData_VertexAttribEnabled.clear();
+	_in->Read(&mData_VertexAttribEnabled);
+
+	_in->Read(Checkpoint("ContextStateDeltaEnd"));
+}
+
 // ------------------------------------------------------------------------------------------------
 void ContextState::ManualPreRestore()
 {
@@ -1770,29 +2279,36 @@ void ContextState::ManualRestore()
 // ------------------------------------------------------------------------------------------------
 void ContextState::glAttachShader(GLuint program, GLuint shader)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		return;
 	}
 
 	progIt->second->glAttachShader(program, shader);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, progIt->first);
 
-	auto shadIt = mData_ShaderObjectsGLSL.find(shader);
-	if (shadIt != mData_ShaderObjectsGLSL.end() && shadIt->second != NULL) {
+	auto shadIt = mData_SharedObjects->mShaderObjectsGLSL.find(shader);
+	if (shadIt != mData_SharedObjects->mShaderObjectsGLSL.end() && shadIt->second != NULL) {
 		shadIt->second->OnShaderAttach();
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ShaderGLSL, shadIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBindTexture(GLenum target, GLuint texture)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (texture != 0) {
-		auto texIt = mData_TextureObjects.find(texture);
-		if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+		auto texIt = mData_SharedObjects->mTextureObjects.find(texture);
+		if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 			texIt->second->glBindTexture(target, texture);
 		} else {
-			mData_TextureObjects[texture] = new GLTexture(target);
+			mData_SharedObjects->mTextureObjects[texture] = new GLTexture(target);
 		}
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texture);
 	}
 
 	mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, target)] = texture;
@@ -1801,39 +2317,48 @@ void ContextState::glBindTexture(GLenum target, GLuint texture)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imagesize, const GLvoid* data)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	GLenum bindTarget = TexImage2DTargetToBoundTarget(target);
 
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, bindTarget)];
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glCompressedTexImage2D(this, target, level, internalformat, width, height, border, imagesize, data);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glCompressedTexImage3D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imagesize, const GLvoid* data)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, target)];
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glCompressedTexImage3D(this, target, level, internalformat, width, height, depth, border, imagesize, data);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDeleteShader(GLuint shader)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (shader == 0) {
 		return;
 	}
 
-	auto shadIt = mData_ShaderObjectsGLSL.find(shader);
-	if (shadIt != mData_ShaderObjectsGLSL.end() && shadIt->second != NULL) {
+	auto shadIt = mData_SharedObjects->mShaderObjectsGLSL.find(shader);
+	if (shadIt != mData_SharedObjects->mShaderObjectsGLSL.end() && shadIt->second != NULL) {
 		shadIt->second->glDeleteShader(shader);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ShaderGLSL, shadIt->first);
 		if (shadIt->second->GetAttachCount() == 0) {
 			// Delete it.
 			GLShader* deadShader = shadIt->second;
-			mData_ShaderObjectsGLSL.erase(shadIt);
+			mData_SharedObjects->mShaderObjectsGLSL.erase(shadIt);
 			SafeDelete(deadShader);		
 		}
 	}
@@ -1842,6 +2367,8 @@ void ContextState::glDeleteShader(GLuint shader)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDeleteTextures(GLsizei n, const GLuint* textures)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	// Spec says that textures that are deleted while bound are replaced by the default texture, do that here.
 	for (auto it = mData_TextureUnits.begin(); it != mData_TextureUnits.end(); ++it) {
 		for (int i = 0; i < n; ++i) {
@@ -1855,10 +2382,11 @@ void ContextState::glDeleteTextures(GLsizei n, const GLuint* textures)
 
 	// Then, remove the name.
 	for (int i = 0; i < n; ++i) {
-		auto texIt = mData_TextureObjects.find(textures[i]);
-		if (texIt != mData_TextureObjects.end()) {
+		auto texIt = mData_SharedObjects->mTextureObjects.find(textures[i]);
+		if (texIt != mData_SharedObjects->mTextureObjects.end()) {
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 			SafeDelete(texIt->second);
-			mData_TextureObjects.erase(texIt);
+			mData_SharedObjects->mTextureObjects.erase(texIt);
 		}
 	}
 }
@@ -1910,16 +2438,22 @@ void ContextState::glEnable(GLenum cap)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glGenBuffersARB(GLsizei n, GLuint *buffers)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (GLsizei i = 0; i < n; ++i) {
-		mData_BufferObjects[buffers[i]] = new GLBuffer;
+		mData_SharedObjects->mBufferObjects[buffers[i]] = new GLBuffer;
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffers[i]);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glGenTextures(GLsizei n, GLuint *textures)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (GLsizei i = 0; i < n; ++i) {
-		mData_TextureObjects[textures[i]] = new GLTexture;
+		mData_SharedObjects->mTextureObjects[textures[i]] = new GLTexture;
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, textures[i]);
 	}
 }
 
@@ -1950,117 +2484,147 @@ void ContextState::glPixelTransferi(GLenum pname, GLint param)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glProgramStringARB(GLenum target, GLenum format, GLsizei len, const GLvoid* string)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto bindIt = mData_ProgramBindingsARB.find(target);
 	if (bindIt == mData_ProgramBindingsARB.end()) {
 		return;
 	}
 
-	auto progARBIt = mData_ProgramObjectsARB.find(bindIt->second);
-	if (progARBIt == mData_ProgramObjectsARB.end() || progARBIt->second == NULL) {
+	auto progARBIt = mData_SharedObjects->mProgramObjectsARB.find(bindIt->second);
+	if (progARBIt == mData_SharedObjects->mProgramObjectsARB.end() || progARBIt->second == NULL) {
 		return;
 	}
 	
 	progARBIt->second->glProgramStringARB(target, format, len, string);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramARB, progARBIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid* pixels)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	GLenum bindTarget = TexImage2DTargetToBoundTarget(target);
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, bindTarget)];
 
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glTexImage2D(this, target, level, internalformat, width, height, border, format, type, pixels);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid* data)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, target)];
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glTexImage3D(this, target, level, internalFormat, width, height, depth, border, format, type, data);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glTexParameterf(GLenum target, GLenum pname, GLfloat param)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, target)];
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glTexParameterf(pname, param);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glTexParameterfv(GLenum target, GLenum pname, const GLfloat* params)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, target)];
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glTexParameterfv(pname, params);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glTexParameteri(GLenum target, GLenum pname, GLint param)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, target)];
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glTexParameteri(pname, param);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glTexParameteriv(GLenum target, GLenum pname, const GLint* params)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, target)];
-	auto texIt = mData_TextureObjects.find(textureID);
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glTexParameteriv(pname, params);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid* pixels)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	GLenum bindTarget = TexImage2DTargetToBoundTarget(target);
 	
 	auto textureID = mData_TextureUnits[std::make_pair(mData_glActiveTexture.texture, bindTarget)];
-	auto texIt = mData_TextureObjects.find(textureID);
+	auto texIt = mData_SharedObjects->mTextureObjects.find(textureID);
 
-	if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+	if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 		texIt->second->glTexSubImage2D(this, target, level, xoffset, yoffset, width, height, format, type, pixels);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBindAttribLocation(GLuint program, GLuint index, const GLchar* name)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		return;
 	}
 
 	progIt->second->glBindAttribLocation(program, index, name);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, progIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBindBuffer(GLenum target, GLuint buffer)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (!IsValidTarget_glBindBuffer(target)) {
 		return;
 	}
 
 	if (buffer != 0) {
-		auto buffIt = mData_BufferObjects.find(buffer);
-		if (buffIt == mData_BufferObjects.end() || buffIt->second == NULL) {
+		auto buffIt = mData_SharedObjects->mBufferObjects.find(buffer);
+		if (buffIt == mData_SharedObjects->mBufferObjects.end() || buffIt->second == NULL) {
 			// TODO: Check and see if this texture is of the same type (or is currently typeless)
-			mData_BufferObjects[buffer] = new GLBuffer(target);
+			mData_SharedObjects->mBufferObjects[buffer] = new GLBuffer(target);
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffer);
 		}
 	}
 
@@ -2094,12 +2658,15 @@ void ContextState::glBindFramebuffer(GLenum target, GLuint framebuffer)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBindMultiTextureEXT(GLenum texunit, GLenum target, GLuint texture)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (texture != 0) {
-		auto texIt = mData_TextureObjects.find(texture);
-		if (texIt != mData_TextureObjects.end() && texIt->second != NULL) {
+		auto texIt = mData_SharedObjects->mTextureObjects.find(texture);
+		if (texIt != mData_SharedObjects->mTextureObjects.end() && texIt->second != NULL) {
 			// TODO: Check and see if this texture is of the same type (or is currently typeless)
 		} else {
-			mData_TextureObjects[texture] = new GLTexture(target);
+			mData_SharedObjects->mTextureObjects[texture] = new GLTexture(target);
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_Texture, texture);
 		}
 	}
 
@@ -2109,17 +2676,20 @@ void ContextState::glBindMultiTextureEXT(GLenum texunit, GLenum target, GLuint t
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBindProgramARB(GLenum target, GLuint program)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (!IsValidTarget_glBindProgramARB(target)) {
 		return;
 	}
 
 	if (program != 0) {
-		auto progArbIt = mData_ProgramObjectsARB.find(program);
-		if (progArbIt == mData_ProgramObjectsARB.end() || progArbIt->second == NULL) {
-			mData_ProgramObjectsARB[program] = new GLProgramARB(this, program, target);
-		} else if (!mData_ProgramObjectsARB[program]->CheckAndSetTarget(target)) {
+		auto progArbIt = mData_SharedObjects->mProgramObjectsARB.find(program);
+		if (progArbIt == mData_SharedObjects->mProgramObjectsARB.end() || progArbIt->second == NULL) {
+			mData_SharedObjects->mProgramObjectsARB[program] = new GLProgramARB(this, program, target);
+		} else if (!mData_SharedObjects->mProgramObjectsARB[program]->CheckAndSetTarget(target)) {
 			return;
 		}
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramARB, program);
 	}
 
 	mData_ProgramBindingsARB[target] = program;
@@ -2128,10 +2698,12 @@ void ContextState::glBindProgramARB(GLenum target, GLuint program)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBindRenderbuffer(GLenum target, GLuint renderbuffer)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	// Check validity
 	if (renderbuffer != 0) {
-		auto rbIt = mData_RenderBufferObjects.find(renderbuffer);
-		if (rbIt == mData_RenderBufferObjects.end() || rbIt->second == NULL) {
+		auto rbIt = mData_SharedObjects->mRenderBufferObjects.find(renderbuffer);
+		if (rbIt == mData_SharedObjects->mRenderBufferObjects.end() || rbIt->second == NULL) {
 			return;
 		}
 	}
@@ -2146,13 +2718,16 @@ void ContextState::glBindRenderbuffer(GLenum target, GLuint renderbuffer)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBindSampler(GLuint unit, GLuint sampler)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (sampler != 0) {
-		auto samplIt = mData_SamplerObjects.find(sampler);
-		if (samplIt == mData_SamplerObjects.end() || samplIt->second == NULL) {
+		auto samplIt = mData_SharedObjects->mSamplerObjects.find(sampler);
+		if (samplIt == mData_SharedObjects->mSamplerObjects.end() || samplIt->second == NULL) {
 			// Per the spec, needs to have been created with glGenSamplers first
 			return;
 		}
 		samplIt->second->glBindSampler(unit, sampler);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Sampler, samplIt->first);
 	}
 
 	mData_SamplerBindings[unit] = sampler;
@@ -2161,6 +2736,8 @@ void ContextState::glBindSampler(GLuint unit, GLuint sampler)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBufferData(GLenum target, GLsizeiptrARB size, const GLvoid* data, GLenum usage)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (!IsValidTarget_glBufferData(target)) {
 		// GL_INVALID_ENUM
 		return;
@@ -2182,18 +2759,21 @@ void ContextState::glBufferData(GLenum target, GLsizeiptrARB size, const GLvoid*
 		return;
 	}
 
-	auto buffIt = mData_BufferObjects.find(bindIt->second);
-	if (buffIt == mData_BufferObjects.end() || buffIt->second == NULL) {
+	auto buffIt = mData_SharedObjects->mBufferObjects.find(bindIt->second);
+	if (buffIt == mData_SharedObjects->mBufferObjects.end() || buffIt->second == NULL) {
 		TraceError(TC("glTrace Internal error with buffer (id: %d) bound at (target: %d)"), buffIt->first, target);
 		assert(0);
 	}
 
 	buffIt->second->glBufferData(target, size, data, usage);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (!IsValidTarget_glBufferSubData(target)) {
 		// GL_INVALID_ENUM
 		return;
@@ -2210,13 +2790,14 @@ void ContextState::glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr si
 		return;
 	}
 
-	auto buffIt = mData_BufferObjects.find(bindIt->second);
-	if (buffIt == mData_BufferObjects.end() || buffIt->second == NULL) {
+	auto buffIt = mData_SharedObjects->mBufferObjects.find(bindIt->second);
+	if (buffIt == mData_SharedObjects->mBufferObjects.end() || buffIt->second == NULL) {
 		TraceError(TC("glTrace Internal error with buffer (id: %d) bound at (target: %d)"), buffIt->first, target);
 		assert(0);
 	}
 
 	buffIt->second->glBufferSubData(target, offset, size, data);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -2228,35 +2809,44 @@ void ContextState::glClipPlane(GLenum plane, const GLdouble* equation)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glCompileShader(GLuint shader)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (shader == 0) {
 		return;
 	}
 
-	auto shadIt = mData_ShaderObjectsGLSL.find(shader);
-	if (shadIt != mData_ShaderObjectsGLSL.end() && shadIt->second != NULL) {
+	auto shadIt = mData_SharedObjects->mShaderObjectsGLSL.find(shader);
+	if (shadIt != mData_SharedObjects->mShaderObjectsGLSL.end() && shadIt->second != NULL) {
 		shadIt->second->glCompileShader(shader);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ShaderGLSL, shadIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 GLhandleARB ContextState::glCreateProgramObjectARB(GLhandleARB _retVal)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (_retVal == 0) {
 		return _retVal;
 	}
 
-	mData_ProgramObjectsGLSL[_retVal] = new GLProgram(this, _retVal);
+	mData_SharedObjects->mProgramObjectsGLSL[_retVal] = new GLProgram(this, _retVal);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, _retVal);
 	return _retVal;
 }
 
 // ------------------------------------------------------------------------------------------------
 GLhandleARB ContextState::glCreateShaderObjectARB(GLhandleARB _retVal, GLenum type)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (_retVal == 0) {
 		return _retVal;
 	}
 
-	mData_ShaderObjectsGLSL[_retVal] = new GLShader(type, _retVal);
+	mData_SharedObjects->mShaderObjectsGLSL[_retVal] = new GLShader(type, _retVal);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ShaderGLSL, _retVal);
 
 	return _retVal;
 }
@@ -2264,6 +2854,8 @@ GLhandleARB ContextState::glCreateShaderObjectARB(GLhandleARB _retVal, GLenum ty
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDeleteBuffersARB(GLsizei n, const GLuint* buffers)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	// First, unbind these buffers if they are bound.
 	for (auto it = mData_BufferBindings.begin(); it != mData_BufferBindings.end(); ++it) {
 		for (int i = 0; i < n; ++i) {
@@ -2281,10 +2873,11 @@ void ContextState::glDeleteBuffersARB(GLsizei n, const GLuint* buffers)
 			continue;
 		}
 
-		auto buffIt = mData_BufferObjects.find(buffers[i]);
-		if (buffIt != mData_BufferObjects.end()) {
+		auto buffIt = mData_SharedObjects->mBufferObjects.find(buffers[i]);
+		if (buffIt != mData_SharedObjects->mBufferObjects.end()) {
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffIt->first);
 			SafeDelete(buffIt->second);
-			mData_BufferObjects.erase(buffIt);
+			mData_SharedObjects->mBufferObjects.erase(buffIt);
 		}
 	}
 }
@@ -2292,6 +2885,8 @@ void ContextState::glDeleteBuffersARB(GLsizei n, const GLuint* buffers)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDeleteFramebuffers(GLsizei n,const GLuint* framebuffers)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (auto it = mData_FrameBufferBindings.begin(); it != mData_FrameBufferBindings.end(); ++it) {
 		for (int i = 0; i < n; ++i) {
 			if (it->second == framebuffers[i]) {
@@ -2307,6 +2902,7 @@ void ContextState::glDeleteFramebuffers(GLsizei n,const GLuint* framebuffers)
 		
 		auto fbIt = mData_FrameBufferObjects.find(framebuffers[i]);
 		if (fbIt != mData_FrameBufferObjects.end()) {
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, fbIt->first);
 			SafeDelete(fbIt->second);
 			mData_FrameBufferObjects.erase(fbIt);
 		}
@@ -2316,6 +2912,8 @@ void ContextState::glDeleteFramebuffers(GLsizei n,const GLuint* framebuffers)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDeleteRenderbuffers(GLsizei n,const GLuint* renderbuffers)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (auto it = mData_RenderBufferBindings.begin(); it != mData_RenderBufferBindings.end(); ++it) {
 		for (int i = 0; i < n; ++i) {
 			if (it->second == renderbuffers[i]) {
@@ -2338,6 +2936,7 @@ void ContextState::glDeleteRenderbuffers(GLsizei n,const GLuint* renderbuffers)
 		for (int i = 0; i < n; ++i) {
 			fbIt->second->OnDeleteRenderbufferObject(renderbuffers[i]);
 		}
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, fbIt->first);
 	}
 
 	for (int i = 0; i < n; ++i) {
@@ -2345,10 +2944,11 @@ void ContextState::glDeleteRenderbuffers(GLsizei n,const GLuint* renderbuffers)
 			continue;
 		}
 		
-		auto rbIt = mData_RenderBufferObjects.find(renderbuffers[i]);
-		if (rbIt != mData_RenderBufferObjects.end()) {
+		auto rbIt = mData_SharedObjects->mRenderBufferObjects.find(renderbuffers[i]);
+		if (rbIt != mData_SharedObjects->mRenderBufferObjects.end()) {
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_RenderBufferObject, rbIt->first);
 			SafeDelete(rbIt->second);
-			mData_RenderBufferObjects.erase(rbIt);
+			mData_SharedObjects->mRenderBufferObjects.erase(rbIt);
 		}
 	}
 }
@@ -2356,6 +2956,8 @@ void ContextState::glDeleteRenderbuffers(GLsizei n,const GLuint* renderbuffers)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDeleteProgramsARB(GLsizei n, const GLuint* programs)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	// First, unbind these programs if they are bound.
 	for (auto it = mData_ProgramBindingsARB.begin(); it != mData_ProgramBindingsARB.end(); ++it) {
 		for (int i = 0; i < n; ++i) {
@@ -2372,10 +2974,11 @@ void ContextState::glDeleteProgramsARB(GLsizei n, const GLuint* programs)
 			continue;
 		}
 
-		auto progARBIt = mData_ProgramObjectsARB.find(programs[i]);
-		if (progARBIt != mData_ProgramObjectsARB.end()) {
+		auto progARBIt = mData_SharedObjects->mProgramObjectsARB.find(programs[i]);
+		if (progARBIt != mData_SharedObjects->mProgramObjectsARB.end()) {
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramARB, progARBIt->first);
 			SafeDelete(progARBIt->second);
-			mData_ProgramObjectsARB.erase(progARBIt);
+			mData_SharedObjects->mProgramObjectsARB.erase(progARBIt);
 		}
 	}
 }
@@ -2383,6 +2986,8 @@ void ContextState::glDeleteProgramsARB(GLsizei n, const GLuint* programs)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDeleteSamplers(GLsizei n, const GLuint* samplers)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	// First, unbind these samplers if they are bound.
 	for (auto it = mData_SamplerBindings.begin(); it != mData_SamplerBindings.end(); ++it) {
 		for (int i = 0; i < n; ++i) {
@@ -2399,10 +3004,11 @@ void ContextState::glDeleteSamplers(GLsizei n, const GLuint* samplers)
 			continue;
 		}
 
-		auto samplIt = mData_SamplerObjects.find(samplers[i]);
-		if (samplIt != mData_SamplerObjects.end()) {
+		auto samplIt = mData_SharedObjects->mSamplerObjects.find(samplers[i]);
+		if (samplIt != mData_SharedObjects->mSamplerObjects.end()) {
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_Sampler, samplIt->first);
 			SafeDelete(samplIt->second);
-			mData_SamplerObjects.erase(samplIt);
+			mData_SharedObjects->mSamplerObjects.erase(samplIt);
 		}
 	}
 }
@@ -2410,21 +3016,26 @@ void ContextState::glDeleteSamplers(GLsizei n, const GLuint* samplers)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDetachShader(GLuint program, GLuint shader)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		return;
 	}
 
 	bool detached = progIt->second->glDetachShader(program, shader);
 	if (detached) {
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, program);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ShaderGLSL, shader);
+
 		// Need to update the attach count in the shader.
-		auto shadIt = mData_ShaderObjectsGLSL.find(shader);
-		assert(shadIt != mData_ShaderObjectsGLSL.end() && shadIt->second != NULL);
+		auto shadIt = mData_SharedObjects->mShaderObjectsGLSL.find(shader);
+		assert(shadIt != mData_SharedObjects->mShaderObjectsGLSL.end() && shadIt->second != NULL);
 		
 		if (shadIt->second->OnShaderDetach()) {
 			// Store a pointer, erase it from the table and then delete it.
 			GLShader* deadShader = shadIt->second;
-			mData_ShaderObjectsGLSL.erase(shadIt);
+			mData_SharedObjects->mShaderObjectsGLSL.erase(shadIt);
 			SafeDelete(deadShader);
 		}
 	}
@@ -2439,11 +3050,14 @@ void ContextState::glDisableVertexAttribArray(GLuint index)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glDrawBuffer(GLenum buffer)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto fbBindIt = mData_FrameBufferBindings.find(GL_DRAW_FRAMEBUFFER);
 	if (fbBindIt != mData_FrameBufferBindings.end() && fbBindIt->second != 0) {
 		auto fbIt = mData_FrameBufferObjects.find(fbBindIt->second);
 		if (fbIt != mData_FrameBufferObjects.end() && fbIt->second != NULL) {
 			fbIt->second->glDrawBuffer(buffer);
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, fbIt->first);
 			return;
 		}
 	}
@@ -2460,6 +3074,8 @@ void ContextState::glEnableVertexAttribArray(GLuint index)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (!IsValidTarget_glFlushMappedBufferRange(target)) {
 		return;
 	}
@@ -2475,18 +3091,21 @@ void ContextState::glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsi
 		return;
 	}
 
-	auto buffIt = mData_BufferObjects.find(bindIt->second);
-	if (buffIt == mData_BufferObjects.end() || buffIt->second == NULL) {
+	auto buffIt = mData_SharedObjects->mBufferObjects.find(bindIt->second);
+	if (buffIt == mData_SharedObjects->mBufferObjects.end() || buffIt->second == NULL) {
 		TraceError(TC("glTrace Internal error with buffer (id: %d) bound at (target: %d)"), buffIt->first, target);
 		assert(0);
 	}
 
 	buffIt->second->glFlushMappedBufferRange(target, offset, length);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	GLenum realTarget = GL_NONE;
 	switch (target) {
 		case GL_READ_FRAMEBUFFER:
@@ -2513,11 +3132,14 @@ void ContextState::glFramebufferRenderbuffer(GLenum target, GLenum attachment, G
 	}
 
 	fbIt->second->glFramebufferRenderbuffer(realTarget, attachment, renderbuffertarget, renderbuffer);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, fbIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	GLenum realTarget = GL_NONE;
 	switch (target) {
 		case GL_READ_FRAMEBUFFER:
@@ -2544,11 +3166,14 @@ void ContextState::glFramebufferTexture2D(GLenum target, GLenum attachment, GLen
 	}
 
 	fbIt->second->glFramebufferTexture2D(realTarget, attachment, textarget, texture, level);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, fbIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glFramebufferTexture3D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level, GLint layer)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	GLenum realTarget = GL_NONE;
 	switch (target) {
 		case GL_READ_FRAMEBUFFER:
@@ -2575,45 +3200,60 @@ void ContextState::glFramebufferTexture3D(GLenum target, GLenum attachment, GLen
 	}
 
 	fbIt->second->glFramebufferTexture3D(realTarget, attachment, textarget, texture, level, layer);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, fbIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glGenFramebuffers(GLsizei n, GLuint* ids)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (int i = 0; i < n; ++i) {
 		mData_FrameBufferObjects[ids[i]] = new GLFrameBufferObject(ids[i]);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, ids[i]);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glGenRenderbuffers(GLsizei n, GLuint* renderbuffers)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (int i = 0; i < n; ++i) {
-		mData_RenderBufferObjects[renderbuffers[i]] = new GLRenderBufferObject(GL_NONE, renderbuffers[i]);
+		mData_SharedObjects->mRenderBufferObjects[renderbuffers[i]] = new GLRenderBufferObject(GL_NONE, renderbuffers[i]);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_RenderBufferObject, renderbuffers[i]);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glGenProgramsARB(GLsizei n, GLuint* programs)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (int i = 0; i < n; ++i) {
-		mData_ProgramObjectsARB[programs[i]] = new GLProgramARB(this, programs[i]);
+		mData_SharedObjects->mProgramObjectsARB[programs[i]] = new GLProgramARB(this, programs[i]);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramARB, programs[i]);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glGenSamplers(GLsizei n, GLuint* samplers)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	for (int i = 0; i < n; ++i) {
-		mData_SamplerObjects[samplers[i]] = new GLSampler(samplers[i]);
+		mData_SharedObjects->mSamplerObjects[samplers[i]] = new GLSampler(samplers[i]);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Sampler, samplers[i]);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 GLint ContextState::glGetUniformLocation(GLint _retVal, GLuint program, const GLchar* name)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		if (_retVal != -1) {
 			Once(TraceError(TC("glGetUniformLocation is returning a valid location, but we cannot find the bound program--trace replay is bad.")));
 		}
@@ -2621,59 +3261,71 @@ GLint ContextState::glGetUniformLocation(GLint _retVal, GLuint program, const GL
 	}
 
 	progIt->second->glGetUniformLocation(_retVal, program, name);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, progIt->first);
 	return _retVal;
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glLinkProgram(GLuint program)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		return;
 	}
 	
 	progIt->second->glLinkProgram(program);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, progIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 GLvoid* ContextState::glMapBufferARB(GLvoid* _retVal, GLenum target, GLenum access)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto bindIt = mData_BufferBindings.find(target);
 	if (bindIt == mData_BufferBindings.end() || bindIt->second == 0) { 
 		// GL_INVALID_OPERATION
 		return NULL;
 	}
 
-	auto buffIt = mData_BufferObjects.find(bindIt->second);
-	if (buffIt == mData_BufferObjects.end() || buffIt->second == NULL) {
+	auto buffIt = mData_SharedObjects->mBufferObjects.find(bindIt->second);
+	if (buffIt == mData_SharedObjects->mBufferObjects.end() || buffIt->second == NULL) {
 		TraceError(TC("glTrace Internal error with buffer (id: %d) bound at (target: %d)"), buffIt->first, target);
 		assert(0);
 	}
 
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffIt->first);
 	return buffIt->second->glMapBuffer(_retVal, target, access);
 }
 
 // ------------------------------------------------------------------------------------------------
 GLvoid* ContextState::glMapBufferRange(GLvoid* _retVal, GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto bindIt = mData_BufferBindings.find(target);
 	if (bindIt == mData_BufferBindings.end() || bindIt->second == 0) { 
 		// GL_INVALID_OPERATION
 		return NULL;
 	}
 
-	auto buffIt = mData_BufferObjects.find(bindIt->second);
-	if (buffIt == mData_BufferObjects.end() || buffIt->second == NULL) {
+	auto buffIt = mData_SharedObjects->mBufferObjects.find(bindIt->second);
+	if (buffIt == mData_SharedObjects->mBufferObjects.end() || buffIt->second == NULL) {
 		TraceError(TC("glTrace Internal error with buffer (id: %d) bound at (target: %d)"), buffIt->first, target);
 		assert(0);
 	}
 
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffIt->first);
 	return buffIt->second->glMapBufferRange(_retVal, target, offset, length, access);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glRenderbufferStorageMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (target != GL_RENDERBUFFER) {
 		return;
 	}
@@ -2683,22 +3335,26 @@ void ContextState::glRenderbufferStorageMultisample(GLenum target, GLsizei sampl
 		return;
 	}
 
-	auto rbIt = mData_RenderBufferObjects.find(bindIt->second);
-	if (rbIt == mData_RenderBufferObjects.end() || rbIt->second == NULL) {
+	auto rbIt = mData_SharedObjects->mRenderBufferObjects.find(bindIt->second);
+	if (rbIt == mData_SharedObjects->mRenderBufferObjects.end() || rbIt->second == NULL) {
 		return;
 	}
 
 	rbIt->second->glRenderbufferStorageMultisample(target, samples, internalformat, width, height);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_RenderBufferObject, rbIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glReadBuffer(GLenum buffer)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto fbBindIt = mData_FrameBufferBindings.find(GL_DRAW_FRAMEBUFFER);
 	if (fbBindIt != mData_FrameBufferBindings.end() && fbBindIt->second != 0) {
 		auto fbIt = mData_FrameBufferObjects.find(fbBindIt->second);
 		if (fbIt != mData_FrameBufferObjects.end() && fbIt->second != NULL) {
 			fbIt->second->glReadBuffer(buffer);
+			mData_SharedObjects->mObjectGenerations.Touch(ESOT_FrameBufferObject, fbIt->first);
 			return;
 		}
 	}
@@ -2709,103 +3365,127 @@ void ContextState::glReadBuffer(GLenum buffer)
 // ------------------------------------------------------------------------------------------------
 void ContextState::glSamplerParameterf(GLuint sampler, GLenum pname, GLfloat param)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (sampler != 0) {
-		auto samplIt = mData_SamplerObjects.find(sampler);
-		if (samplIt == mData_SamplerObjects.end() || samplIt->second == NULL) {
+		auto samplIt = mData_SharedObjects->mSamplerObjects.find(sampler);
+		if (samplIt == mData_SharedObjects->mSamplerObjects.end() || samplIt->second == NULL) {
 			// Per the spec, needs to have been created with glGenSamplers first
 			return;
 		}
 
 		samplIt->second->glSamplerParameterf(sampler, pname, param);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Sampler, samplIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glSamplerParameterfv(GLuint sampler, GLenum pname, const GLfloat* params)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (sampler != 0) {
-		auto samplIt = mData_SamplerObjects.find(sampler);
-		if (samplIt == mData_SamplerObjects.end() || samplIt->second == NULL) {
+		auto samplIt = mData_SharedObjects->mSamplerObjects.find(sampler);
+		if (samplIt == mData_SharedObjects->mSamplerObjects.end() || samplIt->second == NULL) {
 			// Per the spec, needs to have been created with glGenSamplers first
 			return;
 		}
 
 		samplIt->second->glSamplerParameterfv(sampler, pname, params);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Sampler, samplIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glSamplerParameteri(GLuint sampler, GLenum pname, GLint param)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	if (sampler != 0) {
-		auto samplIt = mData_SamplerObjects.find(sampler);
-		if (samplIt == mData_SamplerObjects.end() || samplIt->second == NULL) {
+		auto samplIt = mData_SharedObjects->mSamplerObjects.find(sampler);
+		if (samplIt == mData_SharedObjects->mSamplerObjects.end() || samplIt->second == NULL) {
 			// Per the spec, needs to have been created with glGenSamplers first
 			return;
 		}
 
 		samplIt->second->glSamplerParameteri(sampler, pname, param);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_Sampler, samplIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glShaderSource(GLuint shader, GLsizei count, const GLcharARB** string, const GLint* length)
 {
-	auto shadIt = mData_ShaderObjectsGLSL.find(shader);
-	if (shadIt != mData_ShaderObjectsGLSL.end() && shadIt->second != NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto shadIt = mData_SharedObjects->mShaderObjectsGLSL.find(shader);
+	if (shadIt != mData_SharedObjects->mShaderObjectsGLSL.end() && shadIt->second != NULL) {
 		shadIt->second->glShaderSource(shader, count, string, length);
+		mData_SharedObjects->mObjectGenerations.Touch(ESOT_ShaderGLSL, shadIt->first);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glUniform1f(GLint location, GLfloat v0)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(mData_glUseProgram.program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(mData_glUseProgram.program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		return;
 	}
 	
 	progIt->second->glUniform<1, GLfloat>(location, 1, &v0);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, progIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glUniform1i(GLint location, GLint v0)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(mData_glUseProgram.program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(mData_glUseProgram.program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		return;
 	}
 	
 	progIt->second->glUniform<1, GLint>(location, 1, &v0);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, progIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 void ContextState::glUniform4fv(GLint location, GLsizei count, const GLfloat* value)
 {
-	auto progIt = mData_ProgramObjectsGLSL.find(mData_glUseProgram.program);
-	if (progIt == mData_ProgramObjectsGLSL.end() || progIt->second == NULL) {
+	SharedObjectsLock lock(mData_SharedObjects);
+
+	auto progIt = mData_SharedObjects->mProgramObjectsGLSL.find(mData_glUseProgram.program);
+	if (progIt == mData_SharedObjects->mProgramObjectsGLSL.end() || progIt->second == NULL) {
 		return;
 	}
 	
 	progIt->second->glUniform<4, GLfloat>(location, count, value);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_ProgramGLSL, progIt->first);
 }
 
 // ------------------------------------------------------------------------------------------------
 GLboolean ContextState::glUnmapBuffer(GLboolean _retVal, GLenum target)
 {
+	SharedObjectsLock lock(mData_SharedObjects);
+
 	auto bindIt = mData_BufferBindings.find(target);
 	if (bindIt == mData_BufferBindings.end() || bindIt->second == 0) { 
 		// GL_INVALID_OPERATION
 		return GL_FALSE;
 	}
 
-	auto buffIt = mData_BufferObjects.find(bindIt->second);
-	if (buffIt == mData_BufferObjects.end() || buffIt->second == NULL) {
+	auto buffIt = mData_SharedObjects->mBufferObjects.find(bindIt->second);
+	if (buffIt == mData_SharedObjects->mBufferObjects.end() || buffIt->second == NULL) {
 		TraceError(TC("glTrace Internal error with buffer (id: %d) bound at (target: %d)"), buffIt->first, target);
 		assert(0);
 	}
 
 	buffIt->second->glUnmapBuffer(target);
+	mData_SharedObjects->mObjectGenerations.Touch(ESOT_Buffer, buffIt->first);
 
 	return _retVal;
 }
@@ -2951,6 +3631,18 @@ void ManualPlay_glUniform4fv(GLint location, GLsizei count, const GLfloat* value
 	::glUniform4fv(replayLocation, count, value);
 }
 
+// ------------------------------------------------------------------------------------------------
+void ManualPlay_wglCreateContextAttribsARB(HDC hDC, HGLRC hShareContext, const int* attribList)
+{
+	// Never recorded. The replay makes its own contexts as the trace switches to them.
+}
+
+// ------------------------------------------------------------------------------------------------
+void ManualPlay_wglMakeCurrent(HDC hdc, HGLRC hglrc)
+{
+	GetReplayTrace()->MakeCurrent(hglrc);
+}
+
 // ------------------------------------------------------------------------------------------------
 void ManualPlay_glUseProgram(GLuint program)
 {
@@ -45,3 +45,192 @@ struct GLClipPlane
 
 
 GLenum TexImage2DTargetToBoundTarget(GLenum _target);
+size_t formatAndTypeToSizePerPixel(GLenum _format, GLenum _type);
+
+// The kinds of object ContextState keeps track of individually (see GLObjectGenerations).
+enum EStateObjectType
+{
+	ESOT_Texture,
+	ESOT_Buffer,
+	ESOT_ShaderGLSL,
+	ESOT_ProgramGLSL,
+	ESOT_ProgramARB,
+	ESOT_FrameBufferObject,
+	ESOT_RenderBufferObject,
+	ESOT_Sampler,
+
+	ESOT_Count
+};
+
+// Remembers when each object in a ContextState was last created, modified or deleted, so that a 
+// capture can send only the objects that changed since the one before it. Time is counted in 
+// generations: everything up to and including a capture's generation went out with that capture, 
+// anything that happens after it is stamped with the next one.
+class GLObjectGenerations
+{
+public:
+	GLObjectGenerations() : mGeneration(1), mLastCaptureGeneration(0) { }
+
+	void Touch(EStateObjectType _type, GLuint _handle) { mModified[_type][_handle] = mGeneration; }
+
+	unsigned int GetGeneration() const { return mGeneration; }
+
+	// 0 until the first capture.
+	unsigned int GetLastCaptureGeneration() const { return mLastCaptureGeneration; }
+
+	// Closes the current generation--the state as it is now has been sent.
+	void OnCaptured()
+	{
+		mLastCaptureGeneration = mGeneration;
+		++mGeneration;
+	}
+
+	// Writes the objects of _type touched after _sinceGeneration. Ones that have been deleted since 
+	// are written as such, so that ReadChanged can remove them.
+	template <typename T>
+	void WriteChanged(FileLike* _out, EStateObjectType _type, const std::map<GLuint, T*>& _objects, unsigned int _sinceGeneration) const
+	{
+		const auto& modified = mModified[_type];
+		size_t changedCount = 0;
+		for (auto it = modified.cbegin(); it != modified.cend(); ++it) {
+			if (it->second > _sinceGeneration) {
+				++changedCount;
+			}
+		}
+
+		_out->Write(changedCount);
+		for (auto it = modified.cbegin(); it != modified.cend(); ++it) {
+			if (it->second <= _sinceGeneration) {
+				continue;
+			}
+
+			_out->Write(it->first);
+			auto objIt = _objects.find(it->first);
+			if (objIt == _objects.end()) {
+				_out->Write(GLuint(EOC_Deleted));
+			} else if (objIt->second == NULL) {
+				_out->Write(GLuint(EOC_Null));
+			} else {
+				_out->Write(GLuint(EOC_Present));
+				_out->Write(*(objIt->second));
+			}
+		}
+	}
+
+	// Applies what WriteChanged wrote to _objects. Changed objects are replaced outright.
+	template <typename T>
+	static void ReadChanged(FileLike* _in, std::map<GLuint, T*>* _objects)
+	{
+		size_t changedCount = 0;
+		_in->Read(&changedCount);
+		for (size_t u = 0; u < changedCount; ++u) {
+			GLuint handle = 0;
+			_in->Read(&handle);
+			GLuint change = EOC_Deleted;
+			_in->Read(&change);
+
+			auto objIt = _objects->find(handle);
+			if (objIt != _objects->end()) {
+				SafeDelete(objIt->second);
+				_objects->erase(objIt);
+			}
+
+			if (change == EOC_Deleted) {
+				continue;
+			}
+
+			T* obj = NULL;
+			if (change == EOC_Present) {
+				obj = new T;
+				_in->Read(obj);
+			}
+			(*_objects)[handle] = obj;
+		}
+	}
+
+private:
+	// Matches the has-data flag FileLike writes for maps of objects, plus a value for deletions.
+	enum EObjectChange
+	{
+		EOC_Null = 0,
+		EOC_Present = 1,
+		EOC_Deleted = 2,
+	};
+
+	unsigned int mGeneration;
+	unsigned int mLastCaptureGeneration;
+	std::map<GLuint, unsigned int> mModified[ESOT_Count];
+};
+
+// The objects contexts have in common once they share lists (see wglShareLists, or the share context 
+// passed to wglCreateContextAttribsARB): textures, buffers, shaders, programs, renderbuffers and 
+// samplers. Each ContextState holds a reference to one of these. Framebuffer objects aren't shared, 
+// so they stay with their context.
+class GLSharedObjects
+{
+public:
+	GLSharedObjects();
+	~GLSharedObjects();
+
+	void AddRef() { InterlockedIncrement(&mRefCount); }
+	// Deletes us once the last context sharing us is done with us.
+	void Release();
+
+	// Deletes every object, and starts the generations over.
+	void Clear();
+	void CopyFrom(const GLSharedObjects& _src);
+
+	// Contexts sharing objects can be current on different threads at the same time. Anything that 
+	// looks at the objects of a context that isn't its own, or changes them, holds the lock while it 
+	// does (see SharedObjectsLock).
+	void Lock() const { EnterCriticalSection(&mLock); }
+	void Unlock() const { LeaveCriticalSection(&mLock); }
+
+	// Pins the payloads of every texture and buffer, see SharedPayload::Pin and SharedObjectsPayloadPins.
+	void PinPayloads() const;
+	void UnpinPayloads() const;
+
+	std::map<GLuint, GLTexture*> mTextureObjects;
+	std::map<GLuint, GLBuffer*> mBufferObjects;
+	std::map<GLuint, GLProgram*> mProgramObjectsGLSL;
+	std::map<GLuint, GLShader*> mShaderObjectsGLSL;
+	std::map<GLuint, GLProgramARB*> mProgramObjectsARB;
+	std::map<GLuint, GLRenderBufferObject*> mRenderBufferObjects;
+	std::map<GLuint, GLSampler*> mSamplerObjects;
+
+	// When each of the objects above (and the framebuffer objects of the contexts sharing them) was last
+	// touched, for sending only what changed between captures.
+	GLObjectGenerations mObjectGenerations;
+
+private:
+	volatile LONG mRefCount;
+	mutable CRITICAL_SECTION mLock;
+
+	// Not copyable--contexts share us by pointer. See CopyFrom.
+	GLSharedObjects(const GLSharedObjects&);
+	GLSharedObjects& operator=(const GLSharedObjects&);
+};
+
+// Holds a GLSharedObjects' lock for as long as it's in scope.
+class SharedObjectsLock
+{
+public:
+	SharedObjectsLock(const GLSharedObjects* _objects) : mObjects(_objects) { mObjects->Lock(); }
+	~SharedObjectsLock() { mObjects->Unlock(); }
+
+private:
+	const GLSharedObjects* mObjects;
+};
+
+// Keeps the payloads of a GLSharedObjects pinned for as long as it's in scope. For writing out a snapshot
+// (see ContextState::OnCaptureStart) on another thread: besides taking longer than a frame, the writer 
+// may hold on to the bytes past each object (see BlobStore) until it's done.
+class SharedObjectsPayloadPins
+{
+public:
+	SharedObjectsPayloadPins(const GLSharedObjects* _objects) : mObjects(_objects) { mObjects->PinPayloads(); }
+	~SharedObjectsPayloadPins() { mObjects->UnpinPayloads(); }
+
+private:
+	const GLSharedObjects* mObjects;
+};
@@ -29,9 +29,14 @@
 #include "stdafx.h"
 #include "glbuffer.h"
 
+#include <vector>
 #include "extensions.h"
 #include "functionhooks.gen.h"
 
+// Changed bytes closer together than this are recorded as one run. Every run costs a packet, which 
+// is about this big without its payload.
+const size_t kWrittenRunMergeGap = 64;
+
 // ------------------------------------------------------------------------------------------------
 static void DummyFunction()
 {
@@ -73,13 +78,25 @@ void aligned_free(void* _ptr)
 	}
 }
 
+// ------------------------------------------------------------------------------------------------
+static size_t GetPageSize()
+{
+	static size_t sPageSize = 0;
+	if (sPageSize == 0) {
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		sPageSize = systemInfo.dwPageSize;
+	}
+
+	return sPageSize;
+}
+
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 GLBuffer::GLBuffer(GLenum _target)
 : mTarget(_target)
 , mBufferSize(0)
-, mBufferContents(NULL)
 , mUsage(GL_STREAM_DRAW)
 , mMappedAccess(GL_READ_WRITE)
 , mMapMode(EUnmapped)
@@ -87,16 +104,40 @@ GLBuffer::GLBuffer(GLenum _target)
 , mMapOffset(0)
 , mMapSize(0)
 , mFakeReturnedMappedPointer(NULL)
+, mWriteWatched(false)
 {
 
 }
 
+// ------------------------------------------------------------------------------------------------
+GLBuffer::GLBuffer(const GLBuffer& _rhs)
+: mTarget(_rhs.mTarget)
+, mBufferSize(_rhs.mBufferSize)
+, mBufferContents(_rhs.mBufferContents)
+, mUsage(_rhs.mUsage)
+, mMappedAccess(_rhs.mMappedAccess)
+, mMapMode(_rhs.mMapMode)
+, mDriverReturnedMappedPointer(NULL)
+, mMapOffset(_rhs.mMapOffset)
+, mMapSize(_rhs.mMapSize)
+, mFakeReturnedMappedPointer(NULL)
+, mWriteWatched(false)
+{
+	// The application may keep writing into the original's mapping. The copy gets what's in there 
+	// now, and nobody maps it--which is all Write needs.
+	if (_rhs.mFakeReturnedMappedPointer && _rhs.mFakeReturnedMappedPointer != _rhs.mDriverReturnedMappedPointer) {
+		mFakeReturnedMappedPointer = MallocAndCopy(_rhs.mFakeReturnedMappedPointer, mMapSize);
+	}
+}
+
 // ------------------------------------------------------------------------------------------------
 GLBuffer::~GLBuffer()
 {
-	SafeFree(mFakeReturnedMappedPointer);
+	if (mWriteWatched) {
+		FreeFakeBuffer();
+	}
+	SafeFreePayload(mFakeReturnedMappedPointer);
 	// Do not free mDriverReturnedMappedPointer, because we don't own it.
-	SafeFree(mBufferContents);
 	mTarget = GL_NONE;
 }
 
@@ -104,7 +145,7 @@ GLBuffer::~GLBuffer()
 void GLBuffer::Write(FileLike* _out) const
 {
 	_out->Write(mTarget);
-	_out->Write(mBufferContents, mBufferSize);
+	_out->Write(mBufferContents.Get(), mBufferSize);
 	_out->Write(mMappedAccess);
 	_out->Write((unsigned int)mMapMode);
 	// Never write out mDriverReturnedMappedPointer--there's no circumstances where it is useful 
@@ -122,13 +163,16 @@ void GLBuffer::Write(FileLike* _out) const
 void GLBuffer::Read(FileLike* _in)
 {
 	_in->Read(&mTarget);
-	_in->Read(&mBufferContents, &mBufferSize);
+	GLvoid* bufferContents = NULL;
+	_in->Read(&bufferContents, &mBufferSize);
+	mBufferContents = SharedPayload(bufferContents, mBufferSize);
 	_in->Read(&mMappedAccess);
 	_in->Read((unsigned int*)&mMapMode);
 	_in->Read(&mMapSize);
 	
 	// Set this to NULL. See above for why. 
 	mDriverReturnedMappedPointer = NULL;
+	mWriteWatched = false;
 
 	size_t bufferSize = 0;
 	_in->Read(&mFakeReturnedMappedPointer, &bufferSize);
@@ -144,15 +188,13 @@ void GLBuffer::glBufferData(GLenum target, GLsizeiptr size, const GLvoid* data,
 	mBufferSize = size;
 	mUsage = usage;
 	
-	// Cleanup after ourself in case of repeated calls.
-	SafeFree(mBufferContents);
-
+	// Replacing the contents lets go of the old ones, in case of repeated calls.
 	if (data) {
-		mBufferContents = MallocAndCopy(data, size);
+		mBufferContents = SharedPayload(MallocAndCopy(data, size), size);
 	} else {
 		// If not, our junk is as good as their junk.
-		mBufferContents = malloc(size);
-		assert(mBufferContents);
+		mBufferContents = SharedPayload(malloc(size), size);
+		assert(mBufferContents.Get());
 	}
 }
 
@@ -162,12 +204,17 @@ void GLBuffer::glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
 	assert(mTarget == target);
 	assert(unsigned(offset + size) <= mBufferSize);
 
-	memcpy((GLubyte*)mBufferContents + offset, data, size);
+	memcpy((GLubyte*)mBufferContents.GetWritable() + offset, data, size);
 }
 
 // ------------------------------------------------------------------------------------------------
 void GLBuffer::glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeiptr length)
 {
+	// Mapped while the hooks were idle, so the mapping is the driver's own and already has the data.
+	if (mMapMode == EUnmapped) {
+		return;
+	}
+
 	// Caller should've bailed in these cases.
 	assert(offset >= 0);
 	assert(length >= 0);
@@ -184,8 +231,7 @@ void GLBuffer::glFlushMappedBufferRange(GLenum target, GLintptr offset, GLsizeip
 	// Need to copy into our own version for consistency, and to the driver's copy because otherwise the 
 	// change won't actually happen.
 	if (length && mFakeReturnedMappedPointer != mDriverReturnedMappedPointer) {
-		memcpy((GLubyte*)mBufferContents + mMapOffset + offset, (GLubyte*)mFakeReturnedMappedPointer + offset, length);
-		memcpy((GLubyte*)mDriverReturnedMappedPointer + offset, (GLubyte*)mFakeReturnedMappedPointer + offset, length);
+		CopyFromFakeBuffer(offset, length);
 	}
 }
 
@@ -201,21 +247,13 @@ GLvoid* GLBuffer::glMapBuffer(GLvoid* data, GLenum target, GLenum access)
 	mMapOffset = 0;
 	mMapSize = mBufferSize;
 	mMappedAccess = access;
+	mInvalidatedRun = ByteRun();
 
 	bool createFakeBuffer = ((mMappedAccess & GL_MAP_WRITE_BIT) != 0);
 	if (createFakeBuffer) {
 		// If they're going to write into the buffer, then we need to create a copy for them to scribble into
 		// so we can keep track of what goes back to the driver.
-		// TODO: Store this in the context or something.
-		GLint alignment = 0;
-		gReal_glGetIntegerv(GL_MIN_MAP_BUFFER_ALIGNMENT, &alignment);
-		
-		mFakeReturnedMappedPointer = aligned_malloc(max(1, alignment), mMapSize);
-		assert(mFakeReturnedMappedPointer);
-		
-		// Even if they can't read it, in case they don't write the whole thing.
-		// This isn't striiiiictly correct, but it can avoid an app bug or two.
-		memcpy(mFakeReturnedMappedPointer, (GLubyte*)mBufferContents, mMapSize);
+		AllocateFakeBuffer((const GLubyte*)mBufferContents.Get(), false);
 	} else {
 		mFakeReturnedMappedPointer = mDriverReturnedMappedPointer;
 	}
@@ -236,21 +274,21 @@ GLvoid* GLBuffer::glMapBufferRange(GLvoid* data, GLenum target, GLintptr offset,
 	mMapSize = length;
 	mMappedAccess = access;
 
+	if (mMappedAccess & GL_MAP_INVALIDATE_BUFFER_BIT) {
+		mInvalidatedRun = ByteRun(0, mBufferSize);
+	} else if (mMappedAccess & GL_MAP_INVALIDATE_RANGE_BIT) {
+		mInvalidatedRun = ByteRun(mMapOffset, mMapSize);
+	} else {
+		mInvalidatedRun = ByteRun();
+	}
+
 	bool createFakeBuffer = ((mMappedAccess & GL_MAP_WRITE_BIT) != 0);
 
 	if (createFakeBuffer) {
 		// If they're going to write into the buffer, then we need to create a copy for them to scribble into
 		// so we can keep track of what goes back to the driver.
-		// TODO: Store this in the context or something.
-		GLint alignment = 0;
-		gReal_glGetIntegerv(GL_MIN_MAP_BUFFER_ALIGNMENT, &alignment);
-		
-		mFakeReturnedMappedPointer = aligned_malloc(max(1, alignment), mMapSize);
-		assert(mFakeReturnedMappedPointer);
-		
-		// Even if they can't read it, in case they don't write the whole thing.
-		// This isn't striiiiictly correct, but it can avoid an app bug or two.
-		memcpy(mFakeReturnedMappedPointer, (GLubyte*)mBufferContents + mMapOffset, mMapSize);
+		bool discardContents = (mMappedAccess & (GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)) != 0;
+		AllocateFakeBuffer((const GLubyte*)mBufferContents.Get() + mMapOffset, discardContents);
 	} else {
 		mFakeReturnedMappedPointer = mDriverReturnedMappedPointer;
 	}
@@ -276,19 +314,26 @@ GLboolean GLBuffer::glUnmapBuffer(GLenum target)
 	}
 	
 	if (copyFromFakeBuffer) {
-		assert(mBufferContents);
+		assert(mBufferContents.Get());
 		assert(mFakeReturnedMappedPointer);
 		assert(mDriverReturnedMappedPointer);
 		assert(mFakeReturnedMappedPointer != mDriverReturnedMappedPointer);
 
-		memcpy((GLubyte*)mBufferContents + mMapOffset, mFakeReturnedMappedPointer, mMapSize);
-		memcpy(mDriverReturnedMappedPointer, mFakeReturnedMappedPointer, mMapSize);
+		CopyFromFakeBuffer(0, mMapSize);
 	}
 
 	if (mFakeReturnedMappedPointer != mDriverReturnedMappedPointer) {
-		aligned_free(mFakeReturnedMappedPointer);
+		// Replaying the map throws these away, so they all have to come back, changed or not.
+		if (mInvalidatedRun.mLength > 0) {
+			mWrittenRuns.clear();
+			mWrittenRuns.push_back(mInvalidatedRun);
+		}
+
+		FreeFakeBuffer();
 	}
 
+	mInvalidatedRun = ByteRun();
+
 	mFakeReturnedMappedPointer = NULL;
 	mDriverReturnedMappedPointer = NULL;
 	mMapOffset = 0;
@@ -299,6 +344,126 @@ GLboolean GLBuffer::glUnmapBuffer(GLenum target)
 	return GL_TRUE;
 }
 
+// ------------------------------------------------------------------------------------------------
+void GLBuffer::AllocateFakeBuffer(const GLvoid* _initialContents, bool _discardContents)
+{
+	mWriteWatched = false;
+	if (gOptions->WriteWatchBuffers && mMapSize > 0) {
+		// Page aligned, which is more than GL_MIN_MAP_BUFFER_ALIGNMENT ever asks for.
+		mFakeReturnedMappedPointer = VirtualAlloc(NULL, mMapSize, MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE);
+		mWriteWatched = (mFakeReturnedMappedPointer != NULL);
+		if (!mWriteWatched) {
+			Once(TraceWarn(TC("Couldn't allocate write-watched memory for a buffer mapping, copying back all of it instead.")));
+		}
+	}
+
+	if (mWriteWatched) {
+		// Unless the application asked for the old contents to be thrown away. Then the pages it doesn't 
+		// write aren't copied back, and the partial pages it does write can come back with zeroes in them.
+		if (!_discardContents) {
+			memcpy(mFakeReturnedMappedPointer, _initialContents, mMapSize);
+		}
+
+		// Only the application's writes count.
+		ResetWriteWatch(mFakeReturnedMappedPointer, mMapSize);
+		return;
+	}
+
+	// TODO: Store this in the context or something.
+	GLint alignment = 0;
+	gReal_glGetIntegerv(GL_MIN_MAP_BUFFER_ALIGNMENT, &alignment);
+		
+	mFakeReturnedMappedPointer = aligned_malloc(max(1, alignment), mMapSize);
+	assert(mFakeReturnedMappedPointer);
+		
+	// Even if they can't read it, in case they don't write the whole thing.
+	// This isn't striiiiictly correct, but it can avoid an app bug or two.
+	memcpy(mFakeReturnedMappedPointer, _initialContents, mMapSize);
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLBuffer::FreeFakeBuffer()
+{
+	if (mWriteWatched) {
+		VirtualFree(mFakeReturnedMappedPointer, 0, MEM_RELEASE);
+		mWriteWatched = false;
+	} else {
+		aligned_free(mFakeReturnedMappedPointer);
+	}
+
+	mFakeReturnedMappedPointer = NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLBuffer::CopyFromFakeBuffer(size_t _offset, size_t _length)
+{
+	if (!mWriteWatched) {
+		CopyFromFakeBufferRange(_offset, _length);
+		return;
+	}
+
+	// Whole pages covering the range. Pages aren't reset as they're copied: one straddling the end of 
+	// a flushed range may have more written to it for a later flush.
+	const size_t pageSize = GetPageSize();
+	size_t firstPage = _offset / pageSize;
+	size_t endPage = (_offset + _length + pageSize - 1) / pageSize;
+	GLubyte* fakeBuffer = (GLubyte*)mFakeReturnedMappedPointer;
+
+	std::vector<PVOID> writtenPages(endPage - firstPage);
+	ULONG_PTR writtenPageCount = writtenPages.size();
+	ULONG granularity = 0;
+	if (GetWriteWatch(0, fakeBuffer + firstPage * pageSize, (endPage - firstPage) * pageSize, &writtenPages[0], &writtenPageCount, &granularity) != 0) {
+		Once(TraceWarn(TC("GetWriteWatch failed on a buffer mapping, copying back all of it instead.")));
+		CopyFromFakeBufferRange(_offset, _length);
+		return;
+	}
+
+	for (ULONG_PTR i = 0; i < writtenPageCount; ) {
+		// Consecutive pages go in one copy.
+		GLubyte* runStart = (GLubyte*)writtenPages[i];
+		GLubyte* runEnd = runStart + granularity;
+		for (++i; i < writtenPageCount && writtenPages[i] == runEnd; ++i) {
+			runEnd += granularity;
+		}
+
+		size_t start = max(size_t(runStart - fakeBuffer), _offset);
+		size_t end = min(size_t(runEnd - fakeBuffer), _offset + _length);
+		if (start < end) {
+			CopyFromFakeBufferRange(start, end - start);
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLBuffer::CopyFromFakeBufferRange(size_t _offset, size_t _length)
+{
+	// The driver gets all of it: it may have handed us memory that doesn't hold the old contents.
+	const GLubyte* fakeBuffer = (const GLubyte*)mFakeReturnedMappedPointer;
+	memcpy((GLubyte*)mDriverReturnedMappedPointer + _offset, fakeBuffer + _offset, _length);
+
+	// Our contents only need what changed, which is also all the trace needs to hear about. Offsets in 
+	// the runs are into the buffer, not the mapping.
+	size_t firstRun = mWrittenRuns.size();
+	const GLubyte* oldContents = (const GLubyte*)mBufferContents.Get() + mMapOffset;
+	FindChangedRuns(oldContents + _offset, fakeBuffer + _offset, _length, mMapOffset + _offset, kWrittenRunMergeGap, &mWrittenRuns);
+	if (firstRun == mWrittenRuns.size()) {
+		return;
+	}
+
+	GLubyte* contents = (GLubyte*)mBufferContents.GetWritable();
+	for (size_t i = firstRun; i < mWrittenRuns.size(); ++i) {
+		const ByteRun& run = mWrittenRuns[i];
+		memcpy(contents + run.mOffset, fakeBuffer + (run.mOffset - mMapOffset), run.mLength);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLBuffer::TakeWrittenRuns(std::vector<ByteRun>* _outRuns)
+{
+	_outRuns->clear();
+	_outRuns->swap(mWrittenRuns);
+}
+
 // ------------------------------------------------------------------------------------------------
 GLuint GLBuffer::Create(const GLTrace* _trace) const
 {
@@ -311,7 +476,7 @@ GLuint GLBuffer::Create(const GLTrace* _trace) const
 	::glBindBuffer(mTarget, returnHandle);
 	CHECK_GL_ERROR();
 
-	::glBufferData(mTarget, mBufferSize, mBufferContents, mUsage);
+	::glBufferData(mTarget, mBufferSize, mBufferContents.Get(), mUsage);
 	CHECK_GL_ERROR();
 
 	return returnHandle;
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include "bytediff.h"
+
 class GLTrace;
 
 enum GLBufferMapMode
@@ -44,6 +46,9 @@ class GLBuffer
 {
 public:
 	GLBuffer(GLenum _target=GL_NONE);
+	// Shares the contents with _rhs until one of them changes. A mapping isn't carried over, only
+	// what's been written into it so far.
+	GLBuffer(const GLBuffer& _rhs);
 	~GLBuffer();
 
 	void Write(FileLike* _out) const;
@@ -58,14 +63,33 @@ public:
 
 	bool IsMapped() const { return mMapMode != EUnmapped; }
 
+	const void* GetContents() const { return mBufferContents.Get(); }
+
+	// Hands over the runs of the buffer (by offset into it) that the application changed through 
+	// mappings since the last call. The bytes are in GetContents.
+	void TakeWrittenRuns(std::vector<ByteRun>* _outRuns);
+
 	GLuint Create(const GLTrace* _trace) const;
 
+	// See SharedPayload::Pin.
+	void PinPayloads() const { mBufferContents.Pin(); }
+	void UnpinPayloads() const { mBufferContents.Unpin(); }
+
 private:
+	void AllocateFakeBuffer(const GLvoid* _initialContents, bool _discardContents);
+	void FreeFakeBuffer();
+
+	// Copies [_offset, _offset + _length) of the mapping to the driver's mapping, and what changed in 
+	// it to our contents. With a write-watched mapping, only the pages the application wrote in that 
+	// range are looked at.
+	void CopyFromFakeBuffer(size_t _offset, size_t _length);
+	void CopyFromFakeBufferRange(size_t _offset, size_t _length);
+
 	GLenum mTarget;
 
 	// The real contents of the buffer, as far as we know.
 	size_t mBufferSize;
-	GLvoid* mBufferContents;
+	SharedPayload mBufferContents;
 
 	GLenum mUsage;
 
@@ -77,4 +101,11 @@ private:
 
 	size_t mMapSize;
 	GLvoid* mFakeReturnedMappedPointer;
+	// mFakeReturnedMappedPointer came from VirtualAlloc with MEM_WRITE_WATCH (see WriteWatchBuffers).
+	bool mWriteWatched;
+
+	// What the current mapping told the driver to throw away.
+	ByteRun mInvalidatedRun;
+	// See TakeWrittenRuns.
+	std::vector<ByteRun> mWrittenRuns;
 };
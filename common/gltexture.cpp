@@ -337,6 +337,25 @@ void GLPixelTransferState::Set() const
 
 }
 
+// ------------------------------------------------------------------------------------------------
+bool GLPixelTransferState::operator==(const GLPixelTransferState& _rhs) const
+{
+	return mData_GL_MAP_COLOR == _rhs.mData_GL_MAP_COLOR
+		&& mData_GL_MAP_STENCIL == _rhs.mData_GL_MAP_STENCIL
+		&& mData_GL_INDEX_SHIFT == _rhs.mData_GL_INDEX_SHIFT
+		&& mData_GL_INDEX_OFFSET == _rhs.mData_GL_INDEX_OFFSET
+		&& mData_GL_RED_SCALE == _rhs.mData_GL_RED_SCALE
+		&& mData_GL_GREEN_SCALE == _rhs.mData_GL_GREEN_SCALE
+		&& mData_GL_BLUE_SCALE == _rhs.mData_GL_BLUE_SCALE
+		&& mData_GL_ALPHA_SCALE == _rhs.mData_GL_ALPHA_SCALE
+		&& mData_GL_DEPTH_SCALE == _rhs.mData_GL_DEPTH_SCALE
+		&& mData_GL_RED_BIAS == _rhs.mData_GL_RED_BIAS
+		&& mData_GL_GREEN_BIAS == _rhs.mData_GL_GREEN_BIAS
+		&& mData_GL_BLUE_BIAS == _rhs.mData_GL_BLUE_BIAS
+		&& mData_GL_ALPHA_BIAS == _rhs.mData_GL_ALPHA_BIAS
+		&& mData_GL_DEPTH_BIAS == _rhs.mData_GL_DEPTH_BIAS;
+}
+
 // ------------------------------------------------------------------------------------------------
 void GLPixelTransferState::glPixelTransferf(GLenum pname, GLfloat param)
 {
@@ -458,8 +477,7 @@ TextureUpdateData::TextureUpdateData(GLenum _target, GLint _level, GLint _intern
 , mType(_type)
 , mPixelStoreState(_pixelStoreState)
 , mPixelTransferState(_pixelTransferState)
-, mPixelData(_pixelData)
-, mPixelDataByteLength(_pixelDataByteLength)
+, mPixelData(_pixelData, _pixelDataByteLength)
 , mCompressed(_compressed)
 , mSubImageUpdate(_subImageUpdate)
 { 
@@ -479,8 +497,6 @@ TextureUpdateData::TextureUpdateData(const TextureUpdateData& _rhs)
 , mBorder(0)
 , mFormat(0)
 , mType(0)
-, mPixelData(NULL)
-, mPixelDataByteLength(0)
 , mCompressed(false)
 , mSubImageUpdate(false)
 {
@@ -505,11 +521,7 @@ TextureUpdateData& TextureUpdateData::operator=(const TextureUpdateData& _rhs)
 		mPixelStoreState = _rhs.mPixelStoreState;
 		mPixelTransferState = _rhs.mPixelTransferState;
 
-		if (_rhs.mPixelData) {
-			mPixelDataByteLength = _rhs.mPixelDataByteLength;
-			mPixelData = malloc(mPixelDataByteLength);
-			memcpy(mPixelData, _rhs.mPixelData, mPixelDataByteLength);
-		} 
+		mPixelData = _rhs.mPixelData;
 
 		mCompressed = _rhs.mCompressed;
 		mSubImageUpdate = _rhs.mSubImageUpdate;
@@ -536,8 +548,7 @@ TextureUpdateData& TextureUpdateData::operator=(TextureUpdateData&& _rhs)
 		mPixelStoreState = _rhs.mPixelStoreState;
 		mPixelTransferState = _rhs.mPixelTransferState;
 
-		mPixelData = _rhs.mPixelData;
-		mPixelDataByteLength = _rhs.mPixelDataByteLength;
+		mPixelData = std::move(_rhs.mPixelData);
 		mCompressed = _rhs.mCompressed;
 		mSubImageUpdate = _rhs.mSubImageUpdate;
 
@@ -552,8 +563,6 @@ TextureUpdateData& TextureUpdateData::operator=(TextureUpdateData&& _rhs)
 		_rhs.mBorder = 0;
 		_rhs.mFormat = 0;
 		_rhs.mType = 0;
-		_rhs.mPixelData = NULL;
-		_rhs.mPixelDataByteLength = 0;
 		_rhs.mCompressed = false;
 		_rhs.mSubImageUpdate = false;
 	}
@@ -578,7 +587,7 @@ void TextureUpdateData::Write(FileLike* _out) const
 	_out->Write(mPixelStoreState);
 	_out->Write(mPixelTransferState);
 	// TODO: Check mUsedDuringCapture here
-	_out->Write(mPixelData, mPixelDataByteLength);
+	_out->Write(mPixelData.Get(), mPixelData.GetLength());
 	_out->Write(mCompressed);
 	_out->Write(mSubImageUpdate);
 }
@@ -599,7 +608,10 @@ void TextureUpdateData::Read(FileLike* _in)
 	_in->Read(&mType);
 	_in->Read(&mPixelStoreState);
 	_in->Read(&mPixelTransferState);
-	_in->Read(&mPixelData, &mPixelDataByteLength); 
+	GLvoid* pixelData = NULL;
+	size_t pixelDataByteLength = 0;
+	_in->Read(&pixelData, &pixelDataByteLength); 
+	mPixelData = SharedPayload(pixelData, pixelDataByteLength);
 	_in->Read(&mCompressed);
 	_in->Read(&mSubImageUpdate);
 }
@@ -635,6 +647,26 @@ GLTexture::~GLTexture()
 
 }
 
+// ------------------------------------------------------------------------------------------------
+void GLTexture::PinPayloads() const
+{
+	for (auto levelIt = mUpdates.cbegin(); levelIt != mUpdates.cend(); ++levelIt) {
+		for (auto it = levelIt->second.cbegin(); it != levelIt->second.cend(); ++it) {
+			it->mPixelData.Pin();
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLTexture::UnpinPayloads() const
+{
+	for (auto levelIt = mUpdates.cbegin(); levelIt != mUpdates.cend(); ++levelIt) {
+		for (auto it = levelIt->second.cbegin(); it != levelIt->second.cend(); ++it) {
+			it->mPixelData.Unpin();
+		}
+	}
+}
+
 // ------------------------------------------------------------------------------------------------
 void GLTexture::Write(FileLike* _out) const
 {
@@ -662,7 +694,18 @@ void GLTexture::Write(FileLike* _out) const
 
 	_out->Write(mData_GL_TEXTURE_MAX_ANISOTROPY_EXT);
 
-	_out->Write(mSequentialUpdates);
+	// Written as the flat list it used to be, in the order Create plays them back.
+	size_t updateCount = 0;
+	for (auto levelIt = mUpdates.cbegin(); levelIt != mUpdates.cend(); ++levelIt) {
+		updateCount += levelIt->second.size();
+	}
+
+	_out->Write(updateCount);
+	for (auto levelIt = mUpdates.cbegin(); levelIt != mUpdates.cend(); ++levelIt) {
+		for (auto it = levelIt->second.cbegin(); it != levelIt->second.cend(); ++it) {
+			_out->Write(*it);
+		}
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -692,8 +735,15 @@ void GLTexture::Read(FileLike* _in)
 
 	_in->Read(&mData_GL_TEXTURE_MAX_ANISOTROPY_EXT);
 
-	_in->Read(&mSequentialUpdates);
-
+	// Whoever wrote these already dropped and merged what they could, so just index them.
+	mUpdates.clear();
+	size_t updateCount = 0;
+	_in->Read(&updateCount);
+	for (size_t i = 0; i < updateCount; ++i) {
+		TextureUpdateData update;
+		_in->Read(&update);
+		mUpdates[TargetLevel(update.mTarget, update.mLevel)].push_back(std::move(update));
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -753,7 +803,7 @@ void GLTexture::glCompressedTexImage2D(ContextState* _ctxState, GLenum target, G
 	}
 
 	TextureUpdateData update(target, level, internalformat, width, height, border, 0, 0, ourCopy, bufferLength, true, false, _ctxState->GetPixelStoreState(), _ctxState->GetPixelTransferState());
-	mSequentialUpdates = AppendTextureUpdate(mSequentialUpdates, update);
+	AddTextureUpdate(std::move(update));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -802,7 +852,7 @@ void GLTexture::glTexImage2D(ContextState* _ctxState, GLenum target, GLint level
 	}
 
 	TextureUpdateData update(target, level, internalformat, width, height, border, format, type, ourCopy, bufferLength, false, false, _ctxState->GetPixelStoreState(), _ctxState->GetPixelTransferState());
-	mSequentialUpdates = AppendTextureUpdate(mSequentialUpdates, update);
+	AddTextureUpdate(std::move(update));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -844,7 +894,7 @@ void GLTexture::glTexImage3D(ContextState* _ctxState, GLenum target, GLint level
 	}
 
 	TextureUpdateData update(target, level, internalFormat, width, height, border, format, type, ourCopy, bufferLength, false, false, _ctxState->GetPixelStoreState(), _ctxState->GetPixelTransferState(), 0, 0, depth);
-	mSequentialUpdates = AppendTextureUpdate(mSequentialUpdates, update);
+	AddTextureUpdate(std::move(update));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -887,7 +937,7 @@ void GLTexture::glTexSubImage2D(ContextState* _ctxState, GLenum target, GLint le
 	}
 
 	TextureUpdateData update(target, level, 0, width, height, 0, format, type, ourCopy, bufferLength, false, true, _ctxState->GetPixelStoreState(), _ctxState->GetPixelTransferState(), xoffset, yoffset);
-	mSequentialUpdates = AppendTextureUpdate(mSequentialUpdates, update);
+	AddTextureUpdate(std::move(update));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -1144,43 +1194,44 @@ GLuint GLTexture::Create(const GLTrace* _glTrace) const
 		::glBindTexture(mTarget, returnHandle);
 		CHECK_GL_ERROR();
 
-		for (auto it = mSequentialUpdates.cbegin(); it != mSequentialUpdates.cend(); ++it) {
-			it->mPixelStoreState.Set();
-			CHECK_GL_ERROR();
-			it->mPixelTransferState.Set();
-			CHECK_GL_ERROR();
-			if (it->IsSubImageUpdate()) {
-				if (it->Is2D()) {
-					if (it->IsCompressed()) {
-						assert(0);
+		for (auto levelIt = mUpdates.cbegin(); levelIt != mUpdates.cend(); ++levelIt) {
+			for (auto it = levelIt->second.cbegin(); it != levelIt->second.cend(); ++it) {
+				it->mPixelStoreState.Set();
+				CHECK_GL_ERROR();
+				it->mPixelTransferState.Set();
+				CHECK_GL_ERROR();
+				if (it->IsSubImageUpdate()) {
+					if (it->Is2D()) {
+						if (it->IsCompressed()) {
+							assert(0);
+						} else {
+							::glTexSubImage2D(it->mTarget, it->mLevel, it->mXOffset, it->mYOffset, it->mWidth, it->mHeight, it->mFormat, it->mType, it->GetPixelData());
+						}
 					} else {
-						::glTexSubImage2D(it->mTarget, it->mLevel, it->mXOffset, it->mYOffset, it->mWidth, it->mHeight, it->mFormat, it->mType, it->GetPixelData());
+						// Don't deal with 1D or 3D SubImage updates atm.
+						assert(0);
 					}
+					CHECK_GL_ERROR();
 				} else {
-					// Don't deal with 1D or 3D SubImage updates atm.
-					assert(0);
-				}
-				CHECK_GL_ERROR();
-			} else {
-				if (it->Is2D()) {
-					if (it->IsCompressed()) {
-						::glCompressedTexImage2D(it->mTarget, it->mLevel, it->mInternalFormat, it->mWidth, it->mHeight, it->mBorder, it->GetPixelDataByteLength(), it->GetPixelData());
+					if (it->Is2D()) {
+						if (it->IsCompressed()) {
+							::glCompressedTexImage2D(it->mTarget, it->mLevel, it->mInternalFormat, it->mWidth, it->mHeight, it->mBorder, it->GetPixelDataByteLength(), it->GetPixelData());
+						} else {
+							::glTexImage2D(it->mTarget, it->mLevel, it->mInternalFormat, it->mWidth, it->mHeight, it->mBorder, it->mFormat, it->mType, it->GetPixelData());
+						}
+					} else if (it->Is3D()) {
+						::glTexImage3D(it->mTarget, it->mLevel, it->mInternalFormat, it->mWidth, it->mHeight, it->mDepth, it->mBorder, it->mFormat, it->mType, it->GetPixelData());
+
 					} else {
-						::glTexImage2D(it->mTarget, it->mLevel, it->mInternalFormat, it->mWidth, it->mHeight, it->mBorder, it->mFormat, it->mType, it->GetPixelData());
+						// Shouldn't happen right now--I don't do 1D textures yet.
+						assert(0);
 					}
-				} else if (it->Is3D()) {
-					::glTexImage3D(it->mTarget, it->mLevel, it->mInternalFormat, it->mWidth, it->mHeight, it->mDepth, it->mBorder, it->mFormat, it->mType, it->GetPixelData());
-
-				} else {
-					// Shouldn't happen right now--I don't do 1D textures yet.
-					assert(0);
+					CHECK_GL_ERROR();
 				}
-				CHECK_GL_ERROR();
 			}
-
 		}
 	} else {
-		assert(mSequentialUpdates.size() == 0);
+		assert(mUpdates.empty());
 	}
 
 	// TODO: Set texture state. Doh.
@@ -1189,36 +1240,110 @@ GLuint GLTexture::Create(const GLTrace* _glTrace) const
 }
 
 // ------------------------------------------------------------------------------------------------
-std::vector<TextureUpdateData> GLTexture::AppendTextureUpdate(const std::vector<TextureUpdateData>& _currentList, const TextureUpdateData& _update)
+void GLTexture::AddTextureUpdate(TextureUpdateData&& _update)
 {
-	std::vector<TextureUpdateData> retVal;
-	retVal.reserve(_currentList.size() + 1);
-	
+	std::vector<TextureUpdateData>& levelUpdates = mUpdates[TargetLevel(_update.mTarget, _update.mLevel)];
+
+	// A new image replaces everything that was in the level.
+	if (!_update.IsSubImageUpdate()) {
+		levelUpdates.clear();
+		levelUpdates.push_back(std::move(_update));
+		return;
+	}
+
+	// Streaming into a level over and over shouldn't grow the texture--fold it into the image if we can.
+	if (levelUpdates.size() == 1 && MergeIntoLevelImage(&levelUpdates[0], _update)) {
+		return;
+	}
+
+	// Sub-image updates the new one covers completely are dead. The image that set the level up has to
+	// stay, since the sub-image updates need a surface to land on.
 	Rect2D updateRect = _update.GetUpdateRect();
-	for (auto it = _currentList.begin(); it != _currentList.end(); ++it) {
-		// Filter out updates to the same target and level, because this supercedes those.
-		// skipping the push at the bottom of the loop will filter out a previous update.
-		auto levelTargetPair = std::make_pair(it->mLevel, it->mTarget);
-
-		if (it->mLevel == _update.mLevel && it->mTarget == _update.mTarget) {
-			if (_update.mSubImageUpdate == false) {
-				continue;
-			}
+	for (auto it = levelUpdates.begin(); it != levelUpdates.end(); ) {
+		if (it->IsSubImageUpdate() && updateRect.Contains(it->GetUpdateRect())) {
+			it = levelUpdates.erase(it);
+		} else {
+			++it;
+		}
+	}
 
-#if 0 // This needs a little more love to make it robust
-			// Need to keep the first update because we need a texImage2D to setup the surface.
-			// We could destroy the texels that it stores, but don't for now--I'm lazy.
-			if (updateRect.Contains(it->GetUpdateRect())) {
-				continue;
-			}
-#endif
+	levelUpdates.push_back(std::move(_update));
+}
+
+// ------------------------------------------------------------------------------------------------
+bool GLTexture::MergeIntoLevelImage(TextureUpdateData* _levelImage, const TextureUpdateData& _update)
+{
+	assert(_levelImage && _update.IsSubImageUpdate());
+	if (_levelImage->IsSubImageUpdate() || !_levelImage->Is2D() || !_update.Is2D()) {
+		return false;
+	}
+
+	if (_levelImage->IsCompressed() || _update.IsCompressed()) {
+		return false;
+	}
+
+	// Images specified with a NULL pointer have nothing to merge into.
+	if (_levelImage->GetPixelData() == NULL || _update.GetPixelData() == NULL || _levelImage->mBorder != 0) {
+		return false;
+	}
+
+	if (_levelImage->mFormat != _update.mFormat || _levelImage->mType != _update.mType) {
+		return false;
+	}
+
+	// Both have to be plain rows of pixels, differing in nothing but their alignment.
+	const GLPixelStoreState* stores[] = { &_levelImage->mPixelStoreState, &_update.mPixelStoreState };
+	for (size_t i = 0; i < ARRAYSIZE(stores); ++i) {
+		if (stores[i]->glGet<GLint>(GL_UNPACK_ROW_LENGTH) != 0
+		 || stores[i]->glGet<GLint>(GL_UNPACK_SKIP_PIXELS) != 0
+		 || stores[i]->glGet<GLint>(GL_UNPACK_SKIP_ROWS) != 0
+		 || stores[i]->glGet<GLint>(GL_UNPACK_SWAP_BYTES) != 0
+		 || stores[i]->glGet<GLint>(GL_UNPACK_LSB_FIRST) != 0) {
+			return false;
 		}
+	}
 
-		retVal.push_back(*it);
+	// Pixel transfer is applied as the texels are specified, so merged texels would have to have gone 
+	// through the same one.
+	if (!(_levelImage->mPixelTransferState == _update.mPixelTransferState)) {
+		return false;
 	}
 
-	retVal.push_back(_update);
-	return retVal;
+	size_t bytesPerPixel = formatAndTypeToSizePerPixel(_update.mFormat, _update.mType);
+	if (bytesPerPixel == 0) {
+		return false;
+	}
+
+	if (_update.mXOffset < 0 || _update.mYOffset < 0 || _update.mWidth <= 0 || _update.mHeight <= 0
+	 || _update.mXOffset + _update.mWidth > _levelImage->mWidth
+	 || _update.mYOffset + _update.mHeight > _levelImage->mHeight) {
+		return false;
+	}
+
+	size_t dstRowLength = iceil<size_t>(bytesPerPixel * _levelImage->mWidth, _levelImage->mPixelStoreState.glGet<GLint>(GL_UNPACK_ALIGNMENT));
+	size_t srcRowLength = iceil<size_t>(bytesPerPixel * _update.mWidth, _update.mPixelStoreState.glGet<GLint>(GL_UNPACK_ALIGNMENT));
+	size_t copyLength = bytesPerPixel * _update.mWidth;
+
+	if (dstRowLength * (_levelImage->mHeight - 1) + bytesPerPixel * _levelImage->mWidth > _levelImage->GetPixelDataByteLength()
+	 || srcRowLength * (_update.mHeight - 1) + copyLength > _update.GetPixelDataByteLength()) {
+		return false;
+	}
+
+	// Anybody else still holding the image (an earlier capture of the texture, say) keeps the old texels.
+	unsigned char* dst = (unsigned char*) _levelImage->mPixelData.GetWritable();
+	const unsigned char* src = (const unsigned char*) _update.GetPixelData();
+	if (!dst) {
+		return false;
+	}
+
+	dst += dstRowLength * _update.mYOffset + bytesPerPixel * _update.mXOffset;
+	for (GLsizei row = 0; row < _update.mHeight; ++row) {
+		memcpy(dst, src, copyLength);
+		dst += dstRowLength;
+		src += srcRowLength;
+	}
+
+	return true;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <map>
 #include <vector>
 
 class ContextState;
@@ -205,6 +206,8 @@ public:
 
 	void Set() const;
 
+	bool operator==(const GLPixelTransferState& _rhs) const;
+
 private:
 	GLboolean mData_GL_MAP_COLOR;
 	GLboolean mData_GL_MAP_STENCIL;
@@ -242,8 +245,8 @@ public:
 	void Write(FileLike* _out) const;
 	void Read(FileLike* _in);
 
-	const GLvoid* GetPixelData() const { return mPixelData; }
-	size_t GetPixelDataByteLength() const { return mPixelDataByteLength; }
+	const GLvoid* GetPixelData() const { return mPixelData.Get(); }
+	size_t GetPixelDataByteLength() const { return mPixelData.GetLength(); }
 	bool IsCompressed() const { return mCompressed; }
 	bool IsSubImageUpdate() const { return mSubImageUpdate; }
 	bool Is2D() const { return mDepth == -1; }
@@ -274,20 +277,15 @@ private:
 	GLPixelStoreState mPixelStoreState;
 	GLPixelTransferState mPixelTransferState;
 
-	GLvoid* mPixelData;
-	size_t mPixelDataByteLength;
+	// Never changes once the update's been made, so copies of the update (and of the texture) share it.
+	SharedPayload mPixelData;
 
 	bool mCompressed;
 	bool mSubImageUpdate;
 
 	inline void ReleaseData()
 	{
-		if (mPixelData) {
-			free(mPixelData);
-			mPixelData = NULL;
-		}
-
-		mPixelDataByteLength = 0;
+		mPixelData.Reset();
 	}
 
 	// TODO: Add accessors, get rid of friendliness.
@@ -321,6 +319,10 @@ public:
 
 	GLuint Create(const GLTrace* _trace) const;
 
+	// See SharedPayload::Pin.
+	void PinPayloads() const;
+	void UnpinPayloads() const;
+
 private:
 	// Stored both here and in the update to determine if we need to bail out early.
 	GLenum mTarget;
@@ -345,9 +347,17 @@ private:
 
 	GLfloat mData_GL_TEXTURE_MAX_ANISOTROPY_EXT;
 
-	std::vector<TextureUpdateData> mSequentialUpdates;
+	// Replaying a texture's updates per (target, level) rebuilds it--updates to different levels don't 
+	// depend on each other. Within a level they're in the order they were made, minus the ones that 
+	// later updates have made pointless.
+	typedef std::pair<GLenum, GLint> TargetLevel;
+	std::map<TargetLevel, std::vector<TextureUpdateData>> mUpdates;
+
+	void AddTextureUpdate(TextureUpdateData&& _update);
 
-	std::vector<TextureUpdateData> AppendTextureUpdate(const std::vector<TextureUpdateData>& _currentList, const TextureUpdateData& _update);
+	// Copies a sub-image update into the level's image, if that's all the level has and the pixels 
+	// are laid out the same way. Returns false if the update has to be kept on its own.
+	static bool MergeIntoLevelImage(TextureUpdateData* _levelImage, const TextureUpdateData& _update);
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -28,21 +28,93 @@
 
 #include "stdafx.h"
 #include "gltrace.h"
+#include "tracewriter.h"
 
 #include "common/functionhooks.gen.h"
 #include "common/extensions.h"
 
-const unsigned int kEndianTestValue = 0x12345678;
-
 GLTrace* gReplayTrace = NULL;
 
+// ------------------------------------------------------------------------------------------------
+// Has payloads read through _in come out of _arena for as long as it's around, even if reading throws.
+class ScopedPayloadArena
+{
+public:
+	ScopedPayloadArena(FileLike* _in, PayloadArena* _arena)
+	: mIn(_in)
+	, mPrevArena(_in->GetPayloadArena())
+	{
+		mIn->SetPayloadArena(_arena);
+	}
+
+	~ScopedPayloadArena() { mIn->SetPayloadArena(mPrevArena); }
+
+private:
+	FileLike* mIn;
+	PayloadArena* mPrevArena;
+};
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+TraceFileSource::TraceFileSource(const TCHAR* _filename, ETraceLoadMode _loadMode)
+: mFile(NULL)
+, mMappedFile(NULL)
+, mFileLike(NULL)
+{
+	if (_loadMode == ETLM_Mapped) {
+		mMappedFile = MappedFile::Open(_filename);
+		if (mMappedFile) {
+			mFileLike = new FileLike(mMappedFile);
+			return;
+		}
+
+		// Most likely there wasn't enough contiguous address space. Reading it is slower, but works.
+		LogWarn(TC("Couldn't map trace '%s', falling back to reading it."), _filename);
+	}
+
+	if (_tfopen_s(&mFile, _filename, TC("rb")) != 0) {
+		throw 10;
+	}
+	assert(mFile);
+
+	mFileLike = new FileLike(mFile);
+}
+
+// ------------------------------------------------------------------------------------------------
+TraceFileSource::~TraceFileSource()
+{
+	SafeDelete(mFileLike);
+	SafeDelete(mMappedFile);
+	if (mFile) {
+		fclose(mFile);
+		mFile = NULL;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+MappedFile* TraceFileSource::DetachMappedFile()
+{
+	MappedFile* retVal = mMappedFile;
+	mMappedFile = NULL;
+	return retVal;
+}
+
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 GLTrace::GLTrace()
 : mContextState(NULL)
+, mContextStateGeneration(0)
+, mContextStateContext(0)
 , mMaxTextureHandle(0)
 , mProgramGLSL(0)
+, mReplayDC(NULL)
+, mMainReplayContext(NULL)
+, mCurrentTraceContext(NULL)
+, mCurrentFrame(0)
+, mMappedFile(NULL)
+, mBlobStore(NULL)
 {
 	mContextState = new ContextState;
 	gContextState = mContextState;
@@ -51,9 +123,16 @@ GLTrace::GLTrace()
 // ------------------------------------------------------------------------------------------------
 GLTrace::~GLTrace()
 {
+	DeleteReplayContexts();
+
 	gContextState = NULL;
 	SafeDelete(mContextState);
+	mGLCommands.clear();
+	mPayloads.Clear();
 
+	// These must go last, everything above may reference them.
+	SafeDelete(mBlobStore);
+	SafeDelete(mMappedFile);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -68,11 +147,47 @@ void GLTrace::Reset()
 	SafeDelete(mContextState);
 	mContextState = new ContextState;
 	
+	mContextStateGeneration = 0;
+	mContextStateContext = 0;
+	
 	// Set the global state
 	gContextState = mContextState;
 
-	// TODO: This leaks--need to actually free all of the memory in these commands.
+	ResetCommands();
+
+	SafeDelete(mBlobStore);
+	SafeDelete(mMappedFile);
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLTrace::ResetCommands()
+{
+	// The commands don't own their payloads, so there's nothing to free one by one.
 	mGLCommands.clear();
+	mPayloads.Clear();
+	mFrames.clear();
+	mCurrentFrame = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLTrace::DeleteReplayContexts()
+{
+	if (!mMainReplayContext) {
+		return;
+	}
+
+	// Whoever's playing us expects to be left on the context they started us on.
+	::wglMakeCurrent(mReplayDC, mMainReplayContext);
+	for (auto it = mReplayContexts.cbegin(); it != mReplayContexts.cend(); ++it) {
+		if (it->second.mReplayContext != mMainReplayContext) {
+			::wglDeleteContext(it->second.mReplayContext);
+		}
+	}
+
+	mReplayContexts.clear();
+	mReplayDC = NULL;
+	mMainReplayContext = NULL;
+	mCurrentTraceContext = NULL;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -84,56 +199,342 @@ void GLTrace::ReadContextState(FileLike *_from)
 // ------------------------------------------------------------------------------------------------
 void GLTrace::RecvGLCommand(const SSerializeDataPacket& _pkt)
 {
+	// A SwapBuffers closes the frame it's in, anything after it starts the next one.
+	if (mFrames.empty() || mGLCommands.back().mDataType == ESTSwapBuffersData) {
+		mFrames.push_back(Frame(mGLCommands.size()));
+	}
+
 	mGLCommands.push_back(_pkt);
+	++mFrames.back().mCommandCount;
 }
 
 // ------------------------------------------------------------------------------------------------
-void GLTrace::Save(const TCHAR* _filename)
+bool GLTrace::ReceiveCapture(FileLike* _in, const TCHAR* _filename, ETraceCodec _codec, bool _stream)
 {
-	FILE* wfp = 0;
-	if (_tfopen_s(&wfp, _filename, TC("wb")) != 0) {
-		throw 10;
+	unsigned int generation = 0;
+	unsigned __int64 context = 0;
+	unsigned int baseGeneration = ReceiveCaptureHeader(_in, &generation, &context);
+	if (baseGeneration == 0) {
+		// Reset for a new frame capture.
+		Reset();
+		_in->Read(mContextState);
+	} else {
+		// Only the objects that changed are coming, on top of the state from the last capture.
+		if (baseGeneration != mContextStateGeneration || context != mContextStateContext) {
+			LogError(TC("Application sent context state changes since generation %d of context 0x%I64x, but we have generation %d of context 0x%I64x."), baseGeneration, context, mContextStateGeneration, (unsigned __int64)mContextStateContext);
+			throw 8;
+		}
+
+		ResetCommands();
+		mContextStateGeneration = 0;
+		mContextState->ReadDelta(_in);
 	}
-	assert(wfp);
+	mContextStateContext = context;
+	mContextStateGeneration = generation;
+	LogInfo(TC("Received Context State!"));
 
-	{
-		FileLike out(wfp);
+	// When streaming, the commands are written as they arrive and we don't hold on to any of them.
+	if (_stream) {
+		return StreamCaptureCommands(_in, mContextState, _filename, _codec);
+	}
+
+	ReceiveCaptureCommands(_in, this, NULL);
+
+	LogInfo(TC("Saving capture to %s..."), _filename);
+	Save(_filename, _codec);
+
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool GLTrace::StreamCapture(FileLike* _in, const TCHAR* _filename, ETraceCodec _codec)
+{
+	unsigned int generation = 0;
+	unsigned __int64 context = 0;
+	if (ReceiveCaptureHeader(_in, &generation, &context) != 0) {
+		LogError(TC("Application sent context state changes, but there's no earlier capture to apply them to."));
+		throw 8;
+	}
+
+	ContextState contextState;
+	_in->Read(&contextState);
+	LogInfo(TC("Received Context State!"));
+
+	return StreamCaptureCommands(_in, &contextState, _filename, _codec);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool GLTrace::StreamCaptureCommands(FileLike* _in, const ContextState* _contextState, const TCHAR* _filename, ETraceCodec _codec)
+{
+	LogInfo(TC("Streaming capture to %s..."), _filename);
+	TraceStreamWriter streamWriter(_filename, _codec);
+	streamWriter.SubmitContextState(_contextState);
+
+	ReceiveCaptureCommands(_in, NULL, &streamWriter);
+
+	if (!streamWriter.Finish()) {
+		LogError(TC("Failed to write capture to %s."), _filename);
+		return false;
+	}
+
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+unsigned int GLTrace::ReceiveCaptureHeader(FileLike* _in, unsigned int* _outGeneration, unsigned __int64* _outContext)
+{
+	assert(_outGeneration);
+	assert(_outContext);
+
+	unsigned int packetFormatVersion = 0;
+	_in->Read(&packetFormatVersion);
+	if (packetFormatVersion != kPacketFormatVersion) {
+		LogError(TC("Application is sending packet format version %d, but we expected %d. Are eztrace and inception from the same build?"), packetFormatVersion, kPacketFormatVersion);
+		throw 8;
+	}
+
+	unsigned int baseGeneration = 0;
+	_in->Read(&baseGeneration);
+	_in->Read(_outGeneration);
+	_in->Read(_outContext);
+	return baseGeneration;
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLTrace::ReceiveCaptureCommands(FileLike* _in, GLTrace* _collectInto, TraceStreamWriter* _streamTo)
+{
+	assert((_collectInto == NULL) != (_streamTo == NULL));
+
+	size_t lastPacketCommand = (size_t)-1;
+	int frameCommandCount = 0;
+	
+	SSerializeDataPacket lastPkt;
+
+	// TODO: Make this async again. 
+	_in->Read(Checkpoint("FrameCommandsBegin"));
+	LogInfo(TC("Beginning to collect frame commands..."));
+
+	// Collected commands keep their payloads for as long as the trace keeps them. Streamed ones are freed 
+	// one by one as soon as they've been written.
+	ScopedPayloadArena scopedArena(_in, _collectInto ? &_collectInto->mPayloads : NULL);
+
+	// TODO: Receive the rest of the trace here!
+	while (1) {
+		size_t payloadBytesBefore = _in->GetPayloadBytesRead();
+		SSerializeDataPacket pkt;
+		_in->Read(&pkt);
+
+		if (lastPacketCommand != (size_t)-1 && pkt.mPacketId != lastPacketCommand + 1) {
+			LogError(TC("We went out of sync with the application."));
+			throw 8;
+		}
+
+		// Print before handing the packet off--the stream writer frees its payloads once it's written.
+		if (pkt.mDataType == EST_Message) {
+			PrintTraceMessage(pkt.mData_Message.level, pkt.mData_Message.messageBody);
+		}
+
+		if (_streamTo) {
+			_streamTo->SubmitPacket(pkt, _in->GetPayloadBytesRead() - payloadBytesBefore);
+		} else {
+			_collectInto->RecvGLCommand(pkt);
+		}
+			
+		// For debugging.
+		lastPkt = pkt;
+		// Book-keeping, also for debugging.
+		lastPacketCommand = pkt.mPacketId;
+		++frameCommandCount;
+
+		// Once we get the sentinel, let's bail.
+		if (pkt.mDataType == EST_Sentinel) {
+			LogInfo(TC("Received %d frame commands"), frameCommandCount);
+			break;
+		}
+	}
+
+	_in->Read(Checkpoint("FrameCommandsEnd"));
+	_in->Read(Checkpoint("TraceCapturingEnd"));
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLTrace::Save(const TCHAR* _filename, ETraceCodec _codec)
+{
+	TraceWriter writer(_filename, _codec, false);
+	writer.WriteContextState(*mContextState);
+	for (auto frameIt = mFrames.cbegin(); frameIt != mFrames.cend(); ++frameIt) {
+		for (size_t i = 0; i < frameIt->mCommandCount; ++i) {
+			writer.WritePacket(mGLCommands[frameIt->mFirstCommand + i]);
+		}
+	}
+	writer.Finish();
+}
+
+// ------------------------------------------------------------------------------------------------
+GLTrace* GLTrace::Load(const TCHAR* _filename, ETraceLoadMode _loadMode)
+{
+	return LoadPacketRange(_filename, 0, (size_t)-1, _loadMode);
+}
 
-		out.Write(Checkpoint("GLTrace"));
-		unsigned int endianCheck = kEndianTestValue;
-		out.Write(endianCheck); // To deal with endianness.
+// ------------------------------------------------------------------------------------------------
+GLTrace* GLTrace::LoadFrame(const TCHAR* _filename, unsigned int _frameNumber, ETraceLoadMode _loadMode)
+{
+	TraceFileSource source(_filename, _loadMode);
+	TraceIndex index;
+	ReadHeader(source.GetFileLike(), &index, _filename);
 
-		// TODO: Should probably write out some metadata like resolution, extensions used, errors encountered, etc.
+	size_t firstBlock = index.FindFirstBlockForFrame(_frameNumber);
+	size_t endBlock = firstBlock;
+	if (firstBlock == (size_t)-1) {
+		LogError(TC("Trace '%s' has no frame %d (it has %d frames)."), _filename, _frameNumber, index.GetFrameCount());
+		firstBlock = endBlock = 0;
+	} else {
+		endBlock = firstBlock + index.GetFrame(_frameNumber).mBlockCount;
+	}
 
-		out.Write(*mContextState);
-		out.Write(mGLCommands);
+	GLTrace* retTrace = LoadBlocks(&source, index, firstBlock, endBlock);
+
+	// Frames that repeat this one (or that it repeats) come along with its blocks, we only want the one.
+	if (retTrace->mFrames.size() > 1) {
+		retTrace->mFrames.resize(1);
 	}
 
-	fclose(wfp);
+	return retTrace;
+}
+
+// ------------------------------------------------------------------------------------------------
+GLTrace* GLTrace::LoadPacketRange(const TCHAR* _filename, size_t _firstPacketId, size_t _lastPacketId, ETraceLoadMode _loadMode)
+{
+	TraceFileSource source(_filename, _loadMode);
+	TraceIndex index;
+	ReadHeader(source.GetFileLike(), &index, _filename);
+
+	size_t firstBlock = 0, 
+	       endBlock = 0;
+
+	size_t packetCount = index.GetPacketCount();
+	if (_firstPacketId < packetCount && _firstPacketId <= _lastPacketId) {
+		_lastPacketId = min(_lastPacketId, packetCount - 1);
+		firstBlock = index.FindBlockForPacket(_firstPacketId);
+		endBlock = index.FindBlockForPacket(_lastPacketId) + 1;
+		assert(firstBlock != (size_t)-1 && endBlock != 0);
+	}
+
+	return LoadBlocks(&source, index, firstBlock, endBlock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLTrace::LoadIndex(const TCHAR* _filename, TraceIndex* _outIndex)
+{
+	assert(_outIndex);
+
+	TraceFileSource source(_filename, ETLM_Read);
+	ReadHeader(source.GetFileLike(), _outIndex, _filename);
 }
 
 // ------------------------------------------------------------------------------------------------
-GLTrace* GLTrace::Load(const TCHAR* _filename)
+void GLTrace::ReadHeader(FileLike* _in, TraceIndex* _outIndex, const TCHAR* _filename)
 {
-	FILE* rfp = 0;
-	if (_tfopen_s(&rfp, _filename, TC("rb")) != 0) {
+	_in->Read(Checkpoint("GLTrace"));
+	unsigned int endianCheck;
+	_in->Read(&endianCheck);
+	assert(kEndianTestValue == endianCheck);
+
+	unsigned int packetFormatVersion = 0;
+	_in->Read(&packetFormatVersion);
+	if (packetFormatVersion != kPacketFormatVersion) {
+		LogError(TC("Trace '%s' uses packet format version %d, but only version %d is supported."), _filename, packetFormatVersion, kPacketFormatVersion);
+		throw 10;
+	}
+
+	unsigned int containerVersion = 0;
+	_in->Read(&containerVersion);
+	if (containerVersion != kTraceContainerVersion) {
+		LogError(TC("Trace '%s' uses container version %d, but only version %d is supported."), _filename, containerVersion, kTraceContainerVersion);
 		throw 10;
 	}
-	assert(rfp);
 
+	unsigned int codec = ETC_None;
+	_in->Read(&codec);
+	if (codec >= ETC_Count) {
+		LogError(TC("Trace '%s' was written with an unknown codec (%d)."), _filename, codec);
+		throw 10;
+	}
+
+	TraceFileOffset indexOffset = kInvalidTraceFileOffset;
+	_in->Read(&indexOffset);
+	TraceFileOffset chunkTableOffset = kInvalidTraceFileOffset;
+	_in->Read(&chunkTableOffset);
+	if (indexOffset == kInvalidTraceFileOffset) {
+		LogError(TC("Trace '%s' has no index--it was probably not completely written."), _filename);
+		throw 10;
+	}
+
+	_in->BeginDecoding((ETraceCodec)codec, chunkTableOffset);
+	_in->Seek(indexOffset);
+	_in->Read(_outIndex);
+}
+
+// ------------------------------------------------------------------------------------------------
+GLTrace* GLTrace::LoadBlocks(TraceFileSource* _source, const TraceIndex& _index, size_t _firstBlock, size_t _endBlock)
+{
+	assert(_firstBlock <= _endBlock && _endBlock <= _index.GetBlockCount());
+	assert(_index.HasSection(ETS_ContextState));
+	assert(_index.HasSection(ETS_Blobs));
+
+	FileLike* in = _source->GetFileLike();
 	GLTrace *retTrace = new GLTrace;
+
+	// Payloads read from here on may point into the mapping, so the trace needs to keep it alive.
+	retTrace->mMappedFile = _source->DetachMappedFile();
+
+	// Payloads in everything else refer to the blobs, so they need to be read first.
+	in->Seek(_index.GetSectionOffset(ETS_Blobs));
+	retTrace->mBlobStore = new BlobStore;
+	in->Read(retTrace->mBlobStore);
+	in->SetBlobStore(retTrace->mBlobStore);
+
+	in->Seek(_index.GetSectionOffset(ETS_ContextState));
+	in->Read(retTrace->mContextState);
+
+	size_t packetCount = 0;
+	for (size_t blockNum = _firstBlock; blockNum < _endBlock; ++blockNum) {
+		packetCount += _index.GetBlock(blockNum).mPacketCount;
+	}
+	retTrace->mGLCommands.resize(packetCount);
+
+	// Remember where each block's commands went, for putting the frames back together.
+	std::vector<size_t> blockFirstCommand;
+	blockFirstCommand.reserve(_endBlock - _firstBlock + 1);
+
+	size_t packetNum = 0;
 	{
-		FileLike in(rfp);
-		
-		in.Read(Checkpoint("GLTrace"));
-		unsigned int endianCheck;
-		in.Read(&endianCheck);
-		assert(kEndianTestValue == endianCheck);
+		ScopedPayloadArena scopedArena(in, &retTrace->mPayloads);
+		for (size_t blockNum = _firstBlock; blockNum < _endBlock; ++blockNum) {
+			const TraceBlockInfo& block = _index.GetBlock(blockNum);
+			blockFirstCommand.push_back(packetNum);
+			in->Seek(block.mOffset);
+			for (size_t i = 0; i < block.mPacketCount; ++i) {
+				in->Read(&retTrace->mGLCommands[packetNum++]);
+			}
+		}
+	}
+	blockFirstCommand.push_back(packetNum);
+
+	// Only frames that were loaded completely can be played as frames.
+	for (unsigned int frameNum = 0; frameNum < _index.GetFrameCount(); ++frameNum) {
+		const TraceFrameInfo& frame = _index.GetFrame(frameNum);
+		if (frame.mBlockCount > 0 && frame.mFirstBlock >= _firstBlock && frame.mFirstBlock + frame.mBlockCount <= _endBlock) {
+			size_t firstCommand = blockFirstCommand[frame.mFirstBlock - _firstBlock];
+			size_t endCommand = blockFirstCommand[frame.mFirstBlock + frame.mBlockCount - _firstBlock];
+			retTrace->mFrames.push_back(Frame(firstCommand, endCommand - firstCommand));
+		}
+	}
 
-		in.Read(retTrace->mContextState);
-		in.Read(&(retTrace->mGLCommands));
+	// Otherwise (e.g. a range of commands from the middle of a frame), play whatever we've got as one.
+	if (retTrace->mFrames.empty() && packetNum > 0) {
+		retTrace->mFrames.push_back(Frame(0, packetNum));
 	}
-	fclose(rfp);
 
 	return retTrace;
 }
@@ -144,32 +545,33 @@ void GLTrace::CreateResources()
 	CHECK_GL_ERROR();
 
 	// TODO: Other resources.
-	const auto& textures = mContextState->GetTextureObjects();
+	const GLSharedObjects* sharedObjects = mContextState->GetSharedObjects();
+	const auto& textures = sharedObjects->mTextureObjects;
 	for (auto it = textures.cbegin(); it != textures.cend(); ++it) {
 		CreateTexture(it->first, it->second);
 	}
 
-	const auto& buffers = mContextState->GetBufferObjects();
+	const auto& buffers = sharedObjects->mBufferObjects;
 	for (auto it = buffers.cbegin(); it != buffers.cend(); ++it) {
 		CreateBuffer(it->first, it->second);
 	}
 
-	const auto& shaders = mContextState->GetShaderObjectsGLSL();
+	const auto& shaders = sharedObjects->mShaderObjectsGLSL;
 	for (auto it = shaders.cbegin(); it != shaders.cend(); ++it) {
 		CreateShader(it->first, it->second);
 	}
 
-	const auto& programs = mContextState->GetProgramObjectsGLSL();
+	const auto& programs = sharedObjects->mProgramObjectsGLSL;
 	for (auto it = programs.cbegin(); it != programs.cend(); ++it) {
 		CreateProgram(it->first, it->second);
 	}
 
-	const auto& programsARB = mContextState->GetProgramObjectsARB();
+	const auto& programsARB = sharedObjects->mProgramObjectsARB;
 	for (auto it = programsARB.cbegin(); it != programsARB.cend(); ++it) {
 		CreateProgramARB(it->first, it->second);
 	}
 
-	const auto& renderbuffers = mContextState->GetRenderBufferObjects();
+	const auto& renderbuffers = sharedObjects->mRenderBufferObjects;
 	for (auto it = renderbuffers.cbegin(); it != renderbuffers.cend(); ++it) {
 		CreateRenderBuffer(it->first, it->second);
 	}
@@ -179,7 +581,7 @@ void GLTrace::CreateResources()
 		CreateFrameBufferObject(it->first, it->second);
 	}
 
-	const auto& samplers = mContextState->GetSamplerObjects();
+	const auto& samplers = sharedObjects->mSamplerObjects;
 	for (auto it = samplers.cbegin(); it != samplers.cend(); ++it) {
 		CreateSamplerObject(it->first, it->second);
 	}
@@ -297,12 +699,55 @@ void GLTrace::Render()
 {
 	CHECK_GL_ERROR();
 
-	int commandNum = 0;
-	for (auto it = mGLCommands.cbegin(); it != mGLCommands.cend(); ++it) {
-		it->Play();
+	if (mFrames.empty()) {
+		return;
+	}
+
+	const Frame& frame = mFrames[mCurrentFrame];
+	for (size_t i = 0; i < frame.mCommandCount; ++i) {
+		mGLCommands[frame.mFirstCommand + i].Play();
 		CHECK_GL_ERROR();
-		++commandNum;
 	}
+
+	mCurrentFrame = (mCurrentFrame + 1) % mFrames.size();
+}
+
+// ------------------------------------------------------------------------------------------------
+void GLTrace::MakeCurrent(HGLRC _traceContext)
+{
+	HGLRC traceContext = mCurrentTraceContext ? mCurrentTraceContext : mContextState->GetContext();
+	if (_traceContext == traceContext) {
+		return;
+	}
+
+	if (!mMainReplayContext) {
+		mReplayDC = ::wglGetCurrentDC();
+		mMainReplayContext = ::wglGetCurrentContext();
+		ReplayContext& mainContext = mReplayContexts[traceContext];
+		mainContext.mReplayContext = mMainReplayContext;
+		mainContext.mProgramGLSL = 0;
+	}
+
+	auto it = mReplayContexts.find(_traceContext);
+	if (it == mReplayContexts.end()) {
+		ReplayContext created;
+		created.mReplayContext = ::wglCreateContext(mReplayDC);
+		created.mProgramGLSL = 0;
+		if (!created.mReplayContext || !::wglShareLists(mMainReplayContext, created.mReplayContext)) {
+			Once(TraceError(TC("Couldn't create a context to replay the trace's context %p on, playing it on the current one."), _traceContext));
+			if (created.mReplayContext) {
+				::wglDeleteContext(created.mReplayContext);
+			}
+			return;
+		}
+
+		it = mReplayContexts.insert(std::make_pair(_traceContext, created)).first;
+	}
+
+	mReplayContexts[traceContext].mProgramGLSL = mProgramGLSL;
+	::wglMakeCurrent(mReplayDC, it->second.mReplayContext);
+	mProgramGLSL = it->second.mProgramGLSL;
+	mCurrentTraceContext = _traceContext;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -31,6 +31,9 @@
 #include <map>
 #include <vector>
 
+#include "common/payloadarena.h"
+
+class BlobStore;
 class ContextState;
 class FileLike;
 class GLBuffer;
@@ -41,8 +44,38 @@ class GLRenderBufferObject;
 class GLSampler;
 class GLShader;
 class GLTexture;
+class MappedFile;
+class TraceIndex;
+class TraceStreamWriter;
 struct SSerializeDataPacket;
 
+enum ETraceLoadMode
+{
+	ETLM_Read,		// Read everything into memory up front.
+	ETLM_Mapped,	// Map the trace, payloads reference the mapping and are only paged in when used. 
+					// Compressed traces still have to be decoded into memory, but are decoded from the mapping.
+};
+
+// ------------------------------------------------------------------------------------------------
+// Owns whatever a trace is being loaded from--either a file we're reading or a mapping of it.
+class TraceFileSource
+{
+public:
+	TraceFileSource(const TCHAR* _filename, ETraceLoadMode _loadMode);
+	~TraceFileSource();
+
+	FileLike* GetFileLike() const { return mFileLike; }
+
+	// Hands ownership of the mapping (if there is one) to the caller.
+	MappedFile* DetachMappedFile();
+
+private:
+	FILE* mFile;
+	MappedFile* mMappedFile;
+	FileLike* mFileLike;
+};
+
+// ------------------------------------------------------------------------------------------------
 class GLTrace
 {
 public:
@@ -55,16 +88,45 @@ public:
 	void ReadContextState(FileLike* _from);
 	void RecvGLCommand(const SSerializeDataPacket& _pkt);
 
-	void Save(const TCHAR* _filename);
-	static GLTrace* Load(const TCHAR* _filename);
+	// Receives one capture as the hooks send it (see OnCaptureStart/OnCaptureEnd), picking up right 
+	// after its "TraceCapturingBegin" checkpoint, and writes it to _filename. With _stream, commands are 
+	// written as they arrive instead of being collected first. Returns false if the file couldn't be 
+	// written.
+	// The context state is kept afterwards, so that the next capture only needs to send what changed in 
+	// it (see GetCaptureStateGeneration).
+	bool ReceiveCapture(FileLike* _in, const TCHAR* _filename, ETraceCodec _codec, bool _stream);
+
+	// The application's context state generation that our context state matches, and the context it's
+	// of, for asking the next capture to only send what changed since. 0 if we don't have one.
+	unsigned int GetCaptureStateGeneration() const { return mContextStateGeneration; }
+	unsigned __int64 GetCaptureStateContext() const { return mContextStateContext; }
+
+	// Same as ReceiveCapture with _stream, but without a GLTrace. Constructing a GLTrace points 
+	// gContextState at the trace's state, which mustn't happen inside the application being traced. 
+	// With nothing kept from an earlier capture, the capture must come with the whole context state.
+	static bool StreamCapture(FileLike* _in, const TCHAR* _filename, ETraceCodec _codec);
+
+	void Save(const TCHAR* _filename, ETraceCodec _codec = ETC_LZ);
+	static GLTrace* Load(const TCHAR* _filename, ETraceLoadMode _loadMode = ETLM_Read);
+
+	// Load only part of the commands in a trace. The full context state is always loaded. Commands are 
+	// loaded a block at a time, so the result may include commands on either side of the requested range.
+	static GLTrace* LoadFrame(const TCHAR* _filename, unsigned int _frameNumber, ETraceLoadMode _loadMode = ETLM_Read);
+	static GLTrace* LoadPacketRange(const TCHAR* _filename, size_t _firstPacketId, size_t _lastPacketId, ETraceLoadMode _loadMode = ETLM_Read);
+
+	// Read just the index of a trace, for tools that want to decide what to load.
+	static void LoadIndex(const TCHAR* _filename, TraceIndex* _outIndex);
 
 	void CreateResources();
 	void RestoreContextState();
 	void BindResources();
 
+	// Plays one frame per call, starting over after the last one.
 	void Render();
 	bool IsReplayComplete() const;
 
+	size_t GetFrameCount() const { return mFrames.size(); }
+
 	ContextState* GetContextState() const { return mContextState; }
 	
 	// For a given handle from a trace, return the handle of that object to replay with.
@@ -81,6 +143,11 @@ public:
 
 	void glUseProgram(GLuint program) { mProgramGLSL = program; }
 
+	// Switches replay to the context standing in for _traceContext. The trace's own context is the one 
+	// that was current when we started playing; the others are created the first time the trace uses 
+	// them, sharing its objects.
+	void MakeCurrent(HGLRC _traceContext);
+
 	inline GLint GetUniformLocation(GLint _traceLocation) 
 	{
 		// -1 is a safe value, per OGL spec.
@@ -111,8 +178,58 @@ private:
 	GLuint mMaxTextureHandle;
 	GLuint mProgramGLSL;
 
+	struct ReplayContext
+	{
+		HGLRC mReplayContext;
+		// mProgramGLSL while this context isn't current.
+		GLuint mProgramGLSL;
+	};
+
+	// By their handles in the trace. Empty until the trace first switches contexts.
+	std::map<HGLRC, ReplayContext> mReplayContexts;
+	HDC mReplayDC;
+	HGLRC mMainReplayContext;
+	// NULL while we're on the trace's own context.
+	HGLRC mCurrentTraceContext;
+
+	// Commands are only stored once. A frame is a run of them, ending with a SwapBuffers (or at the end 
+	// of the trace); consecutive frames that were identical share the same run.
+	struct Frame
+	{
+		Frame(size_t _firstCommand=0, size_t _commandCount=0) : mFirstCommand(_firstCommand), mCommandCount(_commandCount) { }
+
+		size_t mFirstCommand;
+		size_t mCommandCount;
+	};
+
 	ContextState* mContextState;
+	// Written by the capture thread, read by whoever asks for the next capture. The generation is 0 
+	// while the context is being changed.
+	volatile unsigned int mContextStateGeneration;
+	volatile unsigned __int64 mContextStateContext;
 	std::vector<SSerializeDataPacket> mGLCommands;
+	// Where the payloads of mGLCommands that were read into the heap live. They go when the commands do.
+	PayloadArena mPayloads;
+	std::vector<Frame> mFrames;
+	size_t mCurrentFrame;
+
+	// Non-NULL when the trace was loaded with ETLM_Mapped.
+	MappedFile* mMappedFile;
+
+	// Non-NULL when the trace was loaded from a file. Payloads in the trace may point into it.
+	BlobStore* mBlobStore;
+
+	static void ReadHeader(FileLike* _in, TraceIndex* _outIndex, const TCHAR* _filename);
+	void ResetCommands();
+	void DeleteReplayContexts();
+
+	// Reads what precedes the context state in a capture. Returns the generation the context state that 
+	// follows is a delta against, or 0 if it's all there.
+	static unsigned int ReceiveCaptureHeader(FileLike* _in, unsigned int* _outGeneration, unsigned __int64* _outContext);
+	static bool StreamCaptureCommands(FileLike* _in, const ContextState* _contextState, const TCHAR* _filename, ETraceCodec _codec);
+	// Commands go to exactly one of _collectInto and _streamTo.
+	static void ReceiveCaptureCommands(FileLike* _in, GLTrace* _collectInto, TraceStreamWriter* _streamTo);
+	static GLTrace* LoadBlocks(TraceFileSource* _source, const TraceIndex& _index, size_t _firstBlock, size_t _endBlock);
 
 	void CreateTexture(GLuint _traceTextureHandle, const GLTexture* _glTexture);
 	void CreateBuffer(GLuint _traceBufferHandle, const GLBuffer* _glBuffer);
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "hash128.h"
+
+// ------------------------------------------------------------------------------------------------
+static inline unsigned int Rotl32(unsigned int _x, int _r)
+{
+	return (_x << _r) | (_x >> (32 - _r));
+}
+
+// ------------------------------------------------------------------------------------------------
+static inline unsigned int FMix32(unsigned int _h)
+{
+	_h ^= _h >> 16;
+	_h *= 0x85ebca6b;
+	_h ^= _h >> 13;
+	_h *= 0xc2b2ae35;
+	_h ^= _h >> 16;
+	return _h;
+}
+
+// ------------------------------------------------------------------------------------------------
+static inline unsigned int ReadBlock32(const unsigned char* _p)
+{
+	unsigned int retVal;
+	memcpy(&retVal, _p, sizeof(retVal));
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void Hash128::Read(FileLike* _in)
+{
+	_in->Read(&mLow);
+	_in->Read(&mHigh);
+}
+
+// ------------------------------------------------------------------------------------------------
+void Hash128::Write(FileLike* _out) const
+{
+	_out->Write(mLow);
+	_out->Write(mHigh);
+}
+
+// ------------------------------------------------------------------------------------------------
+Hash128 HashBytes(const void* _bytes, size_t _len, unsigned int _seed)
+{
+	const unsigned char* data = (const unsigned char*)_bytes;
+	const size_t blockCount = _len / 16;
+
+	unsigned int h1 = _seed;
+	unsigned int h2 = _seed;
+	unsigned int h3 = _seed;
+	unsigned int h4 = _seed;
+
+	const unsigned int c1 = 0x239b961b; 
+	const unsigned int c2 = 0xab0e9789;
+	const unsigned int c3 = 0x38b34ae5; 
+	const unsigned int c4 = 0xa1e38b93;
+
+	for (size_t i = 0; i < blockCount; ++i) {
+		const unsigned char* block = data + i * 16;
+		unsigned int k1 = ReadBlock32(block + 0);
+		unsigned int k2 = ReadBlock32(block + 4);
+		unsigned int k3 = ReadBlock32(block + 8);
+		unsigned int k4 = ReadBlock32(block + 12);
+
+		k1 *= c1; k1 = Rotl32(k1, 15); k1 *= c2; h1 ^= k1;
+		h1 = Rotl32(h1, 19); h1 += h2; h1 = h1 * 5 + 0x561ccd1b;
+
+		k2 *= c2; k2 = Rotl32(k2, 16); k2 *= c3; h2 ^= k2;
+		h2 = Rotl32(h2, 17); h2 += h3; h2 = h2 * 5 + 0x0bcaa747;
+
+		k3 *= c3; k3 = Rotl32(k3, 17); k3 *= c4; h3 ^= k3;
+		h3 = Rotl32(h3, 15); h3 += h4; h3 = h3 * 5 + 0x96cd1c35;
+
+		k4 *= c4; k4 = Rotl32(k4, 18); k4 *= c1; h4 ^= k4;
+		h4 = Rotl32(h4, 13); h4 += h1; h4 = h4 * 5 + 0x32ac3b17;
+	}
+
+	// Tail
+	const unsigned char* tail = data + blockCount * 16;
+	unsigned int k1 = 0;
+	unsigned int k2 = 0;
+	unsigned int k3 = 0;
+	unsigned int k4 = 0;
+
+	switch (_len & 15) {
+	case 15: k4 ^= tail[14] << 16;
+	case 14: k4 ^= tail[13] << 8;
+	case 13: k4 ^= tail[12] << 0;
+		k4 *= c4; k4 = Rotl32(k4, 18); k4 *= c1; h4 ^= k4;
+
+	case 12: k3 ^= tail[11] << 24;
+	case 11: k3 ^= tail[10] << 16;
+	case 10: k3 ^= tail[ 9] << 8;
+	case  9: k3 ^= tail[ 8] << 0;
+		k3 *= c3; k3 = Rotl32(k3, 17); k3 *= c4; h3 ^= k3;
+
+	case  8: k2 ^= tail[ 7] << 24;
+	case  7: k2 ^= tail[ 6] << 16;
+	case  6: k2 ^= tail[ 5] << 8;
+	case  5: k2 ^= tail[ 4] << 0;
+		k2 *= c2; k2 = Rotl32(k2, 16); k2 *= c3; h2 ^= k2;
+
+	case  4: k1 ^= tail[ 3] << 24;
+	case  3: k1 ^= tail[ 2] << 16;
+	case  2: k1 ^= tail[ 1] << 8;
+	case  1: k1 ^= tail[ 0] << 0;
+		k1 *= c1; k1 = Rotl32(k1, 15); k1 *= c2; h1 ^= k1;
+	};
+
+	// Finalization
+	h1 ^= (unsigned int)_len; 
+	h2 ^= (unsigned int)_len; 
+	h3 ^= (unsigned int)_len; 
+	h4 ^= (unsigned int)_len;
+
+	h1 += h2; h1 += h3; h1 += h4;
+	h2 += h1; h3 += h1; h4 += h1;
+
+	h1 = FMix32(h1);
+	h2 = FMix32(h2);
+	h3 = FMix32(h3);
+	h4 = FMix32(h4);
+
+	h1 += h2; h1 += h3; h1 += h4;
+	h2 += h1; h3 += h1; h4 += h1;
+
+	return Hash128(((unsigned __int64)h2 << 32) | h1, ((unsigned __int64)h4 << 32) | h3);
+}
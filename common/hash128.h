@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// ------------------------------------------------------------------------------------------------
+// A 128-bit content hash. Used to identify payloads by their contents (see BlobStore).
+struct Hash128
+{
+	Hash128() : mLow(0), mHigh(0) { }
+	Hash128(unsigned __int64 _low, unsigned __int64 _high) : mLow(_low), mHigh(_high) { }
+
+	bool operator==(const Hash128& _rhs) const { return mLow == _rhs.mLow && mHigh == _rhs.mHigh; }
+	bool operator!=(const Hash128& _rhs) const { return !(*this == _rhs); }
+	bool operator<(const Hash128& _rhs) const { return mHigh < _rhs.mHigh || (mHigh == _rhs.mHigh && mLow < _rhs.mLow); }
+
+	void Read(FileLike* _in);
+	void Write(FileLike* _out) const;
+
+	unsigned __int64 mLow;
+	unsigned __int64 mHigh;
+};
+
+// MurmurHash3 (x86, 128-bit variant)--fast on the 32-bit builds we ship, and plenty for telling 
+// payloads apart.
+Hash128 HashBytes(const void* _bytes, size_t _len, unsigned int _seed = 0);
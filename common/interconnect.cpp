@@ -31,12 +31,91 @@
 
 #include "common/filelike.h"
 #include "common/functionhooks.gen.h"
+#include "common/sendring.h"
 
+// How long the send thread lets a trickle of small sends sit in the ring before sending them anyway.
+const DWORD kSendThreadIdleTimeoutMs = 5;
 
-const size_t kSendBufferSize = 1024 * 1024;
+// How long we give the send thread to get everything out when the stream is torn down.
+const DWORD kSendThreadShutdownTimeoutMs = 5000;
+
+// The client only ever sends the odd RemoteCommand, so its ring is small and wakes the host right away.
+const size_t kSharedClientRingSize = 64 * 1024;
+const size_t kSharedClientRingHighWaterMark = 1;
+
+// How long a shared memory receive waits for the other side before checking on the ring again.
+const DWORD kSharedRecvTimeoutMs = 5;
+
+// How long the client keeps looking for the host's shared memory before giving up.
+const DWORD kSharedConnectTimeoutMs = 10000;
+const DWORD kSharedConnectRetryMs = 10;
+
+// At the start of the shared memory, followed by the host's ring and then the client's.
+struct SharedTransportHeader
+{
+	volatile LONG mReady;	// Set by the host once both rings are initialized.
+	size_t mHostRingOffset;
+	size_t mClientRingOffset;
+};
+
+const size_t kSharedTransportHeaderSize = 64;
+
+const TCHAR* kMessageTransportVariable = TC("GFXTRACE_TRANSPORT");
 
 MessageStream* gMessageStream = NULL;
 
+// ------------------------------------------------------------------------------------------------
+bool ParseMessageTransport(const TCHAR* _name, EMessageTransport* _outTransport)
+{
+	assert(_outTransport);
+	for (int i = 0; i < EMT_Count; ++i) {
+		if (i == EMT_Loopback) {
+			continue;
+		}
+
+		if (_tcsicmp(_name, MessageTransportName((EMessageTransport)i)) == 0) {
+			(*_outTransport) = (EMessageTransport)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// ------------------------------------------------------------------------------------------------
+const TCHAR* MessageTransportName(EMessageTransport _transport)
+{
+	switch (_transport) {
+	case EMT_Socket:		return TC("socket");
+	case EMT_SharedMemory:	return TC("shm");
+	case EMT_Loopback:		return TC("loopback");
+	default:				assert(!"Unknown transport in MessageTransportName"); break;
+	}
+	return TC("unknown");
+}
+
+// ------------------------------------------------------------------------------------------------
+void SetMessageTransportForChildProcesses(EMessageTransport _transport)
+{
+	SetEnvironmentVariable(kMessageTransportVariable, MessageTransportName(_transport));
+}
+
+// ------------------------------------------------------------------------------------------------
+EMessageTransport GetMessageTransportFromEnvironment()
+{
+	TCHAR name[32] = { 0 };
+	DWORD len = GetEnvironmentVariable(kMessageTransportVariable, name, sizeof(name) / sizeof(name[0]));
+	if (len == 0 || len >= sizeof(name) / sizeof(name[0])) {
+		return EMT_Socket;
+	}
+
+	EMessageTransport retVal = EMT_Socket;
+	if (!ParseMessageTransport(name, &retVal)) {
+		LogWarn(TC("Unknown transport '%s' in %s, using sockets."), name, kMessageTransportVariable);
+	}
+	return retVal;
+}
+
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
@@ -47,31 +126,90 @@ NetworkError::NetworkError(int _errorNum)
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
-MessageStream::MessageStream(bool _isHost, const char* _address, const char* _port)
+MessageStream::MessageStream(bool _isHost, const char* _address, const char* _port, EMessageTransport _transport)
 : mHost(_isHost)
+, mTransport(_transport)
 , mSocket(INVALID_SOCKET)
 , mHostAddressInfo(NULL)
 , mNextPacketId(0)
-, mSendBuffer(NULL)
+, mSendRing(NULL)
+, mSendThreadHandle(NULL)
+, mStopSendThread(false)
+, mSharedMapping(NULL)
+, mSharedView(NULL)
+, mRecvRing(NULL)
+, mRecvBuffer(NULL)
+, mRecvStart(0)
+, mRecvEnd(0)
 , mAddress(_address)
 , mPort(_port)
 {
-	SetupSocket();
+	mRecvBuffer = (unsigned char*)_aligned_malloc(kRecvBufferSize, kRecvBufferAlignment);
+	if (!mRecvBuffer) {
+		throw 8;
+	}
+
+	if (mTransport == EMT_SharedMemory) {
+		SetupSharedMemory();
+	} else if (mTransport == EMT_Loopback) {
+		SetupLoopback();
+	} else {
+		SetupSocket();
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
 MessageStream::~MessageStream()
 {
-	if (mSendBuffer) { 
-		// Try to get our data out.
-		FlushSendBuffer(true);
-		SafeDelete(mSendBuffer);
+	if (mTransport != EMT_Socket) {
+		// Closing our rings is how the other side finds out we've gone away. Whatever is still in
+		// the outgoing ring gets drained first.
+		if (mSendRing) {
+			mSendRing->Flush();
+			mSendRing->Close();
+		}
+		if (mRecvRing) {
+			mRecvRing->Close();
+		}
+		if (mRecvRing == mSendRing) {
+			mRecvRing = NULL;
+		}
+		SafeDelete(mSendRing);
+		SafeDelete(mRecvRing);
+
+		if (mSharedView) {
+			UnmapViewOfFile(mSharedView);
+			mSharedView = NULL;
+		}
+		if (mSharedMapping) {
+			CloseHandle(mSharedMapping);
+			mSharedMapping = NULL;
+		}
+		_aligned_free(mRecvBuffer);
+		mRecvBuffer = NULL;
+		return;
+	}
+
+	if (mSendRing) { 
+		// Try to get our data out. If the process is exiting the send thread is already gone, in which 
+		// case there's nobody to send it anyway.
+		mStopSendThread = true;
+		mSendRing->Flush();
+		if (WaitForSingleObject(mSendThreadHandle, kSendThreadShutdownTimeoutMs) == WAIT_OBJECT_0) {
+			CloseHandle(mSendThreadHandle);
+			mSendThreadHandle = NULL;
+			SafeDelete(mSendRing);
+		} else {
+			// Still stuck in a send. Leak the ring rather than pull it out from under the thread.
+			mSendRing->Close();
+		}
 	}
 
 	SafeDelete(mHostAddressInfo);
+	_aligned_free(mRecvBuffer);
+	mRecvBuffer = NULL;
 
 	WSACleanup();
-
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -143,8 +281,6 @@ void MessageStream::SetupHostSocket()
 	}
 
 	Handshake();
-
-	// mSendBuffer = new SimpleBuffer(kSendBufferSize);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -197,49 +333,220 @@ void MessageStream::Handshake()
 
 	if (mHost) {
 		fileLike.Write(syn);
+		fileLike.Flush();
+		FlushSendBuffer();
 		fileLike.Read(&ack);
 	} else {
 		fileLike.Read(&syn);
 		fileLike.Write(ack);
+		fileLike.Flush();
+		FlushSendBuffer();
+	}
+
+	if (mTransport == EMT_Socket) {
+		// Turn on non-blocking modes for sockets now.
+		u_long asyncMode = 1;
+		ioctlsocket(mSocket, FIONBIO, &asyncMode);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+std::string MessageStream::GetSharedObjectName(const char* _suffix) const
+{
+	return std::string("Local\\gfxtrace_") + mPort + _suffix;
+}
+
+// ------------------------------------------------------------------------------------------------
+void MessageStream::SetupSharedMemory()
+{
+	if (mHost) {
+		assert(gOptions);
+		size_t hostRingSize = 1;
+		while (hostRingSize < gOptions->SendRingSize) {
+			hostRingSize <<= 1;
+		}
+
+		size_t hostRingOffset = kSharedTransportHeaderSize;
+		size_t clientRingOffset = hostRingOffset + SendRing::GetSharedSize(hostRingSize);
+		size_t totalSize = clientRingOffset + SendRing::GetSharedSize(kSharedClientRingSize);
+
+		mSharedMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)totalSize, GetSharedObjectName("").c_str());
+		if (mSharedMapping == NULL) {
+			LogVerbose(TC("Host: Failed creating shared memory"));
+			throw 2;
+		}
+
+		if (GetLastError() == ERROR_ALREADY_EXISTS) {
+			// Somebody else is already capturing--same as failing to bind the port.
+			LogVerbose(TC("Host: Shared memory is already in use"));
+			CloseHandle(mSharedMapping);
+			mSharedMapping = NULL;
+			throw 3;
+		}
+
+		mSharedView = MapViewOfFile(mSharedMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (mSharedView == NULL) {
+			LogVerbose(TC("Host: Failed mapping shared memory"));
+			CloseHandle(mSharedMapping);
+			mSharedMapping = NULL;
+			throw 5;
+		}
+
+		SharedTransportHeader* header = (SharedTransportHeader*)mSharedView;
+		header->mHostRingOffset = hostRingOffset;
+		header->mClientRingOffset = clientRingOffset;
+		SendRing::InitializeShared((unsigned char*)mSharedView + hostRingOffset, hostRingSize, gOptions->SendRingHighWaterMark);
+		SendRing::InitializeShared((unsigned char*)mSharedView + clientRingOffset, kSharedClientRingSize, kSharedClientRingHighWaterMark);
+		InterlockedExchange(&header->mReady, 1);
+	} else {
+		// The host creates the shared memory when it starts up, which may not have happened yet.
+		DWORD startTime = GetTickCount();
+		while ((mSharedMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, GetSharedObjectName("").c_str())) == NULL) {
+			if (GetTickCount() - startTime > kSharedConnectTimeoutMs) {
+				LogVerbose(TC("Client: Couldn't find the host's shared memory. We're gonna crash."));
+				throw 2;
+			}
+			Sleep(kSharedConnectRetryMs);
+		}
+
+		mSharedView = MapViewOfFile(mSharedMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (mSharedView == NULL) {
+			LogVerbose(TC("Client: Failed mapping shared memory"));
+			CloseHandle(mSharedMapping);
+			mSharedMapping = NULL;
+			throw 5;
+		}
+
+		SharedTransportHeader* header = (SharedTransportHeader*)mSharedView;
+		while (header->mReady == 0) {
+			if (GetTickCount() - startTime > kSharedConnectTimeoutMs) {
+				LogVerbose(TC("Client: The host never finished setting up shared memory."));
+				throw 2;
+			}
+			Sleep(kSharedConnectRetryMs);
+		}
+		MemoryBarrier();
+	}
+
+	AttachSharedRings();
+	Handshake();
+}
+
+// ------------------------------------------------------------------------------------------------
+void MessageStream::SetupLoopback()
+{
+	assert(gOptions);
+	mSendRing = new SendRing(gOptions->SendRingSize, gOptions->SendRingHighWaterMark);
+	mRecvRing = mSendRing;
+}
+
+// ------------------------------------------------------------------------------------------------
+void MessageStream::AttachSharedRings()
+{
+	// Named events are created by whichever side gets there first and opened by the other.
+	HANDLE hostSpace = CreateEventA(NULL, FALSE, FALSE, GetSharedObjectName("_host_space").c_str());
+	HANDLE hostData = CreateEventA(NULL, FALSE, FALSE, GetSharedObjectName("_host_data").c_str());
+	HANDLE clientSpace = CreateEventA(NULL, FALSE, FALSE, GetSharedObjectName("_client_space").c_str());
+	HANDLE clientData = CreateEventA(NULL, FALSE, FALSE, GetSharedObjectName("_client_data").c_str());
+	if (!hostSpace || !hostData || !clientSpace || !clientData) {
+		LogVerbose(TC("Failed creating shared memory events"));
+		throw 2;
+	}
+
+	const SharedTransportHeader* header = (const SharedTransportHeader*)mSharedView;
+	SendRing* hostRing = new SendRing((unsigned char*)mSharedView + header->mHostRingOffset, hostSpace, hostData);
+	SendRing* clientRing = new SendRing((unsigned char*)mSharedView + header->mClientRingOffset, clientSpace, clientData);
+
+	mSendRing = mHost ? hostRing : clientRing;
+	mRecvRing = mHost ? clientRing : hostRing;
+}
+
+// ------------------------------------------------------------------------------------------------
+DWORD WINAPI MessageStream_RunSendThread(LPVOID _streamPtr)
+{
+	((MessageStream*)_streamPtr)->Thread_Send();
+	return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+void MessageStream::EnableSendRing(size_t _capacity, size_t _highWaterMark)
+{
+	if (mTransport != EMT_Socket) {
+		return;
 	}
 
-	// Turn on non-blocking modes for sockets now.
-	u_long asyncMode = 1;
-	ioctlsocket(mSocket, FIONBIO, &asyncMode);
+	assert(mSendRing == NULL);
+	assert(mSocket != INVALID_SOCKET);
+
+	mSendRing = new SendRing(_capacity, _highWaterMark);
+	mSendThreadHandle = CreateThread(NULL, 0, MessageStream_RunSendThread, this, 0, NULL);
+	if (!mSendThreadHandle) {
+		SafeDelete(mSendRing);
+		throw 8;
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
-void MessageStream::FlushSendBuffer(bool _optional)
+void MessageStream::FlushSendBuffer()
 {
-	size_t bufferedByteSize = 0;
-	const void* bufferBytes = mSendBuffer->GetBytes(&bufferedByteSize);
-	if (bufferedByteSize > 0) {
-		ReallySend(bufferBytes, bufferedByteSize, _optional);
-		mSendBuffer->EmptyBuffer();
+	if (mSendRing) {
+		mSendRing->Flush();
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
 void MessageStream::BufferedSend(const void* _bytes, size_t _size, bool _optional)
 {
-	if (!mSendBuffer) { 
+	if (!mSendRing) { 
 		ReallySend(_bytes, _size, _optional);
 		return;
 	}
 
-	if (!mSendBuffer->WouldOverflow(_size)) {
-		mSendBuffer->AddBytes(_bytes, _size);
-	} else { 
-		// Time to flush the cache.
- 		FlushSendBuffer(false);
+	// The ring is only closed if the send thread hit an error, which is where ReallySend would have thrown.
+	if (!mSendRing->Write(_bytes, _size) && !_optional) {
+		throw 7;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void MessageStream::SendGather(const SendSegment* _segments, size_t _count)
+{
+	assert(_count <= kMaxSendSegments);
+	if (!mSendRing) {
+		ReallySendGather(_segments, _count);
+		return;
+	}
+
+	for (size_t i = 0; i < _count; ++i) {
+		if (_segments[i].mLen > 0 && !mSendRing->Write(_segments[i].mBytes, _segments[i].mLen)) {
+			throw 7;
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void MessageStream::Thread_Send()
+{
+	try {
+		while (1) {
+			size_t byteCount = 0;
+			const void* bytes = mSendRing->Peek(&byteCount);
+			if (byteCount == 0) {
+				if (mStopSendThread || mSendRing->IsClosed()) {
+					return;
+				}
+
+				mSendRing->WaitForData(kSendThreadIdleTimeoutMs);
+				continue;
+			}
 
-		// Check to see if the packet is larger than the send buffer 
-		if (mSendBuffer->WouldOverflow(_size)) { 
-			ReallySend(_bytes, _size, _optional); 
-		} else { 
-			mSendBuffer->AddBytes(_bytes, _size);
+			ReallySend(bytes, byteCount);
+			mSendRing->Consume(byteCount);
 		}
-	} 
+	} catch (...) {
+		// Unblock the producer; its next send will fail.
+		mSendRing->Close();
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -253,13 +560,15 @@ void MessageStream::ReallySend(const void* _bytes, size_t _size, bool _optional)
 		if (sentThisTime == SOCKET_ERROR) {
 			int socketError = WSAGetLastError();
 			if (socketError == WSAEWOULDBLOCK) {
-				// Try again. Don't sleep, because that nukes performance from orbit.
+				// The socket buffer is full. Sleep until it has room, rather than spinning on it.
+				WaitForSocket(true, INFINITE);
 				continue;
 			}
 			
 			if (!_optional) { 
 				throw 7;
 			} 
+			break;
 		}
 		if (sentThisTime == 0) {
 			if (!_optional) {
@@ -273,45 +582,243 @@ void MessageStream::ReallySend(const void* _bytes, size_t _size, bool _optional)
 	} while (bytesSent < _size);
 }
 
+// ------------------------------------------------------------------------------------------------
+void MessageStream::ReallySendGather(const SendSegment* _segments, size_t _count)
+{
+	WSABUF buffers[kMaxSendSegments];
+	DWORD bufferCount = 0;
+	for (size_t i = 0; i < _count; ++i) {
+		if (_segments[i].mLen > 0) {
+			buffers[bufferCount].buf = (CHAR*)_segments[i].mBytes;
+			buffers[bufferCount].len = (ULONG)_segments[i].mLen;
+			++bufferCount;
+		}
+	}
+
+	WSABUF* nextBuffer = buffers;
+	while (bufferCount > 0) {
+		DWORD sentThisTime = 0;
+		if (WSASend(mSocket, nextBuffer, bufferCount, &sentThisTime, 0, NULL, NULL) == SOCKET_ERROR) {
+			if (WSAGetLastError() == WSAEWOULDBLOCK) {
+				WaitForSocket(true, INFINITE);
+				continue;
+			}
+			throw 7;
+		}
+
+		if (sentThisTime == 0) {
+			throw 6;
+		}
+
+		// Skip whatever went out. A partial send can stop in the middle of a buffer.
+		while (bufferCount > 0 && sentThisTime >= nextBuffer->len) {
+			sentThisTime -= nextBuffer->len;
+			++nextBuffer;
+			--bufferCount;
+		}
+
+		if (bufferCount > 0) {
+			nextBuffer->buf += sentThisTime;
+			nextBuffer->len -= sentThisTime;
+		}
+	}
+}
 
 // ------------------------------------------------------------------------------------------------
+bool MessageStream::WaitForSocket(bool _writable, DWORD _timeoutMs)
+{
+	fd_set sockets;
+	FD_ZERO(&sockets);
+	FD_SET(mSocket, &sockets);
+
+	// Errors show up as readable (so the recv that follows reports them), or in the exception set.
+	fd_set errorSockets;
+	FD_ZERO(&errorSockets);
+	FD_SET(mSocket, &errorSockets);
+
+	struct timeval timeout = { 0 };
+	timeout.tv_sec = _timeoutMs / 1000;
+	timeout.tv_usec = (_timeoutMs % 1000) * 1000;
+
+	// The first parameter is ignored by Winsock.
+	int ready = select(0, _writable ? NULL : &sockets, _writable ? &sockets : NULL, &errorSockets, 
+	                   _timeoutMs == INFINITE ? NULL : &timeout);
+	if (ready == SOCKET_ERROR) {
+		throw NetworkError(WSAGetLastError());
+	}
+
+	if (FD_ISSET(mSocket, &errorSockets)) {
+		int socketError = 0;
+		int optionLen = sizeof(socketError);
+		getsockopt(mSocket, SOL_SOCKET, SO_ERROR, (char*)&socketError, &optionLen);
+		throw NetworkError(socketError ? socketError : WSAECONNRESET);
+	}
+
+	return ready > 0;
+}
+
 // ------------------------------------------------------------------------------------------------
+bool MessageStream::WaitForRecv(DWORD _timeoutMs)
+{
+	if (mRecvEnd > mRecvStart) {
+		return true;
+	}
+
+	if (!mRecvRing) {
+		return WaitForSocket(false, _timeoutMs);
+	}
+
+	if (mRecvRing->IsEmpty() && !mRecvRing->IsClosed()) {
+		mRecvRing->WaitForData(_timeoutMs);
+	}
+	return !mRecvRing->IsEmpty() || mRecvRing->IsClosed();
+}
+
 // ------------------------------------------------------------------------------------------------
-SimpleBuffer::SimpleBuffer(size_t _bufferSize)
-: mBuffer(NULL)
-, mEnd(0)
-, mSize(_bufferSize)
+void MessageStream::WaitForTransport()
 {
-	mBuffer = (unsigned char *)malloc(mSize);
-	if (!mBuffer) {
-		throw 8;
+	if (mRecvRing) {
+		// The ring only signals at its high-water mark, so check back on it every so often.
+		mRecvRing->WaitForData(kSharedRecvTimeoutMs);
+	} else {
+		WaitForSocket(false, INFINITE);
 	}
 }
 
 // ------------------------------------------------------------------------------------------------
-SimpleBuffer::~SimpleBuffer()
+size_t MessageStream::RecvAvailable(void* _out, size_t _maxLen)
 {
-	free(mBuffer);
-	mBuffer = NULL;
+	if (mRecvRing) {
+		unsigned char* dst = (unsigned char*)_out;
+		size_t totalDataRead = 0;
+		while (totalDataRead < _maxLen) {
+			size_t byteCount = 0;
+			const void* bytes = mRecvRing->Peek(&byteCount);
+			if (byteCount == 0) {
+				break;
+			}
+
+			size_t toCopy = min(byteCount, _maxLen - totalDataRead);
+			memcpy(dst + totalDataRead, bytes, toCopy);
+			mRecvRing->Consume(toCopy);
+			totalDataRead += toCopy;
+		}
+
+		// Only once it's drained, so we don't lose the last thing the other side said.
+		if (totalDataRead == 0 && mRecvRing->IsClosed()) {
+			throw NetworkError(WSAECONNRESET);
+		}
+		return totalDataRead;
+	}
+
+	int dataRead = recv(mSocket, (char*)_out, (int)_maxLen, 0);
+	if (dataRead == SOCKET_ERROR) {
+		int errorNum = WSAGetLastError(); 
+		if (errorNum == WSAEWOULDBLOCK) {
+			return 0;
+		// I've split these into two blocks because one of them is expected and the other isn't.
+		} else if (errorNum == WSAECONNRESET) {
+			// The remote client disconnected, probably not an issue.
+			throw NetworkError(errorNum);
+		} else {
+			// Some other wonky network error--place a breakpoint here.
+			throw NetworkError(errorNum);
+		}
+	} else if (dataRead == 0) {
+		// The remote side closed the connection gracefully. Same thing as far as we're concerned.
+		throw NetworkError(WSAECONNRESET);
+	}
+
+	return (size_t)dataRead;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool MessageStream::FillRecvBufferIfAvailable()
+{
+	assert(mRecvStart == mRecvEnd);
+	mRecvStart = 0;
+	mRecvEnd = RecvAvailable(mRecvBuffer, kRecvBufferSize);
+	return mRecvEnd > 0;
 }
 
 // ------------------------------------------------------------------------------------------------
-bool SimpleBuffer::AddBytes(const void* _bytes, size_t _size)
+const unsigned char* MessageStream::FillRecvBuffer(size_t _len, size_t* _outBufferedLen)
 {
-	if (WouldOverflow(_size)) { 
-		return false;
+	assert(_len < kRecvDirectSize);
+	assert(_outBufferedLen);
+
+	if (mRecvEnd - mRecvStart < _len) {
+		// Move the leftovers (less than _len) to the front, then fill in behind them.
+		memmove(mRecvBuffer, mRecvBuffer + mRecvStart, mRecvEnd - mRecvStart);
+		mRecvEnd -= mRecvStart;
+		mRecvStart = 0;
+
+		while (mRecvEnd < _len) {
+			size_t dataRead = RecvAvailable(mRecvBuffer + mRecvEnd, kRecvBufferSize - mRecvEnd);
+			if (dataRead == 0) {
+				WaitForTransport();
+			}
+			mRecvEnd += dataRead;
+		}
 	}
 
-	memcpy((unsigned char*)mBuffer + mEnd, _bytes, _size);
-	mEnd += _size;
+	(*_outBufferedLen) = mRecvEnd - mRecvStart;
+	return mRecvBuffer + mRecvStart;
+}
 
-	return true;
+// ------------------------------------------------------------------------------------------------
+void MessageStream::ConsumeRecvBuffer(size_t _len)
+{
+	assert(_len <= mRecvEnd - mRecvStart);
+	mRecvStart += _len;
 }
 
 // ------------------------------------------------------------------------------------------------
-bool SimpleBuffer::WouldOverflow(size_t _requestedSize) const
+unsigned char* MessageStream::DetachRecvBuffer()
 {
-	return mEnd + _requestedSize > mSize;
+	unsigned char* newBuffer = (unsigned char*)_aligned_malloc(kRecvBufferSize, kRecvBufferAlignment);
+	if (!newBuffer) {
+		LogError(TC("Couldn't allocate a new receive buffer."));
+		throw 1;
+	}
+
+	unsigned char* retVal = mRecvBuffer;
+	memcpy(newBuffer, mRecvBuffer + mRecvStart, mRecvEnd - mRecvStart);
+	mRecvEnd -= mRecvStart;
+	mRecvStart = 0;
+	mRecvBuffer = newBuffer;
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void MessageStream::BlockingRecvSlow(void* _outBuffer, size_t _len)
+{
+	// Use up whatever we have first.
+	unsigned char* dst = (unsigned char*)_outBuffer;
+	size_t buffered = mRecvEnd - mRecvStart;
+	assert(buffered < _len);
+	memcpy(dst, mRecvBuffer + mRecvStart, buffered);
+	mRecvStart = mRecvEnd = 0;
+	dst += buffered;
+	_len -= buffered;
+
+	if (_len < kRecvDirectSize) {
+		size_t bufferedLen = 0;
+		const unsigned char* bytes = FillRecvBuffer(_len, &bufferedLen);
+		memcpy(dst, bytes, _len);
+		ConsumeRecvBuffer(_len);
+		return;
+	}
+
+	// Big receives (texture and buffer payloads) go straight where they're going.
+	while (_len > 0) {
+		size_t dataRead = RecvAvailable(dst, _len);
+		if (dataRead == 0) {
+			WaitForTransport();
+		}
+		dst += dataRead;
+		_len -= dataRead;
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -320,11 +827,16 @@ void RemoteCommand::Read(FileLike* _fileLike)
 	unsigned int myCommand = 0;
 	_fileLike->Read(&myCommand);
 	mRemoteCommandType = (EnumRemoteCommand)myCommand;
+	_fileLike->Read(&mFrameCount);
+	_fileLike->Read(&mBaseGeneration);
+	_fileLike->Read(&mBaseContext);
 }
 
 // ------------------------------------------------------------------------------------------------
 void RemoteCommand::Write(FileLike* _fileLike) const
 {
 	_fileLike->Write((unsigned int)mRemoteCommandType);
-
+	_fileLike->Write(mFrameCount);
+	_fileLike->Write(mBaseGeneration);
+	_fileLike->Write(mBaseContext);
 }
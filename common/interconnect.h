@@ -34,10 +34,47 @@
 #include <WS2tcpip.h>
 
 static const char* kPort = "34199";
+
+// How much MessageStream receives at a time. Receives at least kRecvDirectSize big skip the buffer
+// and go straight to their destination.
+const size_t kRecvBufferSize = 256 * 1024;
+const size_t kRecvDirectSize = 64 * 1024;
+// The receive buffer comes from _aligned_malloc with this, so it can be handed over (see DetachRecvBuffer).
+const size_t kRecvBufferAlignment = 64;
+
+// One piece of a scatter-gather send, see MessageStream::SendGather.
+struct SendSegment
+{
+	const void* mBytes;
+	size_t mLen;
+};
+
+const size_t kMaxSendSegments = 32;
 struct SSerializeDataPacket;
 
 class FileLike;
-class SimpleBuffer;
+class SendRing;
+
+// What a MessageStream actually talks over. Either way it's the same stream of bytes.
+enum EMessageTransport
+{
+	EMT_Socket,			// TCP on the loopback adapter.
+	EMT_SharedMemory,	// A pair of rings in memory shared between the two processes, see SendRing.
+	EMT_Loopback,		// No other process: what's sent is received on the same stream, see DirectCapture.
+						// Can't be picked on the command line.
+
+	EMT_Count
+};
+
+// Converts between transports and the names used on the command line. ParseMessageTransport returns
+// false for names it doesn't know.
+bool ParseMessageTransport(const TCHAR* _name, EMessageTransport* _outTransport);
+const TCHAR* MessageTransportName(EMessageTransport _transport);
+
+// eztrace tells the process it launches which transport to use through the environment, which the 
+// child inherits. Defaults to EMT_Socket if nothing (or nothing sensible) was set.
+void SetMessageTransportForChildProcesses(EMessageTransport _transport);
+EMessageTransport GetMessageTransportFromEnvironment();
 
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
@@ -60,7 +97,9 @@ private:
 class MessageStream
 {
 public:
-	MessageStream(bool _isHost, const char* _address, const char* _port);
+	// With EMT_SharedMemory, _address is unused and _port just names the shared memory, so that both
+	// sides agree on it. With EMT_Loopback, neither is used and there's no handshake.
+	MessageStream(bool _isHost, const char* _address, const char* _port, EMessageTransport _transport=EMT_Socket);
 	~MessageStream();
 
 	inline size_t AllocatePacketId() { return mNextPacketId++; }
@@ -68,53 +107,80 @@ public:
 	// Sends always succeed--or they raise an exception.
 	inline void Send(const void* _bytes, size_t _len)		{ BufferedSend(_bytes, _len); }
 
+	// Sends the segments back to back, as one send (at most kMaxSendSegments of them). Without a send 
+	// ring, that's a single WSASend straight out of the segments.
+	void SendGather(const SendSegment* _segments, size_t _count);
+
 	template <typename T> 
 	inline void OptionalSend(const T& _t)					{ BufferedSend((const void *)&_t, sizeof(_t), true); }
 
+	// Receives come out of a buffer that's refilled with as much as the transport has available, so
+	// that the many small fields of a packet don't each cost a recv. Recv returns false if there's 
+	// nothing to receive at all; once it starts receiving it waits for everything.
 	inline bool Recv(void* _out, size_t _len)
 	{
-		size_t totalDataRead = 0;
-		do {
-			int dataRead = recv(mSocket, ((char*)_out) + totalDataRead, _len - totalDataRead, 0);
-			if (dataRead == SOCKET_ERROR) {
-				int errorNum = WSAGetLastError(); 
-				if (errorNum == WSAEWOULDBLOCK) {
-					if (totalDataRead == 0) { 
-						return false;
-					} else {
-						// I don't do partial reads--once I start receiving I wait for everything.
-						Sleep(1);
-					}
-				// I've split these into two blocks because one of them is expected and the other isn't.
-				} else if (errorNum == WSAECONNRESET) {
-					// The remote client disconnected, probably not an issue.
-					throw NetworkError(errorNum);
-				} else {
-					// Some other wonky network error--place a breakpoint here.
-					throw NetworkError(errorNum);
-				}
-			} else {
-				totalDataRead += dataRead;
-			}
-		} while (totalDataRead < _len);
+		if (mRecvEnd == mRecvStart && !FillRecvBufferIfAvailable()) {
+			return false;
+		}
 
+		BlockingRecv(_out, _len);
 		return true;
 	}
 
 	inline void BlockingRecv(void* _outBuffer, size_t _len)
 	{
-		while (!Recv(_outBuffer, _len)) {
-			Sleep(1);
+		if (_len <= mRecvEnd - mRecvStart) {
+			memcpy(_outBuffer, mRecvBuffer + mRecvStart, _len);
+			mRecvStart += _len;
+		} else {
+			BlockingRecvSlow(_outBuffer, _len);
 		}
 	}
 
-	void FlushSendBuffer(bool _optional=false);
+	// For parsing in place. Receives until at least _len bytes are buffered (_len must be under 
+	// kRecvDirectSize), then returns everything that's buffered. The bytes stay put until the next 
+	// receive; say how many were used with ConsumeRecvBuffer.
+	const unsigned char* FillRecvBuffer(size_t _len, size_t* _outBufferedLen);
+	void ConsumeRecvBuffer(size_t _len);
+	// Gives the receive buffer away, for keeping pointers into it past the next receive--release it with
+	// _aligned_free. Receives go into a new one from here on, which starts with whatever was buffered 
+	// and not consumed yet.
+	unsigned char* DetachRecvBuffer();
+
+	// Waits until there's something to receive (or the other side has gone away, in which case the 
+	// next receive throws). Returns false if nothing showed up within _timeoutMs.
+	bool WaitForRecv(DWORD _timeoutMs);
+
+	// From here on, sends are copied into a ring and a dedicated thread does the actual sending, so 
+	// the caller doesn't pay for the socket. Sends only block if the ring is completely full. 
+	// See SendRing for _highWaterMark. Does nothing for shared memory or loopback, where sends already 
+	// go into a ring that somebody else drains.
+	void EnableSendRing(size_t _capacity, size_t _highWaterMark);
+
+	// With a send ring, makes sure the sender thread gets to what's been sent so far. Doesn't wait, and 
+	// never fails--a dead peer shows up on the next send instead.
+	void FlushSendBuffer();
 
 private:
+	EMessageTransport mTransport;
 	SOCKET mSocket;
 	struct addrinfo *mHostAddressInfo;
 	size_t mNextPacketId;
-	SimpleBuffer* mSendBuffer;
+
+	SendRing* mSendRing;
+	HANDLE mSendThreadHandle;
+	volatile bool mStopSendThread;
+
+	// For EMT_SharedMemory. mSendRing is our outgoing ring in the shared memory (there's no send 
+	// thread), mRecvRing the incoming one. For EMT_Loopback, they're one and the same.
+	HANDLE mSharedMapping;
+	void* mSharedView;
+	SendRing* mRecvRing;
+
+	// Received but not yet read: [mRecvStart, mRecvEnd).
+	unsigned char* mRecvBuffer;
+	size_t mRecvStart;
+	size_t mRecvEnd;
 
 	// Used if someone asks for a receive of a small string.
 	char mSmallBuffer[64];
@@ -131,38 +197,39 @@ private:
 	// communicate anything to the host ahead of time).
 	void SetupClientSocket();
 
+	// The host creates the shared memory and sets up both rings, the client attaches to them.
+	void SetupSharedMemory();
+	void AttachSharedRings();
+	std::string GetSharedObjectName(const char* _suffix) const;
+
+	void SetupLoopback();
+
 	void Handshake();
 
+	// Waits until the socket can be read from (or written to, if _writable) without blocking, or 
+	// _timeoutMs has passed. Returns false on timeout.
+	bool WaitForSocket(bool _writable, DWORD _timeoutMs);
+
+	void BlockingRecvSlow(void* _outBuffer, size_t _len);
+	bool FillRecvBufferIfAvailable();
+
+	// Receives whatever the transport has right now, up to _maxLen, without waiting. Returns 0 if 
+	// there's nothing. Throws NetworkError if the other side went away.
+	size_t RecvAvailable(void* _out, size_t _maxLen);
+	// Blocks until the transport has something to receive.
+	void WaitForTransport();
+
 	void BufferedSend(const void* _bytes, size_t _size, bool _optional=false);
 	void ReallySend(const void* _bytes, size_t _size, bool _optional=false);
-};
-
-extern MessageStream* gMessageStream;
+	void ReallySendGather(const SendSegment* _segments, size_t _count);
 
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-// ------------------------------------------------------------------------------------------------
-class SimpleBuffer
-{
-public:
-	SimpleBuffer(size_t _bufferSize);
-	~SimpleBuffer();
-
-	bool AddBytes(const void* _bytes, size_t _size);
-	void EmptyBuffer() { mEnd = 0; }
-	bool WouldOverflow(size_t _requestedSize) const;
-	const void* GetBytes(size_t* _outByteCount) const 
-	{ 
-		(*_outByteCount) = mEnd; 
-		return mBuffer; 
-	}
+	void Thread_Send();
 
-private:
-	void* mBuffer;
-	size_t mEnd;
-	size_t mSize;
+	friend DWORD WINAPI MessageStream_RunSendThread(LPVOID _streamPtr);
 };
 
+extern MessageStream* gMessageStream;
+
 // ------------------------------------------------------------------------------------------------
 enum EnumRemoteCommand 
 {
@@ -175,13 +242,17 @@ enum EnumRemoteCommand
 struct RemoteCommand
 {
 	EnumRemoteCommand mRemoteCommandType;
+	unsigned int mFrameCount;	// For ERC_Capture, how many frames to capture.
+	unsigned int mBaseGeneration;	// For ERC_Capture, the context state generation we still have from the last capture, or 0.
+	unsigned __int64 mBaseContext;	// For ERC_Capture, the context (HGLRC) that state is of. Generations are only comparable within one.
 
-	RemoteCommand(EnumRemoteCommand _type=ERC_None) : mRemoteCommandType(_type) { }
+	RemoteCommand(EnumRemoteCommand _type=ERC_None, unsigned int _frameCount=1, unsigned int _baseGeneration=0, unsigned __int64 _baseContext=0) 
+	: mRemoteCommandType(_type), mFrameCount(_frameCount), mBaseGeneration(_baseGeneration), mBaseContext(_baseContext) { }
 
 	void Read(FileLike* _fileLike);
 	void Write(FileLike* _fileLike) const;
 };
 
 // ------------------------------------------------------------------------------------------------
-struct RC_Capture : public RemoteCommand { RC_Capture() : RemoteCommand(ERC_Capture) { } };
+struct RC_Capture : public RemoteCommand { RC_Capture(unsigned int _frameCount=1, unsigned int _baseGeneration=0, unsigned __int64 _baseContext=0) : RemoteCommand(ERC_Capture, _frameCount, _baseGeneration, _baseContext) { } };
 struct RC_Terminate : public RemoteCommand { RC_Terminate() : RemoteCommand(ERC_Terminate) { } };
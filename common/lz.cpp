@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "lz.h"
+
+const int kLZHashLog = 14;
+const size_t kLZHashSize = 1 << kLZHashLog;
+
+// Matches may not start in the last few bytes of a block, which keeps the match finder's reads in bounds.
+const size_t kLZLastLiterals = 5;
+
+// ------------------------------------------------------------------------------------------------
+static inline unsigned int LZRead32(const unsigned char* _p)
+{
+	unsigned int retVal;
+	memcpy(&retVal, _p, sizeof(retVal));
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+static inline unsigned int LZHash(unsigned int _sequence)
+{
+	return (_sequence * 2654435761U) >> (32 - kLZHashLog);
+}
+
+// ------------------------------------------------------------------------------------------------
+static inline unsigned char* LZWriteLength(unsigned char* _op, size_t _len)
+{
+	while (_len >= 255) {
+		*_op++ = 255;
+		_len -= 255;
+	}
+	*_op++ = (unsigned char)_len;
+	return _op;
+}
+
+// ------------------------------------------------------------------------------------------------
+static inline unsigned char* LZWriteSequence(unsigned char* _op, const unsigned char* _literals, size_t _literalCount, size_t _offset, size_t _matchLen)
+{
+	unsigned char* token = _op++;
+	size_t extraMatch = _matchLen - kLZMinMatch;
+
+	*token = (unsigned char)((min(_literalCount, (size_t)15) << 4) | min(extraMatch, (size_t)15));
+	if (_literalCount >= 15) {
+		_op = LZWriteLength(_op, _literalCount - 15);
+	}
+
+	memcpy(_op, _literals, _literalCount);
+	_op += _literalCount;
+
+	*_op++ = (unsigned char)(_offset & 0xFF);
+	*_op++ = (unsigned char)(_offset >> 8);
+
+	if (extraMatch >= 15) {
+		_op = LZWriteLength(_op, extraMatch - 15);
+	}
+
+	return _op;
+}
+
+// ------------------------------------------------------------------------------------------------
+size_t LZCompress(const void* _src, size_t _srcLen, void* _dst)
+{
+	const unsigned char* src = (const unsigned char*)_src;
+	const unsigned char* ip = src;
+	const unsigned char* anchor = src;
+	const unsigned char* const iend = src + _srcLen;
+	unsigned char* op = (unsigned char*)_dst;
+
+	if (_srcLen > kLZMinMatch + kLZLastLiterals) {
+		const unsigned char* const matchLimit = iend - kLZLastLiterals;
+
+		// Positions are stored relative to src, so 0 can't be told apart from "empty"--which is fine, a 
+		// bogus candidate just fails the compare below.
+		unsigned int* hashTable = new unsigned int[kLZHashSize];
+		memset(hashTable, 0, kLZHashSize * sizeof(unsigned int));
+
+		while (ip + kLZMinMatch <= matchLimit) {
+			unsigned int sequence = LZRead32(ip);
+			unsigned int hash = LZHash(sequence);
+			const unsigned char* candidate = src + hashTable[hash];
+			hashTable[hash] = (unsigned int)(ip - src);
+
+			if (candidate >= ip || (size_t)(ip - candidate) > kLZMaxOffset || LZRead32(candidate) != sequence) {
+				++ip;
+				continue;
+			}
+
+			// Extend the match backwards over literals we haven't emitted yet, then forwards.
+			while (ip > anchor && candidate > src && ip[-1] == candidate[-1]) {
+				--ip;
+				--candidate;
+			}
+
+			const unsigned char* matchEnd = ip + kLZMinMatch;
+			const unsigned char* candidateEnd = candidate + kLZMinMatch;
+			while (matchEnd < matchLimit && *matchEnd == *candidateEnd) {
+				++matchEnd;
+				++candidateEnd;
+			}
+
+			op = LZWriteSequence(op, anchor, (size_t)(ip - anchor), (size_t)(ip - candidate), (size_t)(matchEnd - ip));
+
+			// Seed the table with a position inside the match so runs keep matching.
+			if (matchEnd - 2 > ip) {
+				hashTable[LZHash(LZRead32(matchEnd - 2))] = (unsigned int)(matchEnd - 2 - src);
+			}
+
+			ip = anchor = matchEnd;
+		}
+
+		delete [] hashTable;
+	}
+
+	// Whatever is left goes out as literals.
+	size_t literalCount = (size_t)(iend - anchor);
+	*op++ = (unsigned char)(min(literalCount, (size_t)15) << 4);
+	if (literalCount >= 15) {
+		op = LZWriteLength(op, literalCount - 15);
+	}
+	memcpy(op, anchor, literalCount);
+	op += literalCount;
+
+	size_t retVal = (size_t)(op - (unsigned char*)_dst);
+	assert(retVal <= LZCompressBound(_srcLen));
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+static inline bool LZReadLength(const unsigned char** _ip, const unsigned char* _iend, size_t* _len)
+{
+	unsigned char b;
+	do {
+		if (*_ip >= _iend) {
+			return false;
+		}
+		b = *(*_ip)++;
+		(*_len) += b;
+	} while (b == 255);
+
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool LZDecompress(const void* _src, size_t _srcLen, void* _dst, size_t _dstLen)
+{
+	const unsigned char* ip = (const unsigned char*)_src;
+	const unsigned char* const iend = ip + _srcLen;
+	unsigned char* op = (unsigned char*)_dst;
+	unsigned char* const oend = op + _dstLen;
+
+	while (ip < iend) {
+		unsigned char token = *ip++;
+
+		size_t literalCount = token >> 4;
+		if (literalCount == 15 && !LZReadLength(&ip, iend, &literalCount)) {
+			return false;
+		}
+
+		if (literalCount > (size_t)(iend - ip) || literalCount > (size_t)(oend - op)) {
+			return false;
+		}
+		memcpy(op, ip, literalCount);
+		ip += literalCount;
+		op += literalCount;
+
+		// The last sequence has no match.
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return false;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		size_t matchLen = token & 0xF;
+		if (matchLen == 15 && !LZReadLength(&ip, iend, &matchLen)) {
+			return false;
+		}
+		matchLen += kLZMinMatch;
+
+		if (offset == 0 || offset > (size_t)(op - (unsigned char*)_dst) || matchLen > (size_t)(oend - op)) {
+			return false;
+		}
+
+		// Matches may overlap their own output (that's how runs are encoded), so copy bytewise then.
+		const unsigned char* match = op - offset;
+		if (offset >= matchLen) {
+			memcpy(op, match, matchLen);
+			op += matchLen;
+		} else {
+			for (size_t i = 0; i < matchLen; ++i) {
+				*op++ = *match++;
+			}
+		}
+	}
+
+	return op == oend;
+}
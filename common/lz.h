@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// A small, fast LZ77-family codec for trace blocks. The format is byte oriented and close in spirit
+// to LZ4: a sequence is a token byte (literal count in the high nibble, match length - kLZMinMatch in
+// the low nibble, 15 meaning "more length bytes follow"), the literals, a 16-bit little-endian match
+// offset and any extra match length bytes. The final sequence is literals only.
+// Blocks are independent, which is what lets us encode and decode them in parallel.
+
+const size_t kLZMinMatch = 4;
+const size_t kLZMaxOffset = 65535;
+
+// The most bytes LZCompress can produce for _srcLen input bytes.
+inline size_t LZCompressBound(size_t _srcLen) 
+{ 
+	return _srcLen + (_srcLen / 255) + 16; 
+}
+
+// Compresses _srcLen bytes into _dst, which must be able to hold LZCompressBound(_srcLen) bytes.
+// Returns the compressed size.
+size_t LZCompress(const void* _src, size_t _srcLen, void* _dst);
+
+// Decompresses a block produced by LZCompress. _dstLen must be the exact uncompressed size.
+// Returns false if the block is malformed--we never read or write outside the supplied buffers.
+bool LZDecompress(const void* _src, size_t _srcLen, void* _dst, size_t _dstLen);
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "mappedfile.h"
+
+#include <map>
+
+// Borrowed ranges keyed by their base address.
+static std::map<const unsigned char*, size_t> gBorrowedPayloadRanges;
+
+// ------------------------------------------------------------------------------------------------
+void RegisterBorrowedPayloadRange(const void* _base, size_t _size)
+{
+	assert(_base);
+	gBorrowedPayloadRanges[(const unsigned char*)_base] = _size;
+}
+
+// ------------------------------------------------------------------------------------------------
+void UnregisterBorrowedPayloadRange(const void* _base)
+{
+	gBorrowedPayloadRanges.erase((const unsigned char*)_base);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool IsBorrowedPayload(const void* _ptr)
+{
+	if (_ptr == NULL || gBorrowedPayloadRanges.empty()) {
+		return false;
+	}
+
+	// Find the last range starting at or before _ptr, then check whether _ptr falls inside it.
+	auto it = gBorrowedPayloadRanges.upper_bound((const unsigned char*)_ptr);
+	if (it == gBorrowedPayloadRanges.begin()) {
+		return false;
+	}
+	--it;
+
+	return (const unsigned char*)_ptr < it->first + it->second;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+MappedFile::MappedFile()
+: mFile(INVALID_HANDLE_VALUE)
+, mMapping(NULL)
+, mBase(NULL)
+, mSize(0)
+{
+
+}
+
+// ------------------------------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+	if (mBase) {
+		UnregisterBorrowedPayloadRange(mBase);
+		UnmapViewOfFile(mBase);
+		mBase = NULL;
+	}
+
+	if (mMapping) {
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+
+	if (mFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+MappedFile* MappedFile::Open(const TCHAR* _filename)
+{
+	MappedFile* retVal = new MappedFile;
+
+	retVal->mFile = CreateFile(_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (retVal->mFile == INVALID_HANDLE_VALUE) {
+		SafeDelete(retVal);
+		return NULL;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(retVal->mFile, &fileSize) || fileSize.QuadPart == 0 || (unsigned __int64)fileSize.QuadPart > (size_t)-1) {
+		SafeDelete(retVal);
+		return NULL;
+	}
+	retVal->mSize = (size_t)fileSize.QuadPart;
+
+	retVal->mMapping = CreateFileMapping(retVal->mFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (retVal->mMapping == NULL) {
+		SafeDelete(retVal);
+		return NULL;
+	}
+
+	retVal->mBase = (unsigned char*)MapViewOfFile(retVal->mMapping, FILE_MAP_COPY, 0, 0, 0);
+	if (retVal->mBase == NULL) {
+		SafeDelete(retVal);
+		return NULL;
+	}
+
+	RegisterBorrowedPayloadRange(retVal->mBase, retVal->mSize);
+	return retVal;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// ------------------------------------------------------------------------------------------------
+// A read-only view of an entire file. Payloads read through a FileLike over a MappedFile point
+// directly into the view instead of being copied, so pages are only faulted in when they're used.
+// The view is copy-on-write, so code that scribbles on a payload gets a private page rather than
+// an access violation.
+class MappedFile
+{
+public:
+	// Returns NULL if the file couldn't be opened or mapped (e.g. there isn't enough contiguous 
+	// address space for it). 
+	static MappedFile* Open(const TCHAR* _filename);
+	~MappedFile();
+
+	const unsigned char* GetBase() const { return mBase; }
+	size_t GetSize() const { return mSize; }
+
+	bool Contains(const void* _ptr) const 
+	{ 
+		return _ptr >= mBase && _ptr < mBase + mSize; 
+	}
+
+private:
+	MappedFile();
+
+	HANDLE mFile;
+	HANDLE mMapping;
+	unsigned char* mBase;
+	size_t mSize;
+};
+
+// Payloads can point into memory owned by something else--a mapped trace, a trace's blob section--
+// in which case they must not be freed individually. Owners of such ranges register them here.
+// Ranges are only registered and unregistered while loading and unloading traces, which we don't do 
+// concurrently with anything else.
+void RegisterBorrowedPayloadRange(const void* _base, size_t _size);
+void UnregisterBorrowedPayloadRange(const void* _base);
+bool IsBorrowedPayload(const void* _ptr);
+
+// Like SafeFree, but for payloads that may be borrowed rather than on the heap.
+template <typename T>
+void SafeFreePayload(T*& _ptr) 
+{ 
+	if (!IsBorrowedPayload(_ptr)) {
+		free(_ptr); 
+	}
+	_ptr = NULL; 
+}
+
+template <typename T>
+void SafeFreePayload(const T*& _ptr) 
+{ 
+	if (!IsBorrowedPayload(_ptr)) {
+		free(const_cast<T*>(_ptr)); 
+	}
+	_ptr = NULL; 
+}
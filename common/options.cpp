@@ -31,6 +31,12 @@
 
 Options* gOptions = NULL;
 
+const TCHAR* kIdleHooksVariable = TC("GFXTRACE_IDLE_HOOKS");
+const TCHAR* kWriteWatchBuffersVariable = TC("GFXTRACE_WRITE_WATCH_BUFFERS");
+const TCHAR* kShadowBudgetVariable = TC("GFXTRACE_SHADOW_BUDGET_MB");
+const TCHAR* kSendRingSizeVariable = TC("GFXTRACE_SEND_RING_KB");
+const TCHAR* kSendRingHighWaterMarkVariable = TC("GFXTRACE_SEND_RING_HIGH_WATER_KB");
+
 #ifdef _UNICODE
     typedef std::wstring tstring;
 #else
@@ -94,6 +100,24 @@ int ParseInto(int _curArgNum, int _argsNeeded, int _argCount, TCHAR* _argv[], TC
     return 2;
 }
 
+// ------------------------------------------------------------------------------------------------
+int ParseInto(int _curArgNum, int _argsNeeded, int _argCount, TCHAR* _argv[], unsigned int* _dest)
+{
+    if (_curArgNum + _argsNeeded >= _argCount) {
+        LogError(TC("Not enough parameters for argument \"%s\""), _argv[_curArgNum]);
+        return 0;
+    }
+
+    assert(_argsNeeded == 1);
+    TCHAR* end = NULL;
+    (*_dest) = (unsigned int)_tcstoul(_argv[_curArgNum + _argsNeeded], &end, 10);
+    if (end == _argv[_curArgNum + _argsNeeded] || *end != TC('\0')) {
+        LogError(TC("Expected a number for argument \"%s\", got \"%s\""), _argv[_curArgNum], _argv[_curArgNum + _argsNeeded]);
+        return 0;
+    }
+    return 2;
+}
+
 // ------------------------------------------------------------------------------------------------
 int ParseRemainingArgsInto(int _curArgNum, int _argCount, TCHAR* _argv[], TCHAR* _exeName, TCHAR** _dest)
 {
@@ -136,8 +160,16 @@ Options::Options()
 
 	// Set defaults.
 	OutputTraceName = _tcsdup(TC("trace.gft"));
+	TraceCodec = _tcsdup(TraceCodecName(ETC_LZ));
+	Transport = _tcsdup(MessageTransportName(EMT_Socket));
 	
 	ServerPort = 65536 - 31337;
+	SendRingSize = 32 * 1024 * 1024;
+	SendRingHighWaterMark = 256 * 1024;
+	CaptureFrameCount = 1;
+	IdleHooks = false;
+	WriteWatchBuffers = false;
+	ShadowBudgetMB = 0;
 
 	CaptureAllTextures = true;
 	FixBadFlushBufferRangeArgs = true;
@@ -151,6 +183,8 @@ Options::~Options()
 	SafeDeleteArray(WorkingDirectory);
 	SafeDeleteArray(ProcessArgs);
     SafeDeleteArray(InceptionDllPath);
+    SafeDeleteArray(TraceCodec);
+    SafeDeleteArray(Transport);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -179,6 +213,34 @@ Options* ParseCommandLine(int argc, TCHAR *argv[])
             consumed += ParseInto(i, 1, argc, argv, &(retVal->WorkingDirectory));
         } else if (_tcscmp(TC("-o"), curArg) == 0) {
             consumed += ParseInto(i, 1, argc, argv, &(retVal->OutputTraceName));
+        } else if (_tcscmp(TC("-c"), curArg) == 0) {
+            consumed += ParseInto(i, 1, argc, argv, &(retVal->TraceCodec));
+        } else if (_tcscmp(TC("-f"), curArg) == 0) {
+            consumed += ParseInto(i, 1, argc, argv, &(retVal->CaptureFrameCount));
+        } else if (_tcscmp(TC("-s"), curArg) == 0) {
+            retVal->StreamTrace = true;
+            consumed += 1;
+        } else if (_tcscmp(TC("-t"), curArg) == 0) {
+            consumed += ParseInto(i, 1, argc, argv, &(retVal->Transport));
+        } else if (_tcscmp(TC("-i"), curArg) == 0) {
+            retVal->IdleHooks = true;
+            consumed += 1;
+        } else if (_tcscmp(TC("-m"), curArg) == 0) {
+            retVal->WriteWatchBuffers = true;
+            consumed += 1;
+        } else if (_tcscmp(TC("-r"), curArg) == 0) {
+            consumed += ParseInto(i, 1, argc, argv, &(retVal->ShadowBudgetMB));
+        } else if (_tcscmp(TC("-rs"), curArg) == 0) {
+            unsigned int sendRingKB = 0;
+            consumed += ParseInto(i, 1, argc, argv, &sendRingKB);
+            retVal->SendRingSize = size_t(sendRingKB) * 1024;
+        } else if (_tcscmp(TC("-rw"), curArg) == 0) {
+            unsigned int highWaterMarkKB = 0;
+            consumed += ParseInto(i, 1, argc, argv, &highWaterMarkKB);
+            retVal->SendRingHighWaterMark = size_t(highWaterMarkKB) * 1024;
+        } else if (_tcscmp(TC("-b"), curArg) == 0) {
+            retVal->BenchmarkTransports = true;
+            consumed += 1;
         } else if (_tcscmp(TC("-h"), curArg) == 0) {
             PrintHelp();
             exit(0);
@@ -198,6 +260,11 @@ Options* ParseCommandLine(int argc, TCHAR *argv[])
         i += consumed;
     }
 
+    if (retVal->BenchmarkTransports) {
+        // Nothing to launch.
+        return retVal;
+    }
+
     ParseRemainingArgsInto(eztraceArgsEnd, argc, argv, retVal->ExeName, &(retVal->ProcessArgs));
 
     bool validArgs = true;
@@ -212,6 +279,28 @@ Options* ParseCommandLine(int argc, TCHAR *argv[])
     }
     LogInfo(TC("Args to be passed to child process: '%s'"), retVal->ProcessArgs);
 
+    ETraceCodec traceCodec = ETC_None;
+    if (!ParseTraceCodec(retVal->TraceCodec, &traceCodec)) {
+        LogError(TC("Unknown trace codec '%s' for parameter -c"), retVal->TraceCodec);
+        validArgs = false;
+    }
+
+    if (retVal->CaptureFrameCount == 0) {
+        LogError(TC("Need to capture at least one frame (parameter -f)"));
+        validArgs = false;
+    }
+
+    if (retVal->SendRingSize == 0 || retVal->SendRingHighWaterMark == 0 || retVal->SendRingHighWaterMark > retVal->SendRingSize) {
+        LogError(TC("The send ring's high water mark (parameter -rw) has to be between 1 KB and its size (parameter -rs)"));
+        validArgs = false;
+    }
+
+    EMessageTransport transport = EMT_Socket;
+    if (!ParseMessageTransport(retVal->Transport, &transport)) {
+        LogError(TC("Unknown transport '%s' for parameter -t"), retVal->Transport);
+        validArgs = false;
+    }
+
     if (validArgs == false) {
         PrintHelp();
         exit(3);
@@ -220,3 +309,104 @@ Options* ParseCommandLine(int argc, TCHAR *argv[])
 	return retVal;
 }
 
+// ------------------------------------------------------------------------------------------------
+void SetIdleHooksForChildProcesses(bool _idleHooks)
+{
+	SetEnvironmentVariable(kIdleHooksVariable, _idleHooks ? TC("1") : NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+static bool GetFlagFromEnvironment(const TCHAR* _variable)
+{
+	TCHAR value[8] = { 0 };
+	DWORD len = GetEnvironmentVariable(_variable, value, ARRAYSIZE(value));
+	if (len == 0 || len >= ARRAYSIZE(value)) {
+		return false;
+	}
+
+	return _tcscmp(value, TC("0")) != 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool GetIdleHooksFromEnvironment()
+{
+	return GetFlagFromEnvironment(kIdleHooksVariable);
+}
+
+// ------------------------------------------------------------------------------------------------
+void SetWriteWatchBuffersForChildProcesses(bool _writeWatchBuffers)
+{
+	SetEnvironmentVariable(kWriteWatchBuffersVariable, _writeWatchBuffers ? TC("1") : NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool GetWriteWatchBuffersFromEnvironment()
+{
+	return GetFlagFromEnvironment(kWriteWatchBuffersVariable);
+}
+
+// ------------------------------------------------------------------------------------------------
+// 0 unsets _variable.
+static void SetNumberForChildProcesses(const TCHAR* _variable, unsigned int _number)
+{
+	if (_number == 0) {
+		SetEnvironmentVariable(_variable, NULL);
+		return;
+	}
+
+	TCHAR value[16];
+	_stprintf_s(value, ARRAYSIZE(value), TC("%u"), _number);
+	SetEnvironmentVariable(_variable, value);
+}
+
+// ------------------------------------------------------------------------------------------------
+// 0 if _variable isn't set.
+static unsigned int GetNumberFromEnvironment(const TCHAR* _variable)
+{
+	TCHAR value[16] = { 0 };
+	DWORD len = GetEnvironmentVariable(_variable, value, ARRAYSIZE(value));
+	if (len == 0 || len >= ARRAYSIZE(value)) {
+		return 0;
+	}
+
+	return (unsigned int)_tcstoul(value, NULL, 10);
+}
+
+// ------------------------------------------------------------------------------------------------
+void SetShadowBudgetForChildProcesses(unsigned int _shadowBudgetMB)
+{
+	SetNumberForChildProcesses(kShadowBudgetVariable, _shadowBudgetMB);
+}
+
+// ------------------------------------------------------------------------------------------------
+unsigned int GetShadowBudgetFromEnvironment()
+{
+	return GetNumberFromEnvironment(kShadowBudgetVariable);
+}
+
+// ------------------------------------------------------------------------------------------------
+void SetSendRingForChildProcesses(size_t _sendRingSize, size_t _sendRingHighWaterMark)
+{
+	SetNumberForChildProcesses(kSendRingSizeVariable, (unsigned int)(_sendRingSize / 1024));
+	SetNumberForChildProcesses(kSendRingHighWaterMarkVariable, (unsigned int)(_sendRingHighWaterMark / 1024));
+}
+
+// ------------------------------------------------------------------------------------------------
+void GetSendRingFromEnvironment(Options* _options)
+{
+	unsigned int sendRingKB = GetNumberFromEnvironment(kSendRingSizeVariable);
+	if (sendRingKB) {
+		_options->SendRingSize = size_t(sendRingKB) * 1024;
+	}
+
+	unsigned int highWaterMarkKB = GetNumberFromEnvironment(kSendRingHighWaterMarkVariable);
+	if (highWaterMarkKB) {
+		_options->SendRingHighWaterMark = size_t(highWaterMarkKB) * 1024;
+	}
+
+	// Each is checked against the other when eztrace parses them, but only one might have made it here.
+	if (_options->SendRingHighWaterMark > _options->SendRingSize) {
+		LogWarn(TC("The send ring's high water mark is bigger than the ring, waking the send thread at %u KB instead."), (unsigned int)(_options->SendRingSize / 1024));
+		_options->SendRingHighWaterMark = _options->SendRingSize;
+	}
+}
@@ -38,9 +38,17 @@ struct Options
 	TCHAR* WorkingDirectory;
 	TCHAR* ProcessArgs;
 	TCHAR* InceptionDllPath;
+	TCHAR* TraceCodec;
+	TCHAR* Transport;
 	
 	DWORD ServerPort;
 
+	// Size of the ring that inception's hooks write captured commands into, and how full it gets before
+	// the send thread is woken up to drain it (it also drains on its own after a few ms). In bytes, but
+	// set in KB on the command line (-rs, -rw).
+	size_t SendRingSize;
+	size_t SendRingHighWaterMark;
+
 	// If true, serializes all texture data.
 	// If false, only serializes texture data that appears to be used in the frame being captured.
 	bool CaptureAllTextures; 
@@ -50,6 +58,28 @@ struct Options
 	// If false always capture faithfully.
 	bool FixBadFlushBufferRangeArgs;
 
+	// If true, eztrace writes commands to the output trace as they arrive instead of collecting the 
+	// whole capture in memory first.
+	bool StreamTrace;
+
+	// How many consecutive frames each capture records.
+	unsigned int CaptureFrameCount;
+
+	// If true, eztrace just measures how fast each transport is and exits.
+	bool BenchmarkTransports;
+
+	// If true, inception's hooks go straight to the driver until a capture is requested, and the state 
+	// at the start of the capture is read back from the driver instead of having been tracked all along.
+	bool IdleHooks;
+
+	// If true, inception's hooks hand out write-watched memory for write mappings of buffers, and only 
+	// copy back the pages the application actually wrote, instead of the whole mapped range.
+	bool WriteWatchBuffers;
+
+	// How many MB of texture and buffer contents inception's hooks keep in memory before spilling the 
+	// ones that haven't been used lately to disk (see ShadowBudget). 0 keeps everything in memory.
+	unsigned int ShadowBudgetMB;
+
 	Options();
     ~Options();
 };
@@ -58,3 +88,20 @@ extern Options* gOptions;
 
 // ------------------------------------------------------------------------------------------------
 Options* ParseCommandLine(int argc, TCHAR *argv[]);
+
+// ------------------------------------------------------------------------------------------------
+// Passes IdleHooks on to the processes we start, and picks it up in them.
+void SetIdleHooksForChildProcesses(bool _idleHooks);
+bool GetIdleHooksFromEnvironment();
+
+// Same for WriteWatchBuffers.
+void SetWriteWatchBuffersForChildProcesses(bool _writeWatchBuffers);
+bool GetWriteWatchBuffersFromEnvironment();
+
+// Same for ShadowBudgetMB.
+void SetShadowBudgetForChildProcesses(unsigned int _shadowBudgetMB);
+unsigned int GetShadowBudgetFromEnvironment();
+
+// Same for SendRingSize and SendRingHighWaterMark. Leaves _options alone for whatever isn't set.
+void SetSendRingForChildProcesses(size_t _sendRingSize, size_t _sendRingHighWaterMark);
+void GetSendRingFromEnvironment(Options* _options);
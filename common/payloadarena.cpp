@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "payloadarena.h"
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+PayloadArena::PayloadArena()
+: mCursor(NULL)
+, mEnd(NULL)
+{
+
+}
+
+// ------------------------------------------------------------------------------------------------
+void* PayloadArena::Allocate(size_t _len)
+{
+	size_t alignedLen = iceil(max(_len, size_t(1)), kPayloadArenaAlignment);
+
+	// Big payloads get a chunk of their own, and leave the current one as it is.
+	if (alignedLen > kPayloadArenaChunkSize / 4) {
+		void* retVal = _aligned_malloc(alignedLen, kPayloadArenaAlignment);
+		if (!retVal) {
+			LogError(TC("Couldn't allocate %I64u bytes for a payload."), (unsigned __int64)_len);
+			throw 1;
+		}
+		mChunks.push_back(retVal);
+		return retVal;
+	}
+
+	if (alignedLen > (size_t)(mEnd - mCursor)) {
+		mCursor = (unsigned char*)_aligned_malloc(kPayloadArenaChunkSize, kPayloadArenaAlignment);
+		if (!mCursor) {
+			mEnd = NULL;
+			LogError(TC("Couldn't allocate another %I64u bytes for payloads."), (unsigned __int64)kPayloadArenaChunkSize);
+			throw 1;
+		}
+		mEnd = mCursor + kPayloadArenaChunkSize;
+		mChunks.push_back(mCursor);
+	}
+
+	void* retVal = mCursor;
+	mCursor += alignedLen;
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void PayloadArena::Clear()
+{
+	for (auto it = mChunks.begin(); it != mChunks.end(); ++it) {
+		_aligned_free(*it);
+	}
+	mChunks.clear();
+
+	mCursor = NULL;
+	mEnd = NULL;
+}
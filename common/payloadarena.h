@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+
+// Payloads are carved out of chunks this big. Ones bigger than a quarter of it get a chunk of their own,
+// so that a chunk is never mostly wasted.
+const size_t kPayloadArenaChunkSize = 4 * 1024 * 1024;
+
+// Every payload Allocate hands out starts on a multiple of this, for the GL types that end up being read 
+// out of them. (Payloads in adopted chunks start wherever they happen to.)
+const size_t kPayloadArenaAlignment = 16;
+
+// ------------------------------------------------------------------------------------------------
+// Owns the payloads of a bunch of packets that all go away together (e.g. the commands of a GLTrace).
+// Allocating is a bump of a pointer, and nothing is freed individually--Clear lets go of everything
+// at once, at the cost of a free per chunk. 
+// Not thread-safe; whoever reads the packets allocates, and whoever owns them clears.
+class PayloadArena
+{
+public:
+	PayloadArena();
+	~PayloadArena() { Clear(); }
+
+	void* Allocate(size_t _len);
+
+	// Takes over _chunk, which came from _aligned_malloc and has payloads of ours somewhere in it (see 
+	// FileLike::ReadPayload). Freed along with the rest.
+	void Adopt(void* _chunk) { mChunks.push_back(_chunk); }
+
+	// Frees every payload handed out so far.
+	void Clear();
+
+private:
+	// Disallow copying, the chunks can only have one owner.
+	PayloadArena(const PayloadArena&);
+	PayloadArena& operator=(const PayloadArena&);
+
+	std::vector<void*> mChunks;
+
+	// What's left of the chunk payloads are being carved out of.
+	unsigned char* mCursor;
+	unsigned char* mEnd;
+};
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "sendring.h"
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+SendRing::SendRing(size_t _capacity, size_t _highWaterMark)
+: mState(NULL)
+, mBytes(NULL)
+, mOwnsMemory(true)
+, mCapacity(1)
+, mHighWaterMark(_highWaterMark)
+, mSpaceAvailable(NULL)
+, mDataAvailable(NULL)
+{
+	assert(_capacity > 0);
+	size_t capacity = 1;
+	while (capacity < _capacity) {
+		capacity <<= 1;
+	}
+
+	void* memory = malloc(GetSharedSize(capacity));
+	if (!memory) {
+		throw 8;
+	}
+
+	InitializeShared(memory, capacity, _highWaterMark);
+	Attach(memory);
+
+	mSpaceAvailable = CreateEvent(NULL, FALSE, FALSE, NULL);
+	mDataAvailable = CreateEvent(NULL, FALSE, FALSE, NULL);
+	assert(mSpaceAvailable && mDataAvailable);
+}
+
+// ------------------------------------------------------------------------------------------------
+SendRing::SendRing(void* _sharedMemory, HANDLE _spaceAvailable, HANDLE _dataAvailable)
+: mState(NULL)
+, mBytes(NULL)
+, mOwnsMemory(false)
+, mCapacity(1)
+, mHighWaterMark(0)
+, mSpaceAvailable(_spaceAvailable)
+, mDataAvailable(_dataAvailable)
+{
+	assert(_sharedMemory && _spaceAvailable && _dataAvailable);
+	Attach(_sharedMemory);
+}
+
+// ------------------------------------------------------------------------------------------------
+SendRing::~SendRing()
+{
+	CloseHandle(mDataAvailable);
+	CloseHandle(mSpaceAvailable);
+	if (mOwnsMemory) {
+		SafeFree(mState);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+size_t SendRing::GetSharedSize(size_t _capacity)
+{
+	assert(_capacity > 0 && (_capacity & (_capacity - 1)) == 0);
+	return kSendRingStateSize + _capacity;
+}
+
+// ------------------------------------------------------------------------------------------------
+void SendRing::InitializeShared(void* _sharedMemory, size_t _capacity, size_t _highWaterMark)
+{
+	CompileTimeAssert(sizeof(SendRingState) <= kSendRingStateSize);
+	assert(_sharedMemory);
+	assert(_capacity > 0 && (_capacity & (_capacity - 1)) == 0);
+
+	SendRingState* state = (SendRingState*)_sharedMemory;
+	memset(state, 0, sizeof(*state));
+	state->mCapacity = _capacity;
+	state->mHighWaterMark = min(_highWaterMark, _capacity);
+
+	// Anybody who can see the ring has to see it set up.
+	MemoryBarrier();
+}
+
+// ------------------------------------------------------------------------------------------------
+void SendRing::Attach(void* _memory)
+{
+	mState = (SendRingState*)_memory;
+	mBytes = (unsigned char*)_memory + kSendRingStateSize;
+	mCapacity = mState->mCapacity;
+	mHighWaterMark = mState->mHighWaterMark;
+	assert(mCapacity > 0 && (mCapacity & (mCapacity - 1)) == 0);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool SendRing::Write(const void* _bytes, size_t _len)
+{
+	const unsigned char* src = (const unsigned char*)_bytes;
+	while (_len > 0) {
+		if (mState->mClosed) {
+			return false;
+		}
+
+		size_t writePos = mState->mWritePos;
+		size_t freeBytes = mCapacity - (writePos - mState->mReadPos);
+		if (freeBytes == 0) {
+			// Completely full--make sure the consumer is draining, then wait for it. Re-check after 
+			// announcing ourselves, the consumer may have made room in between.
+			WakeConsumer();
+			InterlockedExchange(&mState->mProducerWaiting, 1);
+			if (mCapacity - (writePos - mState->mReadPos) == 0 && !mState->mClosed) {
+				WaitForSingleObject(mSpaceAvailable, INFINITE);
+			}
+			InterlockedExchange(&mState->mProducerWaiting, 0);
+			continue;
+		}
+
+		size_t index = writePos & (mCapacity - 1);
+		size_t toCopy = min(_len, min(freeBytes, mCapacity - index));
+		memcpy(mBytes + index, src, toCopy);
+
+		// The bytes have to be visible before the position that publishes them.
+		MemoryBarrier();
+		mState->mWritePos = writePos + toCopy;
+
+		src += toCopy;
+		_len -= toCopy;
+	}
+
+	if (mState->mWritePos - mState->mReadPos >= mHighWaterMark) {
+		WakeConsumer();
+	}
+
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void SendRing::Flush()
+{
+	InterlockedExchange(&mState->mFlushRequested, 1);
+	WakeConsumer();
+}
+
+// ------------------------------------------------------------------------------------------------
+const void* SendRing::Peek(size_t* _outLen) const
+{
+	assert(_outLen);
+
+	size_t readPos = mState->mReadPos;
+	size_t writePos = mState->mWritePos;
+	// Don't look at the bytes before we've seen the position that published them.
+	MemoryBarrier();
+
+	size_t index = readPos & (mCapacity - 1);
+	(*_outLen) = min(writePos - readPos, mCapacity - index);
+	return mBytes + index;
+}
+
+// ------------------------------------------------------------------------------------------------
+void SendRing::Consume(size_t _len)
+{
+	assert(_len <= mState->mWritePos - mState->mReadPos);
+
+	// Done reading the bytes before handing the space back.
+	MemoryBarrier();
+	mState->mReadPos = mState->mReadPos + _len;
+
+	if (InterlockedExchange(&mState->mProducerWaiting, 0)) {
+		SetEvent(mSpaceAvailable);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void SendRing::WaitForData(DWORD _timeoutMs)
+{
+	InterlockedExchange(&mState->mConsumerWaiting, 1);
+	bool flushRequested = InterlockedExchange(&mState->mFlushRequested, 0) != 0;
+	if (!flushRequested && mState->mWritePos - mState->mReadPos < mHighWaterMark && !mState->mClosed) {
+		WaitForSingleObject(mDataAvailable, _timeoutMs);
+	}
+	InterlockedExchange(&mState->mConsumerWaiting, 0);
+}
+
+// ------------------------------------------------------------------------------------------------
+void SendRing::Close()
+{
+	InterlockedExchange(&mState->mClosed, 1);
+	SetEvent(mSpaceAvailable);
+	SetEvent(mDataAvailable);
+}
+
+// ------------------------------------------------------------------------------------------------
+void SendRing::WakeConsumer()
+{
+	if (InterlockedExchange(&mState->mConsumerWaiting, 0)) {
+		SetEvent(mDataAvailable);
+	}
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// ------------------------------------------------------------------------------------------------
+// Everything both sides of a SendRing look at. For a ring shared between two processes, this sits at
+// the start of the shared memory, immediately followed by the bytes. Both processes are Win32, so
+// the layout is the same on either side.
+struct SendRingState
+{
+	size_t mCapacity;
+	size_t mHighWaterMark;
+
+	// Free-running positions; the ring index is the position modulo mCapacity. Each is only written by
+	// one side.
+	volatile size_t mWritePos;
+	volatile size_t mReadPos;
+
+	// Set by a side that is about to sleep, so the other side knows it needs to signal.
+	volatile LONG mProducerWaiting;
+	volatile LONG mConsumerWaiting;
+	// Sticky, so that a Flush the consumer didn't see coming isn't lost.
+	volatile LONG mFlushRequested;
+	volatile LONG mClosed;
+};
+
+// Room reserved for the SendRingState in front of the bytes. Keeps the bytes cache-line aligned.
+const size_t kSendRingStateSize = 64;
+
+// ------------------------------------------------------------------------------------------------
+// A single-producer, single-consumer byte ring. The producer (whoever is sending) copies bytes in 
+// without taking any locks, and only blocks when the ring is completely full. The consumer (the 
+// thread that owns the actual transport) drains it in contiguous runs, straight out of the ring.
+// To avoid waking the consumer on every write, it's only signaled once the ring holds at least 
+// the high-water mark, on Flush, or when it times out waiting.
+// The producer and consumer may live in different processes, see the shared memory constructor.
+class SendRing
+{
+public:
+	// _capacity is rounded up to a power of two.
+	SendRing(size_t _capacity, size_t _highWaterMark);
+
+	// Attaches to a ring in memory shared with another process, which one of the two sides has set up
+	// with InitializeShared beforehand. The events must be the same (named) events on both sides; the
+	// ring takes ownership of the handles.
+	SendRing(void* _sharedMemory, HANDLE _spaceAvailable, HANDLE _dataAvailable);
+	~SendRing();
+
+	// How much shared memory a ring with the given capacity needs. _capacity must be a power of two.
+	static size_t GetSharedSize(size_t _capacity);
+	static void InitializeShared(void* _sharedMemory, size_t _capacity, size_t _highWaterMark);
+
+	// Producer side. Returns false if the ring was closed, in which case the bytes were dropped.
+	bool Write(const void* _bytes, size_t _len);
+
+	// Wakes the consumer even if we're below the high-water mark.
+	void Flush();
+
+	// Consumer side. Peek returns the longest contiguous run of unread bytes (possibly empty).
+	const void* Peek(size_t* _outLen) const;
+	void Consume(size_t _len);
+
+	// Waits until there's at least the high-water mark to read, somebody calls Flush or Close, or 
+	// _timeoutMs has passed.
+	void WaitForData(DWORD _timeoutMs);
+
+	// After Close, writes fail and nothing waits anymore. Either side may call it.
+	void Close();
+	bool IsClosed() const { return mState->mClosed != 0; }
+
+	bool IsEmpty() const { return mState->mWritePos == mState->mReadPos; }
+
+	size_t GetCapacity() const { return mCapacity; }
+
+private:
+	SendRingState* mState;
+	unsigned char* mBytes;
+	bool mOwnsMemory;
+
+	// Copies of the values in mState, which never change once the ring is set up.
+	size_t mCapacity;
+	size_t mHighWaterMark;
+
+	HANDLE mSpaceAvailable;
+	HANDLE mDataAvailable;
+
+	void Attach(void* _memory);
+	void WakeConsumer();
+};
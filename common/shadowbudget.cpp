@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "shadowbudget.h"
+
+ShadowBudget* gShadowBudget = NULL;
+
+// Spilled payloads are written in pieces no bigger than this (WriteFile takes a DWORD).
+const size_t kSpillWriteChunkSize = 64 * 1024 * 1024;
+
+// ------------------------------------------------------------------------------------------------
+void ShadowBudget::BlockList::PushBack(SharedPayloadBlock* _block)
+{
+	_block->mPrev = mTail;
+	_block->mNext = NULL;
+	if (mTail) {
+		mTail->mNext = _block;
+	} else {
+		mHead = _block;
+	}
+	mTail = _block;
+}
+
+// ------------------------------------------------------------------------------------------------
+void ShadowBudget::BlockList::Unlink(SharedPayloadBlock* _block)
+{
+	if (_block->mPrev) {
+		_block->mPrev->mNext = _block->mNext;
+	} else {
+		assert(mHead == _block);
+		mHead = _block->mNext;
+	}
+
+	if (_block->mNext) {
+		_block->mNext->mPrev = _block->mPrev;
+	} else {
+		assert(mTail == _block);
+		mTail = _block->mPrev;
+	}
+
+	_block->mPrev = NULL;
+	_block->mNext = NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+ShadowBudget::ShadowBudget(size_t _budgetBytes)
+: mBudget(_budgetBytes)
+, mFrame(1)
+, mResidentBytes(0)
+, mSpillFile(INVALID_HANDLE_VALUE)
+, mSpillFileSize(0)
+, mSpillMapping(NULL)
+, mSpillMappingSize(0)
+, mSpillFailed(false)
+{
+	InitializeCriticalSection(&mLock);
+
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	mAllocationGranularity = systemInfo.dwAllocationGranularity;
+}
+
+// ------------------------------------------------------------------------------------------------
+ShadowBudget::~ShadowBudget()
+{
+	EnterCriticalSection(&mLock);
+	while (mSpilled.mHead) {
+		SharedPayloadBlock* block = mSpilled.mHead;
+		mSpilled.Unlink(block);
+		PageIn(block);
+		block->mBudgeted = false;
+	}
+
+	while (mResident.mHead) {
+		SharedPayloadBlock* block = mResident.mHead;
+		mResident.Unlink(block);
+		block->mBudgeted = false;
+	}
+	mResidentBytes = 0;
+
+	for (auto it = mRetiredBytes.begin(); it != mRetiredBytes.end(); ++it) {
+		free(*it);
+	}
+	mRetiredBytes.clear();
+
+	if (mSpillMapping) {
+		CloseHandle(mSpillMapping);
+		mSpillMapping = NULL;
+	}
+
+	// The file was opened delete-on-close, so this gets rid of it too.
+	if (mSpillFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(mSpillFile);
+		mSpillFile = INVALID_HANDLE_VALUE;
+	}
+	LeaveCriticalSection(&mLock);
+
+	DeleteCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void ShadowBudget::Add(SharedPayloadBlock* _block)
+{
+	assert(_block && _block->mBytes && !_block->mBudgeted);
+	if (_block->mLen < kMinBudgetedPayloadSize) {
+		return;
+	}
+
+	EnterCriticalSection(&mLock);
+	_block->mBudgeted = true;
+	_block->mSpillOffset = -1;
+	_block->mLastUseFrame = mFrame;
+	mResident.PushBack(_block);
+	mResidentBytes += _block->mLen;
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void ShadowBudget::Remove(SharedPayloadBlock* _block)
+{
+	assert(_block && _block->mBudgeted);
+
+	EnterCriticalSection(&mLock);
+	if (_block->mBytes) {
+		mResident.Unlink(_block);
+		mResidentBytes -= _block->mLen;
+	} else {
+		mSpilled.Unlink(_block);
+	}
+	_block->mBudgeted = false;
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void* ShadowBudget::Use(SharedPayloadBlock* _block, bool _forWriting)
+{
+	assert(_block && _block->mBudgeted);
+
+	EnterCriticalSection(&mLock);
+	if (_block->mBytes) {
+		mResident.Unlink(_block);
+	} else {
+		mSpilled.Unlink(_block);
+		PageIn(_block);
+		mResidentBytes += _block->mLen;
+	}
+
+	_block->mLastUseFrame = mFrame;
+	mResident.PushBack(_block);
+
+	if (_forWriting) {
+		_block->mSpillOffset = -1;
+	}
+
+	void* retVal = _block->mBytes;
+	LeaveCriticalSection(&mLock);
+
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void ShadowBudget::Pin(SharedPayloadBlock* _block)
+{
+	assert(_block && _block->mBudgeted);
+
+	EnterCriticalSection(&mLock);
+	++_block->mPinCount;
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void ShadowBudget::Unpin(SharedPayloadBlock* _block)
+{
+	assert(_block && _block->mBudgeted && _block->mPinCount > 0);
+
+	EnterCriticalSection(&mLock);
+	--_block->mPinCount;
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void ShadowBudget::OnFrame()
+{
+	EnterCriticalSection(&mLock);
+	for (auto it = mRetiredBytes.begin(); it != mRetiredBytes.end(); ++it) {
+		free(*it);
+	}
+	mRetiredBytes.clear();
+
+	// Anything used this frame is likely to be used again in the next one, so it stays even if that 
+	// leaves us over budget for a while. So does anything pinned.
+	SharedPayloadBlock* block = mResident.mHead;
+	while (block && mResidentBytes > mBudget && !mSpillFailed) {
+		if (block->mLastUseFrame >= mFrame) {
+			break;
+		}
+
+		SharedPayloadBlock* next = block->mNext;
+		if (block->mPinCount == 0 && !Spill(block)) {
+			break;
+		}
+		block = next;
+	}
+
+	++mFrame;
+	LeaveCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool ShadowBudget::OpenSpillFile()
+{
+	TCHAR tempPath[_MAX_PATH];
+	TCHAR spillFilename[_MAX_PATH];
+	DWORD len = GetTempPath(_MAX_PATH, tempPath);
+	if (len == 0 || len >= _MAX_PATH || GetTempFileName(tempPath, TC("gfx"), 0, spillFilename) == 0) {
+		LogError(TC("Couldn't come up with a name for the shadow spill file, keeping everything in memory."));
+		return false;
+	}
+
+	mSpillFile = CreateFile(spillFilename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (mSpillFile == INVALID_HANDLE_VALUE) {
+		LogError(TC("Couldn't create the shadow spill file '%s', keeping everything in memory."), spillFilename);
+		return false;
+	}
+
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool ShadowBudget::Spill(SharedPayloadBlock* _block)
+{
+	assert(_block->mBytes);
+
+	// Bytes that haven't changed since they were last spilled are already there.
+	if (_block->mSpillOffset < 0) {
+		if (mSpillFile == INVALID_HANDLE_VALUE && !OpenSpillFile()) {
+			mSpillFailed = true;
+			return false;
+		}
+
+		LARGE_INTEGER offset;
+		offset.QuadPart = mSpillFileSize;
+		if (!SetFilePointerEx(mSpillFile, offset, NULL, FILE_BEGIN)) {
+			mSpillFailed = true;
+			return false;
+		}
+
+		const unsigned char* bytes = (const unsigned char*)_block->mBytes;
+		for (size_t written = 0; written < _block->mLen; ) {
+			DWORD chunkSize = (DWORD)min(kSpillWriteChunkSize, _block->mLen - written);
+			DWORD chunkWritten = 0;
+			if (!WriteFile(mSpillFile, bytes + written, chunkSize, &chunkWritten, NULL) || chunkWritten != chunkSize) {
+				// Most likely the disk is full. What's been written so far past mSpillFileSize gets overwritten
+				// next time, if there is one.
+				Once(TraceError(TC("Couldn't write to the shadow spill file, keeping everything in memory from here on.")));
+				mSpillFailed = true;
+				return false;
+			}
+			written += chunkSize;
+		}
+
+		_block->mSpillOffset = mSpillFileSize;
+		mSpillFileSize += _block->mLen;
+	}
+
+	mResident.Unlink(_block);
+	mResidentBytes -= _block->mLen;
+	mSpilled.PushBack(_block);
+
+	mRetiredBytes.push_back(_block->mBytes);
+	_block->mBytes = NULL;
+
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool ShadowBudget::PageIn(SharedPayloadBlock* _block)
+{
+	assert(_block->mBytes == NULL && _block->mSpillOffset >= 0);
+
+	// The application needs the bytes to be somewhere even if we can't get the right ones back, and 
+	// there's nothing better to hand out than zeroes.
+	_block->mBytes = calloc(1, _block->mLen);
+	if (!_block->mBytes) {
+		LogError(TC("Couldn't allocate %I64u bytes to bring a payload back from the shadow spill file."), (unsigned __int64)_block->mLen);
+		throw 1;
+	}
+
+	// Mappings only cover what was in the file when they were made.
+	if (mSpillMapping && mSpillMappingSize < _block->mSpillOffset + (__int64)_block->mLen) {
+		CloseHandle(mSpillMapping);
+		mSpillMapping = NULL;
+	}
+
+	if (!mSpillMapping) {
+		mSpillMapping = CreateFileMapping(mSpillFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		mSpillMappingSize = mSpillFileSize;
+		if (!mSpillMapping) {
+			Once(TraceError(TC("Couldn't map the shadow spill file, payloads brought back from it will be zeroes.")));
+			return false;
+		}
+	}
+
+	// Views have to start on the allocation granularity.
+	__int64 viewOffset = _block->mSpillOffset - (_block->mSpillOffset % mAllocationGranularity);
+	size_t viewLead = (size_t)(_block->mSpillOffset - viewOffset);
+	const unsigned char* view = (const unsigned char*)MapViewOfFile(mSpillMapping, FILE_MAP_READ, (DWORD)(viewOffset >> 32), (DWORD)(viewOffset & 0xFFFFFFFF), viewLead + _block->mLen);
+	if (!view) {
+		Once(TraceError(TC("Couldn't map a view of the shadow spill file, payloads brought back from it will be zeroes.")));
+		return false;
+	}
+
+	memcpy(_block->mBytes, view + viewLead, _block->mLen);
+	UnmapViewOfFile(view);
+
+	return true;
+}
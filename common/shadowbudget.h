@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+
+// Payloads smaller than this stay in memory no matter what--they aren't worth a trip to disk.
+const size_t kMinBudgetedPayloadSize = 4 * 1024;
+
+// ------------------------------------------------------------------------------------------------
+// Keeps the shadow copies the hooks make of the application's textures and buffers (the bytes behind
+// SharedPayloads) within a budget. At the end of each frame, the payloads that weren't used during it
+// are spilled to a scratch file, least recently used first, until the rest fit. Spilled payloads cost 
+// nothing but disk space until somebody asks for their bytes again--usually a capture writing out the
+// state--at which point they're mapped back in from the file.
+// The spill file is append-only: a payload that's spilled again without having changed keeps the copy
+// it already has there, and the space of payloads that go away isn't reused.
+class ShadowBudget
+{
+public:
+	ShadowBudget(size_t _budgetBytes);
+	// Brings back whatever is spilled, so the payloads that outlive us still have their bytes.
+	~ShadowBudget();
+
+	// Called by SharedPayload for new payloads, and when the last owner lets go of one.
+	void Add(SharedPayloadBlock* _block);
+	void Remove(SharedPayloadBlock* _block);
+
+	// The bytes of _block, brought back in if they were spilled. If they're _forWriting, the copy in
+	// the spill file is forgotten.
+	void* Use(SharedPayloadBlock* _block, bool _forWriting);
+
+	// Pinned blocks stay in memory however long they go unused (see SharedPayload::Pin).
+	void Pin(SharedPayloadBlock* _block);
+	void Unpin(SharedPayloadBlock* _block);
+
+	// At the end of each frame (from SwapBuffers).
+	void OnFrame();
+
+private:
+	struct BlockList
+	{
+		SharedPayloadBlock* mHead;
+		SharedPayloadBlock* mTail;
+
+		BlockList() : mHead(NULL), mTail(NULL) { }
+		void PushBack(SharedPayloadBlock* _block);
+		void Unlink(SharedPayloadBlock* _block);
+	};
+
+	size_t mBudget;
+
+	// Threads with contexts of their own use payloads at the same time as the one that's presenting.
+	CRITICAL_SECTION mLock;
+
+	unsigned int mFrame;
+
+	// Budgeted blocks with their bytes in memory, least recently used first, and how many bytes that is.
+	BlockList mResident;
+	size_t mResidentBytes;
+	// Budgeted blocks with their bytes only in the spill file.
+	BlockList mSpilled;
+
+	// Bytes of blocks spilled at the end of the last frame. Whoever used them before then may still be 
+	// holding on to them, so they're only freed at the end of this one.
+	std::vector<void*> mRetiredBytes;
+
+	HANDLE mSpillFile;
+	__int64 mSpillFileSize;
+	HANDLE mSpillMapping;
+	__int64 mSpillMappingSize;
+	bool mSpillFailed;
+
+	DWORD mAllocationGranularity;
+
+	bool OpenSpillFile();
+	bool Spill(SharedPayloadBlock* _block);
+	bool PageIn(SharedPayloadBlock* _block);
+};
+
+extern ShadowBudget* gShadowBudget;
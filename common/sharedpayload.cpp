@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "sharedpayload.h"
+
+#include "shadowbudget.h"
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+SharedPayload::SharedPayload(void* _bytes, size_t _len)
+: mBlock(NULL)
+{
+	if (_bytes) {
+		mBlock = new SharedPayloadBlock;
+		mBlock->mRefCount = 1;
+		mBlock->mBytes = _bytes;
+		mBlock->mLen = _len;
+		mBlock->mBudgeted = false;
+		mBlock->mSpillOffset = -1;
+		mBlock->mLastUseFrame = 0;
+		mBlock->mPinCount = 0;
+		mBlock->mPrev = NULL;
+		mBlock->mNext = NULL;
+
+		// Payloads borrowed from a loaded trace aren't ours to send away.
+		if (gShadowBudget && !IsBorrowedPayload(_bytes)) {
+			gShadowBudget->Add(mBlock);
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+SharedPayload::SharedPayload(const SharedPayload& _rhs)
+: mBlock(_rhs.mBlock)
+{
+	if (mBlock) {
+		InterlockedIncrement(&mBlock->mRefCount);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+SharedPayload::SharedPayload(SharedPayload&& _rhs)
+: mBlock(_rhs.mBlock)
+{
+	_rhs.mBlock = NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+SharedPayload& SharedPayload::operator=(const SharedPayload& _rhs)
+{
+	if (this != &_rhs) {
+		// Take the new reference first, in case both are the same bytes.
+		if (_rhs.mBlock) {
+			InterlockedIncrement(&_rhs.mBlock->mRefCount);
+		}
+		Reset();
+
+		mBlock = _rhs.mBlock;
+	}
+
+	return *this;
+}
+
+// ------------------------------------------------------------------------------------------------
+SharedPayload& SharedPayload::operator=(SharedPayload&& _rhs)
+{
+	if (this != &_rhs) {
+		Reset();
+
+		mBlock = _rhs.mBlock;
+		_rhs.mBlock = NULL;
+	}
+
+	return *this;
+}
+
+// ------------------------------------------------------------------------------------------------
+void SharedPayload::Reset()
+{
+	if (mBlock && InterlockedDecrement(&mBlock->mRefCount) == 0) {
+		if (mBlock->mBudgeted) {
+			gShadowBudget->Remove(mBlock);
+		}
+		SafeFreePayload(mBlock->mBytes);
+		delete mBlock;
+	}
+
+	mBlock = NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+const void* SharedPayload::Get() const
+{
+	if (!mBlock) {
+		return NULL;
+	}
+
+	if (mBlock->mBudgeted) {
+		return gShadowBudget->Use(mBlock, false);
+	}
+
+	return mBlock->mBytes;
+}
+
+// ------------------------------------------------------------------------------------------------
+void* SharedPayload::GetWritable()
+{
+	if (!mBlock) {
+		return NULL;
+	}
+
+	// Only owners can add references, so if we're the only one nobody can show up while we write.
+	if (mBlock->mRefCount > 1) {
+		size_t len = mBlock->mLen;
+		void* copy = MallocAndCopy(Get(), len);
+		(*this) = SharedPayload(copy, len);
+	}
+
+	// Whatever copy of the bytes went to disk is about to be out of date.
+	if (mBlock->mBudgeted) {
+		return gShadowBudget->Use(mBlock, true);
+	}
+
+	return mBlock->mBytes;
+}
+
+// ------------------------------------------------------------------------------------------------
+void SharedPayload::Pin() const
+{
+	if (mBlock && mBlock->mBudgeted) {
+		gShadowBudget->Pin(mBlock);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void SharedPayload::Unpin() const
+{
+	if (mBlock && mBlock->mBudgeted) {
+		gShadowBudget->Unpin(mBlock);
+	}
+}
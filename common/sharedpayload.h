@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// ------------------------------------------------------------------------------------------------
+// The bytes of a payload (a texture update, the contents of a buffer) that can have several owners at 
+// once--say, the live context state and a snapshot of it that a capture is writing out on another 
+// thread. Copying one only adds a reference. Since other owners may be reading them at any time, 
+// shared bytes never change: write through GetWritable, which makes a private copy first if need be.
+// The bytes behind one or more SharedPayloads, and how many of those there are.
+struct SharedPayloadBlock
+{
+	volatile LONG mRefCount;
+	void* mBytes;
+	size_t mLen;
+
+	// The rest belongs to ShadowBudget, and only means anything if mBudgeted. A budgeted block's bytes
+	// can be spilled to disk when they haven't been used for a while, leaving mBytes NULL until they are
+	// used again.
+	bool mBudgeted;
+	__int64 mSpillOffset;			// Where a copy of the bytes is in the spill file, -1 if there isn't a current one.
+	unsigned int mLastUseFrame;
+	unsigned int mPinCount;			// Never spilled while this isn't 0, see SharedPayload::Pin.
+	SharedPayloadBlock* mPrev;
+	SharedPayloadBlock* mNext;
+};
+
+// ------------------------------------------------------------------------------------------------
+class SharedPayload
+{
+public:
+	SharedPayload() : mBlock(NULL) { }
+	// Takes ownership of _bytes, which are released with SafeFreePayload when the last owner lets go.
+	SharedPayload(void* _bytes, size_t _len);
+	SharedPayload(const SharedPayload& _rhs);
+	SharedPayload(SharedPayload&& _rhs);
+	~SharedPayload() { Reset(); }
+
+	SharedPayload& operator=(const SharedPayload& _rhs);
+	SharedPayload& operator=(SharedPayload&& _rhs);
+
+	// Lets go of the bytes, leaving the payload empty.
+	void Reset();
+
+	// Brings the bytes back from the spill file if they were sent there (see ShadowBudget). They stay 
+	// where they are for at least the rest of the frame after this one--or until Unpin, if pinned first.
+	const void* Get() const;
+	size_t GetLength() const { return mBlock ? mBlock->mLen : 0; }
+
+	// The bytes, for changing. If anybody else has them, they get to keep the old ones.
+	void* GetWritable();
+
+	// For readers that take longer than that, like a capture writing a snapshot out on another thread:
+	// the bytes stay in memory from Pin until the matching Unpin.
+	void Pin() const;
+	void Unpin() const;
+
+private:
+	// NULL when there are no bytes.
+	SharedPayloadBlock* mBlock;
+};
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "tracecontainer.h"
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+TraceBlockInfo::TraceBlockInfo()
+: mOffset(kInvalidTraceFileOffset)
+, mByteLength(0)
+, mFirstPacketId(0)
+, mPacketCount(0)
+, mFrameNumber(0)
+{
+
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceBlockInfo::Read(FileLike* _in)
+{
+	_in->Read(&mOffset);
+	_in->Read(&mByteLength);
+	_in->Read(&mFirstPacketId);
+	_in->Read(&mPacketCount);
+	_in->Read(&mFrameNumber);
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceBlockInfo::Write(FileLike* _out) const
+{
+	_out->Write(mOffset);
+	_out->Write(mByteLength);
+	_out->Write(mFirstPacketId);
+	_out->Write(mPacketCount);
+	_out->Write(mFrameNumber);
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+TraceFrameInfo::TraceFrameInfo()
+: mFirstBlock(0)
+, mBlockCount(0)
+{
+
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceFrameInfo::Read(FileLike* _in)
+{
+	_in->Read(&mFirstBlock);
+	_in->Read(&mBlockCount);
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceFrameInfo::Write(FileLike* _out) const
+{
+	_out->Write(mFirstBlock);
+	_out->Write(mBlockCount);
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+TraceIndex::TraceIndex()
+{
+	Reset();
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceIndex::Reset()
+{
+	for (int i = 0; i < ETS_Count; ++i) {
+		mSectionOffsets[i] = kInvalidTraceFileOffset;
+	}
+	mBlocks.clear();
+	mFrames.clear();
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceIndex::Read(FileLike* _in)
+{
+	Reset();
+
+	_in->Read(Checkpoint("TraceIndexBegin"));
+	unsigned int sectionCount = 0;
+	_in->Read(&sectionCount);
+	for (unsigned int i = 0; i < sectionCount; ++i) {
+		TraceFileOffset offset = kInvalidTraceFileOffset;
+		_in->Read(&offset);
+		// Sections we don't know about are skipped.
+		if (i < ETS_Count) {
+			mSectionOffsets[i] = offset;
+		}
+	}
+
+	_in->Read(&mBlocks);
+	_in->Read(&mFrames);
+	_in->Read(Checkpoint("TraceIndexEnd"));
+
+	for (auto it = mFrames.cbegin(); it != mFrames.cend(); ++it) {
+		if (it->mFirstBlock + it->mBlockCount > mBlocks.size()) {
+			throw 10;
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceIndex::Write(FileLike* _out) const
+{
+	_out->Write(Checkpoint("TraceIndexBegin"));
+	_out->Write((unsigned int)ETS_Count);
+	for (int i = 0; i < ETS_Count; ++i) {
+		_out->Write(mSectionOffsets[i]);
+	}
+
+	_out->Write(mBlocks);
+	_out->Write(mFrames);
+	_out->Write(Checkpoint("TraceIndexEnd"));
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceIndex::SetSectionOffset(ETraceSection _section, TraceFileOffset _offset)
+{
+	assert(_section >= 0 && _section < ETS_Count);
+	mSectionOffsets[_section] = _offset;
+}
+
+// ------------------------------------------------------------------------------------------------
+bool TraceIndex::HasSection(ETraceSection _section) const
+{
+	assert(_section >= 0 && _section < ETS_Count);
+	return mSectionOffsets[_section] != kInvalidTraceFileOffset;
+}
+
+// ------------------------------------------------------------------------------------------------
+TraceFileOffset TraceIndex::GetSectionOffset(ETraceSection _section) const
+{
+	assert(_section >= 0 && _section < ETS_Count);
+	return mSectionOffsets[_section];
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceIndex::AddBlock(const TraceBlockInfo& _block)
+{
+	// Blocks have to be added in order, the lookups below rely on it.
+	assert(mBlocks.empty() || mBlocks.back().mFirstPacketId + mBlocks.back().mPacketCount == _block.mFirstPacketId);
+	assert(mBlocks.empty() || mBlocks.back().mFrameNumber <= _block.mFrameNumber);
+	mBlocks.push_back(_block);
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceIndex::AddFrame(const TraceFrameInfo& _frame)
+{
+	assert(_frame.mFirstBlock + _frame.mBlockCount <= mBlocks.size());
+	mFrames.push_back(_frame);
+}
+
+// ------------------------------------------------------------------------------------------------
+size_t TraceIndex::GetPacketCount() const
+{
+	if (mBlocks.empty()) {
+		return 0;
+	}
+
+	return mBlocks.back().mFirstPacketId + mBlocks.back().mPacketCount;
+}
+
+// ------------------------------------------------------------------------------------------------
+size_t TraceIndex::FindBlockForPacket(size_t _packetId) const
+{
+	size_t lo = 0, 
+	       hi = mBlocks.size();
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const TraceBlockInfo& block = mBlocks[mid];
+		if (_packetId < block.mFirstPacketId) {
+			hi = mid;
+		} else if (_packetId >= block.mFirstPacketId + block.mPacketCount) {
+			lo = mid + 1;
+		} else {
+			return mid;
+		}
+	}
+
+	return (size_t)-1;
+}
+
+// ------------------------------------------------------------------------------------------------
+size_t TraceIndex::FindFirstBlockForFrame(unsigned int _frameNumber) const
+{
+	if (_frameNumber >= mFrames.size() || mFrames[_frameNumber].mBlockCount == 0) {
+		return (size_t)-1;
+	}
+
+	return mFrames[_frameNumber].mFirstBlock;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+TraceBlockWriter::TraceBlockWriter(FileLike* _out, TraceIndex* _index)
+: mOut(_out)
+, mIndex(_index)
+, mBlockOpen(false)
+, mNextPacketId(0)
+, mFrameNumber(0)
+{
+	assert(mOut);
+	assert(mIndex);
+}
+
+// ------------------------------------------------------------------------------------------------
+TraceBlockWriter::~TraceBlockWriter()
+{
+	Finish();
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceBlockWriter::WriteFrame(const unsigned char* _bytes, const size_t* _packetEnds, size_t _packetCount)
+{
+	assert(!mBlockOpen);
+
+	TraceFrameInfo frame;
+	frame.mFirstBlock = mIndex->GetBlockCount();
+
+	// Blocks are cut once they reach the target size, and at the end of the frame.
+	size_t blockStart = 0;
+	for (size_t i = 0; i < _packetCount; ++i) {
+		if (!mBlockOpen) {
+			BeginBlock();
+		}
+
+		++mCurrentBlock.mPacketCount;
+		++mNextPacketId;
+
+		size_t blockEnd = _packetEnds[i];
+		if (blockEnd - blockStart >= kTraceBlockTargetSize || i + 1 == _packetCount) {
+			mOut->WriteRaw(_bytes + blockStart, blockEnd - blockStart);
+			blockStart = blockEnd;
+			EndBlock();
+		}
+	}
+
+	frame.mBlockCount = mIndex->GetBlockCount() - frame.mFirstBlock;
+	mIndex->AddFrame(frame);
+	++mFrameNumber;
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceBlockWriter::RepeatFrame()
+{
+	assert(!mBlockOpen);
+	assert(mIndex->GetFrameCount() > 0);
+
+	// Copy it first, the index may grow into where it lives.
+	TraceFrameInfo frame = mIndex->GetFrame(mIndex->GetFrameCount() - 1);
+	mIndex->AddFrame(frame);
+	++mFrameNumber;
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceBlockWriter::Finish()
+{
+	if (mBlockOpen) {
+		EndBlock();
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceBlockWriter::BeginBlock()
+{
+	assert(!mBlockOpen);
+
+	mCurrentBlock = TraceBlockInfo();
+	mCurrentBlock.mOffset = mOut->Tell();
+	mCurrentBlock.mFirstPacketId = mNextPacketId;
+	mCurrentBlock.mFrameNumber = mFrameNumber;
+	mBlockOpen = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceBlockWriter::EndBlock()
+{
+	assert(mBlockOpen);
+
+	mCurrentBlock.mByteLength = mOut->Tell() - mCurrentBlock.mOffset;
+	mIndex->AddBlock(mCurrentBlock);
+	mBlockOpen = false;
+
+	// Blocks are the unit the stream gets flushed in.
+	mOut->Flush();
+}
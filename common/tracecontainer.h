@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+
+class FileLike;
+
+// Version of the .gft container layout (header, sections, command blocks and the trailing index).
+// Bump whenever any of that layout changes. The encoding of the packets themselves is versioned 
+// separately by kPacketFormatVersion.
+const unsigned int kTraceContainerVersion = 4;
+
+// Written right after the "GLTrace" checkpoint, so readers can tell a trace from the wrong-endian machine.
+const unsigned int kEndianTestValue = 0x12345678;
+
+// Commands are grouped into blocks of roughly this many bytes. Blocks always end on a packet boundary
+// (and at the end of every frame), so the last packet of a block may run over.
+// A frame is everything up to and including a SwapBuffers, or up to the end of the trace.
+const size_t kTraceBlockTargetSize = 256 * 1024;
+
+typedef unsigned __int64 TraceFileOffset;
+const TraceFileOffset kInvalidTraceFileOffset = (TraceFileOffset)-1;
+
+// The independently addressable sections of a trace file.
+enum ETraceSection
+{
+	ETS_ContextState,
+	ETS_Textures,
+	ETS_Buffers,
+	ETS_Shaders,
+	ETS_Programs,
+	ETS_ProgramsARB,
+	ETS_FramebufferObjects,
+	ETS_Commands,
+	ETS_Blobs,
+
+	ETS_Count
+};
+
+// ------------------------------------------------------------------------------------------------
+// Describes one block of commands within the commands section.
+struct TraceBlockInfo
+{
+	TraceBlockInfo();
+
+	void Read(FileLike* _in);
+	void Write(FileLike* _out) const;
+
+	TraceFileOffset mOffset;
+	TraceFileOffset mByteLength;
+	size_t mFirstPacketId;		// Ordinal of the first command in this block, counted from the start of the commands section.
+	size_t mPacketCount;
+	unsigned int mFrameNumber;	// The frame the block was written for--later frames may repeat it.
+};
+
+// ------------------------------------------------------------------------------------------------
+// Describes one frame: the run of blocks holding its commands. A frame identical to the one before 
+// it isn't written again, it just refers to the same blocks.
+struct TraceFrameInfo
+{
+	TraceFrameInfo();
+
+	void Read(FileLike* _in);
+	void Write(FileLike* _out) const;
+
+	size_t mFirstBlock;
+	size_t mBlockCount;
+};
+
+// ------------------------------------------------------------------------------------------------
+// The trailing index of a trace file. Lets readers seek straight to a section, a frame or a range
+// of commands without parsing everything in front of it.
+class TraceIndex
+{
+public:
+	TraceIndex();
+
+	void Reset();
+
+	void Read(FileLike* _in);
+	void Write(FileLike* _out) const;
+
+	void SetSectionOffset(ETraceSection _section, TraceFileOffset _offset);
+	bool HasSection(ETraceSection _section) const;
+	TraceFileOffset GetSectionOffset(ETraceSection _section) const;
+
+	void AddBlock(const TraceBlockInfo& _block);
+	size_t GetBlockCount() const { return mBlocks.size(); }
+	const TraceBlockInfo& GetBlock(size_t _blockNum) const { return mBlocks[_blockNum]; }
+
+	void AddFrame(const TraceFrameInfo& _frame);
+	unsigned int GetFrameCount() const { return (unsigned int)mFrames.size(); }
+	const TraceFrameInfo& GetFrame(unsigned int _frameNumber) const { return mFrames[_frameNumber]; }
+
+	// Counts each stored command once, however many frames play it.
+	size_t GetPacketCount() const;
+
+	// Return the block containing the specified command, or (size_t)-1 if there isn't one.
+	size_t FindBlockForPacket(size_t _packetId) const;
+	// Return the first block of the specified frame, or (size_t)-1 if there isn't one.
+	size_t FindFirstBlockForFrame(unsigned int _frameNumber) const;
+
+private:
+	TraceFileOffset mSectionOffsets[ETS_Count];
+	std::vector<TraceBlockInfo> mBlocks;
+	std::vector<TraceFrameInfo> mFrames;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Writes commands into the commands section a frame at a time, grouping them into blocks and 
+// recording each block and frame in a TraceIndex as it goes.
+class TraceBlockWriter
+{
+public:
+	TraceBlockWriter(FileLike* _out, TraceIndex* _index);
+	~TraceBlockWriter();
+
+	// _bytes is the frame's commands, already serialized. _packetEnds[i] is where the i'th of them ends.
+	void WriteFrame(const unsigned char* _bytes, const size_t* _packetEnds, size_t _packetCount);
+
+	// Adds a frame that's exactly the same as the last one written, without writing it again.
+	void RepeatFrame();
+
+	// Closes the currently open block, if any. Called automatically on destruction.
+	void Finish();
+
+private:
+	void BeginBlock();
+	void EndBlock();
+
+	FileLike* mOut;
+	TraceIndex* mIndex;
+
+	bool mBlockOpen;
+	TraceBlockInfo mCurrentBlock;
+	size_t mNextPacketId;
+	unsigned int mFrameNumber;
+};
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "tracewriter.h"
+
+#include "functionhooks.gen.h"
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+TraceWriter::TraceWriter(const TCHAR* _filename, ETraceCodec _codec, bool _spillBlobs)
+: mFile(NULL)
+, mOut(NULL)
+, mBlockWriter(NULL)
+, mHasPreviousFrame(false)
+, mRepeatedFrameCount(0)
+, mFrameOut(NULL)
+, mIndexOffsetLocation(kInvalidTraceFileOffset)
+, mChunkTableOffsetLocation(kInvalidTraceFileOffset)
+{
+	if (_tfopen_s(&mFile, _filename, TC("wb")) != 0) {
+		LogError(TC("Couldn't open '%s' for writing."), _filename);
+		throw 10;
+	}
+	assert(mFile);
+
+	if (_spillBlobs) {
+		TCHAR scratchFilename[_MAX_PATH];
+		_stprintf_s(scratchFilename, _MAX_PATH, TC("%s.blobs"), _filename);
+		mBlobs.SpillTo(scratchFilename);
+	}
+
+	mOut = new FileLike(mFile);
+	mOut->SetTraceIndex(&mIndex);
+
+	mOut->Write(Checkpoint("GLTrace"));
+	unsigned int endianCheck = kEndianTestValue;
+	mOut->Write(endianCheck); // To deal with endianness.
+	mOut->Write(kPacketFormatVersion);
+	mOut->Write(kTraceContainerVersion);
+	mOut->Write((unsigned int)_codec);
+
+	// The index and the codec's chunk table live at the end of the file; these get patched with 
+	// their locations once we know them.
+	mIndexOffsetLocation = mOut->Tell();
+	mOut->Write(kInvalidTraceFileOffset);
+	mChunkTableOffsetLocation = mOut->Tell();
+	mOut->Write(kInvalidTraceFileOffset);
+
+	// Everything past the header goes through the codec.
+	mOut->BeginEncoding(_codec);
+
+	// Payloads in the context state and commands are only written once, to the blobs section.
+	mOut->SetBlobStore(&mBlobs);
+}
+
+// ------------------------------------------------------------------------------------------------
+TraceWriter::~TraceWriter()
+{
+	SafeDelete(mFrameOut);
+	SafeDelete(mBlockWriter);
+
+	// Only unfinished writers get here with a stream, and those have already failed or been abandoned.
+	try {
+		SafeDelete(mOut);
+	} catch (...) {
+		mOut = NULL;
+	}
+
+	if (mFile) {
+		fclose(mFile);
+		mFile = NULL;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceWriter::WriteContextState(const ContextState& _contextState)
+{
+	assert(mOut && mBlockWriter == NULL);
+
+	// TODO: Should probably write out some metadata like resolution, extensions used, errors encountered, etc.
+	mOut->MarkSection(ETS_ContextState);
+	mOut->Write(_contextState);
+
+	mOut->MarkSection(ETS_Commands);
+	mOut->Write(Checkpoint("CommandsBegin"));
+	mBlockWriter = new TraceBlockWriter(mOut, &mIndex);
+
+	mFrameOut = new FileLike(&mFrameBytes);
+	mFrameOut->SetBlobStore(&mBlobs);
+	// The packets were sized against this state when they were received, not whatever gContextState is.
+	mFrameOut->SetContextState(&_contextState);
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceWriter::WritePacket(const SSerializeDataPacket& _pkt)
+{
+	assert(mBlockWriter && mFrameOut);
+
+	mFrameOut->Write(_pkt);
+	mFramePacketEnds.push_back((size_t)mFrameOut->Tell());
+
+	if (_pkt.mDataType == ESTSwapBuffersData) {
+		EndFrame();
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceWriter::EndFrame()
+{
+	assert(!mFramePacketEnds.empty());
+	mFrameOut->Flush();
+
+	// Payloads have been swapped for blob references and packet ids aren't written to files, so 
+	// frames that play the same commands with the same data serialize to the same bytes.
+	if (mHasPreviousFrame && mFrameBytes == mPreviousFrameBytes) {
+		mBlockWriter->RepeatFrame();
+		++mRepeatedFrameCount;
+	} else {
+		mBlockWriter->WriteFrame(&mFrameBytes[0], &mFramePacketEnds[0], mFramePacketEnds.size());
+	}
+
+	mFrameBytes.swap(mPreviousFrameBytes);
+	mFrameBytes.clear();
+	mFramePacketEnds.clear();
+	mHasPreviousFrame = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceWriter::Finish()
+{
+	assert(mOut && mBlockWriter);
+
+	// Whatever came after the last SwapBuffers is a frame too.
+	if (!mFramePacketEnds.empty()) {
+		EndFrame();
+	}
+	SafeDelete(mFrameOut);
+	mPreviousFrameBytes.clear();
+
+	mBlockWriter->Finish();
+	SafeDelete(mBlockWriter);
+	mOut->Write(Checkpoint("CommandsEnd"));
+	LogInfo(TC("Trace commands: %u frames, %u of them repeats of the frame before."), mIndex.GetFrameCount(), mRepeatedFrameCount);
+
+	mOut->SetBlobStore(NULL);
+	mOut->MarkSection(ETS_Blobs);
+	mOut->Write(mBlobs);
+	LogInfo(TC("Trace payloads: %u references to %u unique blobs (%I64u bytes)."), mBlobs.GetReferenceCount(), mBlobs.GetBlobCount(), mBlobs.GetTotalBytes());
+
+	mOut->SetTraceIndex(NULL);
+	TraceFileOffset indexOffset = mOut->Tell();
+	mOut->Write(mIndex);
+
+	TraceFileOffset chunkTableOffset = mOut->EndEncoding();
+
+	mOut->Seek(mIndexOffsetLocation);
+	mOut->Write(indexOffset);
+	mOut->Seek(mChunkTableOffsetLocation);
+	mOut->Write(chunkTableOffset);
+
+	SafeDelete(mOut);
+	if (fclose(mFile) != 0) {
+		mFile = NULL;
+		throw 10;
+	}
+	mFile = NULL;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+enum ETraceStreamItem
+{
+	ETSI_ContextState,
+	ETSI_Packet,
+	ETSI_End,
+};
+
+// ------------------------------------------------------------------------------------------------
+struct TraceStreamItem
+{
+	ETraceStreamItem mType;
+	const ContextState* mContextState;
+	SSerializeDataPacket mPacket;
+	size_t mPayloadBytes;
+};
+
+// ------------------------------------------------------------------------------------------------
+DWORD WINAPI TraceStreamWriter_RunWriteThread(LPVOID _writerPtr)
+{
+	((TraceStreamWriter*)_writerPtr)->Thread_Write();
+	return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+TraceStreamWriter::TraceStreamWriter(const TCHAR* _filename, ETraceCodec _codec)
+: mWriter(_filename, _codec, true)
+, mFreeSlots(NULL)
+, mQueuedItems(NULL)
+, mQueue(NULL)
+, mQueueHead(0)
+, mQueueCount(0)
+, mQueuedPayloadBytes(0)
+, mPayloadBytesReleased(NULL)
+, mThreadHandle(NULL)
+, mFailed(false)
+{
+	InitializeCriticalSection(&mLock);
+	mFreeSlots = CreateSemaphore(NULL, kTraceStreamQueueDepth, kTraceStreamQueueDepth, NULL);
+	mQueuedItems = CreateSemaphore(NULL, 0, kTraceStreamQueueDepth, NULL);
+	mPayloadBytesReleased = CreateEvent(NULL, FALSE, FALSE, NULL);
+	assert(mFreeSlots && mQueuedItems && mPayloadBytesReleased);
+
+	mQueue = new TraceStreamItem[kTraceStreamQueueDepth];
+	mThreadHandle = CreateThread(NULL, 0, TraceStreamWriter_RunWriteThread, this, 0, NULL);
+	assert(mThreadHandle);
+}
+
+// ------------------------------------------------------------------------------------------------
+TraceStreamWriter::~TraceStreamWriter()
+{
+	// If nobody called Finish, stop the thread but leave the file unfinished.
+	if (mThreadHandle) {
+		TraceStreamItem item;
+		item.mType = ETSI_End;
+		item.mContextState = NULL;
+		Submit(item);
+		WaitForSingleObject(mThreadHandle, INFINITE);
+		CloseHandle(mThreadHandle);
+		mThreadHandle = NULL;
+	}
+
+	SafeDeleteArray(mQueue);
+	CloseHandle(mPayloadBytesReleased);
+	CloseHandle(mQueuedItems);
+	CloseHandle(mFreeSlots);
+	DeleteCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceStreamWriter::SubmitContextState(const ContextState* _contextState)
+{
+	assert(_contextState);
+
+	TraceStreamItem item;
+	item.mType = ETSI_ContextState;
+	item.mContextState = _contextState;
+	item.mPayloadBytes = 0;
+	Submit(item);
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceStreamWriter::SubmitPacket(const SSerializeDataPacket& _pkt, size_t _payloadBytes)
+{
+	TraceStreamItem item;
+	item.mType = ETSI_Packet;
+	item.mContextState = NULL;
+	item.mPacket = _pkt;
+	item.mPayloadBytes = _payloadBytes;
+	Submit(item);
+}
+
+// ------------------------------------------------------------------------------------------------
+bool TraceStreamWriter::Finish()
+{
+	assert(mThreadHandle);
+
+	TraceStreamItem item;
+	item.mType = ETSI_End;
+	item.mContextState = NULL;
+	item.mPayloadBytes = 0;
+	Submit(item);
+
+	WaitForSingleObject(mThreadHandle, INFINITE);
+	CloseHandle(mThreadHandle);
+	mThreadHandle = NULL;
+
+	if (mFailed) {
+		return false;
+	}
+
+	try {
+		mWriter.Finish();
+	} catch (...) {
+		return false;
+	}
+
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceStreamWriter::Submit(const TraceStreamItem& _item)
+{
+	// Blocks while the queue is full...
+	WaitForSingleObject(mFreeSlots, INFINITE);
+
+	// ...or its payloads are over budget. With nothing queued anything fits, however big.
+	EnterCriticalSection(&mLock);
+	while (mQueuedPayloadBytes > 0 && mQueuedPayloadBytes + _item.mPayloadBytes > kTraceStreamQueueBytes) {
+		LeaveCriticalSection(&mLock);
+		WaitForSingleObject(mPayloadBytesReleased, INFINITE);
+		EnterCriticalSection(&mLock);
+	}
+
+	mQueue[(mQueueHead + mQueueCount) % kTraceStreamQueueDepth] = _item;
+	++mQueueCount;
+	mQueuedPayloadBytes += _item.mPayloadBytes;
+	LeaveCriticalSection(&mLock);
+
+	ReleaseSemaphore(mQueuedItems, 1, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+void TraceStreamWriter::Thread_Write()
+{
+	while (1) {
+		WaitForSingleObject(mQueuedItems, INFINITE);
+
+		EnterCriticalSection(&mLock);
+		TraceStreamItem item = mQueue[mQueueHead];
+		mQueueHead = (mQueueHead + 1) % kTraceStreamQueueDepth;
+		--mQueueCount;
+		LeaveCriticalSection(&mLock);
+
+		ReleaseSemaphore(mFreeSlots, 1, NULL);
+
+		if (item.mType == ETSI_End) {
+			return;
+		}
+
+		// After a failure keep draining the queue, so that the receiver doesn't block. 
+		if (!mFailed) {
+			try {
+				if (item.mType == ETSI_ContextState) {
+					mWriter.WriteContextState(*item.mContextState);
+				} else {
+					mWriter.WritePacket(item.mPacket);
+				}
+			} catch (...) {
+				LogError(TC("Failed writing trace--the rest of this capture will be dropped."));
+				mFailed = true;
+			}
+		}
+
+		if (item.mType == ETSI_Packet) {
+			item.mPacket.ReleasePayloads();
+		}
+
+		if (item.mPayloadBytes > 0) {
+			EnterCriticalSection(&mLock);
+			mQueuedPayloadBytes -= item.mPayloadBytes;
+			LeaveCriticalSection(&mLock);
+			SetEvent(mPayloadBytesReleased);
+		}
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+
+class ContextState;
+class FileLike;
+class TraceBlockWriter;
+struct SSerializeDataPacket;
+struct TraceStreamItem;
+
+// How far TraceStreamWriter lets the receiver get ahead of the disk: this many packets, holding no more
+// than this many bytes of payloads between them.
+const size_t kTraceStreamQueueDepth = 4096;
+const size_t kTraceStreamQueueBytes = 256 * 1024 * 1024;
+
+// ------------------------------------------------------------------------------------------------
+// Writes a trace file front to back: the header, the context state, the commands, then the blobs and 
+// the index--after which the header is patched to point at the index. 
+// Commands are held back a frame at a time (see TraceBlockWriter), and a frame that comes out exactly 
+// the same as the one before it is only recorded as a repeat.
+class TraceWriter
+{
+public:
+	// With _spillBlobs, payloads are copied out as they're written (see BlobStore::SpillTo), so the 
+	// caller is free to release them right away. Otherwise they must stay alive until Finish.
+	TraceWriter(const TCHAR* _filename, ETraceCodec _codec, bool _spillBlobs);
+	~TraceWriter();
+
+	// Must be called exactly once, before any packets. Packets are written against _contextState, so it 
+	// must stay alive until Finish.
+	void WriteContextState(const ContextState& _contextState);
+	// A SwapBuffers packet ends the frame.
+	void WritePacket(const SSerializeDataPacket& _pkt);
+
+	// Writes everything that goes after the commands and closes the file. If a writer is destroyed 
+	// without being finished, the file is left without an index (and won't load).
+	void Finish();
+
+private:
+	FILE* mFile;
+	FileLike* mOut;
+	TraceIndex mIndex;
+	BlobStore mBlobs;
+	TraceBlockWriter* mBlockWriter;
+
+	// The frame being written, serialized (payloads are already blob references by then), and the one
+	// before it.
+	std::vector<unsigned char> mFrameBytes;
+	std::vector<size_t> mFramePacketEnds;
+	std::vector<unsigned char> mPreviousFrameBytes;
+	bool mHasPreviousFrame;
+	unsigned int mRepeatedFrameCount;
+	FileLike* mFrameOut;
+
+	TraceFileOffset mIndexOffsetLocation;
+	TraceFileOffset mChunkTableOffsetLocation;
+
+	void EndFrame();
+};
+
+// ------------------------------------------------------------------------------------------------
+// Writes a trace on its own thread while its commands are still arriving, so that neither the whole 
+// frame nor the disk write have to wait for the end of the capture. Packets are handed over through 
+// a bounded queue; if the disk can't keep up, Submit blocks rather than letting memory grow. The queue 
+// is bounded by the bytes its packets' payloads take up as well as by their count, so a run of big 
+// texture uploads can't pin more than kTraceStreamQueueBytes.
+class TraceStreamWriter
+{
+public:
+	TraceStreamWriter(const TCHAR* _filename, ETraceCodec _codec);
+	~TraceStreamWriter();
+
+	// _contextState is referenced, not copied--it must stay alive until Finish.
+	void SubmitContextState(const ContextState* _contextState);
+
+	// Takes over _pkt's payloads, which are released once the packet is written. _pkt must have been 
+	// filled in by SSerializeDataPacket::Read. _payloadBytes is how much they take up (see 
+	// FileLike::GetPayloadBytesRead). A packet bigger than the whole budget still goes through, alone.
+	void SubmitPacket(const SSerializeDataPacket& _pkt, size_t _payloadBytes);
+
+	// Waits for everything submitted to be written and finishes the file. Returns false if writing failed
+	// at any point, in which case the file is incomplete.
+	bool Finish();
+
+private:
+	TraceWriter mWriter;
+
+	CRITICAL_SECTION mLock;
+	HANDLE mFreeSlots;
+	HANDLE mQueuedItems;
+	TraceStreamItem* mQueue;
+	size_t mQueueHead;
+	size_t mQueueCount;
+
+	// Payload bytes submitted and not released yet, and a signal for Submit that some have been.
+	size_t mQueuedPayloadBytes;
+	HANDLE mPayloadBytesReleased;
+
+	HANDLE mThreadHandle;
+	volatile bool mFailed;
+
+	void Submit(const TraceStreamItem& _item);
+	void Thread_Write();
+
+	friend DWORD WINAPI TraceStreamWriter_RunWriteThread(LPVOID _writerPtr);
+};
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "workerpool.h"
+
+static WorkerPool* gWorkerPool = NULL;
+
+// ------------------------------------------------------------------------------------------------
+DWORD WINAPI WorkerPool_RunWorkerThread(LPVOID _poolPtr)
+{
+	((WorkerPool*)_poolPtr)->Thread_Worker();
+
+	return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+WorkerPool* GetWorkerPool()
+{
+	// Only the trace writing and loading paths use this, which aren't run concurrently with each other.
+	if (!gWorkerPool) {
+		gWorkerPool = new WorkerPool;
+	}
+
+	return gWorkerPool;
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+WorkerJob::WorkerJob()
+: mDoneEvent(NULL)
+{
+	mDoneEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	assert(mDoneEvent);
+}
+
+// ------------------------------------------------------------------------------------------------
+WorkerJob::~WorkerJob()
+{
+	if (mDoneEvent) {
+		CloseHandle(mDoneEvent);
+		mDoneEvent = NULL;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+void WorkerJob::Wait()
+{
+	WaitForSingleObject(mDoneEvent, INFINITE);
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+WorkerPool::WorkerPool(unsigned int _threadCount)
+: mJobsAvailable(NULL)
+, mShuttingDown(false)
+{
+	InitializeCriticalSection(&mLock);
+	mJobsAvailable = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+	assert(mJobsAvailable);
+
+	if (_threadCount == 0) {
+		SYSTEM_INFO sysInfo;
+		GetSystemInfo(&sysInfo);
+		_threadCount = max(sysInfo.dwNumberOfProcessors, (DWORD)1);
+	}
+
+	for (unsigned int i = 0; i < _threadCount; ++i) {
+		HANDLE threadHandle = CreateThread(NULL, 0, WorkerPool_RunWorkerThread, this, 0, NULL);
+		assert(threadHandle);
+		mThreadHandles.push_back(threadHandle);
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+	mShuttingDown = true;
+	ReleaseSemaphore(mJobsAvailable, (LONG)mThreadHandles.size(), NULL);
+
+	for (auto it = mThreadHandles.begin(); it != mThreadHandles.end(); ++it) {
+		WaitForSingleObject(*it, INFINITE);
+		CloseHandle(*it);
+	}
+	mThreadHandles.clear();
+
+	// Anything left over was never run. Don't leave whoever is waiting on it hanging.
+	for (auto it = mJobs.begin(); it != mJobs.end(); ++it) {
+		SetEvent((*it)->mDoneEvent);
+	}
+	mJobs.clear();
+
+	CloseHandle(mJobsAvailable);
+	DeleteCriticalSection(&mLock);
+}
+
+// ------------------------------------------------------------------------------------------------
+void WorkerPool::Submit(WorkerJob* _job)
+{
+	assert(_job);
+	ResetEvent(_job->mDoneEvent);
+
+	EnterCriticalSection(&mLock);
+	mJobs.push_back(_job);
+	LeaveCriticalSection(&mLock);
+
+	ReleaseSemaphore(mJobsAvailable, 1, NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+void WorkerPool::Thread_Worker()
+{
+	while (1) {
+		WaitForSingleObject(mJobsAvailable, INFINITE);
+		if (mShuttingDown) {
+			return;
+		}
+
+		WorkerJob* job = NULL;
+		EnterCriticalSection(&mLock);
+		if (!mJobs.empty()) {
+			job = mJobs.front();
+			mJobs.pop_front();
+		}
+		LeaveCriticalSection(&mLock);
+
+		if (job) {
+			job->Execute();
+			SetEvent(job->mDoneEvent);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+// A unit of work for a WorkerPool. Derive from this and implement Execute.
+class WorkerJob
+{
+public:
+	WorkerJob();
+	virtual ~WorkerJob();
+
+	virtual void Execute() = 0;
+
+	// Blocks until Execute has finished running on a worker. 
+	void Wait();
+
+private:
+	HANDLE mDoneEvent;
+
+	friend class WorkerPool;
+};
+
+// ------------------------------------------------------------------------------------------------
+// A fixed set of threads pulling jobs off a shared fifo. Jobs are owned by the caller, and must stay
+// alive until they've been waited on.
+class WorkerPool
+{
+public:
+	// _threadCount of 0 means one thread per logical processor.
+	WorkerPool(unsigned int _threadCount = 0);
+	~WorkerPool();
+
+	void Submit(WorkerJob* _job);
+	unsigned int GetThreadCount() const { return (unsigned int)mThreadHandles.size(); }
+
+private:
+	CRITICAL_SECTION mLock;
+	HANDLE mJobsAvailable;
+	std::deque<WorkerJob*> mJobs;
+	std::vector<HANDLE> mThreadHandles;
+	volatile bool mShuttingDown;
+
+	void Thread_Worker();
+
+	friend DWORD WINAPI WorkerPool_RunWorkerThread(LPVOID _poolPtr);
+};
+
+// Shared by everything that wants to spread work across cores (e.g. trace compression). Created on first use.
+WorkerPool* GetWorkerPool();
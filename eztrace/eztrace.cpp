@@ -31,13 +31,21 @@
 
 #include "common/gltrace.h"
 #include "process.h"
+#include "transportbenchmark.h"
+
+// Where captures are received to. It keeps the context state from the last one, so the next capture 
+// only has to send what changed.
+GLTrace* gOutputTrace = NULL;
 
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 void OnHotkeyPressed()
 {
-	gMessageStream->Send(&RC_Capture(), sizeof(RC_Capture));
+	// The application sends all of the state instead if it's capturing a different context this time.
+	unsigned int baseGeneration = gOutputTrace ? gOutputTrace->GetCaptureStateGeneration() : 0;
+	unsigned __int64 baseContext = gOutputTrace ? gOutputTrace->GetCaptureStateContext() : 0;
+	gMessageStream->Send(&RC_Capture(gOptions->CaptureFrameCount, baseGeneration, baseContext), sizeof(RC_Capture));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -57,18 +65,38 @@ void MainLoop(HotkeyManager* _hotkeyMgr)
 int _tmain(int argc, _TCHAR* argv[])
 {
 	Options* opts = ParseCommandLine(argc, argv);
+	gOptions = opts;
+
+	if (opts->BenchmarkTransports) {
+		RunTransportBenchmark();
+		gOptions = NULL;
+		SafeDelete(opts);
+		return 0;
+	}
 
 	HotkeyManager hotkeyManager(kIdStartRangeExe);
 	hotkeyManager.AddHotkey(NULL, MOD_ALT | MOD_CONTROL | MOD_NOREPEAT, 'P', OnHotkeyPressed);
 	
 	GLTrace outputTrace;
-
-	// Create and start the process.
-	Process proc(opts->ExeName, opts->ProcessArgs, opts->WorkingDirectory, opts->InceptionDllPath, &outputTrace, opts->OutputTraceName);
+	gOutputTrace = &outputTrace;
+
+	// Already validated by ParseCommandLine.
+	ETraceCodec traceCodec = ETC_None;
+	ParseTraceCodec(opts->TraceCodec, &traceCodec);
+	EMessageTransport transport = EMT_Socket;
+	ParseMessageTransport(opts->Transport, &transport);
+
+	// Create and start the process, which picks up the transport (and whether to idle) from its environment.
+	SetMessageTransportForChildProcesses(transport);
+	SetIdleHooksForChildProcesses(opts->IdleHooks);
+	SetWriteWatchBuffersForChildProcesses(opts->WriteWatchBuffers);
+	SetShadowBudgetForChildProcesses(opts->ShadowBudgetMB);
+	SetSendRingForChildProcesses(opts->SendRingSize, opts->SendRingHighWaterMark);
+	Process proc(opts->ExeName, opts->ProcessArgs, opts->WorkingDirectory, opts->InceptionDllPath, &outputTrace, opts->OutputTraceName, traceCodec, opts->StreamTrace);
 	proc.Start();
 
 	// Now connect the socket to the process.
-	gMessageStream = new MessageStream(false, "127.0.0.1", kPort);
+	gMessageStream = new MessageStream(false, "127.0.0.1", kPort, transport);
 
 	// Start the capture trace thread, which will (duh) capture the trace for us.
 	proc.RunCaptureTraceThread();
@@ -84,7 +112,9 @@ int _tmain(int argc, _TCHAR* argv[])
 	// Then cleanup time.
 	SafeDelete(gMessageStream);
 	outputTrace.Finalize();
+	gOutputTrace = NULL;
 
+	gOptions = NULL;
 	SafeDelete(opts);
 
 	return 0;
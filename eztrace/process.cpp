@@ -64,7 +64,7 @@ DWORD WINAPI Process_RunCaptureTraceThread(LPVOID _processPtr)
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
-Process::Process(const TCHAR* _exeName, const TCHAR* _processArgs, const TCHAR* _workingDirectory, const TCHAR* _inceptionDllPath, GLTrace* _outTrace, const TCHAR* _outTraceFilename)
+Process::Process(const TCHAR* _exeName, const TCHAR* _processArgs, const TCHAR* _workingDirectory, const TCHAR* _inceptionDllPath, GLTrace* _outTrace, const TCHAR* _outTraceFilename, ETraceCodec _outTraceCodec, bool _streamOutTrace)
 : mOutputTrace(_outTrace)
 , mExeName(NULL)
 , mProcessArgs(NULL)
@@ -74,6 +74,8 @@ Process::Process(const TCHAR* _exeName, const TCHAR* _processArgs, const TCHAR*
 , mCaptureTraceThreadHandle(NULL)
 , mParentThreadId(GetCurrentThreadId())
 , mOutputTraceName(NULL)
+, mOutputTraceCodec(_outTraceCodec)
+, mStreamOutputTrace(_streamOutTrace)
 , mServerRequestsTermination(false)
 {
 	mExeName = AllocateAndCopy(_exeName);
@@ -184,13 +186,14 @@ void Process::Thread_CaptureTrace()
 			return;
 		}
 
-		size_t lastPacketCommand = (size_t)-1;
-		int frameCommandCount = 0;
-		
-		SSerializeDataPacket lastPkt;
 		FileLike fileLikeSocket(gMessageStream);
 
 		try {
+			// Nothing comes in between captures, so don't block forever--we may be asked to stop.
+			if (!gMessageStream->WaitForRecv(kPollTime)) {
+				continue;
+			}
+
 			// This means either we never started a capture or we've completed one. Either one is fine.
 			fileLikeSocket.Read(Checkpoint("TraceCapturingBegin"));
 		} catch (NetworkError &e)
@@ -200,50 +203,10 @@ void Process::Thread_CaptureTrace()
 			}
 		}
 
-		// Reset for a new frame capture.
-		// TODO: This is currently destructive. I don't think it should be.
-		mOutputTrace->Reset();
-
-		mOutputTrace->ReadContextState(&fileLikeSocket);
-		LogInfo(TC("Received Context State!"));
-
-		// TODO: Make this async again. 
-		fileLikeSocket.Read(Checkpoint("FrameCommandsBegin"));
-		LogInfo(TC("Beginning to collect frame commands..."));
-		// TODO: Receive the rest of the trace here!
-		while (1) {
-			SSerializeDataPacket pkt;
-			fileLikeSocket.Read(&pkt);
-
-			if (lastPacketCommand != (size_t)-1 && pkt.mPacketId != lastPacketCommand + 1) {
-				LogError(TC("We went out of sync with the application."));
-				throw 8;
-			}
-
-			mOutputTrace->RecvGLCommand(pkt);
-			if (pkt.mDataType == EST_Message) {
-				PrintTraceMessage(pkt.mData_Message.level, pkt.mData_Message.messageBody);
-			}
-				
-			// For debugging.
-			lastPkt = pkt;
-			// Book-keeping, also for debugging.
-			lastPacketCommand = pkt.mPacketId;
-			++frameCommandCount;
-
-			// Once we get the sentinel, let's bail.
-			if (pkt.mDataType == EST_Sentinel) {
-				LogInfo(TC("Received %d frame commands"), frameCommandCount);
-				break;
-			}
+		if (!mOutputTrace->ReceiveCapture(&fileLikeSocket, mOutputTraceName, mOutputTraceCodec, mStreamOutputTrace)) {
+			continue;
 		}
 
-		fileLikeSocket.Read(Checkpoint("FrameCommandsEnd"));
-		fileLikeSocket.Read(Checkpoint("TraceCapturingEnd"));
-
-		LogInfo(TC("Saving capture to %s..."), mOutputTraceName);
-		mOutputTrace->Save(mOutputTraceName);
-
 		LogInfo(TC("Frame successfully transfered."));
 	}
 }
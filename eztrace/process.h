@@ -34,7 +34,7 @@ struct Options;
 class Process
 {
 public:
-	Process(const TCHAR* _exeName, const TCHAR* _processArgs, const TCHAR* _workingDirectory, const TCHAR* _inceptionDllPath, GLTrace* _outTrace, const TCHAR* _outTraceFilename);
+	Process(const TCHAR* _exeName, const TCHAR* _processArgs, const TCHAR* _workingDirectory, const TCHAR* _inceptionDllPath, GLTrace* _outTrace, const TCHAR* _outTraceFilename, ETraceCodec _outTraceCodec, bool _streamOutTrace);
 	~Process();
 
 	void RunWatchdogThread();
@@ -50,6 +50,8 @@ private:
 	DWORD mParentThreadId;
 
 	TCHAR* mOutputTraceName;
+	ETraceCodec mOutputTraceCodec;
+	bool mStreamOutputTrace;
 
 	volatile bool mServerRequestsTermination;
 
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdafx.h"
+#include "transportbenchmark.h"
+
+// Roughly what a texture-heavy frame looks like: lots of small commands and the odd big upload.
+const size_t kBenchmarkPayloadSizes[] = { 16, 32, 64, 256, 16, 4 * 1024, 64, 64 * 1024, 16, 1024 * 1024 };
+const size_t kBenchmarkPayloadSizeCount = sizeof(kBenchmarkPayloadSizes) / sizeof(kBenchmarkPayloadSizes[0]);
+const size_t kBenchmarkMaxPayloadSize = 1024 * 1024;
+const unsigned int kBenchmarkPacketCount = 200 * kBenchmarkPayloadSizeCount;
+
+// Every run gets its own port (and so its own shared memory name), so nothing lingering from the 
+// previous run gets in the way.
+const unsigned int kBenchmarkFirstPort = 34200;
+
+// How long the client keeps trying to connect while the host thread sets up.
+const int kBenchmarkConnectAttempts = 500;
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+struct TransportBenchmarkRun
+{
+	const TCHAR* mName;
+	EMessageTransport mTransport;
+	bool mUseSendRing;
+
+	char mPort[16];
+	volatile bool mHostFailed;
+};
+
+// ------------------------------------------------------------------------------------------------
+// The host end, same as inception: sends all of the packets, then waits for the client to say it 
+// got them.
+DWORD WINAPI TransportBenchmark_RunHostThread(LPVOID _runPtr)
+{
+	TransportBenchmarkRun* run = (TransportBenchmarkRun*)_runPtr;
+	unsigned char* payload = (unsigned char*)malloc(kBenchmarkMaxPayloadSize);
+	MessageStream* stream = NULL;
+
+	try {
+		stream = new MessageStream(true, "", run->mPort, run->mTransport);
+		if (run->mUseSendRing) {
+			stream->EnableSendRing(gOptions->SendRingSize, gOptions->SendRingHighWaterMark);
+		}
+
+		FileLike out(stream);
+		out.Write(kBenchmarkPacketCount);
+		for (unsigned int i = 0; i < kBenchmarkPacketCount; ++i) {
+			size_t payloadSize = kBenchmarkPayloadSizes[i % kBenchmarkPayloadSizeCount];
+			payload[0] = payload[payloadSize - 1] = (unsigned char)i;
+
+			out.Write(payloadSize);
+			out.WritePayloadByReference(payload, payloadSize);
+
+			// Same as the hooks, whose FileLike goes away after every packet. The payload gets reused.
+			out.Flush();
+		}
+		out.Flush();
+		stream->FlushSendBuffer();
+
+		unsigned int ack = 0;
+		out.Read(&ack);
+		run->mHostFailed = ack != kBenchmarkPacketCount;
+	} catch (...) {
+		run->mHostFailed = true;
+	}
+
+	SafeDelete(stream);
+	SafeFree(payload);
+	return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// The client end, same as eztrace. Returns the time from the end of the handshake until every 
+// packet was received, in seconds, or a negative number if something went wrong.
+double RunTransportBenchmarkClient(TransportBenchmarkRun* _run, unsigned __int64* _outBytes)
+{
+	MessageStream* stream = NULL;
+	for (int attempt = 0; stream == NULL && attempt < kBenchmarkConnectAttempts; ++attempt) {
+		try {
+			stream = new MessageStream(false, "127.0.0.1", _run->mPort, _run->mTransport);
+		} catch (int) {
+			// The host isn't listening yet.
+			Sleep(10);
+		}
+	}
+
+	if (!stream) {
+		return -1.0;
+	}
+
+	unsigned char* payload = (unsigned char*)malloc(kBenchmarkMaxPayloadSize);
+	double retVal = -1.0;
+	(*_outBytes) = 0;
+
+	try {
+		LARGE_INTEGER frequency, startTime, endTime;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&startTime);
+
+		FileLike in(stream);
+		unsigned int packetCount = 0;
+		in.Read(&packetCount);
+
+		bool payloadsMatch = true;
+		for (unsigned int i = 0; i < packetCount; ++i) {
+			size_t payloadSize = 0;
+			in.Read(&payloadSize);
+			if (payloadSize == 0 || payloadSize > kBenchmarkMaxPayloadSize) {
+				throw 10;
+			}
+
+			in.ReadRaw(payload, payloadSize);
+			payloadsMatch = payloadsMatch && payload[0] == (unsigned char)i && payload[payloadSize - 1] == (unsigned char)i;
+			(*_outBytes) += sizeof(payloadSize) + payloadSize;
+		}
+
+		QueryPerformanceCounter(&endTime);
+
+		in.Write(packetCount);
+		in.Flush();
+		stream->FlushSendBuffer();
+
+		if (payloadsMatch) {
+			retVal = (double)(endTime.QuadPart - startTime.QuadPart) / (double)frequency.QuadPart;
+		} else {
+			LogError(TC("%s: received garbage."), _run->mName);
+		}
+	} catch (...) {
+		retVal = -1.0;
+	}
+
+	SafeFree(payload);
+	SafeDelete(stream);
+	return retVal;
+}
+
+// ------------------------------------------------------------------------------------------------
+void RunTransportBenchmark()
+{
+	TransportBenchmarkRun runs[] = {
+		{ TC("socket"),				EMT_Socket,			false },
+		{ TC("socket + send ring"),	EMT_Socket,			true },
+		{ TC("shared memory"),		EMT_SharedMemory,	false },
+	};
+	const int runCount = sizeof(runs) / sizeof(runs[0]);
+
+	for (int i = 0; i < runCount; ++i) {
+		TransportBenchmarkRun* run = &runs[i];
+		sprintf_s(run->mPort, sizeof(run->mPort), "%u", kBenchmarkFirstPort + i);
+		run->mHostFailed = false;
+
+		HANDLE hostThread = CreateThread(NULL, 0, TransportBenchmark_RunHostThread, run, 0, NULL);
+		if (!hostThread) {
+			LogError(TC("%s: couldn't start the host thread."), run->mName);
+			continue;
+		}
+
+		unsigned __int64 bytesReceived = 0;
+		double seconds = RunTransportBenchmarkClient(run, &bytesReceived);
+
+		WaitForSingleObject(hostThread, INFINITE);
+		CloseHandle(hostThread);
+
+		if (seconds < 0.0 || run->mHostFailed) {
+			LogError(TC("%s: failed."), run->mName);
+			continue;
+		}
+
+		double megabytes = (double)bytesReceived / (1024.0 * 1024.0);
+		LogInfo(TC("%-20s %10.1f MB/s (%.1f MB in %.3f s)"), run->mName, megabytes / max(seconds, 1e-9), megabytes, seconds);
+	}
+}
@@ -305,7 +305,7 @@ int CALLBACK WinMain(
     Initialize();
 	Options* opts = ParseCommandLine(0, NULL);
 
-	gTrace = GLTrace::Load(opts->OutputTraceName);
+	gTrace = GLTrace::Load(opts->OutputTraceName, ETLM_Mapped);
 	gTrace->CreateResources();
 	gTrace->RestoreContextState();
 
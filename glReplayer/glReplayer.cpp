@@ -153,7 +153,7 @@ int CALLBACK WinMain(
     Initialize();
 	Options* opts = ParseCommandLine(0, NULL);
 
-	SetReplayTrace(GLTrace::Load(opts->OutputTraceName));
+	SetReplayTrace(GLTrace::Load(opts->OutputTraceName, ETLM_Mapped));
 	gTrace = GetReplayTrace();
 	gTrace->CreateResources();
 	gTrace->RestoreContextState();
@@ -33,8 +33,15 @@
 
 // TODO: Move declarations to non-generated header
 #include "common/functionhooks.gen.h"
+#include "common/capturestatewriter.h"
+#include "common/commandrecorder.h"
+#include "common/contextregistry.h"
+#include "common/directcapture.h"
+#include "common/flightrecorder.h"
+#include "common/shadowbudget.h"
 
 extern bool gFirstMakeCurrent;
+extern bool gIdleHooks;
 
 #pragma comment(lib, "opengl32.lib")
 
@@ -73,19 +80,66 @@ BOOL APIENTRY DllMain( HMODULE hModule,
 	{
 	case DLL_PROCESS_ATTACH:
 		{
-			gMessageStream = new MessageStream(true, "", kPort);
-			atexit(TrapExit);
-
 			// TODO: This should come from the message stream.
 			gOptions = new Options;
-			gContextState = new ContextState;
+			gOptions->WriteWatchBuffers = GetWriteWatchBuffersFromEnvironment();
+			gOptions->ShadowBudgetMB = GetShadowBudgetFromEnvironment();
+			GetSendRingFromEnvironment(gOptions);
+			if (gOptions->ShadowBudgetMB) {
+				gShadowBudget = new ShadowBudget(size_t(gOptions->ShadowBudgetMB) * 1024 * 1024);
+			}
+
+			gDirectCapture = DirectCapture::CreateFromEnvironment();
+			if (!gDirectCapture) {
+				gFlightRecorder = FlightRecorder::CreateFromEnvironment();
+			}
+
+			if (gDirectCapture) {
+				gMessageStream = gDirectCapture->GetMessageStream();
+			} else if (gFlightRecorder) {
+				gMessageStream = gFlightRecorder->GetMessageStream();
+			} else {
+				gMessageStream = new MessageStream(true, "", kPort, GetMessageTransportFromEnvironment());
+				gMessageStream->EnableSendRing(gOptions->SendRingSize, gOptions->SendRingHighWaterMark);
+			}
+
+			// The flight recorder keeps its own keyframes, everything else captures on request.
+			if (!gFlightRecorder) {
+				gCaptureStateWriter = new CaptureStateWriter(gMessageStream);
+
+				// Nothing to track until somebody asks for a capture.
+				gIdleHooks = GetIdleHooksFromEnvironment();
+				gIsTracking = !gIdleHooks;
+			}
+			atexit(TrapExit);
+
+			gContextRegistry = new ContextRegistry;
+			gCommandRecorder = new CommandRecorder;
 			AttachDetours();
 		}
 		break;
 	case DLL_PROCESS_DETACH:
 		DetachHooks();
-		SafeDelete(gContextState);
+		// Whatever's still queued goes out before the stream does.
+		SafeDelete(gCommandRecorder);
+		SafeDelete(gContextRegistry);
+		if (gCaptureStateWriter) {
+			// We may be going away in the middle of a capture, with the hooks sending to the writer.
+			gMessageStream = gCaptureStateWriter->EndCapture();
+			SafeDelete(gCaptureStateWriter);
+		}
+		if (gDirectCapture) {
+			// The stream belongs to the direct capture.
+			gMessageStream = NULL;
+			SafeDelete(gDirectCapture);
+		} else if (gFlightRecorder) {
+			// Likewise.
+			gMessageStream = NULL;
+			SafeDelete(gFlightRecorder);
+		}
 		SafeDelete(gMessageStream);
+		// Last, since everything above can be holding on to payloads.
+		SafeDelete(gShadowBudget);
 		SafeDelete(gOptions);
 		gFirstMakeCurrent = true; // Need to re-find extensions if we detach.
 		break;